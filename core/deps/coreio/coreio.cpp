@@ -9,6 +9,15 @@
 #include <string>
 #include <iomanip>
 #include <cctype>
+#ifdef HOST_64BIT_CPU
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#elif !defined(HAVE_LIBNX) && !defined(VITA)
+#include <sys/mman.h>
+#define HAVE_FILE_MAPPING
+#endif
+#endif
 
 #define TRUE 1
 #define FALSE 0
@@ -24,6 +33,10 @@ struct CORE_FILE {
 
 	string host;
 	int port;
+
+	const u8* map;
+	size_t map_size;
+	bool map_failed;
 };
 
 core_file* core_fopen(const char* filename)
@@ -33,6 +46,9 @@ core_file* core_fopen(const char* filename)
 	CORE_FILE* rv = new CORE_FILE();
 	rv->f = 0;
 	rv->path = p;
+	rv->map = 0;
+	rv->map_size = 0;
+	rv->map_failed = false;
   {
 		rv->f = fopen(filename, "rb");
 
@@ -83,6 +99,14 @@ int core_fclose(core_file* fc)
 {
    CORE_FILE* f = (CORE_FILE*)fc;
 
+   if (f->map)
+   {
+#ifdef _WIN32
+      UnmapViewOfFile(f->map);
+#elif defined(HAVE_FILE_MAPPING)
+      munmap((void*)f->map, f->map_size);
+#endif
+   }
    if (f->f)
       fclose(f->f);
 
@@ -104,3 +128,38 @@ size_t core_fsize(core_file* fc)
    }
    return 0;
 }
+
+const u8* core_fmap(core_file* fc, size_t* size)
+{
+   CORE_FILE* f = (CORE_FILE*)fc;
+
+   if (f->map == NULL && !f->map_failed && f->f != NULL)
+   {
+      // Only 64-bit hosts have room to map whole disc images
+      f->map_failed = true;
+      size_t file_size = core_fsize(fc);
+      if (file_size > 0)
+      {
+#ifdef _WIN32
+         HANDLE mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(f->f)), NULL, PAGE_READONLY, 0, 0, NULL);
+         if (mapping != NULL)
+         {
+            f->map = (const u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+         }
+#elif defined(HAVE_FILE_MAPPING)
+         void* p = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fileno(f->f), 0);
+         if (p != MAP_FAILED)
+            f->map = (const u8*)p;
+#endif
+      }
+      if (f->map != NULL)
+      {
+         f->map_size = file_size;
+         f->map_failed = false;
+      }
+   }
+   *size = f->map_size;
+
+   return f->map;
+}
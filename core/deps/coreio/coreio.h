@@ -10,4 +10,6 @@ size_t core_fseek(core_file* fc, size_t offs, size_t origin);
 int core_fread(core_file* fc, void* buff, size_t len);
 int core_fclose(core_file* fc);
 size_t core_fsize(core_file* fc);
-size_t core_ftell(core_file* fc);
\ No newline at end of file
+size_t core_ftell(core_file* fc);
+// Maps the whole file read-only, once, until it's closed. Returns NULL if it can't be mapped.
+const u8* core_fmap(core_file* fc, size_t* size);
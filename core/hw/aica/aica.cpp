@@ -5,6 +5,8 @@
 #include "hw/holly/holly_intc.h"
 #include "hw/holly/sb.h"
 #include "hw/sh4/sh4_sched.h"
+#include "aica_thread.h"
+#include <atomic>
 
 #define SH4_IRQ_BIT (1 << (holly_SPU_IRQ & 31))
 
@@ -64,7 +66,7 @@ static void update_arm_interrupts()
 }
 
 //sh4 side
-static void UpdateSh4Ints()
+static void RaiseSh4Ints()
 {
    u32 p_ints = MCIEB->full & MCIPD->full;
    if (p_ints)
@@ -81,16 +83,45 @@ static void UpdateSh4Ints()
 
 }
 
+static std::atomic<bool> sh4_ints_pending;
+
+static void UpdateSh4Ints()
+{
+#ifdef HAVE_AICA_THREAD
+   if (aica_thread_running)
+   {
+      // holly interrupts can only be changed on the SH4 thread, see libAICA_UpdateSh4Ints
+      sh4_ints_pending = true;
+      return;
+   }
+#endif
+   RaiseSh4Ints();
+}
+
+// Called on the SH4 thread when the AICA thread may have changed the SH4 interrupt
+void libAICA_UpdateSh4Ints()
+{
+   if (sh4_ints_pending.exchange(false))
+      RaiseSh4Ints();
+}
 
 AicaTimer timers[3];
 int aica_schid = -1;
 const int AICA_TICK = 145125;	// 44.1 KHz / 32
 
-static int AicaUpdate(int tag, int c, int j)
+void libAICA_Run32()
 {
 	arm_Run(32);
 	if (!settings.aica.NoBatch && !settings.aica.DSPEnabled)
 		AICA_Sample32();
+}
+
+static int AicaUpdate(int tag, int c, int j)
+{
+#ifdef HAVE_AICA_THREAD
+	if (!aica_thread_Update(32))
+#endif
+		libAICA_Run32();
 
 	return AICA_TICK;
 }
@@ -273,6 +304,9 @@ s32 libAICA_Init()
 
 void libAICA_Reset(bool manual)
 {
+#ifdef HAVE_AICA_THREAD
+	aica_thread_Stop();
+#endif
 	if (!manual)
 	{
 		init_mem();
@@ -285,6 +319,9 @@ void libAICA_Reset(bool manual)
 
 void libAICA_Term()
 {
+#ifdef HAVE_AICA_THREAD
+	aica_thread_Stop();
+#endif
 	sgc_Term();
 	term_mem();
 }
@@ -0,0 +1,114 @@
+/*
+	aica_bench: measures the channel mixer of AICA_Sample32, without the ARM7 or the DSP.
+
+	Built with "make aica_bench". Usage: aica_bench [-n blocks]
+
+	The channels play looped samples from pseudo-random sound RAM, with random pitches, LFOs, volumes and pans.
+	For each sample format and number of channels, reports the number of voices mixed per millisecond, i.e. channel
+	samples per ms, and how many voices that is in real time at 44.1 kHz.
+	The checksum only depends on the mixer output.
+*/
+#include "aica.h"
+#include "aica_if.h"
+#include "aica_mem.h"
+#include "sgc_if.h"
+
+extern s16 pl, pr;
+
+static u32 rand_state = 1;
+
+static u32 bench_rand()
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+static void write_channel_reg(u32 channel, u32 reg, u16 value)
+{
+	*(u16 *)&aica_reg[channel * 0x80 + reg] = value;
+	WriteChannelReg(channel, reg, 2);
+}
+
+static void setup_channels(u32 count, u32 format)
+{
+	for (u32 ch = 0; ch < 64; ch++)
+	{
+		u32 sa = (bench_rand() % (ARAM_SIZE / 2)) & ~1;
+		bool on = ch < count;
+		write_channel_reg(ch, 0x00, (sa >> 16) | (format << 7) | (1 << 9) | (on ? 1 << 14 : 0));
+		write_channel_reg(ch, 0x04, sa & 0xFFFF);
+		write_channel_reg(ch, 0x08, bench_rand() & 0xFFF);
+		write_channel_reg(ch, 0x0C, 0x1000 + (bench_rand() & 0x7FFF));
+		// AR, no decay so that all the channels keep playing
+		write_channel_reg(ch, 0x10, 0x1F);
+		// RR, DL. The channels keyed off stop right away.
+		write_channel_reg(ch, 0x14, 0x1F | ((bench_rand() & 0x1F) << 5));
+		// FNS, OCT from -2 to +1
+		write_channel_reg(ch, 0x18, (bench_rand() & 0x3FF) | (((bench_rand() % 4 + 14) & 0xF) << 11));
+		// LFO
+		write_channel_reg(ch, 0x1C, bench_rand() & 0x7FFF);
+		// DISDL, DIPAN
+		write_channel_reg(ch, 0x24, (bench_rand() & 0x1F) | ((8 + (bench_rand() & 7)) << 8));
+		// TL, low-pass filter on one channel out of 4
+		write_channel_reg(ch, 0x28, (bench_rand() & 0x1F) | ((ch & 3) != 0 ? 1 << 5 : 0) | ((bench_rand() & 0x3F) << 8));
+		for (u32 reg = 0x2C; reg <= 0x44; reg += 4)
+			write_channel_reg(ch, reg, bench_rand() & 0x1FFF);
+	}
+	// Key on
+	write_channel_reg(0, 0x00, *(u16 *)&aica_reg[0] | (1 << 15));
+}
+
+int main(int argc, char *argv[])
+{
+	int blocks = 20000;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			blocks = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "Usage: %s [-n blocks]\n", argv[0]);
+			return 1;
+		}
+	}
+	settings.aica.NoBatch = false;
+	settings.aica.DSPEnabled = false;
+	settings.aica.NoSound = true;
+	settings.aica.CDDAMute = 1;
+	ARAM_SIZE = 2 * 1024 * 1024;
+	ARAM_MASK = ARAM_SIZE - 1;
+	// Room for the streams that go past the end of the sound RAM
+	aica_ram.size = ARAM_SIZE;
+	aica_ram.data = new u8[ARAM_SIZE * 2];
+	for (u32 i = 0; i < ARAM_SIZE * 2; i++)
+		aica_ram.data[i] = bench_rand();
+	CommonData = (CommonData_struct *)&aica_reg[0x2800];
+	DSPData = (DSPData_struct *)&aica_reg[0x3000];
+	CommonData->MVOL = 0xF;
+	sgc_Init();
+
+	static const char *format_names[] = { "PCM16", "PCM8", "ADPCM" };
+	u32 checksum = 0;
+	for (u32 format = 0; format < 3; format++)
+	{
+		for (u32 count = 16; count <= 64; count *= 2)
+		{
+			setup_channels(count, format);
+			for (int i = 0; i < 100; i++)
+				AICA_Sample32();
+			double start = os_GetSeconds();
+			for (int i = 0; i < blocks; i++)
+			{
+				AICA_Sample32();
+				checksum = checksum * 31 + (u16)pl + ((u32)(u16)pr << 16);
+			}
+			double ms = (os_GetSeconds() - start) * 1000.0;
+			double voices = (double)count * blocks * 32 / ms;
+			printf("%-6s %2d voices: %8.0f voices/ms, %6.0f voices in real time\n", format_names[format], count, voices, voices / 44.1);
+		}
+	}
+	printf("checksum %08x\n", checksum);
+	sgc_Term();
+
+	return 0;
+}
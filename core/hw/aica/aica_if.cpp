@@ -5,11 +5,13 @@
 */
 
 #include "aica_if.h"
+#include "aica_thread.h"
 #include "hw/sh4/sh4_mem.h"
 #include "hw/holly/sb.h"
 #include "hw/holly/holly_intc.h"
 #include "hw/sh4/sh4_sched.h"
 #include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/blockoptimizer.h"
 
 #include <time.h>
 
@@ -156,6 +158,7 @@ static int DreamcastSecond(int tag, int c, int j)
 	settings.dreamcast.RTC++;
 
 #if FEAT_SHREC != DYNAREC_NONE
+	rdv_InstallOptimizedBlocks();
 	bm_Periodical_1s();
 #endif
 
@@ -233,6 +236,10 @@ void Write_SB_ADST(u32 addr, u32 data)
             dst=tmp;
          }
 
+#ifdef HAVE_AICA_THREAD
+         // The audio thread must not run while the DMA writes to its memory
+         aica_thread_Sync();
+#endif
          WriteMemBlock_nommu_dma(dst,src,len);
 
          // indicate that dma is in progress
@@ -0,0 +1,280 @@
+/*
+	Optional AICA thread. See aica_thread.h
+*/
+#include "aica_thread.h"
+
+#ifdef HAVE_AICA_THREAD
+#include <atomic>
+#include "aica.h"
+#include "aica_if.h"
+#include "hw/gdrom/gdromv3.h"
+
+void libAICA_Run32();
+void libAICA_UpdateSh4Ints();
+void WriteSample(s16 r, s16 l);
+void libCore_CDDA_Sector(s16* sector);
+
+bool aica_thread_running;
+static std::atomic<bool> thread_stop;
+
+// Samples given by the SH4 and samples run by the AICA thread, in blocks of 32
+static std::atomic<u32> sh4_samples;
+static std::atomic<u32> aica_samples;
+
+static cMutex aica_lock;
+static cResetEvent work_event;		// more samples to run
+static cResetEvent done_event;		// samples run
+
+// SH4 register writes: single producer (SH4), single consumer (whoever holds aica_lock)
+struct RegWrite
+{
+	u32 addr;
+	u32 data;
+	u32 sz;
+};
+#define MAILBOX_SIZE 1024
+static RegWrite mailbox[MAILBOX_SIZE];
+static std::atomic<u32> mailbox_head;	// next write to apply
+static std::atomic<u32> mailbox_tail;	// next free entry
+
+// Audio output of the AICA thread, written to the frontend by the SH4 thread
+#define AUDIO_RING_SIZE 8192
+static u32 audio_ring[AUDIO_RING_SIZE];
+static std::atomic<u32> audio_head;
+static std::atomic<u32> audio_tail;
+
+// CDDA sectors read by the SH4 thread, since the GD-ROM belongs to it
+#define CDDA_RING_SIZE 8
+#define CDDA_SAMPLES 588
+struct CDDASector
+{
+	// GD-ROM state before the sector was read, to give back the sectors that weren't played
+	cdda_t cdda;
+	u32 status;
+	s16 data[CDDA_SAMPLES * 2];
+};
+static CDDASector cdda_ring[CDDA_RING_SIZE];
+static std::atomic<u32> cdda_head;
+static std::atomic<u32> cdda_tail;
+// GD-ROM state after the last sector read ahead
+static cdda_t cdda_read;
+static u32 status_read;
+
+// Applies the queued register writes. Called with aica_lock held.
+static void Drain()
+{
+	u32 head = mailbox_head.load(std::memory_order_relaxed);
+	u32 tail = mailbox_tail.load(std::memory_order_acquire);
+	for (; head != tail; head++)
+	{
+		const RegWrite& write = mailbox[head % MAILBOX_SIZE];
+		WriteMem_aica_reg(write.addr, write.data, write.sz);
+	}
+	mailbox_head.store(head, std::memory_order_release);
+}
+
+static void *aica_thread_func(void *)
+{
+	while (true)
+	{
+		bool work = aica_samples.load(std::memory_order_relaxed) != sh4_samples.load(std::memory_order_acquire)
+				|| mailbox_head.load(std::memory_order_relaxed) != mailbox_tail.load(std::memory_order_acquire);
+		if (!work)
+		{
+			if (thread_stop)
+				break;
+			work_event.Wait();
+			continue;
+		}
+		aica_lock.Lock();
+		Drain();
+		if (aica_samples.load(std::memory_order_relaxed) != sh4_samples.load(std::memory_order_acquire))
+		{
+			libAICA_Run32();
+			aica_samples.fetch_add(32, std::memory_order_release);
+		}
+		aica_lock.Unlock();
+		done_event.Set();
+	}
+	return NULL;
+}
+
+static cThread aica_thread(aica_thread_func, NULL);
+
+// Sends the audio output of the AICA thread to the frontend, keeps the CDDA ring filled
+// and raises or cancels the SH4 interrupt
+static void Collect(u32 lag)
+{
+	u32 tail = audio_tail.load(std::memory_order_acquire);
+	u32 head = audio_head.load(std::memory_order_relaxed);
+	for (; head != tail; head++)
+	{
+		u32 sample = audio_ring[head % AUDIO_RING_SIZE];
+		WriteSample((s16)(sample >> 16), (s16)sample);
+	}
+	audio_head.store(head, std::memory_order_release);
+
+	// Enough sectors for the samples the AICA thread can run before the next tick
+	u32 sectors = lag == 0 ? 0 : std::min(2 + lag / CDDA_SAMPLES, (u32)CDDA_RING_SIZE);
+	while (cdda_tail.load(std::memory_order_relaxed) - cdda_head.load(std::memory_order_acquire) < sectors)
+	{
+		u32 tail = cdda_tail.load(std::memory_order_relaxed);
+		CDDASector& sector = cdda_ring[tail % CDDA_RING_SIZE];
+		sector.cdda = cdda;
+		sector.status = SecNumber.Status;
+		libCore_CDDA_Sector(sector.data);
+		cdda_read = cdda;
+		status_read = SecNumber.Status;
+		cdda_tail.store(tail + 1, std::memory_order_release);
+	}
+
+	libAICA_UpdateSh4Ints();
+}
+
+static bool SameCDDA(const cdda_t& a, const cdda_t& b)
+{
+	return a.playing == b.playing && a.repeats == b.repeats && a.CurrAddr.FAD == b.CurrAddr.FAD
+			&& a.EndAddr.FAD == b.EndAddr.FAD && a.StartAddr.FAD == b.StartAddr.FAD;
+}
+
+// Discards the CDDA sectors read ahead. The GD-ROM goes back to the first one unless a command
+// changed its state in the meantime. Only called when the AICA thread is idle.
+static void DiscardCDDA()
+{
+	u32 head = cdda_head.load(std::memory_order_relaxed);
+	u32 tail = cdda_tail.load(std::memory_order_relaxed);
+	if (head == tail)
+		return;
+	if (SameCDDA(cdda, cdda_read) && SecNumber.Status == status_read)
+	{
+		const CDDASector& sector = cdda_ring[head % CDDA_RING_SIZE];
+		cdda = sector.cdda;
+		SecNumber.Status = sector.status;
+	}
+	cdda_head.store(tail, std::memory_order_relaxed);
+}
+
+static void Start()
+{
+	sh4_samples = 0;
+	aica_samples = 0;
+	// Stop gave back the sectors read ahead
+	cdda_head = 0;
+	cdda_tail = 0;
+	thread_stop = false;
+	aica_thread_running = true;
+	aica_thread.Start();
+	INFO_LOG(AICA, "AICA thread started");
+}
+
+void aica_thread_Stop()
+{
+	if (!aica_thread_running)
+		return;
+	thread_stop = true;
+	work_event.Set();
+	aica_thread.WaitToEnd();
+	aica_thread_running = false;
+	// No samples or writes are left but the interrupts and audio output still need to be handled
+	Collect(0);
+	DiscardCDDA();
+	INFO_LOG(AICA, "AICA thread stopped");
+}
+
+bool aica_thread_Update(u32 samples)
+{
+	u32 lag = std::min(settings.aica.ThreadLag, (u32)AICA_THREAD_MAX_LAG);
+	if (lag == 0)
+	{
+		aica_thread_Stop();
+		return false;
+	}
+	if (!aica_thread_running)
+		Start();
+
+	Collect(lag);
+	sh4_samples.fetch_add(samples, std::memory_order_release);
+	work_event.Set();
+	while (sh4_samples.load(std::memory_order_relaxed) - aica_samples.load(std::memory_order_acquire) > lag)
+		done_event.Wait();
+
+	return true;
+}
+
+void aica_thread_Sync()
+{
+	if (!aica_thread_running)
+		return;
+	work_event.Set();
+	while (aica_samples.load(std::memory_order_acquire) != sh4_samples.load(std::memory_order_relaxed)
+			|| mailbox_head.load(std::memory_order_acquire) != mailbox_tail.load(std::memory_order_relaxed))
+		done_event.Wait();
+	Collect(0);
+}
+
+void aica_thread_SyncState()
+{
+	if (!aica_thread_running)
+		return;
+	aica_thread_Sync();
+	DiscardCDDA();
+}
+
+u32 aica_thread_ReadReg(u32 addr, u32 sz)
+{
+	aica_lock.Lock();
+	Drain();
+	u32 data = ReadMem_aica_reg(addr, sz);
+	aica_lock.Unlock();
+	libAICA_UpdateSh4Ints();
+
+	return data;
+}
+
+void aica_thread_WriteReg(u32 addr, u32 data, u32 sz)
+{
+	u32 reg = addr & 0x7FFF;
+	u32 tail = mailbox_tail.load(std::memory_order_relaxed);
+	// Writes to the SH4 interrupt registers must take effect right away, or the SH4 would take
+	// the interrupt it has just acknowledged again. So must ARM7 resets, or the ARM7 could run
+	// the sound driver the SH4 uploads after the reset.
+	if ((reg < MCIEB_addr || reg >= MCIRE_addr + 4) && (reg & ~1) != 0x2C00
+			&& tail - mailbox_head.load(std::memory_order_acquire) < MAILBOX_SIZE)
+	{
+		mailbox[tail % MAILBOX_SIZE] = { addr, data, sz };
+		mailbox_tail.store(tail + 1, std::memory_order_release);
+		return;
+	}
+	aica_lock.Lock();
+	Drain();
+	WriteMem_aica_reg(addr, data, sz);
+	aica_lock.Unlock();
+	libAICA_UpdateSh4Ints();
+}
+
+void aica_thread_WriteSample(s16 r, s16 l)
+{
+	u32 tail = audio_tail.load(std::memory_order_relaxed);
+	if (tail - audio_head.load(std::memory_order_acquire) >= AUDIO_RING_SIZE)
+		// Can't happen since the lag is bounded
+		return;
+	audio_ring[tail % AUDIO_RING_SIZE] = ((u32)(u16)r << 16) | (u16)l;
+	audio_tail.store(tail + 1, std::memory_order_release);
+}
+
+void aica_thread_CDDA_Sector(s16 *sector)
+{
+	u32 head = cdda_head.load(std::memory_order_relaxed);
+	if (head == cdda_tail.load(std::memory_order_acquire))
+	{
+		// Not running on the AICA thread any more
+		if (!aica_thread_running)
+			libCore_CDDA_Sector(sector);
+		else
+			memset(sector, 0, CDDA_SAMPLES * 2 * sizeof(s16));
+		return;
+	}
+	memcpy(sector, cdda_ring[head % CDDA_RING_SIZE].data, CDDA_SAMPLES * 2 * sizeof(s16));
+	cdda_head.store(head + 1, std::memory_order_release);
+}
+#endif
@@ -0,0 +1,48 @@
+/*
+	Optional AICA thread.
+
+	When settings.aica.ThreadLag isn't 0, the ARM7, the sound channels and the DSP run on their own thread,
+	at most ThreadLag samples behind the SH4. The SH4 scheduler tick only gives the AICA thread the samples
+	it may run, and collects its audio output and interrupt changes.
+
+	SH4 register writes are queued in a lock-free mailbox and applied by the AICA thread between two runs.
+	The AICA state is only changed with aica_lock held: SH4 register reads, the interrupt registers and
+	the ARM7 reset register take it, apply the queued writes, and access the registers directly. These are
+	the resynchronization points, together with G2 DMA and save states, which wait for the thread to catch up.
+
+	SH4 accesses to the AICA RAM don't go through the thread: the RAM is mapped in the SH4 address space.
+	So the AICA thread can see a RAM write before a register write that the SH4 made earlier but is still
+	in the mailbox, and the SH4 sees the ARM7 RAM writes up to ThreadLag samples late. Sound drivers
+	poll their command buffers in RAM and tolerate this, but the lag is capped to AICA_THREAD_MAX_LAG
+	samples (about 6 ms) to keep the window small.
+*/
+#pragma once
+#include "types.h"
+
+#if !defined(TARGET_NO_THREADS)
+#define HAVE_AICA_THREAD
+#endif
+
+#ifdef HAVE_AICA_THREAD
+#define AICA_THREAD_MAX_LAG 256
+
+extern bool aica_thread_running;
+
+// Starts or stops the thread according to the settings, and runs it for the given number of samples.
+// Called by the SH4 scheduler, on the SH4 thread.
+bool aica_thread_Update(u32 samples);
+// Stops the thread once it has run all the samples it was given
+void aica_thread_Stop();
+// Waits until the thread has run all the samples it was given and has applied the queued writes
+void aica_thread_Sync();
+// Same as aica_thread_Sync, and also gives back the CDDA sectors read ahead, so that the GD-ROM
+// state matches what the AICA has played. Called before a state is saved or loaded.
+void aica_thread_SyncState();
+
+u32 aica_thread_ReadReg(u32 addr, u32 sz);
+void aica_thread_WriteReg(u32 addr, u32 data, u32 sz);
+
+// AICA thread side
+void aica_thread_WriteSample(s16 r, s16 l);
+void aica_thread_CDDA_Sector(s16 *sector);
+#endif
@@ -19,11 +19,22 @@
  */
 
 #include "sgc_if.h"
+#include "aica_thread.h"
 #include "dsp.h"
 #include "aica_mem.h"
 #include "aica_if.h"
 #include <math.h>
 #include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#define AICA_MIX_SIMD
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AICA_MIX_SIMD
+#endif
 #undef FAR
 
 //#define CLIP_WARN
@@ -34,6 +45,25 @@
 
 void WriteSample(s16 r, s16 l);
 
+static inline void OutputSample(s16 r, s16 l)
+{
+#ifdef HAVE_AICA_THREAD
+	if (aica_thread_running)
+		aica_thread_WriteSample(r, l);
+	else
+#endif
+		WriteSample(r, l);
+}
+
+static inline void ReadCDDASector(s16 *sector)
+{
+#ifdef HAVE_AICA_THREAD
+	aica_thread_CDDA_Sector(sector);
+#else
+	libCore_CDDA_Sector(sector);
+#endif
+}
+
 #ifdef CLIP_WARN
 #define clip_verify(x) verify(x)
 #else
@@ -302,8 +332,24 @@ enum _EG_state
 
 struct ChannelEx;
 
+// State of a channel for each sample of a block, filled by StepBlock.
+// The interpolation, filter and volumes are then applied to the whole block by AICA_Sample32.
+struct VoiceBlock
+{
+	s32 s0[32];
+	s32 s1[32];
+	s32 fp[32];
+	u32 fv[32];		// FEG value, only used when the low-pass filter is on
+	u32 att[32];	// AEG and ALFO attenuation
+	s32 gainL[32];
+	s32 gainR[32];
+	s32 gainDsp[32];
+	SampleType sample[32];
+};
+
 //make these DYNACALL ? they were fastcall before ..
 void (* STREAM_STEP_LUT[5][2][2])(ChannelEx* ch);
+u32 (* STREAM_STEP_BLOCK_LUT[5][2][2])(ChannelEx* ch, VoiceBlock& vb);
 void (* STREAM_INITAL_STEP_LUT[5])(ChannelEx* ch);
 void (* AEG_STEP_LUT[4])(ChannelEx* ch);
 void (* FEG_STEP_LUT[4])(ChannelEx* ch);
@@ -364,6 +410,7 @@ struct ChannelEx
 	void (* StepAEG)(ChannelEx* ch);
 	void (* StepFEG)(ChannelEx* ch);
 	void (* StepStream)(ChannelEx* ch);
+	u32 (* StepBlock)(ChannelEx* ch, VoiceBlock& vb);
 	void (* StepStreamInitial)(ChannelEx* ch);
 	
 	struct
@@ -445,6 +492,48 @@ struct ChannelEx
 
 		return rv;
 	}
+	__forceinline static SampleType Filter(SampleType sample, u32 fv, s32 q, SampleType& prev1, SampleType& prev2)
+	{
+		s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
+		sample = f * sample + (0x2000 - f + q) * prev1 - q * prev2;
+		sample >>= 13;
+		clip16(sample);
+		prev2 = prev1;
+		prev1 = sample;
+
+		return sample;
+	}
+	__forceinline u32 GetOffsetAtt()
+	{
+		//Volume & Mixer processing
+		//All attenuations are added together then applied and mixed :)
+		
+		//offset is up to 511
+		//*Att is up to 511
+		//logtable handles up to 1024, anything >=255 is mute
+
+		u32 ofsatt;
+		if (ccd->VOFF == 1)
+		{
+			ofsatt = 0;
+		}
+		else
+		{
+			ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
+			ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
+		}
+		return ofsatt;
+	}
+	__forceinline void GetGains(u32 ofsatt, s32& gainL, s32& gainR, s32& gainDsp)
+	{
+		u32 const max_att = ((16 << 4) - 1) - ofsatt;
+		
+		s32* logtable = ofsatt + tl_lut;
+
+		gainL = logtable[std::min(VolMix.DLAtt, max_att)];
+		gainR = logtable[std::min(VolMix.DRAtt, max_att)];
+		gainDsp = logtable[std::min(VolMix.DSPAtt, max_att)];
+	}
 	__forceinline bool Step(SampleType& oLeft, SampleType& oRight, SampleType& oDsp)
 	{
 		if (!enabled)
@@ -458,44 +547,14 @@ struct ChannelEx
 
 			// Low-pass filter
 			if (FEG.active)
-			{
-				u32 fv = FEG.GetValue();
-				s32 f = (((fv & 0xFF) | 0x100) << 4) >> ((fv >> 8) ^ 0x1F);
-				sample = f * sample + (0x2000 - f + FEG.q) * FEG.prev1 - FEG.q * FEG.prev2;
-				sample >>= 13;
-				clip16(sample);
-				FEG.prev2 = FEG.prev1;
-				FEG.prev1 = sample;
-			}
+				sample = Filter(sample, FEG.GetValue(), FEG.q, FEG.prev1, FEG.prev2);
 
-			//Volume & Mixer processing
-			//All attenuations are added together then applied and mixed :)
-			
-			//offset is up to 511
-			//*Att is up to 511
-			//logtable handles up to 1024, anything >=255 is mute
-
-			u32 ofsatt;
-			if (ccd->VOFF == 1)
-			{
-				ofsatt = 0;
-			}
-			else
-			{
-				ofsatt = lfo.alfo + (AEG.GetValue() >> 2);
-				ofsatt = std::min(ofsatt, (u32)255); // make sure it never gets more 255 -- it can happen with some alfo/aeg combinations
-			}
-			u32 const max_att = ((16 << 4) - 1) - ofsatt;
-			
-			s32* logtable = ofsatt + tl_lut;
-
-			u32 dl = std::min(VolMix.DLAtt, max_att);
-			u32 dr = std::min(VolMix.DRAtt, max_att);
-			u32 ds = std::min(VolMix.DSPAtt, max_att);
-
-			oLeft = FPMul(sample, logtable[dl], 15);
-			oRight = FPMul(sample, logtable[dr], 15);
-			oDsp = FPMul(sample, logtable[ds], 11);	// 20 bits
+			s32 gainL, gainR, gainDsp;
+			GetGains(GetOffsetAtt(), gainL, gainR, gainDsp);
+
+			oLeft = FPMul(sample, gainL, 15);
+			oRight = FPMul(sample, gainR, 15);
+			oDsp = FPMul(sample, gainDsp, 11);	// 20 bits
 
 			clip_verify(((s16)oLeft)==oLeft);
 			clip_verify(((s16)oRight)==oRight);
@@ -522,6 +581,33 @@ struct ChannelEx
 		mixr+=oRight;
 	}
 
+	// Same as GetGains for each sample of the block. The channel state is copied so that it isn't reloaded
+	// after each store to the block.
+	void GainBlock(VoiceBlock& vb, u32 n)
+	{
+		const u32 dl = VolMix.DLAtt;
+		const u32 dr = VolMix.DRAtt;
+		const u32 ds = VolMix.DSPAtt;
+		for (u32 i = 0; i < n; i++)
+		{
+			// ofsatt + min(att, 255 - ofsatt)
+			u32 ofsatt = vb.att[i];
+			vb.gainL[i] = tl_lut[std::min(ofsatt + dl, (u32)255)];
+			vb.gainR[i] = tl_lut[std::min(ofsatt + dr, (u32)255)];
+			vb.gainDsp[i] = tl_lut[std::min(ofsatt + ds, (u32)255)];
+		}
+	}
+	void FilterBlock(VoiceBlock& vb, u32 n)
+	{
+		SampleType prev1 = FEG.prev1;
+		SampleType prev2 = FEG.prev2;
+		const s32 q = FEG.q;
+		for (u32 i = 0; i < n; i++)
+			vb.sample[i] = Filter(vb.sample[i], vb.fv[i], q, prev1, prev2);
+		FEG.prev1 = prev1;
+		FEG.prev2 = prev2;
+	}
+
 	__forceinline static void StepAll(SampleType& mixl, SampleType& mixr)
 	{
 		for (int i = 0; i < 64; i++)
@@ -606,6 +692,7 @@ struct ChannelEx
 			fmt=4;
 
 		StepStream=STREAM_STEP_LUT[fmt][ccd->LPCTL][ccd->LPSLNK];
+		StepBlock=STREAM_STEP_BLOCK_LUT[fmt][ccd->LPCTL][ccd->LPSLNK];
 		StepStreamInitial=STREAM_INITAL_STEP_LUT[fmt];
 	}
 	//SA,PCMS
@@ -1162,7 +1249,46 @@ void FegStep(ChannelEx* ch)
 	}
 }
 
-static void staticinitialise()
+// Steps a channel for a block of 32 samples, keeping what ChannelEx::Step needs to compute each output sample
+// in vb. The stream step can't change during a block, so it's inlined along with the envelope steps.
+// Returns the number of samples, less than 32 if the channel stopped.
+template<s32 PCMS,u32 LPCTL,u32 LPSLNK>
+u32 StepBlock(ChannelEx* ch, VoiceBlock& vb)
+{
+	u32 n = 0;
+	for (; n < 32 && ch->enabled; n++)
+	{
+		vb.s0[n] = ch->s0;
+		vb.s1[n] = ch->s1;
+		vb.fp[n] = ch->step.fp;
+		vb.fv[n] = ch->FEG.GetValue();
+		vb.att[n] = ch->GetOffsetAtt();
+
+		// Same as StepAEG and StepFEG
+		switch (ch->AEG.state)
+		{
+		case EG_Attack: AegStep<EG_Attack>(ch); break;
+		case EG_Decay1: AegStep<EG_Decay1>(ch); break;
+		case EG_Decay2: AegStep<EG_Decay2>(ch); break;
+		case EG_Release: AegStep<EG_Release>(ch); break;
+		}
+		if (ch->FEG.active)
+		{
+			switch (ch->FEG.state)
+			{
+			case EG_Attack: FegStep<EG_Attack>(ch); break;
+			case EG_Decay1: FegStep<EG_Decay1>(ch); break;
+			case EG_Decay2: FegStep<EG_Decay2>(ch); break;
+			case EG_Release: FegStep<EG_Release>(ch); break;
+			}
+		}
+		StreamStep<PCMS,LPCTL,LPSLNK>(ch);
+		ch->lfo.Step(ch);
+	}
+	return n;
+}
+
+static void staticinitialise()
 {
 	STREAM_STEP_LUT[0][0][0]=&StreamStep<0,0,0>;
 	STREAM_STEP_LUT[1][0][0]=&StreamStep<1,0,0>;
@@ -1188,6 +1314,30 @@ static void staticinitialise()
 	STREAM_STEP_LUT[3][1][1]=&StreamStep<3,1,1>;
 	STREAM_STEP_LUT[4][1][1]=&StreamStep<-1,1,1>;
 
+	STREAM_STEP_BLOCK_LUT[0][0][0]=&StepBlock<0,0,0>;
+	STREAM_STEP_BLOCK_LUT[1][0][0]=&StepBlock<1,0,0>;
+	STREAM_STEP_BLOCK_LUT[2][0][0]=&StepBlock<2,0,0>;
+	STREAM_STEP_BLOCK_LUT[3][0][0]=&StepBlock<3,0,0>;
+	STREAM_STEP_BLOCK_LUT[4][0][0]=&StepBlock<-1,0,0>;
+
+	STREAM_STEP_BLOCK_LUT[0][0][1]=&StepBlock<0,0,1>;
+	STREAM_STEP_BLOCK_LUT[1][0][1]=&StepBlock<1,0,1>;
+	STREAM_STEP_BLOCK_LUT[2][0][1]=&StepBlock<2,0,1>;
+	STREAM_STEP_BLOCK_LUT[3][0][1]=&StepBlock<3,0,1>;
+	STREAM_STEP_BLOCK_LUT[4][0][1]=&StepBlock<-1,0,1>;
+
+	STREAM_STEP_BLOCK_LUT[0][1][0]=&StepBlock<0,1,0>;
+	STREAM_STEP_BLOCK_LUT[1][1][0]=&StepBlock<1,1,0>;
+	STREAM_STEP_BLOCK_LUT[2][1][0]=&StepBlock<2,1,0>;
+	STREAM_STEP_BLOCK_LUT[3][1][0]=&StepBlock<3,1,0>;
+	STREAM_STEP_BLOCK_LUT[4][1][0]=&StepBlock<-1,1,0>;
+
+	STREAM_STEP_BLOCK_LUT[0][1][1]=&StepBlock<0,1,1>;
+	STREAM_STEP_BLOCK_LUT[1][1][1]=&StepBlock<1,1,1>;
+	STREAM_STEP_BLOCK_LUT[2][1][1]=&StepBlock<2,1,1>;
+	STREAM_STEP_BLOCK_LUT[3][1][1]=&StepBlock<3,1,1>;
+	STREAM_STEP_BLOCK_LUT[4][1][1]=&StepBlock<-1,1,1>;
+
 	STREAM_INITAL_STEP_LUT[0]=&StepDecodeSampleInitial<0>;
 	STREAM_INITAL_STEP_LUT[1]=&StepDecodeSampleInitial<1>;
 	STREAM_INITAL_STEP_LUT[2]=&StepDecodeSampleInitial<2>;
@@ -1348,6 +1498,90 @@ void WriteCommonReg8(u32 reg,u32 data)
 s16 cdda_sector[CDDA_SIZE]={0};
 u32 cdda_index=CDDA_SIZE<<1;
 
+#if defined(__SSE2__)
+static __forceinline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+#ifdef __SSE4_1__
+	return _mm_mullo_epi32(a, b);
+#else
+	// The low 32 bits of the products are the same for signed and unsigned operands
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+#endif
+
+// Same as ChannelEx::InterpolateSample for each sample of the block
+static void InterpolateBlock(VoiceBlock& vb, u32 n)
+{
+	u32 i = 0;
+#if defined(__SSE2__)
+	const __m128i one = _mm_set1_epi32(1024);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i fp = _mm_loadu_si128((const __m128i *)&vb.fp[i]);
+		__m128i a = _mm_srai_epi32(mullo_epi32(_mm_loadu_si128((const __m128i *)&vb.s0[i]), _mm_sub_epi32(one, fp)), 10);
+		__m128i b = _mm_srai_epi32(mullo_epi32(_mm_loadu_si128((const __m128i *)&vb.s1[i]), fp), 10);
+		_mm_storeu_si128((__m128i *)&vb.sample[i], _mm_add_epi32(a, b));
+	}
+#elif defined(AICA_MIX_SIMD)
+	const int32x4_t one = vdupq_n_s32(1024);
+	for (; i + 4 <= n; i += 4)
+	{
+		int32x4_t fp = vld1q_s32(&vb.fp[i]);
+		int32x4_t a = vshrq_n_s32(vmulq_s32(vld1q_s32(&vb.s0[i]), vsubq_s32(one, fp)), 10);
+		int32x4_t b = vshrq_n_s32(vmulq_s32(vld1q_s32(&vb.s1[i]), fp), 10);
+		vst1q_s32(&vb.sample[i], vaddq_s32(a, b));
+	}
+#endif
+	for (; i < n; i++)
+		vb.sample[i] = FPMul(vb.s0[i], (1024 - vb.fp[i]), 10) + FPMul(vb.s1[i], vb.fp[i], 10);
+}
+
+// Applies the channel volumes to each sample of the block and adds them to the mix, like ChannelEx::Step.
+// A sample with no direct output is mixed at its DSP send level.
+static void MixBlock(const VoiceBlock& vb, u32 n, SampleType *mxl, SampleType *mxr)
+{
+	u32 i = 0;
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i sample = _mm_loadu_si128((const __m128i *)&vb.sample[i]);
+		__m128i left = _mm_srai_epi32(mullo_epi32(sample, _mm_loadu_si128((const __m128i *)&vb.gainL[i])), 15);
+		__m128i right = _mm_srai_epi32(mullo_epi32(sample, _mm_loadu_si128((const __m128i *)&vb.gainR[i])), 15);
+		__m128i dsp = _mm_srai_epi32(mullo_epi32(sample, _mm_loadu_si128((const __m128i *)&vb.gainDsp[i])), 11);
+		__m128i dspOnly = _mm_cmpeq_epi32(_mm_add_epi32(left, right), _mm_setzero_si128());
+		left = _mm_or_si128(_mm_and_si128(dspOnly, dsp), _mm_andnot_si128(dspOnly, left));
+		right = _mm_or_si128(_mm_and_si128(dspOnly, dsp), _mm_andnot_si128(dspOnly, right));
+		_mm_storeu_si128((__m128i *)&mxl[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&mxl[i]), left));
+		_mm_storeu_si128((__m128i *)&mxr[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&mxr[i]), right));
+	}
+#elif defined(AICA_MIX_SIMD)
+	for (; i + 4 <= n; i += 4)
+	{
+		int32x4_t sample = vld1q_s32(&vb.sample[i]);
+		int32x4_t left = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&vb.gainL[i])), 15);
+		int32x4_t right = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&vb.gainR[i])), 15);
+		int32x4_t dsp = vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&vb.gainDsp[i])), 11);
+		uint32x4_t dspOnly = vceqq_s32(vaddq_s32(left, right), vdupq_n_s32(0));
+		vst1q_s32(&mxl[i], vaddq_s32(vld1q_s32(&mxl[i]), vbslq_s32(dspOnly, dsp, left)));
+		vst1q_s32(&mxr[i], vaddq_s32(vld1q_s32(&mxr[i]), vbslq_s32(dspOnly, dsp, right)));
+	}
+#endif
+	for (; i < n; i++)
+	{
+		SampleType oLeft = FPMul(vb.sample[i], vb.gainL[i], 15);
+		SampleType oRight = FPMul(vb.sample[i], vb.gainR[i], 15);
+		if (0==(oLeft+oRight))
+		{
+			oLeft=oRight=FPMul(vb.sample[i], vb.gainDsp[i], 11);
+		}
+		mxl[i] += oLeft;
+		mxr[i] += oRight;
+	}
+}
+
 //no DSP for now in this version
 void AICA_Sample32()
 {
@@ -1356,31 +1590,28 @@ void AICA_Sample32()
 		return;
 	}
 
-	SampleType mxlr[64];
-	memset(mxlr,0,sizeof(mxlr));
+	SampleType mxl[32];
+	SampleType mxr[32];
+	memset(mxl,0,sizeof(mxl));
+	memset(mxr,0,sizeof(mxr));
 
 	//Generate 32 samples for each channel, before moving to next channel
 	//much more cache efficient !
-	u32 sg=0;
+	//The channel state is stepped sample by sample, then the interpolation and volumes are applied
+	//to the whole block at once
+	VoiceBlock vb;
 	for (int ch = 0; ch < 64; ch++)
 	{
-		for (int i=0;i<32;i++)
-		{
-			SampleType oLeft,oRight,oDsp;
-			//stop working on this channel if its turned off ...
-			if (!Chans[ch].Step(oLeft, oRight, oDsp))
-				break;
-
-			sg++;
-
-			if (0==(oLeft+oRight))
-			{
-				oLeft=oRight=oDsp;
-			}
-
-			mxlr[i*2+0] += oLeft;
-			mxlr[i*2+1] += oRight;
-		}
+		//stop working on this channel if its turned off ...
+		u32 n = Chans[ch].StepBlock(&Chans[ch], vb);
+		if (n == 0)
+			continue;
+
+		Chans[ch].GainBlock(vb, n);
+		InterpolateBlock(vb, n);
+		if (Chans[ch].FEG.active)
+			Chans[ch].FilterBlock(vb, n);
+		MixBlock(vb, n, mxl, mxr);
 	}
 	//OK , generated all Channels  , now DSP/ect + final mix ;p
 	//CDDA EXTS input
@@ -1389,13 +1620,13 @@ void AICA_Sample32()
 	{
 		SampleType mixl,mixr;
 
-		mixl=mxlr[i*2+0];
-		mixr=mxlr[i*2+1];
+		mixl=mxl[i];
+		mixr=mxr[i];
 
 		if (cdda_index>=CDDA_SIZE)
 		{
 			cdda_index=0;
-			libCore_CDDA_Sector(cdda_sector);
+			ReadCDDASector(cdda_sector);
 		}
 		s32 EXTS0L=cdda_sector[cdda_index];
 		s32 EXTS0R=cdda_sector[cdda_index+1];
@@ -1462,7 +1693,7 @@ void AICA_Sample32()
 		pl=mixl;
 		pr=mixr;
 
-		if (!settings.aica.NoSound) WriteSample(mixr,mixl);
+		if (!settings.aica.NoSound) OutputSample(mixr,mixl);
 	}
 }
 
@@ -1481,7 +1712,7 @@ void AICA_Sample()
 	if (cdda_index>=CDDA_SIZE)
 	{
 		cdda_index=0;
-		libCore_CDDA_Sector(cdda_sector);
+		ReadCDDASector(cdda_sector);
 	}
 	s32 EXTS0L=cdda_sector[cdda_index];
 	s32 EXTS0R=cdda_sector[cdda_index+1];
@@ -1557,7 +1788,7 @@ void AICA_Sample()
 	pl=mixl;
 	pr=mixr;
 
-	WriteSample(mixr,mixl);
+	OutputSample(mixr,mixl);
 }
 
 bool channel_serialize(void **data, unsigned int *total_size)
@@ -108,19 +108,17 @@ static void FillReadBuffer(void)
 {
 	read_buff.cache_index=0;
 	u32 count = read_params.remaining_sectors;
-	u32 hint=0;
 
 	if (count > 32)
-	{
-		hint = max(count - 32, (u32)32);
 		count = 32;
-	}
 
 	read_buff.cache_size=count*read_params.sector_type;
 
 	libGDR_ReadSector(read_buff.cache,read_params.start_sector,count,read_params.sector_type);
 	read_params.start_sector+=count;
 	read_params.remaining_sectors-=count;
+	// Let the disc prepare the rest of the transfer while these are sent
+	libGDR_ReadAhead(read_params.start_sector,read_params.remaining_sectors);
 }
 
 void gd_set_state(gd_states state)
@@ -7,6 +7,7 @@
 #include "hw/pvr/pvr_mem.h"
 #include "hw/gdrom/gdrom_if.h"
 #include "hw/aica/aica_if.h"
+#include "hw/aica/aica_thread.h"
 #include "hw/naomi/naomi.h"
 #include "hw/modem/modem.h"
 
@@ -427,6 +428,10 @@ T DYNACALL ReadMem_area0(u32 addr)
 	//map 0x0070 to 0x0070
 	else if ((base ==0x0070) /*&& (addr>= 0x00700000)*/ && (addr<=0x00707FFF)) //	:AICA- Sound Cntr. Reg.
 	{
+#ifdef HAVE_AICA_THREAD
+		if (aica_thread_running)
+			return (T) aica_thread_ReadReg(addr,sz);
+#endif
 		return (T) ReadMem_aica_reg(addr,sz);//libAICA_ReadReg(addr,sz);
 	}
 	//map 0x0071 to 0x0071
@@ -519,7 +524,12 @@ void  DYNACALL WriteMem_area0(u32 addr,T data)
 	//map 0x0070 to 0x0070
 	else if ((base >=0x0070) && (base <=0x0070) /*&& (addr>= 0x00700000)*/ && (addr<=0x00707FFF)) // AICA- Sound Cntr. Reg.
 	{
-		WriteMem_aica_reg(addr,data,sz);
+#ifdef HAVE_AICA_THREAD
+		if (aica_thread_running)
+			aica_thread_WriteReg(addr,data,sz);
+		else
+#endif
+			WriteMem_aica_reg(addr,data,sz);
 		return;
 	}
 	//map 0x0071 to 0x0071
@@ -1,8 +1,10 @@
 #include "Renderer_if.h"
 #include "ta.h"
+#include "ta_capture.h"
 #include "hw/pvr/pvr_mem.h"
 #include "rend/TexCache.h"
 #include "cheats.h"
+#include "emulator.h"
 
 /*
 
@@ -57,8 +59,8 @@
 
 
 	rendv2x hacks
-	- Only a single pending render. Any renders while still pending are dropped (before parsing)
-	- wait and block for parse/texcache. Render is async
+	- Up to settings.pvr.RenderQueueDepth pending renders. Any renders while the queue is full are dropped (before parsing)
+	- wait and block for parse/texcache. Render is async. With a deeper queue, only wait for render to texture
 */
 
 extern int screen_width;
@@ -81,6 +83,7 @@ static bool do_swap;
 
 int max_idx,max_mvo,max_op,max_pt,max_tr,max_vtx,max_modt, ovrn;
 bool pend_rend = false;
+static u32 pend_frame_seq;	// frame rend_end_render waits for
 
 static bool render_called = false;
 u32 fb_watch_addr_start;
@@ -102,6 +105,12 @@ void rend_create_renderer()
 		NOTICE_LOG(PVR, "Creating Open GL per-triangle/strip renderer");
 		renderer = rend_GLES2();
 		break;
+#ifdef HAVE_SOFTREND
+	case 2:
+		NOTICE_LOG(PVR, "Creating software renderer");
+		renderer = rend_softrend();
+		break;
+#endif
 #if defined(HAVE_OIT)
 	case 3:
 		NOTICE_LOG(PVR, "Creating Open GL per-pixel renderer");
@@ -168,8 +177,11 @@ bool rend_frame(TA_context* ctx, bool draw_osd)
    bool proc = renderer->Process(ctx);
 #if !defined(TARGET_NO_THREADS)
    if (settings.rend.ThreadedRendering && (!proc || (!ctx->rend.isRenderFramebuffer && !ctx->rend.isRTT)))
+   {
 	   // If rendering to texture, continue locking until the frame is rendered
+	   SetFrameProcessed(ctx);
       re.Set();
+   }
 #endif
    
    bool do_swp = proc && renderer->Render();
@@ -189,7 +201,8 @@ bool rend_single_frame(void)
 #if !defined(TARGET_NO_THREADS)
 				if (settings.rend.ThreadedRendering)
 				{
-					if (!rs.Wait(100))
+					// rs is only set once when several frames are queued
+					if (!rend_framePending() && !rs.Wait(100))
 						return false;
 					if (do_swap)
 					{
@@ -220,7 +233,10 @@ bool rend_single_frame(void)
 				 && settings.rend.ThreadedRendering && settings.rend.DelayFrameSwapping;
 
 		if (settings.rend.ThreadedRendering && _pvrrc->rend.isRTT)
+		{
+			SetFrameProcessed(_pvrrc);
 			re.Set();
+		}
 
 		//clear up & free data ..
 		FinishRender(_pvrrc);
@@ -273,16 +289,23 @@ void rend_start_render(void)
          max_mvo              = max(max_mvo,  ctx->rend.global_param_mvo.used());
          max_modt             = max(max_modt, ctx->rend.modtrig.used());
 
+         ta_capture_frame(ctx);
+
          if (QueueRender(ctx))
          {
             palette_update();
+            // With a deeper render queue, only wait for the frames whose result is needed by the emulator
+            pend_rend = settings.pvr.RenderQueueDepth <= 1 || is_rtt;
+            pend_frame_seq = ctx->frame_seq;
 #if !defined(TARGET_NO_THREADS)
             if (settings.rend.ThreadedRendering)
             	rs.Set();
             else
 #endif
+            {
             	rend_single_frame();
-            pend_rend = true;
+            	pend_rend = true;
+            }
          }
       }
       else
@@ -300,7 +323,11 @@ void rend_end_render(void)
    {
 #if !defined(TARGET_NO_THREADS)
 	   if (settings.rend.ThreadedRendering)
-		   re.Wait();
+	   {
+		   // re is also set to cancel the wait when the emulator is stopped
+		   while (!IsFrameProcessed(pend_frame_seq) && dc_is_running())
+			   re.Wait();
+	   }
 	   else
 #endif
 		  if(renderer != NULL)
@@ -16,6 +16,7 @@
 #include "pvr_mem.h"
 #include "Renderer_if.h"
 #include "rend/CustomTexture.h"
+#include "rend/TexCache.h"
 
 void libPvr_LockedBlockWrite (vram_block* block,u32 addr)
 {
@@ -45,6 +46,8 @@ s32 libPvr_Init(void)
 void libPvr_Term(void)
 {
    custom_texture.Terminate();	// Avoid deadlock on exit (win32)
+   TermTextureDecoder();
+   ta_parse_term();
    rend_term();
    spg_Term();
 }
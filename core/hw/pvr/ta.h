@@ -35,6 +35,8 @@ void DYNACALL ta_vtx_data32(void* data);
 void ta_vtx_data(u32* data, u32 size);
 
 bool ta_parse_vdrc(TA_context* ctx);
+// Stops the parallel parser threads
+void ta_parse_term();
 
 #define STRIPS_AS_PPARAMS 1
 
@@ -0,0 +1,154 @@
+/*
+	TA frame capture. See ta_capture.h
+*/
+#include <limits.h>
+#include "ta_capture.h"
+#include "pvr_mem.h"
+#include "Renderer_if.h"
+#include "deps/zlib/zlib.h"
+#include "file/file_path.h"
+#include "rend/TexCache.h"
+
+#define TA_CAPTURE_MAGIC 0x43415454		// "TTAC"
+#define TA_CAPTURE_VERSION 1
+
+#ifdef _WIN32
+#define TA_CAPTURE_DIR "tacapture\\"
+#else
+#define TA_CAPTURE_DIR "tacapture/"
+#endif
+
+// File layout: header, pvr registers, TA data, zlib compressed vram
+struct TaCaptureHeader
+{
+	u32 magic;
+	u32 version;
+	u32 address;			// TA context address
+	u32 ta_size;
+	u32 render_pass_count;
+	u32 render_passes[sizeof(tad_context::render_passes) / sizeof(u8*)];	// end of each pass, from the start of the TA data
+	u32 vram_size;
+	u32 vram_compressed_size;
+};
+
+void ta_capture_frame(TA_context* ctx)
+{
+	extern char content_name[PATH_MAX];
+
+	if (settings.pvr.CaptureFrames == 0 || ctx->rend.isRenderFramebuffer)
+		return;
+	settings.pvr.CaptureFrames--;
+
+	string dir = get_writable_data_path(TA_CAPTURE_DIR);
+	if (!path_is_valid(dir.c_str()))
+		path_mkdir(dir.c_str());
+	char name[32];
+	sprintf(name, "_%06d" TA_CAPTURE_EXT, FrameCount);
+	string path = dir + content_name + name;
+	if (ta_capture_write(ctx, path))
+		INFO_LOG(PVR, "TA frame captured to %s", path.c_str());
+}
+
+bool ta_capture_write(TA_context* ctx, const string& path)
+{
+	TaCaptureHeader header = { 0 };
+	header.magic = TA_CAPTURE_MAGIC;
+	header.version = TA_CAPTURE_VERSION;
+	header.address = ctx->Address;
+	header.ta_size = ctx->tad.End() - ctx->tad.thd_root;
+	header.render_pass_count = ctx->tad.render_pass_count;
+	for (u32 i = 0; i < ctx->tad.render_pass_count; i++)
+		header.render_passes[i] = ctx->tad.render_passes[i] - ctx->tad.thd_root;
+	header.vram_size = VRAM_SIZE;
+
+	uLongf compressed_size = compressBound(VRAM_SIZE);
+	vector<u8> compressed(compressed_size);
+	if (compress2(&compressed[0], &compressed_size, vram.data, VRAM_SIZE, Z_BEST_SPEED) != Z_OK)
+	{
+		WARN_LOG(PVR, "TA capture: vram compression failed");
+		return false;
+	}
+	header.vram_compressed_size = compressed_size;
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(PVR, "TA capture: can't create %s", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+			&& fwrite(pvr_regs, pvr_RegSize, 1, f) == 1
+			&& (header.ta_size == 0 || fwrite(ctx->tad.thd_root, header.ta_size, 1, f) == 1)
+			&& fwrite(&compressed[0], compressed_size, 1, f) == 1;
+	fclose(f);
+	if (!ok)
+		WARN_LOG(PVR, "TA capture: error writing %s", path.c_str());
+
+	return ok;
+}
+
+bool ta_capture_read(const string& path, TA_context* ctx)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+	{
+		WARN_LOG(PVR, "TA capture: can't open %s", path.c_str());
+		return false;
+	}
+	TaCaptureHeader header;
+	vector<u8> compressed;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1
+			&& header.magic == TA_CAPTURE_MAGIC
+			&& header.version == TA_CAPTURE_VERSION
+			&& header.ta_size <= TA_DATA_SIZE
+			&& header.render_pass_count < sizeof(header.render_passes) / sizeof(header.render_passes[0])
+			&& (vram.data == NULL || header.vram_size == VRAM_SIZE)
+			&& fread(pvr_regs, pvr_RegSize, 1, f) == 1;
+	if (ok)
+	{
+		ctx->Reset();
+		ok = header.ta_size == 0 || fread(ctx->tad.thd_root, header.ta_size, 1, f) == 1;
+	}
+	if (ok)
+	{
+		compressed.resize(header.vram_compressed_size);
+		ok = fread(&compressed[0], compressed.size(), 1, f) == 1;
+	}
+	fclose(f);
+	if (!ok)
+	{
+		WARN_LOG(PVR, "TA capture: invalid file %s", path.c_str());
+		return false;
+	}
+
+	if (vram.data == NULL)
+	{
+		VRAM_SIZE = header.vram_size;
+		VRAM_MASK = VRAM_SIZE - 1;
+		vram.data = (u8 *)calloc(VRAM_SIZE, 1);
+		vram.size = VRAM_SIZE;
+	}
+	vector<u8> data(VRAM_SIZE);
+	uLongf size = VRAM_SIZE;
+	if (uncompress(&data[0], &size, &compressed[0], compressed.size()) != Z_OK || size != VRAM_SIZE)
+	{
+		WARN_LOG(PVR, "TA capture: corrupted vram in %s", path.c_str());
+		return false;
+	}
+	for (u32 offset = 0; offset < VRAM_SIZE; offset += PAGE_SIZE)
+		if (memcmp(&vram.data[offset], &data[offset], PAGE_SIZE))
+		{
+			// Invalidates the textures using this page
+			VramLockedWriteOffset(offset);
+			memcpy(&vram.data[offset], &data[offset], PAGE_SIZE);
+		}
+	pal_needs_update = true;
+
+	ctx->Address = header.address;
+	ctx->tad.thd_data = ctx->tad.thd_root + header.ta_size;
+	ctx->tad.render_pass_count = header.render_pass_count;
+	for (u32 i = 0; i < header.render_pass_count; i++)
+		ctx->tad.render_passes[i] = ctx->tad.thd_root + header.render_passes[i];
+
+	return true;
+}
@@ -0,0 +1,21 @@
+/*
+	TA frame capture.
+
+	A capture file holds what is needed to parse and render a frame offline: the TA data and
+	render passes of the context, the pvr registers (including the palette ram) and vram.
+	Captures are written to the tacapture folder of the data directory and can be replayed
+	with the ta_replay tool.
+*/
+#pragma once
+#include "ta_ctx.h"
+
+#define TA_CAPTURE_EXT ".tac"
+
+// Called by rend_start_render. Writes the frame to a new capture file while settings.pvr.CaptureFrames isn't 0.
+void ta_capture_frame(TA_context* ctx);
+
+bool ta_capture_write(TA_context* ctx, const string& path);
+// Loads a capture into ctx, the pvr registers and vram. The textures using the vram pages
+// that changed are invalidated.
+// If vram isn't allocated yet, it is allocated with the size of the captured vram.
+bool ta_capture_read(const string& path, TA_context* ctx);
@@ -1,3 +1,4 @@
+#include <atomic>
 #include "ta.h"
 #include "ta_ctx.h"
 
@@ -105,13 +106,57 @@ void VDecEnd(void)
 	vd_ctx = 0;
 }
 
-cMutex mtx_rqueue;
-TA_context* rqueue;
+// Render queue: single producer (emu thread), single consumer (render thread)
+// Frames are queued at the tail by QueueRender and removed from the head by FinishRender.
+struct RenderQueueSlot
+{
+	TA_context* ctx;
+	double queued;
+	double dequeued;
+};
+static RenderQueueSlot rqueue[RENDER_QUEUE_MAX];
+static std::atomic<u32> rqueue_head;
+static std::atomic<u32> rqueue_tail;
+static std::atomic<u32> rqueue_processed;	// sequence number of the last processed frame
 cResetEvent frame_finished;
 
+struct RenderQueueStats
+{
+	u32 queued;
+	u32 rendered;
+	u32 dropped_full;	// dropped by QueueRender because the queue was full
+	u32 dropped_stale;	// skipped by DequeueRender because a more recent frame was pending
+	u32 max_pending;
+};
+static RenderQueueStats rqueue_stats;
+
+// Frame pacing info of a frame removed from the queue. Times are in seconds (os_GetSeconds).
+// Only used by the render thread.
+struct RenderQueueTiming
+{
+	double queued;
+	double dequeued;	// 0 if the frame was dropped
+	double finished;
+};
+#define RENDER_TIMINGS_SIZE 128
+static RenderQueueTiming rqueue_timings[RENDER_TIMINGS_SIZE];
+static u32 rqueue_timings_count;
+static double last_stats_log;
+static u32 last_stats_rendered;
+
 double last_frame = 0;
 u64 last_cycles = 0;
 
+static u32 rqueue_depth()
+{
+	return max(1u, min((u32)RENDER_QUEUE_MAX, settings.pvr.RenderQueueDepth));
+}
+
+static bool rqueue_full()
+{
+	return rqueue_tail.load(std::memory_order_relaxed) - rqueue_head.load(std::memory_order_acquire) >= rqueue_depth();
+}
+
 bool QueueRender(TA_context* ctx)
 {
    verify(ctx != 0);
@@ -133,66 +178,151 @@ bool QueueRender(TA_context* ctx)
 
 	bool too_fast = (cycle_span / time_span) > (SH4_MAIN_CLOCK * 1.2);
 
-	if (rqueue && too_fast && settings.pvr.SynchronousRendering) {
+	if (rqueue_full() && too_fast && settings.pvr.SynchronousRendering) {
 		//wait for a frame if
-		//  we have another one queue'd and
+		//  the queue is full and
 		//  sh4 run at > 120% on the last slice
 		//  and SynchronousRendering is enabled
-		frame_finished.Wait();
+		frame_finished.Reset();
+		if (rqueue_full())
+			frame_finished.Wait();
 	}
 
-	if (rqueue)
+	if (rqueue_full())
    {
+		// Drop the new frame: the queued ones are already being waited for
+		rqueue_stats.dropped_full++;
 		tactx_Recycle(ctx);
 		return false;
 	}
 
-   frame_finished.Reset();
-   mtx_rqueue.Lock();
-	TA_context* old = rqueue;
-	rqueue=ctx;
-   mtx_rqueue.Unlock();
+	u32 tail = rqueue_tail.load(std::memory_order_relaxed);
+	ctx->frame_seq = tail + 1;
+	RenderQueueSlot& slot = rqueue[tail % RENDER_QUEUE_MAX];
+	slot.ctx = ctx;
+	slot.queued = last_frame;
+	slot.dequeued = 0;
+	rqueue_tail.store(tail + 1, std::memory_order_release);
 
-   verify(!old);
+	rqueue_stats.queued++;
 
 	return true;
 }
 
+static void rqueue_AddTiming(const RenderQueueSlot& slot, bool dropped)
+{
+	RenderQueueTiming& timing = rqueue_timings[rqueue_timings_count++ % RENDER_TIMINGS_SIZE];
+	timing.queued = slot.queued;
+	timing.dequeued = dropped ? 0 : slot.dequeued;
+	timing.finished = os_GetSeconds();
+}
+
+// Removes the frame at the head of the queue
+static void rqueue_Pop(bool dropped)
+{
+	u32 head = rqueue_head.load(std::memory_order_relaxed);
+	RenderQueueSlot& slot = rqueue[head % RENDER_QUEUE_MAX];
+	TA_context* ctx = slot.ctx;
+	rqueue_AddTiming(slot, dropped);
+	rqueue_processed.store(ctx->frame_seq, std::memory_order_release);
+	slot.ctx = NULL;
+	tactx_Recycle(ctx);
+	rqueue_head.store(head + 1, std::memory_order_release);
+}
+
+static void rqueue_LogStats()
+{
+	double now = os_GetSeconds();
+	if (now - last_stats_log < 10.0)
+		return;
+	last_stats_log = now;
+	if (rqueue_stats.rendered == last_stats_rendered)
+		return;
+	last_stats_rendered = rqueue_stats.rendered;
+
+	// Pacing of the last rendered frames
+	double wait_total = 0, wait_max = 0, render_total = 0, render_max = 0;
+	u32 frames = 0;
+	u32 count = min(rqueue_timings_count, (u32)RENDER_TIMINGS_SIZE);
+	for (u32 i = 0; i < count; i++)
+	{
+		const RenderQueueTiming& timing = rqueue_timings[i];
+		if (timing.dequeued == 0)
+			continue;
+		double wait = timing.dequeued - timing.queued;
+		double render = timing.finished - timing.dequeued;
+		wait_total += wait;
+		wait_max = max(wait_max, wait);
+		render_total += render;
+		render_max = max(render_max, render);
+		frames++;
+	}
+	INFO_LOG(PVR, "Render queue: %d frames queued, %d rendered, %d dropped (queue full), %d dropped (stale), max pending %d",
+			rqueue_stats.queued, rqueue_stats.rendered, rqueue_stats.dropped_full, rqueue_stats.dropped_stale, rqueue_stats.max_pending);
+	if (frames > 0)
+		INFO_LOG(PVR, "Render queue: last %d frames waited %.2f ms (max %.2f ms), rendered in %.2f ms (max %.2f ms)",
+				frames, wait_total * 1000 / frames, wait_max * 1000, render_total * 1000 / frames, render_max * 1000);
+}
+
 TA_context* DequeueRender(void)
 {
-   mtx_rqueue.Lock();
-	TA_context* rv = rqueue;
-   mtx_rqueue.Unlock();
+	u32 head = rqueue_head.load(std::memory_order_relaxed);
+	u32 tail = rqueue_tail.load(std::memory_order_acquire);
+	if (head == tail)
+		return NULL;
+	rqueue_stats.max_pending = max(rqueue_stats.max_pending, tail - head);
 
-	if (rv)
+	if (settings.pvr.RenderQueueLatestOnly)
+	{
+		// Skip the queued frames that have a more recent one behind them,
+		// unless the emulator needs their result
+		while (tail - head > 1)
+		{
+			TA_context* ctx = rqueue[head % RENDER_QUEUE_MAX].ctx;
+			if (ctx->rend.isRTT || ctx->rend.isRenderFramebuffer)
+				break;
+			rqueue_Pop(true);
+			rqueue_stats.dropped_stale++;
+			head++;
+		}
+	}
+	RenderQueueSlot& slot = rqueue[head % RENDER_QUEUE_MAX];
+	if (slot.dequeued == 0)
+	{
+		slot.dequeued = os_GetSeconds();
 		FrameCount++;
+	}
 
-	return rv;
+	return slot.ctx;
 }
 
 bool rend_framePending(void)
 {
-   mtx_rqueue.Lock();
-	TA_context* rv = rqueue;
-   mtx_rqueue.Unlock();
-
-	return rv != 0;
+	return rqueue_head.load(std::memory_order_relaxed) != rqueue_tail.load(std::memory_order_acquire);
 }
 
 void FinishRender(TA_context* ctx)
 {
 	if (ctx != NULL)
 	{
-		verify(rqueue == ctx);
-		mtx_rqueue.Lock();
-		rqueue = NULL;
-		mtx_rqueue.Unlock();
-
-		tactx_Recycle(ctx);
+		verify(rend_framePending() && rqueue[rqueue_head.load(std::memory_order_relaxed) % RENDER_QUEUE_MAX].ctx == ctx);
+		rqueue_stats.rendered++;
+		rqueue_Pop(false);
+		rqueue_LogStats();
 	}
 	frame_finished.Set();
 }
 
+void SetFrameProcessed(TA_context* ctx)
+{
+	rqueue_processed.store(ctx->frame_seq, std::memory_order_release);
+}
+
+bool IsFrameProcessed(u32 frame_seq)
+{
+	return (s32)(rqueue_processed.load(std::memory_order_acquire) - frame_seq) >= 0;
+}
+
 cMutex mtx_pool;
 
 /* texture cache entry pool. */
@@ -223,7 +353,8 @@ TA_context* tactx_Alloc(void)
 void tactx_Recycle(TA_context* poped_ctx)
 {
    mtx_pool.Lock();
-   if (ctx_pool.size()>2)
+   // keep enough contexts for a full render queue
+   if (ctx_pool.size() > rqueue_depth() + 1)
    {
       poped_ctx->Free();
       delete poped_ctx;
@@ -152,6 +152,43 @@ struct rend_context
 		fZ_max= 1.0f;
       isRenderFramebuffer = false;
 	}
+
+	void Alloc()
+	{
+      unsigned modtrig_size = 16384;
+      unsigned    vert_size = 4*1024*1024; //up to 4 mb of vtx data/frame = ~ 96k vtx/frame
+
+		verts.InitBytes(vert_size,&Overrun, "verts"); 
+		idx.Init(120*1024,&Overrun, "idx"); // up to 120K indices (idx have stripification overhead)
+		global_param_op.Init(16384,&Overrun, "global_param_op");
+		global_param_pt.Init(4096,&Overrun, "global_param_pt");
+		global_param_mvo.Init(4096,&Overrun, "global_param_mvo");
+      global_param_mvo_tr.Init(4096,&Overrun, "global_param_mvo_tr");
+#if STRIPS_AS_PPARAMS
+      // That makes a lot of polyparams but this is required for proper sorting...
+		// Rez uses more than 8192 translucent polygons sometimes
+      global_param_tr.Init(10240, &Overrun, "global_param_tr");
+#else
+		global_param_tr.Init(8192,&Overrun, "global_param_tr");
+#endif
+
+		modtrig.Init(modtrig_size,&Overrun, "modtrig");
+
+      render_passes.Init(sizeof(RenderPass) * 10, &Overrun, "render_passes");	// 10 render passes
+	}
+
+	void Free()
+	{
+		verts.Free();
+		idx.Free();
+		global_param_op.Free();
+		global_param_pt.Free();
+		global_param_tr.Free();
+		modtrig.Free();
+		global_param_mvo.Free();
+      global_param_mvo_tr.Free();
+      render_passes.Free();
+	}
 };
 
 #define TA_DATA_SIZE (8 * 1024 * 1024)
@@ -161,6 +198,7 @@ struct TA_context
 {
 	u32 Address;
 	u32 LastUsed;
+	u32 frame_seq;		// render queue sequence number
 
 	cMutex thd_inuse;
 	cMutex rend_inuse;
@@ -196,27 +234,8 @@ struct TA_context
 	}
 	void Alloc()
 	{
-      unsigned modtrig_size = 16384;
-      unsigned    vert_size = 4*1024*1024; //up to 4 mb of vtx data/frame = ~ 96k vtx/frame
       tad.Reset((u8*)OS_aligned_malloc(32, TA_DATA_SIZE));
-
-		rend.verts.InitBytes(vert_size,&rend.Overrun, "verts"); 
-		rend.idx.Init(120*1024,&rend.Overrun, "idx"); // up to 120K indices (idx have stripification overhead)
-		rend.global_param_op.Init(16384,&rend.Overrun, "global_param_op");
-		rend.global_param_pt.Init(4096,&rend.Overrun, "global_param_pt");
-		rend.global_param_mvo.Init(4096,&rend.Overrun, "global_param_mvo");
-      rend.global_param_mvo_tr.Init(4096,&rend.Overrun, "global_param_mvo_tr");
-#if STRIPS_AS_PPARAMS
-      // That makes a lot of polyparams but this is required for proper sorting...
-		// Rez uses more than 8192 translucent polygons sometimes
-      rend.global_param_tr.Init(10240, &rend.Overrun, "global_param_tr");
-#else
-		rend.global_param_tr.Init(8192,&rend.Overrun, "global_param_tr");
-#endif
-
-		rend.modtrig.Init(modtrig_size,&rend.Overrun, "modtrig");
-
-      rend.render_passes.Init(sizeof(RenderPass) * 10, &rend.Overrun, "render_passes");	// 10 render passes
+		rend.Alloc();
 		
 		Reset();
 	}
@@ -233,15 +252,7 @@ struct TA_context
 	void Free()
 	{
       OS_aligned_free(tad.thd_root);
-		rend.verts.Free();
-		rend.idx.Free();
-		rend.global_param_op.Free();
-		rend.global_param_pt.Free();
-		rend.global_param_tr.Free();
-		rend.modtrig.Free();
-		rend.global_param_mvo.Free();
-      rend.global_param_mvo_tr.Free();
-      rend.render_passes.Free();
+		rend.Free();
 	}
 };
 
@@ -266,9 +277,28 @@ void tactx_Recycle(TA_context* poped_ctx);
 #define TACTX_NONE (0xFFFFFFFF)
 
 void SetCurrentTARC(u32 addr);
+/*
+	Render queue
+
+	Up to settings.pvr.RenderQueueDepth frames can be pending. When the queue is full, new frames are dropped,
+	or the emu thread waits for a frame to finish if SynchronousRendering is enabled and the emulation is
+	running too fast. With RenderQueueLatestOnly, the renderer skips the pending frames that are followed by a
+	more recent one, except render to texture and framebuffer frames.
+	Every 10 seconds, the render thread logs the queue counters and the time spent by the last frames in the
+	queue and in the renderer.
+*/
+#define RENDER_QUEUE_MAX 3
+
+// Emu thread. Returns false if the frame is dropped
 bool QueueRender(TA_context* ctx);
+// Render thread. Returns the oldest pending frame without removing it from the queue
 TA_context* DequeueRender();
+bool rend_framePending();
+// Render thread. Removes the frame returned by DequeueRender from the queue
 void FinishRender(TA_context* ctx);
+// Render thread. The TA data of the frame has been consumed
+void SetFrameProcessed(TA_context* ctx);
+bool IsFrameProcessed(u32 frame_seq);
 bool TryDecodeTARC();
 void VDecEnd();
 
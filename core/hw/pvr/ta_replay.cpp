@@ -0,0 +1,311 @@
+/*
+	ta_replay: replays TA capture files without a GPU and reports the time spent in
+	each stage of the rendering pipeline.
+
+	Built with "make ta_replay". Usage: ta_replay [-n iterations] [-t threads] [-r soft] capture.tac...
+
+	Textures are decoded by a texture cache that keeps nothing once decoded.
+	The first iteration of a frame decodes all its textures, the following ones only look them up.
+
+	With -r soft, each iteration also renders the frame with the software renderer. Its own parsing
+	isn't timed, only the binning and rasterization. A hash of the last rendered image is printed
+	so that the output of two builds can be compared.
+
+	The hash of the vertices and indices decoded by the TA parser is printed too. Lists are decoded
+	in parallel when there are several threads, which changes the vertex order, and the fields a
+	vertex type doesn't use keep what the buffers held before. So hashes are only comparable between
+	runs of the same captures, in the same order and with the same number of threads.
+
+	Each capture is also decoded with and without the batch vertex decoder, which must give the same
+	vertices and indices. Exits with 1 if they differ, after printing the first differing vertex.
+*/
+#include "ta_capture.h"
+#include "Renderer_if.h"
+#include "rend/TexCache.h"
+#include "rend/sorter.h"
+#ifdef HAVE_SOFTREND
+#include "rend/soft/softrend.h"
+#include "rend/soft/softrend_output.h"
+#endif
+#include "deps/xxhash/xxhash.h"
+
+void LoadSettings(void);
+void FillBGP(TA_context* ctx);
+
+struct ReplayTexture : BaseTextureCacheData
+{
+	bool created = false;
+
+	std::string GetId() override { char s[20]; sprintf(s, "%p", this); return s; }
+	void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded) override { }
+};
+
+struct ReplayRenderer : Renderer
+{
+	bool Init() override { return true; }
+	void Resize(int w, int h) override { }
+	void Term() override { textures.Clear(); }
+	bool Process(TA_context* ctx) override { return true; }
+	bool Render() override { return true; }
+	void Present() override { }
+
+	u64 GetTexture(TSP tsp, TCW tcw) override
+	{
+		double start = os_GetSeconds();
+		ReplayTexture* texture = textures.getTextureCacheData(tsp, tcw);
+		if (!texture->created)
+		{
+			texture->Create();
+			texture->created = true;
+		}
+		if (texture->NeedsUpdate())
+			texture->Update();
+		texture_time += os_GetSeconds() - start;
+
+		return (u64)(uintptr_t)texture;
+	}
+
+	BaseTextureCache<ReplayTexture> textures;
+	double texture_time = 0;
+};
+
+enum ReplayStage { StageParse, StageTextures, StageSortStrips, StageSortTriangles, StageRaster, StageCount };
+static const char *stage_names[StageCount] = { "parse", "textures", "sort strips", "sort triangles", "raster" };
+
+// Renderer of the raster stage, NULL if there isn't one
+static Renderer *raster_renderer;
+
+struct ReplayTimes
+{
+	double total[StageCount];
+	double cold_textures;		// first iteration
+};
+
+static void replay_frame(ReplayRenderer& rend, TA_context* ctx, double times[StageCount], u32 *vertex_hash)
+{
+	rend.texture_time = 0;
+	double start = os_GetSeconds();
+	ctx->rend_inuse.Lock();
+	BeginTextureBatch();
+	ta_parse_vdrc(ctx);
+	double parsed = os_GetSeconds();
+	FlushTextureBatch();
+	double flushed = os_GetSeconds();
+	times[StageParse] = parsed - start - rend.texture_time;
+	times[StageTextures] = rend.texture_time + flushed - parsed;
+	if (vertex_hash != NULL)
+	{
+		*vertex_hash = XXH32(ctx->rend.verts.head(), ctx->rend.verts.used() * sizeof(Vertex), 7);
+		*vertex_hash = XXH32(ctx->rend.idx.head(), ctx->rend.idx.used() * sizeof(u32), *vertex_hash);
+	}
+
+	// Translucent polygons of each pass are sorted as the renderers do it
+	vector<SortTrigDrawParam> sorted_pp;
+	vector<u32> sorted_idx;
+	times[StageSortStrips] = 0;
+	times[StageSortTriangles] = 0;
+	u32 tr_first = 0;
+	for (int pass = 0; pass < ctx->rend.render_passes.used(); pass++)
+	{
+		const RenderPass& render_pass = ctx->rend.render_passes.head()[pass];
+		u32 tr_count = render_pass.tr_count - tr_first;
+		if (render_pass.autosort && tr_count > 0)
+		{
+			start = os_GetSeconds();
+			GenSorted(tr_first, tr_count, sorted_pp, sorted_idx);
+			double sorted = os_GetSeconds();
+			SortPParams(tr_first, tr_count);
+			times[StageSortTriangles] += sorted - start;
+			times[StageSortStrips] += os_GetSeconds() - sorted;
+		}
+		tr_first = render_pass.tr_count;
+	}
+
+	times[StageRaster] = 0;
+	if (raster_renderer != NULL)
+	{
+		// The textures it uses must come from its own cache
+		renderer = raster_renderer;
+		if (raster_renderer->Process(ctx))
+		{
+			start = os_GetSeconds();
+			raster_renderer->Render();
+			times[StageRaster] = os_GetSeconds() - start;
+		}
+		renderer = &rend;
+	}
+}
+
+static void print_vertex(const char *decoder, const Vertex& v)
+{
+	printf("  %-10s xyz %g %g %g uv %g %g col %02x%02x%02x%02x spc %02x%02x%02x%02x uv1 %g %g col1 %02x%02x%02x%02x spc1 %02x%02x%02x%02x\n",
+			decoder, v.x, v.y, v.z, v.u, v.v, v.col[0], v.col[1], v.col[2], v.col[3], v.vtx_spc[0], v.vtx_spc[1], v.vtx_spc[2], v.vtx_spc[3],
+			v.u1, v.v1, v.col1[0], v.col1[1], v.col1[2], v.col1[3], v.spc1[0], v.spc1[1], v.spc1[2], v.spc1[3]);
+}
+
+// Decodes the frame with the per-vertex decoder and with the batch one. Returns false if they disagree.
+static bool check_batch_decoder(const char *name, TA_context* ctx)
+{
+	vector<Vertex> verts[2];
+	vector<u32> idx[2];
+	for (int batch = 0; batch < 2; batch++)
+	{
+		// The fields a vertex type doesn't use keep what the buffer held
+		memset(ctx->rend.verts.head(), 0, ctx->rend.verts.used() * sizeof(Vertex));
+		settings.pvr.TaBatchDecoder = batch == 1;
+		ctx->rend_inuse.Lock();
+		BeginTextureBatch();
+		ta_parse_vdrc(ctx);
+		FlushTextureBatch();
+		verts[batch].assign(ctx->rend.verts.head(), ctx->rend.verts.head() + ctx->rend.verts.used());
+		idx[batch].assign(ctx->rend.idx.head(), ctx->rend.idx.head() + ctx->rend.idx.used());
+	}
+	settings.pvr.TaBatchDecoder = true;
+
+	u32 count = min(verts[0].size(), verts[1].size());
+	for (u32 i = 0; i < count; i++)
+	{
+		if (memcmp(&verts[0][i], &verts[1][i], sizeof(Vertex)) == 0)
+			continue;
+		printf("%s: vertex %d differs\n", name, i);
+		print_vertex("per vertex", verts[0][i]);
+		print_vertex("batch", verts[1][i]);
+		return false;
+	}
+	if (verts[0].size() != verts[1].size())
+	{
+		printf("%s: %d vertices per vertex, %d batched\n", name, (int)verts[0].size(), (int)verts[1].size());
+		return false;
+	}
+	if (idx[0] != idx[1])
+	{
+		printf("%s: indices differ\n", name);
+		return false;
+	}
+	return true;
+}
+
+static void print_times(const char *name, const double times[StageCount], double cold_textures, int iterations)
+{
+	printf("%-40s", name);
+	int stage_count = raster_renderer != NULL ? StageCount : StageRaster;
+	for (int stage = 0; stage < stage_count; stage++)
+		printf(" %s %7.3f ms", stage_names[stage], times[stage] * 1000.0 / iterations);
+	printf(" (cold textures %7.3f ms)\n", cold_textures * 1000.0);
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 100;
+	const char *raster = NULL;
+	vector<string> files;
+	LoadSettings();
+	settings.pvr.ta_skip = 0;
+	settings.rend.UseMipmaps = true;
+	settings.pvr.SoftRendAVX2 = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			settings.pvr.MaxThreads = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			raster = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		fprintf(stderr, "Usage: %s [-n iterations] [-t threads] [-r soft] capture" TA_CAPTURE_EXT "...\n", argv[0]);
+		return 1;
+	}
+	if (raster != NULL)
+	{
+#ifdef HAVE_SOFTREND
+		if (!strcmp(raster, "soft"))
+		{
+			settings.pvr.FrameOutput = FrameOutputNone;
+			raster_renderer = rend_softrend();
+			raster_renderer->Init();
+		}
+#endif
+		if (raster_renderer == NULL)
+		{
+			fprintf(stderr, "Unsupported renderer: %s\n", raster);
+			return 1;
+		}
+	}
+
+	ReplayRenderer rend;
+	renderer = &rend;
+	TA_context* ctx = tactx_Alloc();
+	_pvrrc = ctx;
+
+	double total[StageCount] = { 0 };
+	double total_cold_textures = 0;
+	int frames = 0;
+	bool decoders_differ = false;
+	for (const string& file : files)
+	{
+		if (!ta_capture_read(file, ctx))
+		{
+			fprintf(stderr, "Can't load %s\n", file.c_str());
+			continue;
+		}
+		FrameCount++;
+		palette_update();
+		// Same as rend_start_render
+		FillBGP(ctx);
+		ctx->rend.isRTT = (FB_W_SOF1 & 0x1000000) != 0;
+		ctx->rend.fb_X_CLIP = FB_X_CLIP;
+		ctx->rend.fb_Y_CLIP = FB_Y_CLIP;
+		ctx->rend.fog_clamp_min = FOG_CLAMP_MIN;
+		ctx->rend.fog_clamp_max = FOG_CLAMP_MAX;
+
+		double frame_total[StageCount] = { 0 };
+		double cold_textures = 0;
+		u32 vertex_hash = 0;
+		for (int i = 0; i < iterations; i++)
+		{
+			double times[StageCount];
+			replay_frame(rend, ctx, times, i == 0 ? &vertex_hash : NULL);
+			if (i == 0)
+				cold_textures = times[StageTextures];
+			for (int stage = 0; stage < StageCount; stage++)
+				frame_total[stage] += times[stage];
+		}
+		if (ctx->rend.Overrun)
+			fprintf(stderr, "%s: rendering context overrun\n", file.c_str());
+		if (!check_batch_decoder(file.c_str(), ctx))
+			decoders_differ = true;
+		print_times(file.c_str(), frame_total, cold_textures, iterations);
+		printf("%-40s op %d pt %d tr %d mvo %d verts %d idx %d passes %d vertex hash %08x\n", "", ctx->rend.global_param_op.used(),
+				ctx->rend.global_param_pt.used(), ctx->rend.global_param_tr.used(), ctx->rend.global_param_mvo.used(),
+				ctx->rend.verts.used(), ctx->rend.idx.used(), ctx->rend.render_passes.used(), vertex_hash);
+#ifdef HAVE_SOFTREND
+		if (raster_renderer != NULL)
+		{
+			SoftrendStats stats = softrend_GetStats();
+			printf("%-40s %s %.3f Mpixels image %08x\n", "", stats.avx2 ? "avx2" : "sse2", stats.pixels / 1000000.0,
+					XXH32(softrend_GetFrame(), MAX_RENDER_PIXELS * sizeof(u32), 7));
+		}
+#endif
+		for (int stage = 0; stage < StageCount; stage++)
+			total[stage] += frame_total[stage];
+		total_cold_textures += cold_textures;
+		frames++;
+	}
+	if (frames > 1)
+		print_times("average", total, total_cold_textures / frames, iterations * frames);
+
+	ta_parse_term();
+	TermTextureDecoder();
+	rend.Term();
+	if (raster_renderer != NULL)
+	{
+		raster_renderer->Term();
+		delete raster_renderer;
+	}
+
+	return frames == 0 || decoders_differ;
+}
@@ -3,12 +3,19 @@
 
 	Parsing of the TA stream and generation of vertex data !
 */
+#include <atomic>
 #include <cmath>
 #include "ta.h"
 #include "ta_ctx.h"
 #include "pvr_mem.h"
 #include "Renderer_if.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 // TODO/FIXME - should be moved later
 bool pal_needs_update=true;
 
@@ -33,9 +40,6 @@ extern int screen_height;
 #define TA_EOL 
 #define TA_V64H
 
-//cache state vars
-static u32 tileclip_val = 0;
-
 static u8 f32_su8_tbl[65536];
 #define float_to_satu8(val) f32_su8_tbl[((u32&)val)>>16]
 
@@ -62,19 +66,92 @@ static u8 float_to_satu8_math(float val)
 	return u8(saturate01(val)*255);
 }
 
-//vdec state variables
-static ModTriangle* lmr;
+/*
+	Batch conversions used to decode 4 vertices at once.
+	They give the same results as float_to_satu8 and the scalar vertex macros.
+*/
 
-static PolyParam* CurrentPP;
-static List<PolyParam>* CurrentPPlist;
+// ARGB float colors to RGBA bytes
+static INLINE void float_colors_x4(const f32* const src[4], u32 dst[4])
+{
+#if defined(__SSE2__)
+	__m128i rgba[4];
+	for (int i = 0; i < 4; i++)
+	{
+		// Only the 16 upper bits are used by float_to_satu8
+		__m128i bits = _mm_and_si128(_mm_loadu_si128((const __m128i *)src[i]), _mm_set1_epi32(0xffff0000));
+		bits = _mm_andnot_si128(_mm_cmplt_epi32(bits, _mm_setzero_si128()), bits);
+		__m128i over = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x3f800000));
+		bits = _mm_or_si128(_mm_andnot_si128(over, bits), _mm_and_si128(over, _mm_set1_epi32(0x3f800000)));
+		__m128i argb = _mm_cvttps_epi32(_mm_mul_ps(_mm_castsi128_ps(bits), _mm_set1_ps(255.f)));
+		rgba[i] = _mm_shuffle_epi32(argb, _MM_SHUFFLE(0, 3, 2, 1));
+	}
+	__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(rgba[0], rgba[1]), _mm_packs_epi32(rgba[2], rgba[3]));
+	_mm_storeu_si128((__m128i *)dst, bytes);
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	uint16x4_t rgba[4];
+	for (int i = 0; i < 4; i++)
+	{
+		// Only the 16 upper bits are used by float_to_satu8
+		int32x4_t bits = vreinterpretq_s32_u32(vandq_u32(vld1q_u32((const u32 *)src[i]), vdupq_n_u32(0xffff0000)));
+		bits = vbslq_s32(vcltq_s32(bits, vdupq_n_s32(0)), vdupq_n_s32(0), bits);
+		bits = vminq_s32(bits, vdupq_n_s32(0x3f800000));
+		uint32x4_t argb = vcvtq_u32_f32(vmulq_f32(vreinterpretq_f32_s32(bits), vdupq_n_f32(255.f)));
+		rgba[i] = vmovn_u32(vextq_u32(argb, argb, 1));
+	}
+	uint8x16_t bytes = vcombine_u8(vmovn_u16(vcombine_u16(rgba[0], rgba[1])), vmovn_u16(vcombine_u16(rgba[2], rgba[3])));
+	vst1q_u8((u8 *)dst, bytes);
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		u8 *to = (u8 *)&dst[i];
+		to[0] = float_to_satu8(src[i][1]);
+		to[1] = float_to_satu8(src[i][2]);
+		to[2] = float_to_satu8(src[i][3]);
+		to[3] = float_to_satu8(src[i][0]);
+	}
+#endif
+}
 
-//TA state vars	
-DECL_ALIGN(4) static u8 FaceBaseColor[4];
-DECL_ALIGN(4) static u8 FaceOffsColor[4];
-DECL_ALIGN(4) static u8 FaceBaseColor1[4];
-DECL_ALIGN(4) static u8 FaceOffsColor1[4];
-DECL_ALIGN(4) static u32 SFaceBaseColor;
-DECL_ALIGN(4) static u32 SFaceOffsColor;
+// ARGB packed colors to RGBA bytes
+static INLINE void packed_colors_x4(const u32 src[4], u32 dst[4])
+{
+#if defined(__SSE2__)
+	__m128i argb = _mm_loadu_si128((const __m128i *)src);
+	__m128i r = _mm_and_si128(_mm_srli_epi32(argb, 16), _mm_set1_epi32(0xff));
+	__m128i b = _mm_slli_epi32(_mm_and_si128(argb, _mm_set1_epi32(0xff)), 16);
+	__m128i rgba = _mm_or_si128(_mm_and_si128(argb, _mm_set1_epi32(0xff00ff00)), _mm_or_si128(r, b));
+	_mm_storeu_si128((__m128i *)dst, rgba);
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	uint32x4_t argb = vld1q_u32(src);
+	uint32x4_t r = vandq_u32(vshrq_n_u32(argb, 16), vdupq_n_u32(0xff));
+	uint32x4_t b = vshlq_n_u32(vandq_u32(argb, vdupq_n_u32(0xff)), 16);
+	vst1q_u32(dst, vorrq_u32(vandq_u32(argb, vdupq_n_u32(0xff00ff00)), vorrq_u32(r, b)));
+#else
+	for (int i = 0; i < 4; i++)
+		dst[i] = (src[i] & 0xff00ff00) | ((src[i] >> 16) & 0xff) | ((src[i] & 0xff) << 16);
+#endif
+}
+
+// 16-bit uv pairs (v in the low half) to the bits of f32 u and v
+static INLINE void uv16_x4(const u32 src[4], u32 u[4], u32 v[4])
+{
+#if defined(__SSE2__)
+	__m128i uv = _mm_loadu_si128((const __m128i *)src);
+	_mm_storeu_si128((__m128i *)u, _mm_and_si128(uv, _mm_set1_epi32(0xffff0000)));
+	_mm_storeu_si128((__m128i *)v, _mm_slli_epi32(uv, 16));
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	uint32x4_t uv = vld1q_u32(src);
+	vst1q_u32(u, vandq_u32(uv, vdupq_n_u32(0xffff0000)));
+	vst1q_u32(v, vshlq_n_u32(uv, 16));
+#else
+	for (int i = 0; i < 4; i++)
+	{
+		u[i] = src[i] & 0xffff0000;
+		v[i] = src[i] << 16;
+	}
+#endif
+}
 
 //splitter function lookup
 extern u32 ta_type_lut[256];
@@ -87,13 +164,26 @@ static const u32 SZ64 = 2;
 #include "ta_structs.h"
 
 typedef Ta_Dma* DYNACALL TaListFP(Ta_Dma* data,Ta_Dma* data_end);
-typedef void TACALL TaPolyParamFP(void* ptr);
 
-static TaListFP* TaCmd;
-	
-static u32 CurrentList;
-static TaListFP* VertexDataFP;
-static bool ListIsFinished[5];
+// Face colors used by intensity vertices. Polygons with Col_Type 3 use the ones of a previous polygon.
+struct TaFaceColors
+{
+	u8 base[4];
+	u8 offs[4];
+	u8 base1[4];
+};
+
+// A list of the TA stream, from its first global parameter to its end of list parameter
+struct TaSegment
+{
+	Ta_Dma* start;
+	Ta_Dma* end;
+	u32 list_type;
+	// state at the start of the list
+	u32 tileclip;
+	TaFaceColors colors;
+};
+typedef void TACALL TaPolyParamFP(void* ptr);
 
 static INLINE f32 f16(u16 v)
 {
@@ -101,14 +191,40 @@ static INLINE f32 f16(u16 v)
 	return *(f32*)&z;
 }
 
-#define vdrc vd_rc
-
 //Splitter function (normally ta_dma_main , modified for split dma's)
 
+// Instance 0 decodes into vd_rc. The other instances are used by the parallel parser:
+// each one decodes a subset of the lists into its own arena and doesn't look up textures.
 template<u32 instance>
 class FifoSplitter
 {
+	//vdec state variables
+	static ModTriangle* lmr;
+
+	static PolyParam* CurrentPP;
+	static List<PolyParam>* CurrentPPlist;
+
+	//TA state vars
+	static u8 FaceBaseColor[4];
+	static u8 FaceOffsColor[4];
+	static u8 FaceBaseColor1[4];
+	static u8 FaceOffsColor1[4];
+	static u32 SFaceBaseColor;
+	static u32 SFaceOffsColor;
+
+	static u32 CurrentList;
+	static TaListFP* VertexDataFP;
+	static bool ListIsFinished[5];
+
+	static rend_context& vdrc() { return instance == 0 ? vd_rc : arena; }
+
 public:
+	static TaListFP* TaCmd;
+
+	//cache state vars
+	static u32 tileclip_val;
+
+	static rend_context arena;
 
 	static void ta_list_start(u32 new_list)
 	{
@@ -287,11 +403,29 @@ data+=poly_size;
 		if (IS_FIST_HALF)
 			goto fist_half;
 
+		if (HasBatchDecoder(poly_type) && settings.pvr.TaBatchDecoder)
+		{
+			//Groups of 4 vertices, as long as the strip doesn't end before the last one
+			while (data_end + 1 - data >= 4 * poly_size
+					&& !data[0].pcw.EndOfStrip && !data[poly_size].pcw.EndOfStrip && !data[2 * poly_size].pcw.EndOfStrip)
+			{
+				PLD(data,256);
+				AppendPolyVertices4<poly_type,poly_size>(data);
+				data += 3 * poly_size;
+				if (data->pcw.EndOfStrip)
+					goto strip_end;
+				data += poly_size;
+			}
+			if (!HAS_FULL_DATA)
+				goto partial;
+		}
+
 		do
 		{
 			ITER
 		} while (HAS_FULL_DATA);
-			
+
+	partial:
 		if (IS_FIST_HALF)
 		{
 		fist_half:
@@ -677,6 +811,56 @@ public:
 	}
 
 
+	static void GetFaceColors(TaFaceColors& colors)
+	{
+		memcpy(colors.base, FaceBaseColor, sizeof(colors.base));
+		memcpy(colors.offs, FaceOffsColor, sizeof(colors.offs));
+		memcpy(colors.base1, FaceBaseColor1, sizeof(colors.base1));
+	}
+
+	static void SetFaceColors(const TaFaceColors& colors)
+	{
+		memcpy(FaceBaseColor, colors.base, sizeof(colors.base));
+		memcpy(FaceOffsColor, colors.offs, sizeof(colors.offs));
+		memcpy(FaceBaseColor1, colors.base1, sizeof(colors.base1));
+	}
+
+	// True if the stream can be split at the current position
+	static bool IsIdle()
+	{
+		return TaCmd == ta_main && CurrentList == ListType_None;
+	}
+
+	// Decodes the segments into the arena. The segments must start and end outside of any list.
+	static void ParseSegments(const vector<TaSegment>& segments)
+	{
+		arena.Clear();
+		memset(FaceOffsColor1, 0xff, sizeof(FaceOffsColor1));
+		SFaceBaseColor = 0;
+		SFaceOffsColor = 0;
+		for (const TaSegment& segment : segments)
+		{
+			TaCmd = ta_main;
+			CurrentList = ListType_None;
+			VertexDataFP = NullVertexData;
+			tileclip_val = segment.tileclip;
+			SetFaceColors(segment.colors);
+			lmr = NULL;
+			CurrentPP = NULL;
+			CurrentPPlist = NULL;
+
+			Ta_Dma* ta_data = segment.start;
+			Ta_Dma* ta_data_end = segment.end - 1;
+			do
+			{
+				ta_data = TaCmd(ta_data, ta_data_end);
+			} while (ta_data <= ta_data_end);
+
+			if (arena.Overrun)
+				break;
+		}
+	}
+
 	void vdec_init()
 	{
 		VDECInit();
@@ -717,11 +901,11 @@ public:
 		static void StartList(u32 ListType)
 	{
 		if (ListType==ListType_Opaque)
-			CurrentPPlist=&vdrc.global_param_op;
+			CurrentPPlist=&vdrc().global_param_op;
 		else if (ListType==ListType_Punch_Through)
-			CurrentPPlist=&vdrc.global_param_pt;
+			CurrentPPlist=&vdrc().global_param_pt;
 		else if (ListType==ListType_Translucent)
-			CurrentPPlist=&vdrc.global_param_tr;
+			CurrentPPlist=&vdrc().global_param_tr;
 
 		CurrentPP = NULL;
 	}
@@ -749,7 +933,7 @@ public:
 			d_pp = CurrentPPlist->Append();
 			CurrentPP = d_pp;
 		}
-		d_pp->first = vdrc.verts.used();
+		d_pp->first = vdrc().verts.used();
 		d_pp->count = 0;
 
 		d_pp->isp = pp->isp;
@@ -760,7 +944,7 @@ public:
 
 		d_pp->texid = -1;
 
-		if (d_pp->pcw.Texture)
+		if (instance == 0 && d_pp->pcw.Texture)
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 
 		d_pp->tsp1.full = -1;
@@ -828,7 +1012,7 @@ public:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (instance == 0 && pp->pcw.Texture)
 		   CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 
@@ -842,7 +1026,7 @@ public:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (instance == 0 && pp->pcw.Texture)
 		   CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 	__forceinline
@@ -858,14 +1042,14 @@ public:
 	__forceinline
 		static void EndPolyStrip()
 	{
-		CurrentPP->count = vdrc.verts.used() - CurrentPP->first;
+		CurrentPP->count = vdrc().verts.used() - CurrentPP->first;
 
 		if (CurrentPP->count > 0)
 		{
 			PolyParam* d_pp = CurrentPPlist->Append();
 			*d_pp = *CurrentPP;
 			CurrentPP = d_pp;
-			d_pp->first = vdrc.verts.used();
+			d_pp->first = vdrc().verts.used();
 			d_pp->count = 0;
 		}
 	}
@@ -874,8 +1058,8 @@ public:
 	
 	static inline void update_fz(float z)
 	{
-		if ((s32&)vdrc.fZ_max<(s32&)z && (s32&)z<0x49800000)
-			vdrc.fZ_max=z;
+		if ((s32&)vdrc().fZ_max<(s32&)z && (s32&)z<0x49800000)
+			vdrc().fZ_max=z;
 	}
 
 		//Poly Vertex handlers
@@ -884,7 +1068,7 @@ public:
 	static Vertex* vert_cvt_base_(T* vtx)
 	{
 		f32 invW=vtx->xyz[2];
-		Vertex* cv=vdrc.verts.Append();
+		Vertex* cv=vdrc().verts.Append();
 		cv->x=vtx->xyz[0];
 		cv->y=vtx->xyz[1];
 		cv->z=invW;
@@ -896,7 +1080,7 @@ public:
 
 		//Resume vertex base (for B part)
 	#define vert_res_base \
-		Vertex* cv=vdrc.verts.LastPtr();
+		Vertex* cv=vdrc().verts.LastPtr();
 
 		//uv 16/32
 	#define vert_uv_32(u_name,v_name) \
@@ -1065,6 +1249,104 @@ public:
 		vert_float_color(vtx_spc,Offs);
 	}
 
+	// Vertex types that have a batch decoder
+	static constexpr bool HasBatchDecoder(u32 poly_type)
+	{
+		return poly_type <= 1 || (poly_type >= 3 && poly_type <= 6);
+	}
+
+	//Decodes 4 full vertices of a strip, same as AppendPolyVertex0-6
+	template <u32 poly_type,u32 poly_size>
+	__forceinline
+		static void AppendPolyVertices4(Ta_Dma* data)
+	{
+		TA_VertexParam* vp[4];
+		Vertex* cv = vdrc().verts.Append(4);
+
+		for (int i = 0; i < 4; i++)
+		{
+			vp[i] = (TA_VertexParam*)&data[i * poly_size];
+			// All the vertex types start with xyz
+			f32 invW = vp[i]->vtx0.xyz[2];
+			cv[i].x = vp[i]->vtx0.xyz[0];
+			cv[i].y = vp[i]->vtx0.xyz[1];
+			cv[i].z = invW;
+			update_fz(invW);
+		}
+
+		DECL_ALIGN(16) u32 src[4];
+		DECL_ALIGN(16) u32 dst[4];
+		DECL_ALIGN(16) u32 dst2[4];
+		const f32* colors[4];
+		switch (poly_type)
+		{
+		case 0:	//(Non-Textured, Packed Color)
+			for (int i = 0; i < 4; i++)
+				src[i] = vp[i]->vtx0.BaseCol;
+			packed_colors_x4(src, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].col, &dst[i], 4);
+			break;
+
+		case 1:	//(Non-Textured, Floating Color)
+			for (int i = 0; i < 4; i++)
+				colors[i] = &vp[i]->vtx1.BaseA;
+			float_colors_x4(colors, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].col, &dst[i], 4);
+			break;
+
+		case 3:	//(Textured, Packed Color)
+		case 4:	//(Textured, Packed Color, 16bit UV)
+			for (int i = 0; i < 4; i++)
+				src[i] = vp[i]->vtx3.BaseCol;
+			packed_colors_x4(src, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].col, &dst[i], 4);
+			for (int i = 0; i < 4; i++)
+				src[i] = vp[i]->vtx3.OffsCol;
+			packed_colors_x4(src, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].vtx_spc, &dst[i], 4);
+			break;
+
+		case 5:	//(Textured, Floating Color)
+		case 6:	//(Textured, Floating Color, 16bit UV)
+			for (int i = 0; i < 4; i++)
+				colors[i] = &vp[i]->vtx5B.BaseA;
+			float_colors_x4(colors, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].col, &dst[i], 4);
+			for (int i = 0; i < 4; i++)
+				colors[i] = &vp[i]->vtx5B.OffsA;
+			float_colors_x4(colors, dst);
+			for (int i = 0; i < 4; i++)
+				memcpy(cv[i].vtx_spc, &dst[i], 4);
+			break;
+		}
+
+		// uv 32/16
+		if (poly_type == 3 || poly_type == 5)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				cv[i].u = vp[i]->vtx3.u;
+				cv[i].v = vp[i]->vtx3.v;
+			}
+		}
+		else if (poly_type == 4 || poly_type == 6)
+		{
+			for (int i = 0; i < 4; i++)
+				memcpy(&src[i], &vp[i]->vtx4.v, 4);
+			uv16_x4(src, dst, dst2);
+			for (int i = 0; i < 4; i++)
+			{
+				memcpy(&cv[i].u, &dst[i], 4);
+				memcpy(&cv[i].v, &dst2[i], 4);
+			}
+		}
+	}
+
 	//(Textured, Intensity)
 	__forceinline
 		static void AppendPolyVertex7(TA_Vertex7* vtx)
@@ -1210,7 +1492,7 @@ public:
 			CurrentPP=d_pp;
 		}
 
-		d_pp->first = vdrc.verts.used();
+		d_pp->first = vdrc().verts.used();
 		d_pp->count=0;
 		d_pp->isp=spr->isp; 
 		d_pp->tsp=spr->tsp; 
@@ -1220,7 +1502,7 @@ public:
 
 		d_pp->texid = -1;
 		
-		if (d_pp->pcw.Texture) {
+		if (instance == 0 && d_pp->pcw.Texture) {
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 		}
 		d_pp->tcw1.full = -1;
@@ -1247,7 +1529,7 @@ public:
 	{
         CurrentPP->count = 4;
 
-		Vertex* cv = vdrc.verts.Append(4);
+		Vertex* cv = vdrc().verts.Append(4);
 
 		//Fill static stuff
 		append_sprite(0);
@@ -1341,7 +1623,7 @@ public:
 		PolyParam* d_pp = CurrentPPlist->Append();
 		*d_pp = *CurrentPP;
 		CurrentPP = d_pp;
-		d_pp->first = vdrc.verts.used();
+		d_pp->first = vdrc().verts.used();
 		d_pp->count = 0;
 	}
 
@@ -1351,15 +1633,15 @@ public:
 	{
 		List<ModifierVolumeParam> *list = NULL;
 		if (CurrentList == ListType_Opaque_Modifier_Volume)
-			list = &vdrc.global_param_mvo;
+			list = &vdrc().global_param_mvo;
 		else if (CurrentList == ListType_Translucent_Modifier_Volume)
-			list = &vdrc.global_param_mvo_tr;
+			list = &vdrc().global_param_mvo_tr;
 		else
 			return;
 		if (list->used() > 0)
 		{
 			ModifierVolumeParam *p = list->LastPtr();
-			p->count = vdrc.modtrig.used() - p->first;
+			p->count = vdrc().modtrig.used() - p->first;
 			if (p->count == 0)
 				list->PopLast();
 
@@ -1373,21 +1655,21 @@ public:
 
       ModifierVolumeParam *p = NULL;
 		if (CurrentList == ListType_Opaque_Modifier_Volume)
-         p = vdrc.global_param_mvo.Append();
+         p = vdrc().global_param_mvo.Append();
       else if (CurrentList == ListType_Translucent_Modifier_Volume)
-			p = vdrc.global_param_mvo_tr.Append();
+			p = vdrc().global_param_mvo_tr.Append();
       else
 			return;
       p->isp.full = param->isp.full;
       p->isp.VolumeLast = param->pcw.Volume != 0;
-      p->first = vdrc.modtrig.used();
+      p->first = vdrc().modtrig.used();
 	}
 	__forceinline
 		static void AppendModVolVertexA(TA_ModVolA* mvv)
 	{
 	   if (CurrentList != ListType_Opaque_Modifier_Volume && CurrentList != ListType_Translucent_Modifier_Volume)
 			return;
-		lmr=vdrc.modtrig.Append();
+		lmr=vdrc().modtrig.Append();
 
 		lmr->x0=mvv->x0;
 		lmr->y0=mvv->y0;
@@ -1422,6 +1704,21 @@ public:
 	}
 };
 
+template<u32 instance> u32 FifoSplitter<instance>::tileclip_val;
+template<u32 instance> ModTriangle* FifoSplitter<instance>::lmr;
+template<u32 instance> PolyParam* FifoSplitter<instance>::CurrentPP;
+template<u32 instance> List<PolyParam>* FifoSplitter<instance>::CurrentPPlist;
+template<u32 instance> DECL_ALIGN(4) u8 FifoSplitter<instance>::FaceBaseColor[4];
+template<u32 instance> DECL_ALIGN(4) u8 FifoSplitter<instance>::FaceOffsColor[4];
+template<u32 instance> DECL_ALIGN(4) u8 FifoSplitter<instance>::FaceBaseColor1[4];
+template<u32 instance> DECL_ALIGN(4) u8 FifoSplitter<instance>::FaceOffsColor1[4];
+template<u32 instance> u32 FifoSplitter<instance>::SFaceBaseColor;
+template<u32 instance> u32 FifoSplitter<instance>::SFaceOffsColor;
+template<u32 instance> u32 FifoSplitter<instance>::CurrentList;
+template<u32 instance> TaListFP* FifoSplitter<instance>::VertexDataFP;
+template<u32 instance> bool FifoSplitter<instance>::ListIsFinished[5];
+template<u32 instance> rend_context FifoSplitter<instance>::arena;
+template<u32 instance> TaListFP* FifoSplitter<instance>::TaCmd;
 
 static bool ClearZBeforePass(int pass_number);
 
@@ -1429,6 +1726,375 @@ FifoSplitter<0> TAFifo0;
 
 int ta_parse_cnt = 0;
 
+/*
+	Parallel parsing
+
+	A render pass is first scanned to find the start and end of each list. The lists are then
+	decoded by type on up to TA_PARSE_INSTANCES threads, each one into the arena of its own
+	FifoSplitter instance. The arenas are finally appended to vd_rc, and the textures are
+	looked up on the calling thread.
+	Passes that can't be split (lists spanning several passes, split parameters) are decoded serially.
+*/
+#define TA_PARSE_INSTANCES 3
+#define TA_PARSE_MIN_SIZE (64 * 1024)	// smaller passes are decoded serially
+
+typedef void TaParseJobFP(const vector<TaSegment>& segments);
+static TaParseJobFP* const ta_parse_jobs[TA_PARSE_INSTANCES] = {
+	FifoSplitter<1>::ParseSegments,
+	FifoSplitter<2>::ParseSegments,
+	FifoSplitter<3>::ParseSegments,
+};
+static rend_context* const ta_parse_arenas[TA_PARSE_INSTANCES] = {
+	&FifoSplitter<1>::arena,
+	&FifoSplitter<2>::arena,
+	&FifoSplitter<3>::arena,
+};
+static bool ta_parse_arenas_allocated;
+static vector<TaSegment> ta_parse_segments;
+static vector<TaSegment> ta_parse_job_segments[TA_PARSE_INSTANCES];
+
+#if !defined(TARGET_NO_THREADS)
+struct TaParseWorker
+{
+	TaParseWorker(ThreadEntryFP *func, int job) : thread(func, this), job(job) {}
+
+	cThread thread;
+	cResetEvent wakeup;
+	int job;
+};
+
+static vector<TaParseWorker *> ta_parse_workers;
+static volatile bool ta_parse_workers_running;
+static std::atomic<int> ta_parse_workers_busy;
+static cResetEvent ta_parse_done;
+
+static void *ta_parse_worker_thread(void *param)
+{
+	TaParseWorker *worker = (TaParseWorker *)param;
+	while (true)
+	{
+		worker->wakeup.Wait();
+		if (!ta_parse_workers_running)
+			break;
+		ta_parse_jobs[worker->job](ta_parse_job_segments[worker->job]);
+		if (--ta_parse_workers_busy == 0)
+			ta_parse_done.Set();
+	}
+	return NULL;
+}
+#endif
+
+//
+// Find the lists of a render pass, following the same parameter sizes as ta_main.
+// Returns false if the pass can't be split.
+//
+static bool ta_split_lists(Ta_Dma* data, Ta_Dma* data_end, u32& tileclip, TaFaceColors& colors, vector<TaSegment>& segments)
+{
+	u32 list_type = ListType_None;
+	u32 vtx_size = 0;		// 0: no vertex data expected
+	bool strips = false;	// polygon vertices, until end of strip
+	TaSegment segment;
+
+	while (data <= data_end)
+	{
+		switch (data->pcw.ParaType)
+		{
+		case ParamType_End_Of_List:
+			if (list_type != ListType_None)
+			{
+				segment.end = data + SZ32;
+				segments.push_back(segment);
+			}
+			list_type = ListType_None;
+			vtx_size = 0;
+			data += SZ32;
+			break;
+
+		case ParamType_User_Tile_Clip:
+			tileclip = (tileclip & 0xF0000000) | (data->data_32[3] & 63) | ((data->data_32[5] & 63) << 6)
+					| ((data->data_32[4] & 31) << 12) | ((data->data_32[6] & 31) << 17);
+			data += SZ32;
+			break;
+
+		case ParamType_Object_List_Set:
+			data += SZ32;
+			break;
+
+		case ParamType_Polygon_or_Modifier_Volume:
+		case ParamType_Sprite:
+			if (list_type == ListType_None)
+			{
+				list_type = data->pcw.ListType;
+				if (list_type > ListType_Punch_Through)
+					return false;
+				segment.start = data;
+				segment.list_type = list_type;
+				segment.tileclip = tileclip;
+				segment.colors = colors;
+			}
+			tileclip = (tileclip & ~0xF0000000) | (data->pcw.User_Clip << 28);
+			if (data->pcw.ParaType == ParamType_Sprite)
+			{
+				if (IsModVolList(list_type))
+					return false;
+				vtx_size = SZ64;
+				strips = false;
+				data += SZ32;
+			}
+			else if (IsModVolList(list_type))
+			{
+				vtx_size = SZ64;
+				strips = false;
+				data += SZ32;
+			}
+			else
+			{
+				u32 uid = ta_type_lut[data->pcw.obj_ctrl];
+				u32 psz = uid >> 30;
+				u32 pdid = (u8)uid;
+				u32 ppid = (u8)(uid >> 8);
+				if (pdid > 14 || ppid > 4 || (psz == SZ64 && data == data_end))
+					return false;
+				vtx_size = (pdid == 5 || pdid == 6 || pdid >= 11) ? SZ64 : SZ32;
+				strips = true;
+				if (ppid == 1)
+				{
+					TA_PolyParam1* pp = (TA_PolyParam1*)data;
+					poly_float_color(colors.base, FaceColor);
+				}
+				else if (ppid == 2)
+				{
+					TA_PolyParam2B* pp = (TA_PolyParam2B*)(data + 1);
+					poly_float_color(colors.base, FaceColor);
+					poly_float_color(colors.offs, FaceOffset);
+				}
+				else if (ppid == 4)
+				{
+					TA_PolyParam4B* pp = (TA_PolyParam4B*)(data + 1);
+					poly_float_color(colors.base, FaceColor0);
+					poly_float_color(colors.base1, FaceColor1);
+				}
+				data += psz;
+			}
+			break;
+
+		case ParamType_Vertex_Parameter:
+			if (vtx_size == 0)
+				data += SZ32;
+			else if (strips)
+			{
+				do
+				{
+					if (vtx_size == SZ64 && data == data_end)
+						return false;
+					bool end_of_strip = data->pcw.EndOfStrip;
+					data += vtx_size;
+					if (end_of_strip)
+						break;
+				} while (data <= data_end);
+			}
+			else
+			{
+				if (data == data_end)
+					return false;
+				data += SZ64;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+	// Lists must not continue in the next pass
+	return list_type == ListType_None;
+}
+
+// Appends the content of a list to another one. Returns NULL on overrun.
+template<typename T>
+static T* ta_append_list(List<T>& dst, const List<T>& src)
+{
+	int count = src.used();
+	if (count > dst.avail)
+	{
+		dst.sig_overrun();
+		return NULL;
+	}
+	T* p = dst.Append(count);
+	memcpy(p, src.head(), count * sizeof(T));
+
+	return p;
+}
+
+static bool ta_append_poly_params(List<PolyParam>& dst, const List<PolyParam>& src, u32 vtx_base)
+{
+	PolyParam* pp = ta_append_list(dst, src);
+	if (pp == NULL)
+		return false;
+	PolyParam* pp_end = dst.LastPtr(0);
+	// Look up textures. Strips of the same polygon are consecutive and share them.
+	const PolyParam* last_pp = NULL;
+	for (; pp != pp_end; pp++)
+	{
+		pp->first += vtx_base;
+		if (!pp->pcw.Texture)
+			continue;
+		if (last_pp != NULL && pp->tsp.full == last_pp->tsp.full && pp->tcw.full == last_pp->tcw.full
+				&& pp->tsp1.full == last_pp->tsp1.full && pp->tcw1.full == last_pp->tcw1.full)
+		{
+			pp->texid = last_pp->texid;
+			pp->texid1 = last_pp->texid1;
+			continue;
+		}
+		pp->texid = renderer->GetTexture(pp->tsp, pp->tcw);
+		// Two volumes
+		if (pp->tcw1.full != (u32)-1)
+			pp->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
+		last_pp = pp;
+	}
+	return true;
+}
+
+static bool ta_append_mod_vols(List<ModifierVolumeParam>& dst, const List<ModifierVolumeParam>& src, u32 modtrig_base)
+{
+	ModifierVolumeParam* p = ta_append_list(dst, src);
+	if (p == NULL)
+		return false;
+	for (; p != dst.LastPtr(0); p++)
+		p->first += modtrig_base;
+	return true;
+}
+
+// Appends the data decoded in an arena to vd_rc
+static bool ta_append_arena(const rend_context& arena)
+{
+	if (arena.Overrun)
+		return false;
+	u32 vtx_base = vd_rc.verts.used();
+	u32 modtrig_base = vd_rc.modtrig.used();
+	if (ta_append_list(vd_rc.verts, arena.verts) == NULL
+			|| ta_append_list(vd_rc.modtrig, arena.modtrig) == NULL
+			|| !ta_append_poly_params(vd_rc.global_param_op, arena.global_param_op, vtx_base)
+			|| !ta_append_poly_params(vd_rc.global_param_pt, arena.global_param_pt, vtx_base)
+			|| !ta_append_poly_params(vd_rc.global_param_tr, arena.global_param_tr, vtx_base)
+			|| !ta_append_mod_vols(vd_rc.global_param_mvo, arena.global_param_mvo, modtrig_base)
+			|| !ta_append_mod_vols(vd_rc.global_param_mvo_tr, arena.global_param_mvo_tr, modtrig_base))
+		return false;
+	vd_rc.fZ_max = max(vd_rc.fZ_max, arena.fZ_max);
+
+	return true;
+}
+
+//
+// Decodes a render pass in parallel. Returns false if the pass must be decoded serially.
+//
+static bool ta_parse_pass_parallel(TA_context* ctx, Ta_Dma* data, Ta_Dma* data_end)
+{
+#if !defined(TARGET_NO_THREADS)
+	if (settings.pvr.MaxThreads <= 1 || (data_end + 1 - data) * sizeof(Ta_Dma) < TA_PARSE_MIN_SIZE)
+		return false;
+
+	u32 tileclip = TAFifo0.tileclip_val;
+	TaFaceColors colors;
+	TAFifo0.GetFaceColors(colors);
+	ta_parse_segments.clear();
+	if (!ta_split_lists(data, data_end, tileclip, colors, ta_parse_segments))
+		return false;
+
+	// Balance the list types between the jobs, keeping each type on a single job so polygons stay in order
+	u32 list_size[5] = { 0 };
+	for (const TaSegment& segment : ta_parse_segments)
+	{
+		// The first modifier volume of a list also updates the last one of the previous passes
+		if ((segment.list_type == ListType_Opaque_Modifier_Volume && vd_rc.global_param_mvo.used() != 0)
+				|| (segment.list_type == ListType_Translucent_Modifier_Volume && vd_rc.global_param_mvo_tr.used() != 0))
+			return false;
+		list_size[segment.list_type] += segment.end - segment.start;
+	}
+	int job_count = 0;
+	for (u32 size : list_size)
+		if (size != 0)
+			job_count++;
+	job_count = min(job_count, min((int)settings.pvr.MaxThreads, TA_PARSE_INSTANCES));
+	if (job_count <= 1)
+		return false;
+
+	int list_job[5];
+	u32 job_size[TA_PARSE_INSTANCES] = { 0 };
+	bool assigned[5] = { false };
+	for (int i = 0; i < 5; i++)
+	{
+		// Largest remaining list type goes to the least loaded job
+		int type = -1;
+		for (int t = 0; t < 5; t++)
+			if (!assigned[t] && (type == -1 || list_size[t] > list_size[type]))
+				type = t;
+		assigned[type] = true;
+		int job = 0;
+		for (int j = 1; j < job_count; j++)
+			if (job_size[j] < job_size[job])
+				job = j;
+		list_job[type] = job;
+		job_size[job] += list_size[type];
+	}
+	for (int j = 0; j < job_count; j++)
+		ta_parse_job_segments[j].clear();
+	for (const TaSegment& segment : ta_parse_segments)
+		ta_parse_job_segments[list_job[segment.list_type]].push_back(segment);
+
+	if (!ta_parse_arenas_allocated)
+	{
+		for (rend_context* arena : ta_parse_arenas)
+			arena->Alloc();
+		ta_parse_arenas_allocated = true;
+	}
+	ta_parse_workers_running = true;
+	while ((int)ta_parse_workers.size() < job_count - 1)
+	{
+		TaParseWorker *worker = new TaParseWorker(ta_parse_worker_thread, ta_parse_workers.size() + 1);
+		worker->thread.Start();
+		ta_parse_workers.push_back(worker);
+	}
+	ta_parse_workers_busy = job_count - 1;
+	for (int j = 1; j < job_count; j++)
+		ta_parse_workers[j - 1]->wakeup.Set();
+	ta_parse_jobs[0](ta_parse_job_segments[0]);
+	ta_parse_done.Wait();
+
+	for (int j = 0; j < job_count; j++)
+		if (!ta_append_arena(*ta_parse_arenas[j]))
+		{
+			ctx->rend.Overrun = true;
+			break;
+		}
+	TAFifo0.tileclip_val = tileclip;
+	TAFifo0.SetFaceColors(colors);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ta_parse_term()
+{
+#if !defined(TARGET_NO_THREADS)
+	ta_parse_workers_running = false;
+	for (TaParseWorker *worker : ta_parse_workers)
+	{
+		worker->wakeup.Set();
+		worker->thread.WaitToEnd();
+		delete worker;
+	}
+	ta_parse_workers.clear();
+#endif
+	if (ta_parse_arenas_allocated)
+	{
+		for (rend_context* arena : ta_parse_arenas)
+			arena->Free();
+		ta_parse_arenas_allocated = false;
+	}
+}
+
 //
 // Check if a vertex has huge x,y,z values or negative z
 //
@@ -1584,6 +2250,7 @@ bool ta_parse_vdrc(TA_context* ctx)
 		int op_poly_count = 0;
 		int pt_poly_count = 0;
 		int tr_poly_count = 0;
+		bool parallel = true;
 
 		PolyParam *bgpp = vd_rc.global_param_op.head();
 		if (bgpp->pcw.Texture)
@@ -1601,10 +2268,15 @@ bool ta_parse_vdrc(TA_context* ctx)
          Ta_Dma* ta_data=(Ta_Dma*)vd_rc.proc_start;
          Ta_Dma* ta_data_end=((Ta_Dma*)vd_rc.proc_end)-1;
 
-         do
+         // Once a list spans several passes, the following ones are decoded serially too
+         parallel = parallel && TAFifo0.IsIdle();
+         if (!parallel || !ta_parse_pass_parallel(ctx, ta_data, ta_data_end))
          {
-            ta_data =TaCmd(ta_data,ta_data_end);
-         }while(ta_data<=ta_data_end);
+            do
+            {
+               ta_data =TAFifo0.TaCmd(ta_data,ta_data_end);
+            }while(ta_data<=ta_data_end);
+         }
 
          if (ctx->rend.Overrun)
             break;
@@ -1733,6 +2405,14 @@ void vtxdec_init(void)
 		verify(float_to_satu8_math(ff)==float_to_satu8_2(ff));
 		verify(float_to_satu8_math(ff)==float_to_satu8(ff));
 	}
+	for (u32 i=0;i<65536;i+=4)
+	{
+		u32 fr[4]={i<<16,(i+1)<<16,(i+2)<<16,(i+3)<<16};
+		const f32* colors[4]={(f32*)fr,(f32*)fr,(f32*)fr,(f32*)fr};
+		u32 rgba[4];
+		float_colors_x4(colors,rgba);
+		verify(rgba[0]==(float_to_satu8(fr[1]) | (float_to_satu8(fr[2])<<8) | (float_to_satu8(fr[3])<<16) | (float_to_satu8(fr[0])<<24)));
+	}
 #endif
 }
 
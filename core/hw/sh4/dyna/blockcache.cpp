@@ -0,0 +1,344 @@
+/*
+	Persistent shil block cache. See blockcache.h
+*/
+#include "types.h"
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#include <unordered_map>
+#include "deps/xxhash/xxhash.h"
+#include "blockcache.h"
+#include "blockmanager.h"
+#include "ngen.h"
+#include "rec_config.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+
+#define BC_MAGIC 0x31434246	// FBC1
+#define BC_VERSION 3
+#define BC_MAX_ENTRIES 32768
+
+struct CachedParam
+{
+	u32 type;
+	u32 imm;
+};
+
+// Register versions aren't saved since they are recomputed by the register allocator
+struct CachedOp
+{
+	u32 op;
+	u32 Flow;
+	u32 flags;
+	u32 flags2;
+	CachedParam rd, rd2;
+	CachedParam rs1, rs2, rs3;
+	u16 guest_offs;
+	u16 delay_slot;
+};
+
+struct CachedBlock
+{
+	u32 vaddr;
+	u32 fpu_key;
+	u32 sh4_code_size;
+	u32 code_hash;
+	u32 guest_cycles;
+	u32 guest_opcodes;
+	u32 BlockType;
+	u32 BranchBlock;
+	u32 NextBlock;
+	u8 has_fpu_op;
+	u8 has_jcond;
+	u8 read_only;
+	u8 trace;
+	u8 trace_candidate;
+	u8 pad[3];
+	u32 op_count;
+};
+
+struct CacheEntry
+{
+	CachedBlock block;
+	vector<CachedOp> ops;
+};
+
+struct CacheFileHeader
+{
+	u32 magic;
+	u32 version;
+	u32 op_size;
+	u32 flags;
+	u32 count;
+};
+
+static std::unordered_map<u64, CacheEntry> entries;
+static string cache_file;
+static u32 cache_flags;
+static bool dirty;
+static u32 hits;
+static u32 misses;
+
+// Settings that change the decoder output
+static u32 bc_CurrentFlags()
+{
+	return (settings.dynarec.idleskip ? 1 : 0)
+			| (settings.dynarec.DisableDivMatching ? 2 : 0)
+			| (CPU_RATIO << 2)
+			| (ngen_SideExits ? 0x10 : 0);
+}
+
+// Only the fpscr fields used by the decoder
+static u32 bc_FpuKey(fpscr_t fpu_cfg)
+{
+	return fpu_cfg.PR | (fpu_cfg.SZ << 1) | ((fpu_cfg.RM == 1) << 2);
+}
+
+static u64 bc_Key(u32 vaddr, u32 fpu_key)
+{
+	return ((u64)fpu_key << 32) | vaddr;
+}
+
+// Write-protected blocks can have constant reads from their own pages folded in,
+// so the whole pages must be hashed.
+static bool bc_HashGuestCode(u32 addr, u32 size, bool read_only, u32& hash)
+{
+	if (size == 0)
+		return false;
+	if (read_only)
+	{
+		u32 start = addr & ~PAGE_MASK;
+		size = ((addr + size - 1) | PAGE_MASK) - start + 1;
+		addr = start;
+	}
+	if ((addr & RAM_MASK) + size > RAM_SIZE)
+		return false;
+	u8 *ptr = GetMemPtr(addr, size);
+	if (ptr == NULL)
+		return false;
+	hash = XXH32(ptr, size, 7);
+
+	return true;
+}
+
+// Same checks as RuntimeBlockInfo::SetProtectedFlags but without side effects
+static bool bc_CanProtect(u32 addr, u32 size)
+{
+#ifndef TARGET_NO_EXCEPTIONS
+	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+		return false;
+	for (u32 page = addr & ~PAGE_MASK; page < addr + size; page += PAGE_SIZE)
+		if (!bm_IsRamPageProtected(page))
+			return false;
+	return true;
+#else
+	return false;
+#endif
+}
+
+static void bc_SaveParam(CachedParam& dst, const shil_param& src)
+{
+	dst.type = src.type;
+	dst.imm = src._imm;
+}
+
+static void bc_LoadParam(shil_param& dst, const CachedParam& src)
+{
+	dst = shil_param();
+	dst.type = src.type;
+	dst._imm = src.imm;
+}
+
+void bc_Load(const string& file)
+{
+	bc_Term();
+	if (!settings.dynarec.BlockCache)
+		return;
+	cache_file = file;
+	cache_flags = bc_CurrentFlags();
+
+	FILE *f = fopen(file.c_str(), "rb");
+	if (f == NULL)
+		return;
+
+	CacheFileHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != BC_MAGIC
+			|| header.version != BC_VERSION || header.op_size != sizeof(CachedOp))
+	{
+		WARN_LOG(DYNAREC, "Ignoring invalid block cache %s", file.c_str());
+		fclose(f);
+		return;
+	}
+	cache_flags = header.flags;
+	for (u32 i = 0; i < header.count && i < BC_MAX_ENTRIES; i++)
+	{
+		CacheEntry entry;
+		if (fread(&entry.block, sizeof(entry.block), 1, f) != 1 || entry.block.op_count == 0)
+			break;
+		entry.ops.resize(entry.block.op_count);
+		if (fread(&entry.ops[0], sizeof(CachedOp), entry.ops.size(), f) != entry.ops.size())
+			break;
+		entries[bc_Key(entry.block.vaddr, entry.block.fpu_key)] = std::move(entry);
+	}
+	fclose(f);
+	INFO_LOG(DYNAREC, "Loaded %zd blocks from cache %s", entries.size(), file.c_str());
+}
+
+void bc_Save()
+{
+	if (cache_file.empty() || !dirty)
+		return;
+	FILE *f = fopen(cache_file.c_str(), "wb");
+	if (f == NULL)
+	{
+		WARN_LOG(DYNAREC, "Cannot write block cache %s", cache_file.c_str());
+		return;
+	}
+	CacheFileHeader header;
+	header.magic = BC_MAGIC;
+	header.version = BC_VERSION;
+	header.op_size = sizeof(CachedOp);
+	header.flags = cache_flags;
+	header.count = entries.size();
+	fwrite(&header, sizeof(header), 1, f);
+	for (const auto& it : entries)
+	{
+		fwrite(&it.second.block, sizeof(it.second.block), 1, f);
+		fwrite(&it.second.ops[0], sizeof(CachedOp), it.second.ops.size(), f);
+	}
+	fclose(f);
+	dirty = false;
+	INFO_LOG(DYNAREC, "Saved %zd blocks to cache %s: %d hits %d misses", entries.size(), cache_file.c_str(), hits, misses);
+}
+
+void bc_Term()
+{
+	entries.clear();
+	cache_file.clear();
+	dirty = false;
+	hits = 0;
+	misses = 0;
+}
+
+bool bc_Lookup(RuntimeBlockInfo* blk)
+{
+	if (cache_file.empty() || mmu_enabled())
+		return false;
+	if (cache_flags != bc_CurrentFlags())
+	{
+		// Decoder settings changed so all the entries are stale
+		entries.clear();
+		cache_flags = bc_CurrentFlags();
+		dirty = true;
+	}
+	auto it = entries.find(bc_Key(blk->vaddr, bc_FpuKey(blk->fpu_cfg)));
+	if (it == entries.end())
+	{
+		misses++;
+		return false;
+	}
+	const CachedBlock& cached = it->second.block;
+
+	// Let the decoder raise the FPU disabled exception
+	if (cached.has_fpu_op && sr.FD == 1)
+		return false;
+	// Folded constants are only valid if the block pages are still write-protected
+	if (cached.read_only && !bc_CanProtect(blk->addr, cached.sh4_code_size))
+	{
+		misses++;
+		return false;
+	}
+	u32 hash;
+	if (!bc_HashGuestCode(blk->addr, cached.sh4_code_size, cached.read_only, hash) || hash != cached.code_hash)
+	{
+		entries.erase(it);
+		dirty = true;
+		misses++;
+		return false;
+	}
+	blk->sh4_code_size = cached.sh4_code_size;
+	blk->guest_cycles = cached.guest_cycles;
+	blk->guest_opcodes = cached.guest_opcodes;
+	blk->BlockType = (BlockEndType)cached.BlockType;
+	blk->BranchBlock = cached.BranchBlock;
+	blk->NextBlock = cached.NextBlock;
+	blk->has_fpu_op = cached.has_fpu_op;
+	blk->has_jcond = cached.has_jcond;
+	blk->trace = cached.trace;
+	blk->trace_candidate = cached.trace_candidate;
+
+	blk->oplist.resize(it->second.ops.size());
+	for (size_t i = 0; i < it->second.ops.size(); i++)
+	{
+		const CachedOp& src = it->second.ops[i];
+		shil_opcode& op = blk->oplist[i];
+		op.op = (shilop)src.op;
+		op.Flow = src.Flow;
+		op.flags = src.flags;
+		op.flags2 = src.flags2;
+		bc_LoadParam(op.rd, src.rd);
+		bc_LoadParam(op.rd2, src.rd2);
+		bc_LoadParam(op.rs1, src.rs1);
+		bc_LoadParam(op.rs2, src.rs2);
+		bc_LoadParam(op.rs3, src.rs3);
+		op.host_offs = 0;
+		op.guest_offs = src.guest_offs;
+		op.delay_slot = src.delay_slot != 0;
+	}
+	hits++;
+
+	return true;
+}
+
+void bc_Store(RuntimeBlockInfo* blk)
+{
+	if (cache_file.empty() || mmu_enabled() || blk->oplist.empty())
+		return;
+	u64 key = bc_Key(blk->vaddr, bc_FpuKey(blk->fpu_cfg));
+	if (entries.size() >= BC_MAX_ENTRIES && entries.count(key) == 0)
+		return;
+
+	CacheEntry entry;
+	CachedBlock& cached = entry.block;
+	memset(&cached, 0, sizeof(cached));
+	if (!bc_HashGuestCode(blk->addr, blk->sh4_code_size, blk->read_only, cached.code_hash))
+		return;
+	cached.vaddr = blk->vaddr;
+	cached.fpu_key = bc_FpuKey(blk->fpu_cfg);
+	cached.sh4_code_size = blk->sh4_code_size;
+	cached.guest_cycles = blk->guest_cycles;
+	cached.guest_opcodes = blk->guest_opcodes;
+	cached.BlockType = blk->BlockType;
+	cached.BranchBlock = blk->BranchBlock;
+	cached.NextBlock = blk->NextBlock;
+	cached.has_fpu_op = blk->has_fpu_op;
+	cached.has_jcond = blk->has_jcond;
+	cached.read_only = blk->read_only;
+	cached.trace = blk->trace;
+	cached.trace_candidate = blk->trace_candidate;
+	cached.op_count = blk->oplist.size();
+
+	entry.ops.resize(blk->oplist.size());
+	for (size_t i = 0; i < blk->oplist.size(); i++)
+	{
+		const shil_opcode& src = blk->oplist[i];
+		CachedOp& op = entry.ops[i];
+		memset(&op, 0, sizeof(op));
+		op.op = src.op;
+		op.Flow = src.Flow;
+		op.flags = src.flags;
+		op.flags2 = src.flags2;
+		bc_SaveParam(op.rd, src.rd);
+		bc_SaveParam(op.rd2, src.rd2);
+		bc_SaveParam(op.rs1, src.rs1);
+		bc_SaveParam(op.rs2, src.rs2);
+		bc_SaveParam(op.rs3, src.rs3);
+		op.guest_offs = src.guest_offs;
+		op.delay_slot = src.delay_slot;
+	}
+	entries[key] = std::move(entry);
+	dirty = true;
+}
+
+#endif	// FEAT_SHREC != DYNAREC_NONE
@@ -0,0 +1,21 @@
+/*
+	Persistent per-game cache of decoded and optimized shil blocks.
+
+	Blocks are keyed by their start address and the fpscr bits the decoder depends on.
+	Each entry keeps a hash of the guest code (and of the surrounding pages for write-protected
+	blocks, since the optimizer folds reads from them) so that stale entries are never used.
+	Only the shil oplist is cached: host code embeds absolute addresses and is always regenerated.
+*/
+#pragma once
+#include "types.h"
+
+struct RuntimeBlockInfo;
+
+void bc_Load(const string& file);
+void bc_Save();
+void bc_Term();
+
+// Fills the block decoding info and oplist from the cache. Returns false on cache miss.
+bool bc_Lookup(RuntimeBlockInfo* blk);
+// Adds or replaces the cache entry for a freshly decoded and optimized block
+void bc_Store(RuntimeBlockInfo* blk);
@@ -1,11 +1,16 @@
 /*
-	Tiny cute block manager. Doesn't keep block graphs or anything fancy ...
-	Its based on a simple hashed-lists idea
+	Tiny cute block manager.
+	Blocks are found by sh4 address through the fpcb table, and by host code address
+	through a flat hash index. Each block keeps its successors (pNextBlock/pBranchBlock)
+	and its linked predecessors (pre_refs), so discarding a block only unlinks the
+	blocks that jump directly to it, and removes it from the predecessors of the blocks
+	it jumps to.
 */
 
 #include <algorithm>
+#include <chrono>
 #include <set>
-#include <map>
+#include <vector>
 #include "blockmanager.h"
 #include "ngen.h"
 
@@ -24,18 +29,161 @@ op_agent_t          oprofHandle;
 
 typedef std::vector<RuntimeBlockInfoPtr> bm_List;
 typedef std::set<RuntimeBlockInfoPtr> bm_Set;
-typedef std::map<void*, RuntimeBlockInfoPtr> bm_Map;
+
+/*
+	Open-addressing (linear probing) index of the blocks by host code address.
+	Blocks are keyed by the host code granule they start in. Several small blocks can
+	start in the same granule so keys aren't unique, and the block containing a given
+	host pc is found by probing the granules backward from it.
+*/
+class bm_CodeIndex
+{
+public:
+	void insert(const RuntimeBlockInfoPtr& block)
+	{
+		if ((used + tombstones + 1) * 2 > slots.size())
+			rehash(used * 4 > slots.size() ? slots.size() * 2 : slots.size());
+		uintptr_t key = granule((void*)block->code);
+		size_t i = hash(key);
+		while (slots[i].key != EMPTY && slots[i].key != TOMBSTONE)
+			i = (i + 1) & mask;
+		if (slots[i].key == TOMBSTONE)
+			tombstones--;
+		slots[i].key = key;
+		slots[i].block = block;
+		used++;
+		max_granules = std::max(max_granules, (u32)(granule((u8*)block->code + block->host_code_size) - key));
+	}
+
+	RuntimeBlockInfoPtr find(void* code)
+	{
+		size_t i = find_slot(code);
+		return i == NONE ? NULL : slots[i].block;
+	}
+
+	// Returns the block whose host code contains ptr
+	RuntimeBlockInfoPtr find_containing(void* ptr)
+	{
+		bm_stats.lookups++;
+		if (used == 0)
+			return NULL;
+		uintptr_t key = granule(ptr);
+		for (u32 d = 0; d <= max_granules && d <= key; d++)
+		{
+			for (size_t i = hash(key - d); slots[i].key != EMPTY; i = (i + 1) & mask)
+			{
+				bm_stats.lookup_probes++;
+				if (slots[i].key == key - d && slots[i].block->contains_code((u8*)ptr))
+					return slots[i].block;
+			}
+		}
+		return NULL;
+	}
+
+	RuntimeBlockInfoPtr erase(void* code)
+	{
+		size_t i = find_slot(code);
+		if (i == NONE)
+			return NULL;
+		RuntimeBlockInfoPtr block = slots[i].block;
+		slots[i].key = TOMBSTONE;
+		slots[i].block.reset();
+		used--;
+		tombstones++;
+		return block;
+	}
+
+	void clear()
+	{
+		slots.clear();
+		slots.resize(INITIAL_SIZE);
+		mask = INITIAL_SIZE - 1;
+		used = 0;
+		tombstones = 0;
+		max_granules = 0;
+	}
+
+	bool empty() const { return used == 0; }
+
+	template<typename F>
+	void for_each(F f)
+	{
+		for (const Slot& slot : slots)
+			if (slot.key != EMPTY && slot.key != TOMBSTONE)
+				f(slot.block);
+	}
+
+private:
+	static const uintptr_t EMPTY = 0;
+	static const uintptr_t TOMBSTONE = ~(uintptr_t)0;
+	static const size_t NONE = ~(size_t)0;
+	static const size_t INITIAL_SIZE = 16384;
+	static const u32 GRANULE_SHIFT = 6;
+
+	struct Slot
+	{
+		uintptr_t key;
+		RuntimeBlockInfoPtr block;
+	};
+
+	static uintptr_t granule(void* ptr) { return (uintptr_t)ptr >> GRANULE_SHIFT; }
+
+	size_t hash(uintptr_t key) const
+	{
+		return (size_t)((u64)key * 0x9E3779B97F4A7C15ull >> 32) & mask;
+	}
+
+	size_t find_slot(void* code)
+	{
+		if (slots.empty())
+			return NONE;
+		for (size_t i = hash(granule(code)); slots[i].key != EMPTY; i = (i + 1) & mask)
+			if (slots[i].key == granule(code) && (void*)slots[i].block->code == code)
+				return i;
+		return NONE;
+	}
+
+	void rehash(size_t size)
+	{
+		std::vector<Slot> old_slots;
+		old_slots.swap(slots);
+		slots.resize(size < INITIAL_SIZE ? INITIAL_SIZE : size);
+		mask = slots.size() - 1;
+		used = 0;
+		tombstones = 0;
+		for (Slot& slot : old_slots)
+			if (slot.key != EMPTY && slot.key != TOMBSTONE)
+			{
+				size_t i = hash(slot.key);
+				while (slots[i].key != EMPTY)
+					i = (i + 1) & mask;
+				slots[i].key = slot.key;
+				slots[i].block = std::move(slot.block);
+				used++;
+			}
+	}
+
+	std::vector<Slot> slots;
+	size_t mask = 0;
+	size_t used = 0;
+	size_t tombstones = 0;
+	u32 max_granules = 0;
+};
 
 static bm_Set all_temp_blocks;
 static bm_List del_blocks;
 
 bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
-static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+static std::vector<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+// Ram write tracking for the rewind buffer and incremental save states
+static bool ram_tracking;		// all ram was write-protected by bm_ResetRamWriteTracking
+static bool ram_written_pages[RAM_SIZE_MAX/PAGE_SIZE];
 
-static bm_Map blkmap;
+static bm_CodeIndex blkmap;
 // Stats
 u32 protected_blocks;
 u32 unprotected_blocks;
+bm_Stats bm_stats;
 
 #define FPCA(x) ((DynarecCodeEntryPtr&)sh4rcb.fpcb[(x>>1)&FPCB_MASK])
 
@@ -122,22 +270,11 @@ RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr)
 // This takes a RX address and returns the info block ptr (RW space)
 RuntimeBlockInfoPtr bm_GetBlock2(void* dynarec_code)
 {
-	if (blkmap.empty())
-		return NULL;
+	auto start = std::chrono::steady_clock::now();
+	RuntimeBlockInfoPtr block = blkmap.find_containing(CC_RX2RW(dynarec_code));
+	bm_stats.lookup_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 
-	void *dynarecrw = CC_RX2RW(dynarec_code);
-	// Returns a block who's code addr is bigger than dynarec_code (or end)
-	auto iter = blkmap.upper_bound(dynarecrw);
-	if (iter == blkmap.begin())
-		return NULL;
-	iter--;  // Need to go back to find the potential candidate
-
-	// However it might be out of bounds, check for that
-	if ((u8*)iter->second->code + iter->second->host_code_size < (u8*)dynarecrw)
-		return NULL;
-
-	verify(iter->second->contains_code((u8*)dynarecrw));
-	return iter->second;
+	return block;
 }
 
 static void bm_CleanupDeletedBlocks()
@@ -168,12 +305,12 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 	RuntimeBlockInfoPtr block(blk);
 	if (block->temp_block)
 		all_temp_blocks.insert(block);
-	auto iter = blkmap.find((void*)blk->code);
-	if (iter != blkmap.end()) {
-		INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", iter->second->addr, iter->second->code, block->addr, block->code);
+	RuntimeBlockInfoPtr dup = blkmap.find((void*)blk->code);
+	if (dup) {
+		INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", dup->addr, dup->code, block->addr, block->code);
 		verify(false);
 	}
-	blkmap[(void*)block->code] = block;
+	blkmap.insert(block);
 
 	verify((void*)bm_GetCode(block->addr) == (void*)ngen_FailedToFindBlock);
 	FPCA(block->addr) = (DynarecCodeEntryPtr)CC_RW2RX(block->code);
@@ -197,12 +334,14 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 void bm_DiscardBlock(RuntimeBlockInfo* block)
 {
 	// Remove from block map
-	auto it = blkmap.find((void*)block->code);
-	verify(it != blkmap.end());
-	RuntimeBlockInfoPtr block_ptr = it->second;
-
-	blkmap.erase(it);
-
+	RuntimeBlockInfoPtr block_ptr = blkmap.erase((void*)block->code);
+	verify(block_ptr != NULL);
+
+	// The blocks it jumps to must not unlink it or keep it alive
+	if (block_ptr->pNextBlock != NULL)
+		block_ptr->pNextBlock->RemRef(block_ptr.get());
+	if (block_ptr->pBranchBlock != NULL)
+		block_ptr->pBranchBlock->RemRef(block_ptr.get());
 	block_ptr->pNextBlock = NULL;
 	block_ptr->pBranchBlock = NULL;
 	block_ptr->Relink();
@@ -221,6 +360,12 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 void bm_Periodical_1s()
 {
 	bm_CleanupDeletedBlocks();
+	if (bm_stats.lookups > 0 || bm_stats.link_hits > 0 || bm_stats.discards > 0)
+		DEBUG_LOG(DYNAREC, "bm: %d links %d unlinks %d discards, %d lookups %.2f probes %.0f ns/lookup",
+				(int)bm_stats.link_hits, (int)bm_stats.unlinks, (int)bm_stats.discards, (int)bm_stats.lookups,
+				bm_stats.lookups == 0 ? 0.f : (float)bm_stats.lookup_probes / bm_stats.lookups,
+				bm_stats.lookups == 0 ? 0.f : (float)bm_stats.lookup_ns / bm_stats.lookups);
+	memset(&bm_stats, 0, sizeof(bm_stats));
 }
 
 
@@ -232,13 +377,10 @@ void bm_vmem_pagefill(void** ptr, u32 size_bytes)
 	}
 }
 
-void bm_Reset()
+// Write-protects or unprotects all the ram mirrors
+static void bm_ProtectRam(bool protect)
 {
-	bm_ResetCache();
-	bm_CleanupDeletedBlocks();
-	protected_blocks = 0;
-	unprotected_blocks = 0;
-
+	bool (*region_protect)(void *, size_t) = protect ? mem_region_lock : mem_region_unlock;
 	if (_nvmem_enabled())
 	{
 		// Windows cannot lock/unlock a region spanning more than one VirtualAlloc or MapViewOfFile
@@ -246,28 +388,39 @@ void bm_Reset()
 		// No need for this mess in 4GB mode since windows doesn't use it
 		if (RAM_SIZE == 16 * 1024 * 1024)
 		{
-			mem_region_unlock(virt_ram_base + 0x0C000000, RAM_SIZE);
-			mem_region_unlock(virt_ram_base + 0x0D000000, RAM_SIZE);
-			mem_region_unlock(virt_ram_base + 0x0E000000, RAM_SIZE);
-			mem_region_unlock(virt_ram_base + 0x0F000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0C000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0D000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0E000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0F000000, RAM_SIZE);
 		}
 		else
 		{
-			mem_region_unlock(virt_ram_base + 0x0C000000, RAM_SIZE);
-			mem_region_unlock(virt_ram_base + 0x0E000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0C000000, RAM_SIZE);
+			region_protect(virt_ram_base + 0x0E000000, RAM_SIZE);
 		}
 		if (_nvmem_4gb_space())
 		{
-			mem_region_unlock(virt_ram_base + 0x8C000000, 0x90000000 - 0x8C000000);
-			mem_region_unlock(virt_ram_base + 0xAC000000, 0xB0000000 - 0xAC000000);
+			region_protect(virt_ram_base + 0x8C000000, 0x90000000 - 0x8C000000);
+			region_protect(virt_ram_base + 0xAC000000, 0xB0000000 - 0xAC000000);
 		}
 	}
 	else
 	{
-		mem_region_unlock(&mem_b[0], RAM_SIZE);
+		region_protect(&mem_b[0], RAM_SIZE);
 	}
 }
 
+void bm_Reset()
+{
+	bm_ResetCache();
+	bm_CleanupDeletedBlocks();
+	protected_blocks = 0;
+	unprotected_blocks = 0;
+
+	bm_ProtectRam(false);
+	ram_tracking = false;
+}
+
 static void bm_LockPage(u32 addr)
 {
 	addr = addr & (RAM_MASK - PAGE_MASK);
@@ -293,13 +446,17 @@ static void bm_UnlockPage(u32 addr)
 	addr = addr & (RAM_MASK - PAGE_MASK);
 	if (_nvmem_enabled())
 	{
+		// Mirrors are only locked by bm_ProtectRam but unlocking them is harmless
 		if (!mmu_enabled() || !_nvmem_4gb_space())
-			mem_region_unlock(virt_ram_base + 0x0C000000 + addr, PAGE_SIZE);
+			for (u32 mirror = 0x0C000000; mirror < 0x10000000; mirror += RAM_SIZE)
+				mem_region_unlock(virt_ram_base + mirror + addr, PAGE_SIZE);
 		if (_nvmem_4gb_space())
 		{
-			mem_region_unlock(virt_ram_base + 0x8C000000 + addr, PAGE_SIZE);
-			mem_region_unlock(virt_ram_base + 0xAC000000 + addr, PAGE_SIZE);
-			// TODO wraps
+			for (u32 mirror = 0x8C000000; mirror < 0x90000000; mirror += RAM_SIZE)
+			{
+				mem_region_unlock(virt_ram_base + mirror + addr, PAGE_SIZE);
+				mem_region_unlock(virt_ram_base + mirror + 0x20000000 + addr, PAGE_SIZE);
+			}
 		}
 	}
 	else
@@ -313,9 +470,7 @@ void bm_ResetCache()
 	ngen_ResetBlocks();
 	_vmem_bm_reset();
 
-	for (const auto& it : blkmap)
-	{
-		RuntimeBlockInfoPtr block = it.second;
+	blkmap.for_each([](const RuntimeBlockInfoPtr& block) {
 		block->relink_data = 0;
 		block->pNextBlock = 0;
 		block->pBranchBlock = 0;
@@ -324,7 +479,7 @@ void bm_ResetCache()
 		// Avoid circular references
 		block->Discard();
 		del_blocks.push_back(block);
-	}
+	});
 
 	blkmap.clear();
 	// blkmap includes temp blocks as well
@@ -392,13 +547,11 @@ void bm_WriteBlockMap(const string& file)
 	if (f)
 	{
 		INFO_LOG(DYNAREC, "Writing block map !");
-		for (auto& it : blkmap)
-		{
-			RuntimeBlockInfoPtr& block = it.second;
+		blkmap.for_each([f](const RuntimeBlockInfoPtr& block) {
 			fprintf(f, "block: %d:%08X:%p:%d:%d:%d\n", block->BlockType, block->addr, block->code, block->host_code_size, block->guest_cycles, block->guest_opcodes);
 			for(size_t j = 0; j < block->oplist.size(); j++)
 				fprintf(f,"\top: %zd:%d:%s\n", j, block->oplist[j].guest_offs, block->oplist[j].dissasm().c_str());
-		}
+		});
 		fclose(f);
 		INFO_LOG(DYNAREC, "Finished writing block map");
 	}
@@ -426,11 +579,9 @@ bool UDgreater3 ( RuntimeBlockInfo* elem1, RuntimeBlockInfo* elem2 )
 
 void sh4_jitsym(FILE* out)
 {
-	for (auto& it : blkmap)
-	{
-		RuntimeBlockInfoPtr& block = it.second;
+	blkmap.for_each([out](const RuntimeBlockInfoPtr& block) {
 		fprintf(out, "%p %d %08X\n", block->code, block->host_code_size, block->addr);
-	}
+	});
 }
 #if 0
 void bm_PrintTopBlocks()
@@ -531,12 +682,15 @@ RuntimeBlockInfo::~RuntimeBlockInfo()
 
 void RuntimeBlockInfo::AddRef(RuntimeBlockInfoPtr other)
 { 
-	pre_refs.push_back(other); 
+	// Conditional blocks can link both their exits to the same block
+	if (std::find(pre_refs.begin(), pre_refs.end(), other) == pre_refs.end())
+		pre_refs.push_back(other); 
 }
 
-void RuntimeBlockInfo::RemRef(RuntimeBlockInfoPtr other)
+void RuntimeBlockInfo::RemRef(RuntimeBlockInfo* other)
 { 
-	bm_List::iterator it = std::find(pre_refs.begin(), pre_refs.end(), other);
+	bm_List::iterator it = std::find_if(pre_refs.begin(), pre_refs.end(),
+			[other](const RuntimeBlockInfoPtr& ref) { return ref.get() == other; });
 	if (it != pre_refs.end())
 		pre_refs.erase(it);
 }
@@ -546,6 +700,7 @@ void RuntimeBlockInfo::Discard()
 	// Update references
 	for (RuntimeBlockInfoPtr& ref : pre_refs)
 	{
+		bm_stats.unlinks++;
 		if (ref->NextBlock == vaddr)
 			ref->pNextBlock = NULL;
 		if (ref->BranchBlock == vaddr)
@@ -560,8 +715,13 @@ void RuntimeBlockInfo::Discard()
 		// Remove this block from the per-page block lists
 		for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + this->sh4_code_size; addr += PAGE_SIZE)
 		{
-			set<RuntimeBlockInfo*>& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
-			block_list.erase(this);
+			vector<RuntimeBlockInfo*>& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
+			auto it = std::find(block_list.begin(), block_list.end(), this);
+			if (it != block_list.end())
+			{
+				*it = block_list.back();
+				block_list.pop_back();
+			}
 		}
 	}
 }
@@ -593,13 +753,23 @@ void RuntimeBlockInfo::SetProtectedFlags()
 		auto& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
 		if (block_list.empty())
 			bm_LockPage(addr);
-		block_list.insert(this);
+		block_list.push_back(this);
 	}
 }
 
 void bm_RamWriteAccess(u32 addr)
 {
 	addr &= RAM_MASK;
+	if (ram_tracking && !ram_written_pages[addr / PAGE_SIZE])
+	{
+		ram_written_pages[addr / PAGE_SIZE] = true;
+		if (blocks_per_page[addr / PAGE_SIZE].empty())
+		{
+			// Only protected to track writes
+			bm_UnlockPage(addr);
+			return;
+		}
+	}
 	if (unprotected_pages[addr / PAGE_SIZE])
 	{
 		ERROR_LOG(DYNAREC, "Page %08x already unprotected", addr);
@@ -607,11 +777,11 @@ void bm_RamWriteAccess(u32 addr)
 	}
 	unprotected_pages[addr / PAGE_SIZE] = true;
 	bm_UnlockPage(addr);
-	set<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
-	vector<RuntimeBlockInfo*> list_copy;
-	list_copy.insert(list_copy.begin(), block_list.begin(), block_list.end());
+	vector<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
+	vector<RuntimeBlockInfo*> list_copy(block_list);
 	if (!list_copy.empty())
 		DEBUG_LOG(DYNAREC, "bm_RamWriteAccess write access to %08x pc %08x", addr, next_pc);
+	bm_stats.discards += list_copy.size();
 	for (auto& block : list_copy)
 	{
 		bm_DiscardBlock(block);
@@ -619,6 +789,29 @@ void bm_RamWriteAccess(u32 addr)
 	verify(block_list.empty());
 }
 
+bool bm_ResetRamWriteTracking()
+{
+#ifndef TARGET_NO_EXCEPTIONS
+	// vmem32 doesn't report writes to user space
+	if (!settings.dreamcast.FullMMU)
+	{
+		memset(ram_written_pages, 0, sizeof(ram_written_pages));
+		bm_ProtectRam(true);
+		ram_tracking = true;
+
+		return true;
+	}
+#endif
+	ram_tracking = false;
+
+	return false;
+}
+
+bool bm_IsRamPageWritten(u32 addr)
+{
+	return !ram_tracking || ram_written_pages[(addr & RAM_MASK) / PAGE_SIZE];
+}
+
 bool bm_RamWriteAccess(void *p)
 {
 	if (_nvmem_enabled())
@@ -33,7 +33,7 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	bool Setup(u32 pc,fpscr_t fpu_cfg,bool optimise = true,bool trace = false);
 	const char* hash();
 
 	u32 vaddr;
@@ -51,6 +51,8 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool trace;				// forward bt/bf are side exits instead of block ends
+	bool trace_candidate;	// ends on a bt/bf that a trace would go past
 
 	u32 BranchBlock; /* if not 0xFFFFFFFF then jump target */
 	u32 NextBlock;   /* if not 0xFFFFFFFF then next block (by position) */
@@ -65,6 +67,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 
 	BlockEndType BlockType;
 	bool has_jcond;
+	bool optimised;		// the ssa optimizer has been run on the oplist
 
 	vector<shil_opcode> oplist;
 
@@ -82,7 +85,7 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	vector<RuntimeBlockInfoPtr> pre_refs;
 
 	void AddRef(RuntimeBlockInfoPtr other);
-	void RemRef(RuntimeBlockInfoPtr other);
+	void RemRef(RuntimeBlockInfo* other);
 
 	void Discard();
 	void UpdateRefs();
@@ -94,6 +97,17 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool read_only;
 };
 
+struct bm_Stats
+{
+	u64 lookups;		// host code to block lookups
+	u64 lookup_probes;	// index slots visited by the lookups
+	u64 lookup_ns;		// time spent in the lookups
+	u64 link_hits;		// direct block links made by rdv_LinkBlock
+	u64 unlinks;		// direct links of live blocks undone because the target block was discarded
+	u64 discards;		// blocks discarded because their ram pages were written to
+};
+extern bm_Stats bm_stats;
+
 void bm_WriteBlockMap(const string& file);
 
 extern "C" {
@@ -118,6 +132,10 @@ void bm_Term();
 void bm_vmem_pagefill(void** ptr,u32 PAGE_SZ);
 bool bm_RamWriteAccess(void *p);
 void bm_RamWriteAccess(u32 addr);
+// Write-protects all the ram to track the pages written to. Returns false if not supported.
+bool bm_ResetRamWriteTracking();
+// True if the page has been written to since the last bm_ResetRamWriteTracking, or if writes aren't tracked
+bool bm_IsRamPageWritten(u32 addr);
 static inline bool bm_IsRamPageProtected(u32 addr)
 {
 	extern bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
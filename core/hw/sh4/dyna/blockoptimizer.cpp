@@ -0,0 +1,210 @@
+/*
+	Background shil optimizer. See blockoptimizer.h
+*/
+#include "types.h"
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#include <deque>
+#include "deps/xxhash/xxhash.h"
+#include "blockoptimizer.h"
+#include "blockmanager.h"
+#include "ngen.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+
+void AnalyseBlock(RuntimeBlockInfo* blk);
+
+#if !defined(TARGET_NO_THREADS)
+
+struct OptimizerJob
+{
+	RuntimeBlockInfo* block;
+	u32 code_hash;
+	u32 generation;
+};
+
+static std::deque<OptimizerJob> pending;
+static std::deque<OptimizerJob> done;
+static cMutex queue_mutex;
+static cResetEvent work_available;
+static volatile bool worker_running;
+static u32 generation;
+
+static void *bo_ThreadFunc(void *)
+{
+	while (true)
+	{
+		work_available.Wait();
+		if (!worker_running)
+			break;
+		while (true)
+		{
+			queue_mutex.Lock();
+			if (pending.empty())
+			{
+				queue_mutex.Unlock();
+				break;
+			}
+			OptimizerJob job = pending.front();
+			pending.pop_front();
+			queue_mutex.Unlock();
+
+			AnalyseBlock(job.block);
+
+			queue_mutex.Lock();
+			done.push_back(job);
+			queue_mutex.Unlock();
+		}
+	}
+	return NULL;
+}
+
+static cThread worker_thread(bo_ThreadFunc, NULL);
+
+static bool bo_HashGuestCode(u32 addr, u32 size, u32& hash)
+{
+	u8 *ptr = GetMemPtr(addr, size);
+	if (ptr == NULL)
+		return false;
+	hash = XXH32(ptr, size, 7);
+
+	return true;
+}
+
+static void bo_DeleteJobs(std::deque<OptimizerJob>& jobs)
+{
+	for (OptimizerJob& job : jobs)
+		bo_DiscardBlock(job.block);
+	jobs.clear();
+}
+
+bool bo_Enabled()
+{
+	return settings.dynarec.BackgroundOptimizer;
+}
+
+void bo_Term()
+{
+	if (worker_running)
+	{
+		worker_running = false;
+		work_available.Set();
+		worker_thread.WaitToEnd();
+	}
+	bo_DeleteJobs(pending);
+	bo_DeleteJobs(done);
+}
+
+void bo_Flush()
+{
+	queue_mutex.Lock();
+	// The block being optimized is dropped when it's returned
+	generation++;
+	bo_DeleteJobs(pending);
+	bo_DeleteJobs(done);
+	queue_mutex.Unlock();
+}
+
+bool bo_Queue(RuntimeBlockInfo* blk)
+{
+	if (mmu_enabled() || blk->temp_block || blk->oplist.empty())
+		return false;
+	OptimizerJob job;
+	if (!bo_HashGuestCode(blk->addr, blk->sh4_code_size, job.code_hash))
+		return false;
+	if (!worker_running)
+	{
+		worker_running = true;
+		worker_thread.Start();
+	}
+
+	RuntimeBlockInfo* copy = ngen_AllocateBlock();
+	copy->addr = blk->addr;
+	copy->vaddr = blk->vaddr;
+	copy->code = NULL;
+	copy->lookups = copy->runs = copy->staging_runs = 0;
+	copy->host_code_size = copy->host_opcodes = 0;
+	copy->sh4_code_size = blk->sh4_code_size;
+	copy->fpu_cfg = blk->fpu_cfg;
+	copy->guest_cycles = blk->guest_cycles;
+	copy->guest_opcodes = blk->guest_opcodes;
+	copy->has_fpu_op = blk->has_fpu_op;
+	copy->blockcheck_failures = blk->blockcheck_failures;
+	copy->temp_block = false;
+	copy->trace = false;
+	copy->trace_candidate = blk->trace_candidate;
+	copy->BranchBlock = blk->BranchBlock;
+	copy->NextBlock = blk->NextBlock;
+	copy->pBranchBlock = copy->pNextBlock = NULL;
+	copy->csc_RetCache = 0xFFFFFFFF;
+	copy->BlockType = blk->BlockType;
+	copy->has_jcond = blk->has_jcond;
+	// No constant reads are folded: the worker would read memory that can change before the block is installed,
+	// and the install check only covers the block code. rdv_InstallOptimizedBlocks sets the flag again.
+	copy->read_only = false;
+	copy->optimised = false;
+	copy->oplist = blk->oplist;
+	job.block = copy;
+
+	queue_mutex.Lock();
+	job.generation = generation;
+	pending.push_back(job);
+	queue_mutex.Unlock();
+	work_available.Set();
+
+	return true;
+}
+
+RuntimeBlockInfo* bo_GetOptimizedBlock()
+{
+	while (true)
+	{
+		queue_mutex.Lock();
+		if (done.empty())
+		{
+			queue_mutex.Unlock();
+			return NULL;
+		}
+		OptimizerJob job = done.front();
+		done.pop_front();
+		queue_mutex.Unlock();
+
+		u32 hash;
+		if (job.generation == generation
+				&& bo_HashGuestCode(job.block->addr, job.block->sh4_code_size, hash) && hash == job.code_hash)
+			return job.block;
+		bo_DiscardBlock(job.block);
+	}
+}
+
+#else
+
+bool bo_Enabled()
+{
+	return false;
+}
+
+void bo_Term() {}
+void bo_Flush() {}
+
+bool bo_Queue(RuntimeBlockInfo* blk)
+{
+	return false;
+}
+
+RuntimeBlockInfo* bo_GetOptimizedBlock()
+{
+	return NULL;
+}
+
+#endif	// !TARGET_NO_THREADS
+
+void bo_DiscardBlock(RuntimeBlockInfo* blk)
+{
+	// Not accounted in the protected/unprotected block counts yet
+	blk->sh4_code_size = 0;
+	delete blk;
+}
+
+#endif	// FEAT_SHREC != DYNAREC_NONE
@@ -0,0 +1,28 @@
+/*
+	Background shil optimizer.
+
+	When enabled, new blocks are decoded and compiled without running the ssa optimizer so that
+	compile bursts don't stall the emulation thread. A copy of their oplist is optimized on a
+	worker thread and the optimized block replaces the original one the next time
+	rdv_InstallOptimizedBlocks is called.
+	Guest code hashes are compared before installing, so blocks whose code changed are dropped.
+*/
+#pragma once
+#include "types.h"
+
+struct RuntimeBlockInfo;
+
+void bo_Term();
+// Drops all the queued blocks. Must be called when the code cache is cleared.
+void bo_Flush();
+
+bool bo_Enabled();
+// Queues a copy of a compiled block for optimization. Returns false if the block can't be queued.
+bool bo_Queue(RuntimeBlockInfo* blk);
+// Returns the next optimized block whose guest code is unchanged, or NULL
+RuntimeBlockInfo* bo_GetOptimizedBlock();
+// Deletes an optimized block that can't be installed
+void bo_DiscardBlock(RuntimeBlockInfo* blk);
+
+// Replaces the blocks compiled without optimization by their optimized version. Defined in driver.cpp
+void rdv_InstallOptimizedBlocks();
@@ -17,6 +17,8 @@
 
 #define BLOCK_MAX_SH_OPS_SOFT 500
 #define BLOCK_MAX_SH_OPS_HARD 511
+// Max distance of a forward bra that is followed within the same block
+#define BLOCK_MAX_JUMP_SKIP 256
 
 static RuntimeBlockInfo* blk;
 
@@ -148,10 +150,31 @@ static void dec_write_sr(shil_param src)
 	Emit(shop_and,mk_reg(reg_sr_status),src,mk_imm(SR_STATUS_MASK));
 	Emit(shop_and,mk_reg(reg_sr_T),src,mk_imm(SR_T_MASK));
 }
+// Forward bt/bf can leave a trace through a side exit, the fall-through path being the hot one
+static bool dec_CanSideExit(u32 target)
+{
+	return ngen_SideExits && !mmu_enabled() && target > state.cpu.rpc + 2;
+}
+
+static void dec_CondBranch(u32 target,BlockEndType flags)
+{
+	if (dec_CanSideExit(target))
+	{
+		if (blk->trace)
+		{
+			// flags is set to the cycles not executed by dec_DecodeBlock
+			Emit(shop_jexit,shil_param(),mk_reg(reg_sr_T),mk_imm(flags & 1),blk->guest_cycles,mk_imm(target));
+			return;
+		}
+		blk->trace_candidate=true;
+	}
+	dec_End(target,flags,false);
+}
+
 //bf <bdisp8>
 sh4dec(i1000_1011_iiii_iiii)
 {
-	dec_End(dec_jump_simm8(op),BET_Cond_0,false);
+	dec_CondBranch(dec_jump_simm8(op),BET_Cond_0);
 }
 //bf.s <bdisp8>
 sh4dec(i1000_1111_iiii_iiii)
@@ -163,7 +186,7 @@ sh4dec(i1000_1111_iiii_iiii)
 //bt <bdisp8>
 sh4dec(i1000_1001_iiii_iiii)
 {
-	dec_End(dec_jump_simm8(op),BET_Cond_1,false);
+	dec_CondBranch(dec_jump_simm8(op),BET_Cond_1);
 }
 //bt.s <bdisp8>
 sh4dec(i1000_1101_iiii_iiii)
@@ -172,10 +195,25 @@ sh4dec(i1000_1101_iiii_iiii)
 	Emit(shop_jcond,reg_pc_dyn,reg_sr_T);
 	dec_End(dec_jump_simm8(op),BET_Cond_1,true);
 }
+// Short forward branches, typically over a literal pool, don't need to end the block.
+// The skipped bytes are part of the block code range so SMC checks and page protection still cover them.
+static bool dec_CanFollowJump(u32 target)
+{
+	u32 next = state.cpu.rpc + 4;
+	return !mmu_enabled() && target >= next && target - next <= BLOCK_MAX_JUMP_SKIP
+			&& target - blk->vaddr < 0x10000;
+}
+
 //bra <bdisp12>
 sh4dec(i1010_iiii_iiii_iiii)
 {
-	dec_End(dec_jump_simm12(op),BET_StaticJump,true);
+	u32 target = dec_jump_simm12(op);
+	dec_End(target,BET_StaticJump,true);
+	if (dec_CanFollowJump(target))
+	{
+		state.DelayOp=NDO_Jump;
+		state.JumpOp=NDO_NextOp;
+	}
 }
 //braf <REG_N>
 sh4dec(i0000_nnnn_0010_0011)
@@ -1014,6 +1052,10 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 						}
 
 						verify(!(state.cpu.is_delayslot && OPCODE_SETPC(OpDesc[op]->type)));
+						// The fpu config and interrupt state must be re-evaluated if the delay slot changes them
+						if (state.cpu.is_delayslot && state.NextOp == NDO_Jump
+								&& (OPCODE_SETFPSCR(OpDesc[op]->type) || OPCODE_SETSR(OpDesc[op]->type)))
+							state.NextOp = NDO_End;
 						if (!OpDesc[op]->rec_oph)
 						{
 							if (!dec_generic(op))
@@ -1041,9 +1083,13 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_Jump:
-			die("Too old");
+			// Continue decoding at the jump target. The block end is decided by the code there.
 			state.NextOp=state.JumpOp;
 			state.cpu.rpc=state.JumpAddr;
+			state.cpu.is_delayslot=false;
+			state.BlockType=BET_SCL_Intr;
+			state.JumpAddr=0xFFFFFFFF;
+			state.NextAddr=0xFFFFFFFF;
 			break;
 
 		case NDO_End:
@@ -1056,6 +1102,7 @@ _end:
 	blk->NextBlock=state.NextAddr;
 	blk->BranchBlock=state.JumpAddr;
 	blk->BlockType=state.BlockType;
+	u32 decoded_cycles=blk->guest_cycles;
 
 	verify(blk->oplist.size() <= BLOCK_MAX_SH_OPS_HARD);
 	
@@ -1082,12 +1129,14 @@ _end:
 		{
 			//printf("IDLESKIP: %08X reloc match %s\n",blk->addr,blk->hash());
 			blk->guest_cycles=max_cycles*100;
+			blk->trace_candidate=false;
 		}
 		else
 		{
 			//Small-n-simple idle loop detector :p
 			if (state.info.has_readm && !state.info.has_writem && !state.info.has_fpu && blk->guest_opcodes<6)
 			{
+				blk->trace_candidate=false;
 				if (blk->BlockType==BET_Cond_0 || (blk->BlockType==BET_Cond_1 && blk->BranchBlock<=blk->vaddr))
 				{
 					blk->guest_cycles*=3;
@@ -1102,6 +1151,7 @@ _end:
 			//if in syscalls area (ip.bin etc) skip fast :p
 			if ((blk->addr&0x1FFF0000)==0x0C000000)
 			{
+				blk->trace_candidate=false;
 				if (blk->addr&0x8000)
 				{
 					//ip.bin (boot loader/img etc)
@@ -1131,6 +1181,11 @@ _end:
 	blk->guest_cycles=min(blk->guest_cycles,max_cycles);
 	//make sure we don't use wayy-too-few cycles
 	blk->guest_cycles=max(1U,blk->guest_cycles);
+
+	//side exits give back the share of the block cycles they skip
+	for (shil_opcode& op : blk->oplist)
+		if (op.op==shop_jexit)
+			op.flags=(u64)(decoded_cycles-op.flags)*blk->guest_cycles/decoded_cycles;
 	blk=0;
 
 	return true;
@@ -19,6 +19,8 @@
 #include <float.h>
 
 #include "blockmanager.h"
+#include "blockcache.h"
+#include "blockoptimizer.h"
 #include "ngen.h"
 #include "decoder.h"
 
@@ -80,6 +82,7 @@ static void recSh4_ClearCache(void)
 	bm_ResetCache();
 	smc_hotspots.clear();
 	clear_temp_cache(true);
+	bo_Flush();
 }
 
 static void recSh4_Run(void)
@@ -155,7 +158,7 @@ const char* RuntimeBlockInfo::hash()
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg,bool optimise,bool trace)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
@@ -167,6 +170,9 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType=BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
+	optimised = false;
+	this->trace = trace;
+	trace_candidate = false;
 	
 	vaddr=rpc;
 #ifndef NO_MMU
@@ -186,6 +192,13 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	
 	oplist.clear();
 
+	if (!trace && bc_Lookup(this))
+	{
+		SetProtectedFlags();
+		optimised = true;
+		return true;
+	}
+
 #if !defined(NO_MMU)
 	try {
 #endif
@@ -200,13 +213,48 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 #endif
 	SetProtectedFlags();
 
-
-	AnalyseBlock(this);
+	if (optimise)
+	{
+		AnalyseBlock(this);
+		optimised = true;
+		bc_Store(this);
+	}
 
 	return true;
 }
 
-DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+static void rdv_CompileBlock(RuntimeBlockInfo* rbi, bool do_opts)
+{
+	rbi->staging_runs=do_opts?100:-100;
+	bool block_check = rbi->read_only ? false : IsOnRam(rbi->addr);
+	ngen_Compile(rbi, block_check, (rbi->vaddr & 0xFFFFFF) == 0x08300 || (rbi->vaddr & 0xFFFFFF) == 0x10000, false, do_opts);
+	verify(rbi->code!=0);
+
+	bm_AddBlock(rbi);
+}
+
+// Replaces blocks by their version optimized in the background.
+// Must only be called when no block is being executed.
+void rdv_InstallOptimizedBlocks()
+{
+	while (RuntimeBlockInfo* rbi = bo_GetOptimizedBlock())
+	{
+		RuntimeBlockInfoPtr current = mmu_enabled() ? NULL : bm_GetBlock(rbi->addr);
+		if (current == NULL || current->optimised || current->temp_block || current->vaddr != rbi->vaddr
+				|| current->fpu_cfg.full != rbi->fpu_cfg.full || emit_FreeSpace() < 16*1024)
+		{
+			bo_DiscardBlock(rbi);
+			continue;
+		}
+		bm_DiscardBlock(current.get());
+		rbi->SetProtectedFlags();
+		rbi->optimised = true;
+		rdv_CompileBlock(rbi, true);
+		bc_Store(rbi);
+	}
+}
+
+DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures, bool trace)
 {
 	u32 pc=next_pc;
 	//printf("rdv_CompilePC next_pc %p\n", next_pc);
@@ -216,7 +264,7 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 
 	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
 
-	if (!rbi->Setup(pc,fpscr))
+	if (!rbi->Setup(pc,fpscr,trace || !bo_Enabled() || mmu_enabled(),trace))
 	{
 		delete rbi;
 		return NULL;
@@ -232,13 +280,13 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 		if (rbi->read_only)
 			INFO_LOG(DYNAREC, "WARNING: temp block %x (%x) is protected!", rbi->vaddr, rbi->addr);
 	}
-		bool do_opts = !rbi->temp_block;
-		rbi->staging_runs=do_opts?100:-100;
-		bool block_check = rbi->read_only ? false : IsOnRam(rbi->addr);
-		ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
-		verify(rbi->code!=0);
-
-		bm_AddBlock(rbi);
+	if (!rbi->optimised && !bo_Queue(rbi))
+	{
+		AnalyseBlock(rbi);
+		rbi->optimised = true;
+		bc_Store(rbi);
+	}
+	rdv_CompileBlock(rbi, !rbi->temp_block);
 
 	if (emit_ptr != NULL)
 	{
@@ -250,6 +298,20 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 	return rbi->code;
 }
 
+// Replaces a hot block by a trace that goes past its conditional branches.
+// Called on the way out of the block, next_pc is the address of the next block to run.
+void DYNACALL rdv_CompileTrace(u32 addr)
+{
+	RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+	if (block == NULL || block->trace || block->temp_block || mmu_enabled())
+		return;
+	u32 pc = next_pc;
+	bm_DiscardBlock(block.get());
+	next_pc = block->vaddr;
+	rdv_CompilePC(0, true);
+	next_pc = pc;
+}
+
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 {
 	return rdv_FailedToFindBlock(next_pc);
@@ -258,6 +320,7 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc)
 {
 	//printf("rdv_FailedToFindBlock ~ %08X\n",pc);
+	rdv_InstallOptimizedBlocks();
 	next_pc=pc;
 	DynarecCodeEntryPtr code = rdv_CompilePC(0);
 	if (code == NULL)
@@ -357,7 +420,7 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 
 			if (rbi->pBranchBlock!= NULL)
 			{
-				rbi->pBranchBlock->RemRef(rbi);
+				rbi->pBranchBlock->RemRef(rbi.get());
 				rbi->pBranchBlock = NULL;
 				rbi->relink_data = 1;
 			}
@@ -378,6 +441,7 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 
 			nxt->AddRef(rbi);
 		}
+		bm_stats.link_hits++;
 		u32 ncs = rbi->relink_offset + rbi->Relink();
 		verify(rbi->host_code_size >= ncs);
 		rbi->host_code_size = ncs;
@@ -462,11 +526,15 @@ static void recSh4_Init(void)
 	TempCodeCache = CodeCache + CODE_SIZE;
 	ngen_init();
 	bm_ResetCache();
+	bc_Load(get_game_cache_path("blkcache"));
 }
 
 static void recSh4_Term(void)
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+	bo_Term();
+	bc_Save();
+	bc_Term();
 	bm_Term();
 	Sh4_int_Term();
 }
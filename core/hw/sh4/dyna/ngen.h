@@ -78,7 +78,9 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc();
 //Called when a block check failed, and the block needs to be invalidated
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 pc);
 //Called to compile code @pc
-DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
+DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures, bool trace = false);
+//Called when a trace candidate block has gone past its conditional branch TRACE_HOT_RUNS times, to rebuild it as a trace
+void DYNACALL rdv_CompileTrace(u32 addr);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
 
@@ -94,6 +96,9 @@ void ngen_init();
 
 //Called to compile a block
 extern void (*ngen_Compile)(RuntimeBlockInfo* block,bool force_checks, bool reset, bool staging,bool optimise);
+//Set by the dynarecs that implement shop_jexit and count the runs of trace candidate blocks
+extern bool ngen_SideExits;
+#define TRACE_HOT_RUNS 500
 
 //Called when blocks are reseted
 extern void (*ngen_ResetBlocks)();
@@ -190,6 +190,11 @@ shil_opc(jcond)
 shil_recimp()
 shil_opc_end()
 
+//Side exit of a trace: if rs1 == rs2, next_pc = rs3 and leave the block. flags = cycles not executed
+shil_opc(jexit)
+shil_recimp()
+shil_opc_end()
+
 //shop_ifb
 shil_opc(ifb)
 shil_recimp()
@@ -329,6 +329,11 @@ private:
 				memset(last_versions, -1, sizeof(last_versions));
 				continue;
 			}
+			if (op.op == shop_jexit)
+			{
+				// the regs must be saved before leaving the block
+				memset(last_versions, -1, sizeof(last_versions));
+			}
 			if (op.op == shop_pref)
 			{
 				if (op.rs1.is_imm() && (op.rs1.imm_value() & 0xFC000000) != 0xE0000000)
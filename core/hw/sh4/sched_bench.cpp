@@ -0,0 +1,396 @@
+/*
+	sched_bench: replays scheduler traces recorded by the core (see sh4_sched.h) with the min-heap
+	scheduler of sh4_sched.cpp and with the linear scan it replaced, and reports the events per second.
+
+	Built with "make sched_bench". Usage: sched_bench [-n iterations] trace.sct...
+
+	Time advances by SH4_TIMESLICE cycles between ticks, as in UpdateSystem. The requests recorded
+	outside of callbacks are made at their recorded time. Each callback makes the requests it made
+	when it was recorded and returns the same value. Events are the requests and the callbacks.
+	The number of times each callback is called is checked against the trace.
+*/
+#include "types.h"
+#include "sh4_core.h"
+#include "sh4_interpreter.h"
+#include "sh4_sched.h"
+
+extern u64 sh4_sched_ffb;
+extern vector<sched_list> sch_list;
+
+struct TraceRequest
+{
+	u64 time;
+	int id;
+	int cycles;
+};
+
+struct TraceCallback
+{
+	u32 first_request;		// requests made by the callback, in Trace::callback_requests
+	u32 request_count;
+	int ret;
+};
+
+struct Trace
+{
+	u32 id_count = 0;
+	u64 start = 0;
+	u64 end = 0;
+	vector<TraceRequest> requests;						// made outside of callbacks
+	vector<TraceRequest> callback_requests;
+	vector<vector<TraceCallback>> callbacks;			// per id, in call order
+	u64 callback_count = 0;
+};
+
+static bool load_trace(const char *path, Trace& trace)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+	SchedTraceHeader header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != SCHED_TRACE_MAGIC
+			|| header.version != SCHED_TRACE_VERSION)
+	{
+		fclose(f);
+		return false;
+	}
+	trace.id_count = header.id_count;
+	trace.callbacks.resize(header.id_count);
+
+	SchedTraceRecord record;
+	TraceCallback *callback = NULL;
+	int rescheduled_id = -1;
+	bool first = true;
+	while (fread(&record, sizeof(record), 1, f) == 1)
+	{
+		if (record.id >= header.id_count)
+			break;
+		if (first)
+			trace.start = record.time;
+		first = false;
+		trace.end = record.time;
+		switch (record.type)
+		{
+		case SchedTraceRequest:
+			if (callback != NULL)
+			{
+				trace.callback_requests.push_back({ record.time, record.id, record.value });
+				callback->request_count++;
+			}
+			// The scheduler makes this one itself
+			else if (record.id != rescheduled_id)
+				trace.requests.push_back({ record.time, record.id, record.value });
+			break;
+		case SchedTraceCallback:
+			trace.callbacks[record.id].push_back({ (u32)trace.callback_requests.size(), 0, 0 });
+			callback = &trace.callbacks[record.id].back();
+			trace.callback_count++;
+			break;
+		case SchedTraceReturn:
+			if (callback != NULL)
+				callback->ret = record.value;
+			callback = NULL;
+			break;
+		}
+		rescheduled_id = record.type == SchedTraceReturn && record.value > 0 ? record.id : -1;
+		if (record.type == SchedTraceEnd)
+			break;
+	}
+	fclose(f);
+
+	return !first;
+}
+
+// The scheduler before the event queue: sh4_sched_ffts and sh4_sched_tick scan all the callbacks.
+// Like sh4_sched.cpp, it keeps the cycles to the next event in Sh4cntx.
+static u64 linear_ffb;
+
+struct LinearScheduler
+{
+	struct Entry
+	{
+		sh4_sched_callback* cb;
+		int tag;
+		int start;
+		int end;
+	};
+	vector<Entry> list;
+	int next_id = -1;
+
+	u32 Now() { return linear_ffb - Sh4cntx.sh4_sched_next; }
+	u64 Now64() { return linear_ffb - Sh4cntx.sh4_sched_next; }
+
+	u32 Remaining(int id, u32 reference)
+	{
+		if (list[id].end != -1)
+			return list[id].end - reference;
+		return -1;
+	}
+
+	void Ffts()
+	{
+		u32 diff = -1;
+		int slot = -1;
+
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			if (Remaining(i, Now()) < diff)
+			{
+				slot = i;
+				diff = Remaining(i, Now());
+			}
+		}
+
+		linear_ffb -= Sh4cntx.sh4_sched_next;
+
+		next_id = slot;
+		if (slot != -1)
+			Sh4cntx.sh4_sched_next = diff;
+		else
+			Sh4cntx.sh4_sched_next = SH4_MAIN_CLOCK;
+
+		linear_ffb += Sh4cntx.sh4_sched_next;
+	}
+
+	int Register(int tag, sh4_sched_callback* ssc)
+	{
+		list.push_back({ ssc, tag, -1, -1 });
+		return list.size() - 1;
+	}
+
+	void Request(int id, int cycles)
+	{
+		list[id].start = Now();
+		list[id].end = -1;
+
+		if (cycles != -1)
+		{
+			list[id].end = list[id].start + cycles;
+			if (list[id].end == -1)
+				list[id].end++;
+		}
+
+		Ffts();
+	}
+
+	int Elapsed(int id)
+	{
+		if (list[id].end == -1)
+			return -1;
+
+		int rv = Now() - list[id].start;
+		list[id].start = Now();
+		return rv;
+	}
+
+	void HandleCallback(int id)
+	{
+		int remain = list[id].end - list[id].start;
+		int elapsd = Elapsed(id);
+		int jitter = elapsd - remain;
+
+		list[id].end = -1;
+		int re_sch = list[id].cb(list[id].tag, remain, jitter);
+
+		if (re_sch > 0)
+			Request(id, max(0, re_sch - jitter));
+	}
+
+	void Tick(int cycles)
+	{
+		if (Sh4cntx.sh4_sched_next < 0)
+		{
+			u32 fztime = Now() - cycles;
+			if (next_id != -1)
+			{
+				for (size_t i = 0; i < list.size(); i++)
+				{
+					int remaining = Remaining(i, fztime);
+					if (remaining >= 0 && remaining <= (u32)cycles)
+						HandleCallback(i);
+				}
+			}
+			Ffts();
+		}
+	}
+
+	void Slice()
+	{
+		Sh4cntx.sh4_sched_next -= SH4_TIMESLICE;
+		if (Sh4cntx.sh4_sched_next < 0)
+			Tick(SH4_TIMESLICE);
+	}
+
+	void Reset()
+	{
+		list.clear();
+		linear_ffb = 0;
+		Sh4cntx.sh4_sched_next = 0;
+		next_id = -1;
+	}
+};
+
+// sh4_sched.cpp, with the same interface
+struct HeapScheduler
+{
+	u64 Now64() { return sh4_sched_now64(); }
+
+	int Register(int tag, sh4_sched_callback* ssc)
+	{
+		// The callbacks registered by a previous replay are reused
+		for (size_t i = 0; i < sch_list.size(); i++)
+			if (sch_list[i].tag == tag)
+			{
+				sch_list[i].cb = ssc;
+				return i;
+			}
+		return sh4_sched_register(tag, ssc);
+	}
+
+	void Request(int id, int cycles) { sh4_sched_request(id, cycles); }
+
+	void Slice()
+	{
+		Sh4cntx.sh4_sched_next -= SH4_TIMESLICE;
+		if (Sh4cntx.sh4_sched_next < 0)
+			sh4_sched_tick(SH4_TIMESLICE);
+	}
+
+	void Reset()
+	{
+		for (size_t i = 0; i < sch_list.size(); i++)
+			sh4_sched_request(i, -1);
+		sh4_sched_ffb = 0;
+		Sh4cntx.sh4_sched_next = 0;
+	}
+};
+
+struct ReplayStats
+{
+	u64 events;
+	u64 callbacks;
+	u32 mismatched_ids;		// callbacks called a different number of times than in the trace
+};
+
+static const Trace *replay_trace;
+static vector<u32> replay_calls;
+static u64 replay_events;
+static void (*replay_request)(int id, int cycles);
+
+static int replay_callback(int tag, int sch_cycl, int jitter)
+{
+	const vector<TraceCallback>& calls = replay_trace->callbacks[tag];
+	u32 call = replay_calls[tag]++;
+	replay_events++;
+	if (call >= calls.size())
+		return 0;
+	const TraceCallback& callback = calls[call];
+	for (u32 i = 0; i < callback.request_count; i++)
+	{
+		const TraceRequest& request = replay_trace->callback_requests[callback.first_request + i];
+		replay_request(request.id, request.cycles);
+	}
+	replay_events += callback.request_count;
+	if (callback.ret > 0)
+		replay_events++;
+
+	return callback.ret;
+}
+
+template<typename Scheduler>
+static ReplayStats replay(const Trace& trace, Scheduler& scheduler)
+{
+	static Scheduler *current;
+	current = &scheduler;
+	replay_request = [](int id, int cycles) { current->Request(id, cycles); };
+	replay_trace = &trace;
+	replay_calls.assign(trace.id_count, 0);
+	replay_events = 0;
+
+	scheduler.Reset();
+	for (u32 id = 0; id < trace.id_count; id++)
+		verify(scheduler.Register(id, replay_callback) == (int)id);
+
+	// Each slice advances the scheduler time by SH4_TIMESLICE, callbacks don't change it
+	const u64 end = trace.end - trace.start;
+	size_t request = 0;
+	u64 now = 0;
+	for (;;)
+	{
+		for (; request < trace.requests.size() && trace.requests[request].time - trace.start <= now; request++)
+			scheduler.Request(trace.requests[request].id, trace.requests[request].cycles);
+		if (now >= end)
+			break;
+		scheduler.Slice();
+		now += SH4_TIMESLICE;
+	}
+	verify(scheduler.Now64() == now);
+	replay_events += request;
+
+	ReplayStats stats = { replay_events, 0, 0 };
+	for (u32 id = 0; id < trace.id_count; id++)
+	{
+		stats.callbacks += replay_calls[id];
+		if (replay_calls[id] != trace.callbacks[id].size())
+			stats.mismatched_ids++;
+	}
+	return stats;
+}
+
+template<typename Scheduler>
+static double bench(const char *name, const Trace& trace, int iterations)
+{
+	Scheduler scheduler;
+	ReplayStats stats;
+	double start = os_GetSeconds();
+	for (int i = 0; i < iterations; i++)
+		stats = replay(trace, scheduler);
+	double seconds = os_GetSeconds() - start;
+	double rate = stats.events * iterations / seconds;
+	printf("    %-7s %10.2f M events/s, %9llu callbacks", name, rate / 1000000.0, (unsigned long long)stats.callbacks);
+	if (stats.mismatched_ids != 0)
+		printf(", %u ids called a different number of times than in the trace", stats.mismatched_ids);
+	printf("\n");
+
+	return rate;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 20;
+	vector<const char *> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = max(1, atoi(argv[++i]));
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty())
+	{
+		fprintf(stderr, "Usage: %s [-n iterations] trace" SCHED_TRACE_EXT "...\n", argv[0]);
+		return 1;
+	}
+	p_sh4rcb = (Sh4RCB *)calloc(1, sizeof(Sh4RCB));
+
+	int traces = 0;
+	for (const char *file : files)
+	{
+		Trace trace;
+		if (!load_trace(file, trace))
+		{
+			fprintf(stderr, "Can't load %s\n", file);
+			continue;
+		}
+		printf("%s: %u ids, %.3f s, %u requests, %llu callbacks\n", file, trace.id_count,
+				(trace.end - trace.start) / (double)SH4_MAIN_CLOCK, (u32)(trace.requests.size() + trace.callback_requests.size()),
+				(unsigned long long)trace.callback_count);
+		double linear = bench<LinearScheduler>("linear", trace, iterations);
+		double heap = bench<HeapScheduler>("heap", trace, iterations);
+		printf("    speedup %.2fx\n", heap / linear);
+		traces++;
+	}
+	free(p_sh4rcb);
+
+	return traces == 0;
+}
@@ -1,8 +1,10 @@
 
+#include <limits.h>
 #include "types.h"
 #include "sh4_interrupts.h"
 #include "sh4_core.h"
 #include "sh4_sched.h"
+#include "file/file_path.h"
 
 
 //sh4 scheduler
@@ -24,9 +26,103 @@ u64 sh4_sched_ffb;
 
 
 vector<sched_list> sch_list;
+// Binary min-heap of the scheduled ids, ordered by expiry time. The expiry time is kept in the
+// entries so that comparisons don't go through sch_list.
+struct sched_heap_entry
+{
+	u64 end64;
+	int id;
+};
+static vector<sched_heap_entry> sch_heap;
+// Set while sh4_sched_tick runs the callbacks, which computes the next event once they're done
+static bool sch_ticking;
 
 int sh4_sched_next_id=-1;
 
+static bool sh4_sched_before(const sched_heap_entry& a, const sched_heap_entry& b)
+{
+	if (a.end64 != b.end64)
+		return a.end64 < b.end64;
+	// keep callbacks expiring on the same cycle in registration order
+	return a.id < b.id;
+}
+
+static void sh4_sched_heap_up(int i)
+{
+	sched_heap_entry entry = sch_heap[i];
+	while (i > 0)
+	{
+		int parent = (i - 1) / 2;
+		if (!sh4_sched_before(entry, sch_heap[parent]))
+			break;
+		sch_heap[i] = sch_heap[parent];
+		sch_list[sch_heap[i].id].heap_index = i;
+		i = parent;
+	}
+	sch_heap[i] = entry;
+	sch_list[entry.id].heap_index = i;
+}
+
+static void sh4_sched_heap_down(int i)
+{
+	sched_heap_entry entry = sch_heap[i];
+	int size = sch_heap.size();
+	for (;;)
+	{
+		int child = i * 2 + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && sh4_sched_before(sch_heap[child + 1], sch_heap[child]))
+			child++;
+		if (!sh4_sched_before(sch_heap[child], entry))
+			break;
+		sch_heap[i] = sch_heap[child];
+		sch_list[sch_heap[i].id].heap_index = i;
+		i = child;
+	}
+	sch_heap[i] = entry;
+	sch_list[entry.id].heap_index = i;
+}
+
+// Inserts or moves the id in the queue after its expiry time changed
+static void sh4_sched_heap_update(int id)
+{
+	int i = sch_list[id].heap_index;
+	u64 end64 = sch_list[id].end64;
+	if (i == -1)
+	{
+		sch_heap.push_back({ end64, id });
+		sh4_sched_heap_up(sch_heap.size() - 1);
+	}
+	else if (end64 < sch_heap[i].end64)
+	{
+		sch_heap[i].end64 = end64;
+		sh4_sched_heap_up(i);
+	}
+	else if (end64 > sch_heap[i].end64)
+	{
+		sch_heap[i].end64 = end64;
+		sh4_sched_heap_down(i);
+	}
+}
+
+static void sh4_sched_heap_remove(int id)
+{
+	int i = sch_list[id].heap_index;
+	if (i == -1)
+		return;
+	sch_list[id].heap_index = -1;
+	sched_heap_entry last = sch_heap.back();
+	sch_heap.pop_back();
+	if (i == (int)sch_heap.size())
+		return;
+	sch_heap[i] = last;
+	if (i > 0 && sh4_sched_before(last, sch_heap[(i - 1) / 2]))
+		sh4_sched_heap_up(i);
+	else
+		sh4_sched_heap_down(i);
+}
+
 u32 sh4_sched_remaining(int id, u32 reference)
 {
 	if (sch_list[id].end != -1)
@@ -39,19 +135,55 @@ u32 sh4_sched_remaining(int id)
 	return sh4_sched_remaining(id, sh4_sched_now());
 }
 
-void sh4_sched_ffts(void)
+static FILE *trace_file;
+static u64 trace_end;
+
+static void sh4_sched_trace(SchedTraceType type, int id, int value)
 {
-	u32 diff=-1;
-	int slot=-1;
+	SchedTraceRecord record = { (u8)type, 0, (u16)id, value, sh4_sched_now64() };
+	fwrite(&record, sizeof(record), 1, trace_file);
+}
 
-	for (size_t i=0;i<sch_list.size();i++)
+static void sh4_sched_trace_start()
+{
+	extern char content_name[PATH_MAX];
+
+	u64 now = sh4_sched_now64();
+	trace_end = now + (u64)settings.debug.SchedTraceFrames * SH4_MAIN_CLOCK / 60;
+	settings.debug.SchedTraceFrames = 0;
+
+	string dir = get_writable_data_path("schedtrace/");
+	if (!path_is_valid(dir.c_str()))
+		path_mkdir(dir.c_str());
+	char name[32];
+	// Named after the emulated time, in 1/60 s
+	sprintf(name, "_%06u" SCHED_TRACE_EXT, (u32)(now / (SH4_MAIN_CLOCK / 60)));
+	string path = dir + content_name + name;
+	trace_file = fopen(path.c_str(), "wb");
+	if (trace_file == NULL)
 	{
-		if (sh4_sched_remaining(i)<diff)
-		{
-			slot=i;
-			diff=sh4_sched_remaining(i);
-		}
+		WARN_LOG(COMMON, "Can't create scheduler trace %s", path.c_str());
+		return;
 	}
+	SchedTraceHeader header = { SCHED_TRACE_MAGIC, SCHED_TRACE_VERSION, (u32)sch_list.size(), 0 };
+	fwrite(&header, sizeof(header), 1, trace_file);
+	for (size_t i = 0; i < sch_list.size(); i++)
+		if (sch_list[i].end != -1)
+			sh4_sched_trace(SchedTraceRequest, i, sh4_sched_remaining(i, (u32)now));
+	INFO_LOG(COMMON, "Recording scheduler trace to %s", path.c_str());
+}
+
+static void sh4_sched_trace_stop()
+{
+	sh4_sched_trace(SchedTraceEnd, 0, 0);
+	fclose(trace_file);
+	trace_file = NULL;
+}
+
+void sh4_sched_ffts(void)
+{
+	int slot = sch_heap.empty() ? -1 : sch_heap[0].id;
+	u32 diff = slot == -1 ? -1 : sh4_sched_remaining(slot);
 
 	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
 
@@ -66,7 +198,7 @@ void sh4_sched_ffts(void)
 
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
-	sched_list t={ssc,tag,-1,-1};
+	sched_list t={ssc,tag,-1,-1,0,-1};
 
 	sch_list.push_back(t);
 
@@ -91,8 +223,11 @@ u64 sh4_sched_now64(void)
 void sh4_sched_request(int id, int cycles)
 {
 	verify(cycles== -1 || (cycles >= 0 && cycles <= SH4_MAIN_CLOCK));
+	if (trace_file != NULL)
+		sh4_sched_trace(SchedTraceRequest, id, cycles);
 
-	sch_list[id].start = sh4_sched_now();
+	u64 now = sh4_sched_now64();
+	sch_list[id].start = now;
    sch_list[id].end   = -1;
 
 	if (cycles != -1)
@@ -100,8 +235,32 @@ void sh4_sched_request(int id, int cycles)
 		sch_list[id].end = sch_list[id].start + cycles;
 		if (sch_list[id].end == -1)
 			sch_list[id].end++;
+		sch_list[id].end64 = now + cycles;
+		sh4_sched_heap_update(id);
 	}
+	else
+		sh4_sched_heap_remove(id);
 
+	// Nothing to do if the next event is still the same: sh4_sched_ffb is its expiry time
+	if (!sch_ticking && (sch_heap.empty() || sch_heap[0].id != sh4_sched_next_id || sch_heap[0].end64 != sh4_sched_ffb))
+		sh4_sched_ffts();
+}
+
+void sh4_sched_restore()
+{
+	for (const sched_heap_entry& entry : sch_heap)
+		sch_list[entry.id].heap_index = -1;
+	sch_heap.clear();
+
+	u64 now = sh4_sched_now64();
+	for (size_t i = 0; i < sch_list.size(); i++)
+	{
+		if (sch_list[i].end != -1)
+		{
+			sch_list[i].end64 = now + sh4_sched_remaining(i, (u32)now);
+			sh4_sched_heap_update(i);
+		}
+	}
 	sh4_sched_ffts();
 }
 
@@ -122,11 +281,18 @@ static void handle_cb(int id)
 	int elapsd=sh4_sched_elapsed(id);
 	int jitter=elapsd-remain;
 
+	// The id stays in the queue during the callback, so that rescheduling it only moves it
 	sch_list[id].end=-1;
+	if (trace_file != NULL)
+		sh4_sched_trace(SchedTraceCallback, id, 0);
 	int re_sch=sch_list[id].cb(sch_list[id].tag,remain,jitter);
+	if (trace_file != NULL)
+		sh4_sched_trace(SchedTraceReturn, id, re_sch);
 
 	if (re_sch > 0)
 		sh4_sched_request(id, max(0, re_sch - jitter));
+	else if (sch_list[id].end == -1)
+		sh4_sched_heap_remove(id);
 }
 
 void sh4_sched_tick(int cycles)
@@ -138,17 +304,17 @@ void sh4_sched_tick(int cycles)
 
 	if (Sh4cntx.sh4_sched_next<0)
 	{
-		u32 fztime=sh4_sched_now()-cycles;
-		if (sh4_sched_next_id!=-1)
-		{
-			for (int i = 0; i < sch_list.size(); i++)
-			{
-				int remaining = sh4_sched_remaining(i, fztime);
-				verify(remaining >= 0 || remaining == -1);
-				if (remaining >= 0 && remaining <= (u32)cycles)
-					handle_cb(i);
-			}
-		}
+		// Callbacks don't advance time, but they can (re)schedule any event
+		u64 now = sh4_sched_now64();
+		sch_ticking = true;
+		while (!sch_heap.empty() && sch_heap[0].end64 <= now)
+			handle_cb(sch_heap[0].id);
+		sch_ticking = false;
 		sh4_sched_ffts();
+
+		if (trace_file != NULL && now >= trace_end)
+			sh4_sched_trace_stop();
+		else if (settings.debug.SchedTraceFrames != 0 && trace_file == NULL)
+			sh4_sched_trace_start();
 	}
 }
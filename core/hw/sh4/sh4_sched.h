@@ -41,10 +41,51 @@ void sh4_sched_tick(int cycles);
 
 void sh4_sched_ffts();
 
+/*
+	Rebuild the event queue from the start/end fields of sch_list,
+	after they have been restored from a savestate
+*/
+void sh4_sched_restore();
+
 struct sched_list
 {
 	sh4_sched_callback* cb;
 	int tag;
 	int start;
 	int end;
+	u64 end64;		// absolute expiry time, only valid if end != -1
+	int heap_index;	// position in the event queue, -1 if not scheduled
+};
+
+/*
+	Scheduler event traces, replayed by the sched_bench tool.
+
+	While settings.debug.SchedTraceFrames isn't 0, the next tick starts recording that many
+	1/60 s of emulated time to the schedtrace folder of the data directory.
+	The file holds a header followed by records. Recording starts with a request for each
+	pending event. A callback record is followed by the requests made by the callback and
+	a return record with its return value. When the callback asked to be called again, the
+	return record is followed by the request that reschedules it.
+*/
+#define SCHED_TRACE_EXT ".sct"
+#define SCHED_TRACE_MAGIC 0x43524353		// "SCRC"
+#define SCHED_TRACE_VERSION 1
+
+enum SchedTraceType { SchedTraceRequest, SchedTraceCallback, SchedTraceReturn, SchedTraceEnd };
+
+struct SchedTraceHeader
+{
+	u32 magic;
+	u32 version;
+	u32 id_count;		// registered callbacks
+	u32 reserved;
+};
+
+struct SchedTraceRecord
+{
+	u8 type;			// SchedTraceType
+	u8 reserved;
+	u16 id;
+	s32 value;			// requested cycles or callback return value
+	u64 time;			// sh4_sched_now64()
 };
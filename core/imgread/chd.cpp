@@ -1,36 +1,177 @@
 #include "common.h"
+#include "stdclass.h"
 
 #include "deps/chdr/chd.h"
 
 /* tracks are padded to a multiple of this many frames */
 const uint32_t CD_TRACK_PADDING = 4;
 
+// A decompressed hunk
+struct CHDHunk
+{
+	u32 hunk;		// 0xFFFFFFFF if the slot is empty
+	u32 last_used;
+	u8* data;
+};
+
 struct CHDDisc : Disc
 {
 	chd_file* chd;
-	u8* hunk_mem;
-	u32 old_hunk;
 
 	u32 hunkbytes;
 	u32 sph;
 
+	// LRU cache of decompressed hunks, so that seeking back and forth doesn't decompress them again
+	vector<CHDHunk> hunks;
+	u32 use_count;
+	cMutex cache_lock;		// hunks and the read-ahead range
+	cMutex chd_lock;		// chd_read() isn't reentrant
+	u8* read_mem;			// decompression buffer of the emulation thread
+
+#if !defined(TARGET_NO_THREADS)
+	// The prefetch thread decompresses the hunks the GD-ROM is about to read, from next_hunk to last_hunk
+	cThread prefetch_thread;
+	cResetEvent prefetch_wakeup;
+	u8* prefetch_mem;
+	u32 next_hunk;
+	u32 last_hunk;
+	volatile bool prefetch_running;
+#endif
+
 	CHDDisc()
+#if !defined(TARGET_NO_THREADS)
+		: prefetch_thread(PrefetchThread, this)
+#endif
 	{
 		chd=0;
-		hunk_mem=0;
+		read_mem=0;
+		use_count=0;
+#if !defined(TARGET_NO_THREADS)
+		prefetch_mem=0;
+		next_hunk=1;
+		last_hunk=0;
+		prefetch_running=false;
+#endif
 	}
 
 	bool TryOpen(const char* file);
+	void ReadHunk(u32 hunk, u32 hunk_ofs, u8* dst, u32 size);
+	void ReadAhead(u32 FAD, u32 count) override;
 
 	~CHDDisc()
 	{
-		if (hunk_mem)
-			delete [] hunk_mem;
+#if !defined(TARGET_NO_THREADS)
+		if (prefetch_running)
+		{
+			prefetch_running = false;
+			prefetch_wakeup.Set();
+			prefetch_thread.WaitToEnd();
+		}
+		delete [] prefetch_mem;
+#endif
+		for (size_t i = 0; i < hunks.size(); i++)
+			delete [] hunks[i].data;
+		delete [] read_mem;
 		if (chd)
 			chd_close(chd);
 	}
+
+private:
+	CHDHunk* FindHunk(u32 hunk)
+	{
+		for (size_t i = 0; i < hunks.size(); i++)
+			if (hunks[i].hunk == hunk)
+				return &hunks[i];
+		return NULL;
+	}
+
+	// Decompresses a hunk into mem, then swaps it with the least recently used slot.
+	// mem gets the buffer of the evicted hunk. Called with chd_lock held.
+	CHDHunk* DecompressHunk(u32 hunk, u8*& mem)
+	{
+		chd_error err = chd_read(chd, hunk, mem);
+		if (err != CHDERR_NONE)
+			WARN_LOG(GDROM, "chd: error %d reading hunk %d", err, hunk);
+
+		cache_lock.Lock();
+		CHDHunk* slot = &hunks[0];
+		for (size_t i = 1; i < hunks.size(); i++)
+			if (hunks[i].last_used < slot->last_used)
+				slot = &hunks[i];
+		std::swap(slot->data, mem);
+		slot->hunk = hunk;
+		slot->last_used = ++use_count;
+		cache_lock.Unlock();
+
+		return slot;
+	}
+
+#if !defined(TARGET_NO_THREADS)
+	static void* PrefetchThread(void* param)
+	{
+		CHDDisc* disc = (CHDDisc*)param;
+		while (true)
+		{
+			disc->prefetch_wakeup.Wait();
+			if (!disc->prefetch_running)
+				break;
+			disc->Prefetch();
+		}
+		return NULL;
+	}
+
+	void Prefetch()
+	{
+		while (prefetch_running)
+		{
+			cache_lock.Lock();
+			if (next_hunk > last_hunk)
+			{
+				cache_lock.Unlock();
+				break;
+			}
+			u32 hunk = next_hunk++;
+			bool cached = FindHunk(hunk) != NULL;
+			cache_lock.Unlock();
+			if (cached)
+				continue;
+
+			chd_lock.Lock();
+			// The emulation thread may have needed it first
+			cache_lock.Lock();
+			cached = FindHunk(hunk) != NULL;
+			cache_lock.Unlock();
+			if (!cached)
+				DecompressHunk(hunk, prefetch_mem);
+			chd_lock.Unlock();
+		}
+	}
+#endif
 };
 
+void CHDDisc::ReadHunk(u32 hunk, u32 hunk_ofs, u8* dst, u32 size)
+{
+	cache_lock.Lock();
+	CHDHunk* slot = FindHunk(hunk);
+	if (slot == NULL)
+	{
+		cache_lock.Unlock();
+		// Waits for the prefetch thread if it's decompressing this hunk
+		chd_lock.Lock();
+		cache_lock.Lock();
+		slot = FindHunk(hunk);
+		cache_lock.Unlock();
+		if (slot == NULL)
+			slot = DecompressHunk(hunk, read_mem);
+		// Only decompressing evicts hunks
+		cache_lock.Lock();
+		chd_lock.Unlock();
+	}
+	slot->last_used = ++use_count;
+	memcpy(dst, slot->data + hunk_ofs * (2352 + 96), size);
+	cache_lock.Unlock();
+}
+
 struct CHDTrack : TrackFile
 {
 	CHDDisc* disc;
@@ -52,15 +193,9 @@ struct CHDTrack : TrackFile
 	{
 		u32 fad_offs = FAD + Offset;
 		u32 hunk=(fad_offs)/disc->sph;
-		if (disc->old_hunk!=hunk)
-		{
-			chd_read(disc->chd,hunk,disc->hunk_mem); //CHDERR_NONE
-			disc->old_hunk = hunk;
-		}
-
 		u32 hunk_ofs=fad_offs%disc->sph;
 
-		memcpy(dst,disc->hunk_mem+hunk_ofs*(2352+96),fmt);
+		disc->ReadHunk(hunk, hunk_ofs, dst, fmt);
 
 		if (swap_bytes)
 		{
@@ -80,6 +215,28 @@ struct CHDTrack : TrackFile
 	}
 };
 
+void CHDDisc::ReadAhead(u32 FAD, u32 count)
+{
+#if !defined(TARGET_NO_THREADS)
+	if (!prefetch_running || count == 0)
+		return;
+	for (size_t i = tracks.size(); i-- > 0; )
+	{
+		if (FAD < tracks[i].StartFAD || FAD > tracks[i].EndFAD)
+			continue;
+		// Stay in the track, and leave half the cache to the hunks being read
+		u32 end = min(FAD + count - 1, tracks[i].EndFAD);
+		u32 offset = ((CHDTrack*)tracks[i].file)->Offset;
+		cache_lock.Lock();
+		next_hunk = (FAD + offset) / sph;
+		last_hunk = min((end + offset) / sph, next_hunk + (u32)hunks.size() / 2 - 1);
+		cache_lock.Unlock();
+		prefetch_wakeup.Set();
+		break;
+	}
+#endif
+}
+
 bool CHDDisc::TryOpen(const char* file)
 {
 	chd_error err=chd_open(file,CHD_OPEN_READ,0,&chd);
@@ -95,8 +252,7 @@ bool CHDDisc::TryOpen(const char* file)
 	const chd_header* head = chd_get_header(chd);
 
 	hunkbytes = head->hunkbytes;
-	hunk_mem = new u8[hunkbytes];
-	old_hunk=0xFFFFFFF;
+	read_mem = new u8[hunkbytes];
 
 	sph = hunkbytes/(2352+96);
 
@@ -106,6 +262,23 @@ bool CHDDisc::TryOpen(const char* file)
 		return false;
 	}
 
+	hunks.resize(max(settings.imgread.ChdCacheHunks, 2u));
+	for (size_t i = 0; i < hunks.size(); i++)
+	{
+		hunks[i].hunk = 0xFFFFFFFF;
+		hunks[i].last_used = 0;
+		hunks[i].data = new u8[hunkbytes];
+	}
+#if !defined(TARGET_NO_THREADS)
+	if (settings.imgread.ChdReadAhead)
+	{
+		prefetch_mem = new u8[hunkbytes];
+		prefetch_running = true;
+		prefetch_thread.Start();
+	}
+#endif
+	INFO_LOG(GDROM, "chd: caching %d hunks of %d sectors, read-ahead %s", (int)hunks.size(), sph, settings.imgread.ChdReadAhead ? "on" : "off");
+
 	u32 tag;
 	u8 flags;
 	char temp[512];
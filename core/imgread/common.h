@@ -111,6 +111,8 @@ struct Session
 struct TrackFile
 {
 	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)=0;
+	// Reads count sectors converted to fmt straight into dst. Returns false if the track can't, then sectors are read one by one.
+	virtual bool ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt) { return false; }
 	virtual ~TrackFile() {};
 };
 
@@ -172,6 +174,14 @@ struct Disc
 
 		while(count)
 		{
+			u32 run = ReadTrackSectors(FAD,count,dst,fmt);
+			if (run)
+			{
+				dst+=run*fmt;
+				FAD+=run;
+				count-=run;
+				continue;
+			}
 			if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
 			{
 				//TODO: Proper sector conversions
@@ -210,6 +220,28 @@ struct Disc
 			count--;
 		}
 	}
+	// Reads as many sectors as possible from the track holding FAD in one go. Returns how many, 0 if the track file can't.
+	u32 ReadTrackSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
+	{
+		for (size_t i=tracks.size();i-->0;)
+		{
+			const Track& track=tracks[i];
+			if (FAD<track.StartFAD || (FAD>track.EndFAD && track.EndFAD!=0))
+				continue;
+			if (!track.file)
+				return 0;
+			// Stop at the end of the track or where a following track starts
+			if (track.EndFAD!=0)
+				count=min(count,track.EndFAD+1-FAD);
+			for (size_t j=i+1;j<tracks.size();j++)
+				if (tracks[j].StartFAD>FAD)
+					count=min(count,tracks[j].StartFAD-FAD);
+			return track.file->ReadSectors(FAD,count,dst,fmt) ? count : 0;
+		}
+		return 0;
+	}
+	// Sectors FAD to FAD + count - 1 are about to be read
+	virtual void ReadAhead(u32 FAD, u32 count) { }
 	virtual ~Disc() 
 	{
 		for (size_t i=0;i<tracks.size();i++)
@@ -270,6 +302,9 @@ struct RawTrackFile : TrackFile
 	s32 offset;
 	u32 fmt;
 	bool cleanup;
+	// The image file mapped in memory, NULL if it can't be
+	const u8* data;
+	size_t data_size;
 
 	RawTrackFile(core_file* file,u32 file_offs,u32 first_fad,u32 secfmt)
 	{
@@ -278,6 +313,36 @@ struct RawTrackFile : TrackFile
 		this->offset=file_offs-first_fad*secfmt;
 		this->fmt=secfmt;
 		this->cleanup=true;
+		this->data=core_fmap(file,&data_size);
+	}
+
+	// Sectors FAD to FAD + count - 1 in the mapped file, NULL if they aren't all there
+	const u8* MappedSectors(u32 FAD,u32 count)
+	{
+		s64 start=offset+(s64)FAD*fmt;
+		if (data==NULL || start<0 || start+(s64)count*fmt>(s64)data_size)
+			return NULL;
+		return data+start;
+	}
+
+	virtual bool ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
+	{
+		const u8* src=MappedSectors(FAD,count);
+		if (src==NULL)
+			return false;
+		if (fmt==this->fmt && (fmt==2048 || fmt==2352))
+		{
+			memcpy(dst,src,count*fmt);
+			return true;
+		}
+		if (fmt==2048 && this->fmt==2352)
+		{
+			// Same as ConvertSector: mode 1 data follows the header, mode 2 data the sub-header
+			for (u32 i=0;i<count;i++,src+=2352,dst+=2048)
+				memcpy(dst,src+(src[15]==1 ? 0x10 : 0x18),2048);
+			return true;
+		}
+		return false;
 	}
 
 	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)
@@ -302,8 +367,14 @@ struct RawTrackFile : TrackFile
             break;
       }
 
-		core_fseek(file,offset+FAD*fmt,SEEK_SET);
-		core_fread(file, dst, fmt);
+		const u8* src=MappedSectors(FAD,1);
+		if (src!=NULL)
+			memcpy(dst,src,fmt);
+		else
+		{
+			core_fseek(file,offset+FAD*fmt,SEEK_SET);
+			core_fread(file, dst, fmt);
+		}
 	}
 	virtual ~RawTrackFile()
 	{
@@ -1,24 +1,191 @@
+/*
+   Audio output to the frontend.
+
+   The AICA writes its samples to a lock-free single producer, single consumer ring on the emulator thread,
+   and retro_run sends them to the frontend with audio_flush.
+   Without threaded rendering, the emulator runs inside retro_run: the samples of the frame are sent as is.
+   With threaded rendering, the emulator thread runs a bit ahead or behind retro_run, so the samples are
+   resampled with dynamic rate control: the ratio moves by at most MaxRateDelta to keep about TargetFill
+   frames in the ring. This absorbs the jitter between the two threads without crackles or latency build-up.
+   The emulator thread isn't always paced by the render thread (frame buffer writes, 30 fps games, render queue
+   depth above 1), so when the speed is limited, WriteSample waits for the next audio_flush once the ring holds
+   more than LimitFill frames. The rate control can only absorb small speed differences.
+*/
 #include "types.h"
 #include "emulator.h"
 
+#include <atomic>
+#include <cmath>
 #include <libretro.h>
+#include <audio/audio_resampler.h>
 
 extern retro_audio_sample_batch_t audio_batch_cb;
 
-SoundFrame RingBuffer[SAMPLE_COUNT];
+#define RING_SIZE 8192        // frames, must be a power of 2
+static SoundFrame ring[RING_SIZE];
+static std::atomic<u32> ring_head;   // next frame to read
+static std::atomic<u32> ring_tail;   // next frame to write
+
+static const double SampleRate = 44100.0;
+static const u32 TargetFill = 2048;            // about 46 ms
+static const u32 LimitFill = TargetFill + TargetFill / 4;   // the emulator thread waits above this
+static const u32 MaxFill = TargetFill * 3;     // more is dropped
+static const u32 FlushTimeout = 50;            // ms
+static const double MaxRateDelta = 0.005;
+
+static double frame_rate = 60.0;
+static double out_frames_acc;
+static bool primed;
+static void *resampler;
+static cResetEvent audio_flushed;
+static u32 dropped_frames;
+static u32 underruns;
+
+static float in_buf[RING_SIZE * 2];
+static float out_buf[RING_SIZE * 4];
+static s16 out_samples[RING_SIZE * 4];
 
 void WriteSample(s16 r, s16 l)
 {
-   static const u32 RingBufferByteSize = sizeof(RingBuffer);
-   static const u32 RingBufferSampleCount = SAMPLE_COUNT;
-   static volatile u32 WritePtr;  //last written sample
-   static volatile u32 ReadPtr;   //next sample to read
-	const u32 ptr = (WritePtr+1)%RingBufferSampleCount;
-	RingBuffer[ptr].r=r;
-	RingBuffer[ptr].l=l;
-	WritePtr=ptr;
-
-   if (WritePtr==(SAMPLE_COUNT-1))
-      if ( dc_is_running() && (!settings.rend.ThreadedRendering || settings.aica.LimitFPS) )
-         audio_batch_cb((const int16_t*)RingBuffer, SAMPLE_COUNT);
+   u32 tail = ring_tail.load(std::memory_order_relaxed);
+   u32 fill = tail - ring_head.load(std::memory_order_acquire);
+   if (fill >= RING_SIZE)
+   {
+      // Fast-forward, or the frontend isn't reading
+      dropped_frames++;
+      return;
+   }
+   SoundFrame& frame = ring[tail % RING_SIZE];
+   frame.l = l;
+   frame.r = r;
+   ring_tail.store(tail + 1, std::memory_order_release);
+
+   // Only with threaded rendering: otherwise audio_flush runs after dc_run on this thread
+   if (fill >= LimitFill && settings.rend.ThreadedRendering && settings.aica.LimitFPS && !settings.pvr.Headless)
+      // Bounded, so that a frontend that stops calling retro_run can't block the emulator for good
+      audio_flushed.Wait(FlushTimeout);
+}
+
+void audio_set_frame_rate(double fps)
+{
+   frame_rate = fps;
+}
+
+// Calls f(frames, count) for the first count frames of the ring, in at most 2 parts, and removes them
+template<typename F>
+static void read_frames(u32 count, F f)
+{
+   u32 head = ring_head.load(std::memory_order_relaxed);
+   u32 offset = head % RING_SIZE;
+   u32 first = std::min(count, RING_SIZE - offset);
+   f(&ring[offset], first);
+   if (first < count)
+      f(&ring[0], count - first);
+   ring_head.store(head + count, std::memory_order_release);
+}
+
+static void send_silence(u32 frames)
+{
+   memset(out_samples, 0, frames * sizeof(SoundFrame));
+   audio_batch_cb(out_samples, frames);
+}
+
+static void flush_resampled(u32 avail)
+{
+   if (resampler == nullptr)
+   {
+      resampler_simd_mask_t mask = 0;
+#ifdef __SSE__
+      mask |= RESAMPLER_SIMD_SSE;
+#endif
+      resampler = sinc_resampler.init(nullptr, 1.0, RESAMPLER_QUALITY_NORMAL, mask);
+      if (resampler == nullptr)
+      {
+         WARN_LOG(AUDIO, "Can't create the audio resampler");
+         read_frames(avail, [](const SoundFrame *frames, u32 count) { audio_batch_cb((const int16_t *)frames, count); });
+         return;
+      }
+   }
+   out_frames_acc += SampleRate / frame_rate;
+   u32 out_frames = (u32)out_frames_acc;
+   out_frames_acc -= out_frames;
+
+   if (!primed)
+   {
+      // Wait for the emulator thread to get ahead
+      if (avail < TargetFill)
+      {
+         send_silence(out_frames);
+         return;
+      }
+      primed = true;
+   }
+   if (avail > MaxFill)
+   {
+      // The frontend was stalled or the emulator was fast-forwarding
+      dropped_frames += avail - TargetFill;
+      read_frames(avail - TargetFill, [](const SoundFrame *frames, u32 count) {});
+      avail = TargetFill;
+   }
+   // Output frames per input frame: consume faster when the ring fills up
+   double fill = ((double)avail - TargetFill) / TargetFill;
+   double ratio = 1.0 / (1.0 + MaxRateDelta * std::max(-1.0, std::min(1.0, fill)));
+   u32 in_frames = (u32)lround(out_frames / ratio);
+   if (in_frames > avail)
+   {
+      // Underrun: play what's left and wait for the ring to fill up again
+      in_frames = avail;
+      primed = false;
+      underruns++;
+   }
+   if (in_frames == 0)
+      return;
+
+   float *in = in_buf;
+   read_frames(in_frames, [&in](const SoundFrame *frames, u32 count) {
+      for (u32 i = 0; i < count; i++)
+      {
+         *in++ = frames[i].l / 32768.f;
+         *in++ = frames[i].r / 32768.f;
+      }
+   });
+   resampler_data data;
+   data.data_in = in_buf;
+   data.data_out = out_buf;
+   data.input_frames = in_frames;
+   data.output_frames = 0;
+   data.ratio = ratio;
+   sinc_resampler.process(resampler, &data);
+
+   for (size_t i = 0; i < data.output_frames * 2; i++)
+      out_samples[i] = (s16)std::max(-32768.f, std::min(32767.f, roundf(out_buf[i] * 32768.f)));
+   audio_batch_cb(out_samples, data.output_frames);
+}
+
+// Sends the samples written since the last call to the frontend. Called by retro_run.
+void audio_flush(bool resample)
+{
+   u32 avail = ring_tail.load(std::memory_order_acquire) - ring_head.load(std::memory_order_relaxed);
+   // No audio output in headless mode: the frontend would sync on it
+   if (settings.pvr.Headless)
+      read_frames(avail, [](const SoundFrame *frames, u32 count) {});
+   else if (resample)
+      flush_resampled(avail);
+   else
+      read_frames(avail, [](const SoundFrame *frames, u32 count) { audio_batch_cb((const int16_t *)frames, count); });
+   audio_flushed.Set();
+}
+
+void audio_term()
+{
+   if (dropped_frames != 0 || underruns != 0)
+      NOTICE_LOG(AUDIO, "%u audio frames dropped, %u underruns", dropped_frames, underruns);
+   dropped_frames = 0;
+   underruns = 0;
+   if (resampler != nullptr)
+      sinc_resampler.free(resampler);
+   resampler = nullptr;
+   primed = false;
+   out_frames_acc = 0;
+   ring_head.store(ring_tail.load());
 }
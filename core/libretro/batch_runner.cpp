@@ -0,0 +1,424 @@
+/*
+	batch_runner: runs several headless instances of the core in one process, on a pool of threads.
+
+	Built with "make batch_runner" (Linux only).
+	Usage: batch_runner [-n instances] [-t threads] [-f frames] [-s system_dir] [-d work_dir] [-o option=value]... [-r] core.so content...
+
+	The core keeps the state of the emulated system in globals (sh4rcb, pvrrc, the scheduler, the AICA channels,
+	the block manager...), so each instance is a separate copy of the core, loaded with dlmopen() in its own
+	link namespace. glibc has room for 16 namespaces, hence MAX_INSTANCES, but only reserves static TLS for 4 by
+	default: the runner restarts itself with the glibc.rtld.nns tunable set.
+	Instance i runs on thread i % threads, which runs one frame of each of its instances in turn.
+
+	Contents are given to the instances in turn. Each instance gets its own system directory, <work_dir>/<i>,
+	with a copy of the files in <system_dir>/dc, and saves there too.
+	Core options default to the headless software renderer without threaded rendering. Frames can be written
+	out with -o reicast_frame_output=png.
+	The frames are run as fast as possible, and the core is told it is fast-forwarding. With -r, each thread runs
+	its frames at the frame rate of the content instead, like a frontend synced to the display, and the core
+	isn't fast-forwarding.
+*/
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "libretro.h"
+
+#define MAX_INSTANCES 14
+
+struct Instance
+{
+	int index;
+	std::string content;
+	std::string system_dir;
+	void *handle;
+	unsigned frames;
+	double run_time;
+
+	void (*retro_set_environment)(retro_environment_t);
+	void (*retro_set_video_refresh)(retro_video_refresh_t);
+	void (*retro_set_audio_sample)(retro_audio_sample_t);
+	void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+	void (*retro_set_input_poll)(retro_input_poll_t);
+	void (*retro_set_input_state)(retro_input_state_t);
+	void (*retro_init)(void);
+	void (*retro_deinit)(void);
+	bool (*retro_load_game)(const struct retro_game_info *);
+	void (*retro_unload_game)(void);
+	void (*retro_run)(void);
+	void (*retro_get_system_av_info)(retro_system_av_info *);
+
+	bool environment(unsigned cmd, void *data);
+};
+
+static Instance instances[MAX_INSTANCES];
+static std::map<std::string, std::string> options;
+static std::mutex load_mutex;
+static std::string core_path;
+static unsigned frame_count = 3600;
+static bool real_time;
+
+static void log_printf(int index, enum retro_log_level level, const char *fmt, va_list args)
+{
+	static const char *level_names[] = { "D", "I", "W", "E" };
+
+	char line[1024];
+	vsnprintf(line, sizeof(line), fmt, args);
+	size_t len = strlen(line);
+	printf("[%d] %s: %s%s", index, level_names[level & 3], line, len > 0 && line[len - 1] == '\n' ? "" : "\n");
+}
+
+bool Instance::environment(unsigned cmd, void *data)
+{
+	switch (cmd)
+	{
+	case RETRO_ENVIRONMENT_GET_VARIABLE:
+		{
+			retro_variable *var = (retro_variable *)data;
+			auto it = options.find(var->key);
+			if (it == options.end())
+				return false;
+			var->value = it->second.c_str();
+			return true;
+		}
+
+	case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+	case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+		*(const char **)data = system_dir.c_str();
+		return true;
+
+	case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+		*(bool *)data = true;
+		return true;
+
+	case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+		return true;
+
+	case RETRO_ENVIRONMENT_GET_FASTFORWARDING:
+		*(bool *)data = !real_time;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// The libretro callbacks have no user data: each instance gets its own copy of them
+template<int N>
+struct Callbacks
+{
+	static bool environment(unsigned cmd, void *data)
+	{
+		if (cmd == RETRO_ENVIRONMENT_GET_LOG_INTERFACE)
+		{
+			((retro_log_callback *)data)->log = log;
+			return true;
+		}
+		return instances[N].environment(cmd, data);
+	}
+	static void log(enum retro_log_level level, const char *fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		log_printf(N, level, fmt, args);
+		va_end(args);
+	}
+};
+
+static const retro_environment_t environment_callbacks[MAX_INSTANCES] = {
+	Callbacks<0>::environment, Callbacks<1>::environment, Callbacks<2>::environment, Callbacks<3>::environment,
+	Callbacks<4>::environment, Callbacks<5>::environment, Callbacks<6>::environment, Callbacks<7>::environment,
+	Callbacks<8>::environment, Callbacks<9>::environment, Callbacks<10>::environment, Callbacks<11>::environment,
+	Callbacks<12>::environment, Callbacks<13>::environment,
+};
+
+static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) { }
+static void audio_sample(int16_t left, int16_t right) { }
+static size_t audio_sample_batch(const int16_t *data, size_t frames) { return frames; }
+static void input_poll() { }
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id) { return 0; }
+
+static bool make_dir(const std::string& path)
+{
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+static bool copy_file(const std::string& from, const std::string& to)
+{
+	FILE *in = fopen(from.c_str(), "rb");
+	if (in == NULL)
+		return false;
+	FILE *out = fopen(to.c_str(), "wb");
+	bool copied = out != NULL;
+	char buf[65536];
+	size_t n;
+	while (copied && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+		copied = fwrite(buf, 1, n, out) == n;
+	fclose(in);
+	if (out != NULL)
+		copied = fclose(out) == 0 && copied;
+
+	return copied;
+}
+
+// <work_dir>/<index>/dc gets a copy of the files in <system_dir>/dc
+static bool setup_system_dir(Instance& instance, const std::string& system_dir, const std::string& work_dir)
+{
+	instance.system_dir = work_dir + "/" + std::to_string(instance.index);
+	if (!make_dir(work_dir) || !make_dir(instance.system_dir) || !make_dir(instance.system_dir + "/dc"))
+	{
+		fprintf(stderr, "Can't create %s/dc: %s\n", instance.system_dir.c_str(), strerror(errno));
+		return false;
+	}
+	std::string from_dir = system_dir + "/dc/";
+	DIR *dir = opendir(from_dir.c_str());
+	if (dir == NULL)
+		return true;
+	bool copied = true;
+	while (dirent *entry = readdir(dir))
+	{
+		struct stat st;
+		std::string from = from_dir + entry->d_name;
+		if (stat(from.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		std::string to = instance.system_dir + "/dc/" + entry->d_name;
+		if (!copy_file(from, to))
+		{
+			fprintf(stderr, "Can't copy %s to %s\n", from.c_str(), to.c_str());
+			copied = false;
+			break;
+		}
+	}
+	closedir(dir);
+
+	return copied;
+}
+
+template<typename T>
+static bool load_symbol(Instance& instance, T& fn, const char *name)
+{
+	fn = (T)dlsym(instance.handle, name);
+	if (fn == NULL)
+		fprintf(stderr, "[%d] %s not found in %s\n", instance.index, name, core_path.c_str());
+	return fn != NULL;
+}
+
+static bool load_instance(Instance& instance)
+{
+	// A new link namespace gives the instance its own copy of the core globals
+	instance.handle = dlmopen(LM_ID_NEWLM, core_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (instance.handle == NULL)
+	{
+		fprintf(stderr, "[%d] Can't load %s: %s\n", instance.index, core_path.c_str(), dlerror());
+		return false;
+	}
+	if (!load_symbol(instance, instance.retro_set_environment, "retro_set_environment")
+			|| !load_symbol(instance, instance.retro_set_video_refresh, "retro_set_video_refresh")
+			|| !load_symbol(instance, instance.retro_set_audio_sample, "retro_set_audio_sample")
+			|| !load_symbol(instance, instance.retro_set_audio_sample_batch, "retro_set_audio_sample_batch")
+			|| !load_symbol(instance, instance.retro_set_input_poll, "retro_set_input_poll")
+			|| !load_symbol(instance, instance.retro_set_input_state, "retro_set_input_state")
+			|| !load_symbol(instance, instance.retro_init, "retro_init")
+			|| !load_symbol(instance, instance.retro_deinit, "retro_deinit")
+			|| !load_symbol(instance, instance.retro_load_game, "retro_load_game")
+			|| !load_symbol(instance, instance.retro_unload_game, "retro_unload_game")
+			|| !load_symbol(instance, instance.retro_run, "retro_run")
+			|| !load_symbol(instance, instance.retro_get_system_av_info, "retro_get_system_av_info"))
+		return false;
+
+	instance.retro_set_environment(environment_callbacks[instance.index]);
+	instance.retro_set_video_refresh(video_refresh);
+	instance.retro_set_audio_sample(audio_sample);
+	instance.retro_set_audio_sample_batch(audio_sample_batch);
+	instance.retro_set_input_poll(input_poll);
+	instance.retro_set_input_state(input_state);
+	instance.retro_init();
+
+	retro_game_info game = {};
+	game.path = instance.content.c_str();
+	if (!instance.retro_load_game(&game))
+	{
+		fprintf(stderr, "[%d] Can't load %s\n", instance.index, game.path);
+		instance.retro_deinit();
+		return false;
+	}
+
+	return true;
+}
+
+static void worker_thread(std::vector<Instance *> thread_instances)
+{
+	std::vector<Instance *> running;
+	for (Instance *instance : thread_instances)
+	{
+		// Loading isn't thread safe: dc_init() sets up signal handlers and shared memory
+		std::lock_guard<std::mutex> lock(load_mutex);
+		if (load_instance(*instance))
+			running.push_back(instance);
+	}
+	std::chrono::duration<double> frame_time(0);
+	if (real_time && !running.empty())
+	{
+		retro_system_av_info info = {};
+		running[0]->retro_get_system_av_info(&info);
+		frame_time = std::chrono::duration<double>(1.0 / (info.timing.fps > 0 ? info.timing.fps : 60.0));
+	}
+	// One frame of each instance in turn, until they have all done frame_count frames
+	auto next_frame = std::chrono::steady_clock::now();
+	for (unsigned frame = 0; frame < frame_count; frame++)
+	{
+		for (Instance *instance : running)
+		{
+			auto start = std::chrono::steady_clock::now();
+			instance->retro_run();
+			instance->run_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			instance->frames++;
+		}
+		if (real_time)
+		{
+			next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_time);
+			std::this_thread::sleep_until(next_frame);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(load_mutex);
+	for (Instance *instance : running)
+	{
+		instance->retro_unload_game();
+		instance->retro_deinit();
+		// Not unloaded: the core signal handler stays installed, and chains to the one of the previous instance
+	}
+}
+
+static void usage()
+{
+	fprintf(stderr, "Usage: batch_runner [-n instances] [-t threads] [-f frames] [-s system_dir] [-d work_dir] [-o option=value]... [-r] core.so content...\n");
+	exit(1);
+}
+
+// Each namespace loads its own libc, which needs room in the static TLS area
+static void set_tunables(char *argv[])
+{
+	const char *tunables = getenv("GLIBC_TUNABLES");
+	if (tunables != NULL && strstr(tunables, "glibc.rtld.nns") != NULL)
+		return;
+	std::string value = "glibc.rtld.nns=16:glibc.rtld.optional_static_tls=16384";
+	if (tunables != NULL && tunables[0] != '\0')
+		value = std::string(tunables) + ":" + value;
+	setenv("GLIBC_TUNABLES", value.c_str(), 1);
+	execv("/proc/self/exe", argv);
+	perror("Can't restart with GLIBC_TUNABLES set");
+}
+
+int main(int argc, char *argv[])
+{
+	set_tunables(argv);
+
+	int instance_count = 0;
+	int thread_count = std::thread::hardware_concurrency();
+	std::string system_dir = ".";
+	std::string work_dir = "batch";
+	std::vector<std::string> contents;
+
+	options["reicast_renderer"] = "headless";
+	options["reicast_threaded_rendering"] = "disabled";
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r"))
+			real_time = true;
+		else if (argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0' && i + 1 < argc)
+		{
+			const char *arg = argv[++i];
+			switch (argv[i - 1][1])
+			{
+			case 'n':
+				instance_count = atoi(arg);
+				break;
+			case 't':
+				thread_count = atoi(arg);
+				break;
+			case 'f':
+				frame_count = atoi(arg);
+				break;
+			case 's':
+				system_dir = arg;
+				break;
+			case 'd':
+				work_dir = arg;
+				break;
+			case 'o':
+				{
+					const char *eq = strchr(arg, '=');
+					if (eq == NULL)
+						usage();
+					options[std::string(arg, eq - arg)] = eq + 1;
+				}
+				break;
+			default:
+				usage();
+			}
+		}
+		else if (core_path.empty())
+			// dlmopen() only looks in the current directory for a path
+			core_path = strchr(argv[i], '/') == NULL ? std::string("./") + argv[i] : argv[i];
+		else
+			contents.push_back(argv[i]);
+	}
+	if (core_path.empty() || contents.empty())
+		usage();
+	if (instance_count <= 0)
+		instance_count = contents.size();
+	if (instance_count > MAX_INSTANCES)
+	{
+		fprintf(stderr, "At most %d instances\n", MAX_INSTANCES);
+		instance_count = MAX_INSTANCES;
+	}
+	thread_count = std::max(1, std::min(thread_count, instance_count));
+
+	for (int i = 0; i < instance_count; i++)
+	{
+		instances[i].index = i;
+		instances[i].content = contents[i % contents.size()];
+		if (!setup_system_dir(instances[i], system_dir, work_dir))
+			return 1;
+	}
+	printf("%d instances on %d threads, %u frames%s\n", instance_count, thread_count, frame_count, real_time ? " in real time" : "");
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; t++)
+	{
+		std::vector<Instance *> thread_instances;
+		for (int i = t; i < instance_count; i += thread_count)
+			thread_instances.push_back(&instances[i]);
+		threads.emplace_back(worker_thread, thread_instances);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	unsigned total_frames = 0;
+	for (int i = 0; i < instance_count; i++)
+	{
+		const Instance& instance = instances[i];
+		printf("[%d] %s: %u frames, %.1f fps in retro_run\n", i, instance.content.c_str(), instance.frames,
+				instance.run_time > 0 ? instance.frames / instance.run_time : 0.0);
+		total_frames += instance.frames;
+	}
+	printf("Total: %u frames in %.2f s, %.1f fps\n", total_frames, total_time, total_time > 0 ? total_frames / total_time : 0.0);
+
+	return total_frames > 0 ? 0 : 1;
+}
@@ -305,6 +305,31 @@ static void sigill_handler(int sn, siginfo_t * si, void *segfault_ctx)
 extern "C" char __start__;
 #endif // HAVE_LIBNX
 
+static struct sigaction old_sigsegv;
+static struct sigaction old_sigill;
+static struct sigaction old_sigbus;
+
+#if !defined(HAVE_LIBNX) && !defined(VITA)
+// Passes a signal that isn't ours to the action installed before ours.
+// Returns false if there's none and the signal is a crash.
+static bool chain_signal(int sn, siginfo_t *si, void *segfault_ctx)
+{
+   const struct sigaction& old = sn == SIGILL ? old_sigill : sn == SIGBUS ? old_sigbus : old_sigsegv;
+   if (old.sa_flags & SA_SIGINFO)
+   {
+      if (old.sa_sigaction == NULL)
+         return false;
+      old.sa_sigaction(sn, si, segfault_ctx);
+      return true;
+   }
+   if (old.sa_handler == SIG_DFL)
+      return false;
+   if (old.sa_handler != SIG_IGN)
+      old.sa_handler(sn);
+   return true;
+}
+#endif
+
 static void signal_handler(int sn, siginfo_t * si, void *segfault_ctx)
 {
    rei_host_context_t ctx;
@@ -370,6 +395,13 @@ static void signal_handler(int sn, siginfo_t * si, void *segfault_ctx)
 #else
 #error JIT: Not supported arch
 #endif
+#endif
+#if !defined(HAVE_LIBNX) && !defined(VITA)
+   // Not ours. Another copy of the core loaded in this process (see batch_runner.cpp) may own the address.
+   else if (chain_signal(sn, si, segfault_ctx))
+   {
+      // Handled by the previous action
+   }
 #endif
    else
    {
@@ -389,11 +421,6 @@ static void signal_handler(int sn, siginfo_t * si, void *segfault_ctx)
 #endif
 
 #ifndef _WIN32
-#if !defined(TARGET_NO_EXCEPTIONS)
-static struct sigaction old_sigsegv;
-static struct sigaction old_sigill;
-#endif
-
 static int exception_handler_install_platform(void)
 {
 #if defined(HAVE_LIBNX) || defined(VITA)
@@ -409,7 +436,7 @@ static int exception_handler_install_platform(void)
 
 #ifdef __MACH__
    /* this is broken on OSX/iOS/Mach in general */
-   sigaction(SIGBUS, &new_sa, &old_sigsegv);
+   sigaction(SIGBUS, &new_sa, &old_sigbus);
    new_sa.sa_sigaction = sigill_handler;
 #endif
 
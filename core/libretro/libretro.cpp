@@ -71,7 +71,12 @@ char* strdup(const char *str)
 #include "../hw/aica/dsp.h"
 #include "log/LogManager.h"
 #include "cheats.h"
+#include "rewind.h"
 #include "rend/CustomTexture.h"
+#ifdef HAVE_SOFTREND
+#include "rend/soft/softrend.h"
+#include "rend/soft/softrend_output.h"
+#endif
 
 #if defined(_XBOX) || defined(_WIN32)
 char slash = '\\';
@@ -130,6 +135,7 @@ static int astick_deadzone = 0;
 static int trigger_deadzone = 0;
 static bool digital_triggers = false;
 static bool allow_service_buttons = false;
+static int rewind_button = -1;
 
 static bool libretro_supports_bitmasks = false;
 
@@ -195,6 +201,9 @@ static retro_rumble_interface rumble;
 
 void FlushCache();	// Arm dynarec (arm and x86 only)
 bool rend_single_frame();
+void audio_flush(bool resample);
+void audio_set_frame_rate(double fps);
+void audio_term();
 void rend_cancel_emu_wait();
 bool acquire_mainloop_lock();
 
@@ -234,7 +243,9 @@ u64 pixel_buffer_size = 512 * 1024 * 1024;	// Initial size 512 MB
 static void *emu_thread_func(void *)
 {
     emu_in_thread = true ;
+#ifdef VITA
 	sceKernelOpenVMDomain();
+#endif
     while ( true )
     {
     	performed_serialization = false ;
@@ -438,6 +449,12 @@ static void set_variable_visibility(void)
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = CORE_OPTION_NAME "_per_content_vmus";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = CORE_OPTION_NAME "_rewind";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = CORE_OPTION_NAME "_rewind_buffer_size";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = CORE_OPTION_NAME "_rewind_depth";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
    option_display.key = CORE_OPTION_NAME "_show_vmu_screen_settings";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
@@ -454,6 +471,10 @@ static void set_variable_visibility(void)
 
    option_display.key = CORE_OPTION_NAME "_delay_frame_swapping";
    environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = CORE_OPTION_NAME "_render_queue_depth";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
+   option_display.key = CORE_OPTION_NAME "_render_queue_latest_only";
+   environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display);
 
    // Only for per-pixel renderers
    option_display.visible = settings.pvr.rend == 3 || settings.pvr.rend == 5;
@@ -600,6 +621,42 @@ static void update_variables(bool first_startup)
 
       DEBUG_LOG(COMMON, "Got size: %u x %u.\n", screen_width, screen_height);
    }
+#ifdef HAVE_SOFTREND
+   if (first_startup)
+   {
+      var.key = CORE_OPTION_NAME "_renderer";
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      {
+         settings.pvr.Headless = !strcmp(var.value, "headless");
+         if (!strcmp(var.value, "software") || settings.pvr.Headless)
+            settings.pvr.rend = 2;
+      }
+
+      var.key = CORE_OPTION_NAME "_frame_output";
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      {
+         if (!strcmp(var.value, "shm"))
+            settings.pvr.FrameOutput = FrameOutputSharedMemory;
+         else if (!strcmp(var.value, "raw"))
+            settings.pvr.FrameOutput = FrameOutputRaw;
+         else if (!strcmp(var.value, "png"))
+            settings.pvr.FrameOutput = FrameOutputPng;
+         else
+            settings.pvr.FrameOutput = FrameOutputNone;
+      }
+   }
+   if (settings.pvr.rend == 2)
+   {
+      screen_width = MAX_RENDER_WIDTH;
+      screen_height = MAX_RENDER_HEIGHT;
+   }
+
+   var.key = CORE_OPTION_NAME "_softrend_simd";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.pvr.SoftRendAVX2 = strcmp(var.value, "sse2") != 0;
+   else
+      settings.pvr.SoftRendAVX2 = true;
+#endif
 
 
    var.key = CORE_OPTION_NAME "_cpu_mode";
@@ -636,6 +693,20 @@ static void update_variables(bool first_startup)
    else
       GDROM_TICK      = 1500000;
 
+   var.key = CORE_OPTION_NAME "_chd_cache_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.imgread.ChdCacheHunks = max(2, atoi(var.value));
+   else
+      settings.imgread.ChdCacheHunks = 64;
+
+   var.key = CORE_OPTION_NAME "_chd_read_ahead";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.imgread.ChdReadAhead = !strcmp(var.value, "enabled");
+   else
+      settings.imgread.ChdReadAhead = true;
+
    var.key = CORE_OPTION_NAME "_alpha_sorting";
    int previous_renderer = settings.pvr.rend;
 
@@ -841,6 +912,48 @@ static void update_variables(bool first_startup)
          settings.dynarec.DisableDivMatching = 1;
    }
 
+   var.key = CORE_OPTION_NAME "_dynarec_block_cache";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.dynarec.BlockCache = !strcmp("enabled", var.value);
+   else
+      settings.dynarec.BlockCache = false;
+
+   var.key = CORE_OPTION_NAME "_dynarec_background_optimizer";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.dynarec.BackgroundOptimizer = !strcmp("enabled", var.value);
+   else
+      settings.dynarec.BackgroundOptimizer = false;
+
+   var.key = CORE_OPTION_NAME "_rewind";
+
+   rewind_button = -1;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp("l3", var.value))
+         rewind_button = RETRO_DEVICE_ID_JOYPAD_L3;
+      else if (!strcmp("r3", var.value))
+         rewind_button = RETRO_DEVICE_ID_JOYPAD_R3;
+   }
+   settings.rewind.Enable = rewind_button >= 0;
+   if (!settings.rewind.Enable)
+      rewind_Term();
+
+   var.key = CORE_OPTION_NAME "_rewind_buffer_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.rewind.BufferSize = atoi(var.value);
+   else
+      settings.rewind.BufferSize = 128;
+
+   var.key = CORE_OPTION_NAME "_rewind_depth";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.rewind.Depth = atoi(var.value);
+   else
+      settings.rewind.Depth = 30;
+
    var.key = CORE_OPTION_NAME "_force_wince";
 
    settings.dreamcast.ForceWinCE = false;
@@ -973,6 +1086,18 @@ static void update_variables(bool first_startup)
    else
    	settings.rend.DelayFrameSwapping = false;
 
+   var.key = CORE_OPTION_NAME "_render_queue_depth";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	   settings.pvr.RenderQueueDepth = max(1, min(RENDER_QUEUE_MAX, atoi(var.value)));
+   else
+	   settings.pvr.RenderQueueDepth = 1;
+
+   var.key = CORE_OPTION_NAME "_render_queue_latest_only";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+	   settings.pvr.RenderQueueLatestOnly = !strcmp("enabled", var.value);
+   else
+	   settings.pvr.RenderQueueLatestOnly = false;
+
    var.key = CORE_OPTION_NAME "_frame_skipping";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
    {
@@ -1028,6 +1153,13 @@ static void update_variables(bool first_startup)
       settings.aica.NoBatch    = 1;
    }
 
+   var.key = CORE_OPTION_NAME "_aica_thread";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && strcmp(var.value, "disabled"))
+      settings.aica.ThreadLag = atoi(var.value);
+   else
+      settings.aica.ThreadLag = 0;
+
    var.key = CORE_OPTION_NAME "_digital_triggers";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -1088,6 +1220,28 @@ static void update_variables(bool first_startup)
    else
 	  settings.rend.DumpTextures = false;
 
+   var.key = CORE_OPTION_NAME "_capture_ta_frames";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      static char capture_frames[16] = "disabled";
+      if (strcmp(capture_frames, var.value))
+      {
+         strncpy(capture_frames, var.value, sizeof(capture_frames) - 1);
+         settings.pvr.CaptureFrames = atoi(var.value);
+      }
+   }
+
+   var.key = CORE_OPTION_NAME "_record_sched_trace";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      static char sched_trace_frames[16] = "disabled";
+      if (strcmp(sched_trace_frames, var.value))
+      {
+         strncpy(sched_trace_frames, var.value, sizeof(sched_trace_frames) - 1);
+         settings.debug.SchedTraceFrames = atoi(var.value);
+      }
+   }
+
    key[0] = '\0' ;
 
    var.key = key ;
@@ -1213,10 +1367,13 @@ static void update_variables(bool first_startup)
    set_variable_visibility();
 }
 
+static bool rewind_update();
+
 void retro_run (void)
 {
    bool fastforward = false;
    bool updated     = false;
+   bool skip_frame  = false;
 #ifdef VITA // Temporary hack to force fullscreen
    glViewport(0, 0, 960, 544);
 #endif   
@@ -1228,13 +1385,18 @@ void retro_run (void)
 
    refresh_devices(false);
 
+   if (settings.rewind.Enable && settings.System == DC_PLATFORM_DREAMCAST)
+      skip_frame = rewind_update();
+
 #if !defined(TARGET_NO_THREADS)
    if (settings.rend.ThreadedRendering)
    {
 	   // On the first call, we start the emulator thread
 	   if (first_run)
 	   {
+#ifdef VITA
 		   sceKernelCloseVMDomain();
+#endif
 		   emu_thread.Start();
 		   first_run = false;
 	   }
@@ -1245,7 +1407,7 @@ void retro_run (void)
 	   	glsm_ctl(GLSM_CTL_STATE_BIND, NULL);
 #endif
 	   // Render
-	   is_dupe = !rend_single_frame();
+	   is_dupe = skip_frame || !rend_single_frame();
 #ifndef VITA
 	   if (settings.pvr.rend == 0 || settings.pvr.rend == 3)
 	   	glsm_ctl(GLSM_CTL_STATE_UNBIND, NULL);
@@ -1254,13 +1416,25 @@ void retro_run (void)
    else
 #endif
    {
-	   dc_run();
+	   if (skip_frame)
+		   is_dupe = true;
+	   else
+		   dc_run();
    }
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 2)
+      // Headless frames only go to the frame output
+      video_cb(is_dupe || settings.pvr.Headless ? NULL : softrend_GetFrame(), MAX_RENDER_WIDTH, MAX_RENDER_HEIGHT, MAX_RENDER_WIDTH * sizeof(u32));
+   else
+#endif
 #if defined(HAVE_OPENGL) || defined(HAVE_OPENGLES) || defined(HAVE_VULKAN)
    video_cb(is_dupe ? 0 : RETRO_HW_FRAME_BUFFER_VALID, screen_width, screen_height, 0);
 #endif
 #if !defined(TARGET_NO_THREADS)
+   audio_flush(settings.rend.ThreadedRendering);
    if (!settings.rend.ThreadedRendering)
+#else
+   audio_flush(false);
 #endif
 	   is_dupe = true;
 	   
@@ -1541,7 +1715,7 @@ static const char *get_axis_name(unsigned index, const char *default_name)
 
 static void set_input_descriptors()
 {
-   struct retro_input_descriptor desc[22 * 4 + 1];
+   struct retro_input_descriptor desc[22 * 4 + 2];
    int descriptor_index = 0;
    if (settings.System == DC_PLATFORM_NAOMI || settings.System == DC_PLATFORM_ATOMISWAVE)
    {
@@ -1722,6 +1896,8 @@ static void set_input_descriptors()
     	 }
       }
    }
+   if (settings.rewind.Enable && settings.System == DC_PLATFORM_DREAMCAST)
+      desc[descriptor_index++] = { 0, RETRO_DEVICE_JOYPAD, 0, (unsigned)rewind_button, "Rewind" };
    desc[descriptor_index++] = { 0 };
 
    environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
@@ -2022,6 +2198,15 @@ bool retro_load_game(const struct retro_game_info *game)
       preferred = RETRO_HW_CONTEXT_DUMMY;
    bool foundRenderApi = false;
 
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 2)
+   {
+      foundRenderApi = true;
+      // There's no context_reset to initialize it on the render thread
+      renderer_changed = true;
+   }
+   else
+#endif
    if (preferred == RETRO_HW_CONTEXT_OPENGL || preferred == RETRO_HW_CONTEXT_OPENGL_CORE
     || preferred == RETRO_HW_CONTEXT_OPENGLES2 || preferred == RETRO_HW_CONTEXT_OPENGLES3
     || preferred == RETRO_HW_CONTEXT_OPENGLES_VERSION)
@@ -2112,16 +2297,20 @@ void retro_unload_game(void)
 	   DEBUG_LOG(COMMON, "Waiting for emu thread......");
 	   if ( emu_in_thread )
 	   {
-		   frontend_clear_thread_waits_cb(1,NULL) ;
+		   if (frontend_clear_thread_waits_cb != NULL)
+		      frontend_clear_thread_waits_cb(1,NULL) ;
 		   DEBUG_LOG(COMMON, "Waiting for emu thread to end...");
 		   emu_thread.WaitToEnd();
-		   frontend_clear_thread_waits_cb(0,NULL) ;
+		   if (frontend_clear_thread_waits_cb != NULL)
+		      frontend_clear_thread_waits_cb(0,NULL) ;
 	   }
 	   DEBUG_LOG(COMMON, "...Done");
    }
    else
 #endif
 	   dc_term();
+   rewind_Term();
+   audio_term();
 }
 
 
@@ -2142,12 +2331,7 @@ size_t retro_get_memory_size(unsigned type)
 
 size_t retro_serialize_size (void)
 {
-   unsigned int total_size = 0 ;
-   void *data = NULL ;
-
-   dc_serialize(&data, &total_size) ;
-
-   return total_size;
+   return dc_serialize_size();
 }
 
 bool wait_until_dc_running()
@@ -2218,12 +2402,38 @@ bool retro_serialize(void *data, size_t size)
     return result ;
 }
 
+static void before_unserialize()
+{
+#if FEAT_AREC == DYNAREC_JIT
+    FlushCache();
+#endif
+#ifndef NO_MMU
+    mmu_flush_table();
+#endif
+    bm_Reset();
+}
+
+// Resets the emulator caches after the machine state has been replaced
+static void after_unserialize()
+{
+    mmu_set_state();
+    sh4_cpu.ResetCache();
+    dsp.dyndirty = true;
+    sh4_sched_ffts();
+    CalculateSync();
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+       vmu_screen_params[i].vmu_screen_needs_update = true ;
+       lightgun_params[i].dirty = true ;
+    }
+}
+
 bool retro_unserialize(const void * data, size_t size)
 {
    unsigned int total_size = 0 ;
    void *data_ptr = (void*)data ;
    bool result = false ;
-   int i ;
 
 #if !defined(TARGET_NO_THREADS)
     if (settings.rend.ThreadedRendering)
@@ -2243,40 +2453,89 @@ bool retro_unserialize(const void * data, size_t size)
     }
 #endif
 
-#if FEAT_AREC == DYNAREC_JIT
-    FlushCache();
-#endif
-#ifndef NO_MMU
-    mmu_flush_table();
-#endif
-    bm_Reset();
+    before_unserialize();
     custom_texture.Terminate();
 
     result = dc_unserialize(&data_ptr, &total_size, size) ;
 
-    mmu_set_state();
-    sh4_cpu.ResetCache();
-    dsp.dyndirty = true;
-    sh4_sched_ffts();
-    CalculateSync();
+    after_unserialize();
+    rewind_Reset();
+
+    performed_serialization = true ;
 
-    for ( i = 0 ; i < 4 ; i++)
+#if !defined(TARGET_NO_THREADS)
+    if (settings.rend.ThreadedRendering)
     {
-       vmu_screen_params[i].vmu_screen_needs_update = true ;
-       lightgun_params[i].dirty = true ;
+    	mtx_mainloop.Unlock() ;
+    	mtx_serialization.Unlock() ;
     }
+#endif
 
-    performed_serialization = true ;
+    return result ;
+}
+
+// Runs func with the emulator thread stopped
+static bool with_emu_stopped(void (*func)())
+{
+#if !defined(TARGET_NO_THREADS)
+    if (settings.rend.ThreadedRendering)
+    {
+    	if (first_run)
+    		return false;
+    	mtx_serialization.Lock() ;
+    	if ( !wait_until_dc_running()) {
+        	mtx_serialization.Unlock() ;
+        	return false ;
+    	}
+  		dc_stop() ;
+  		if ( !acquire_mainloop_lock() )
+  		{
+  			dc_start() ;
+        	mtx_serialization.Unlock() ;
+  			return false ;
+  		}
+    }
+#endif
+
+    func();
 
 #if !defined(TARGET_NO_THREADS)
     if (settings.rend.ThreadedRendering)
     {
+    	performed_serialization = true ;
     	mtx_mainloop.Unlock() ;
     	mtx_serialization.Unlock() ;
     }
 #endif
+    return true;
+}
 
-    return result ;
+static void rewind_step()
+{
+    before_unserialize();
+    if (rewind_Step())
+       after_unserialize();
+}
+
+static unsigned rewind_held_frames;
+
+// Takes rewind snapshots, or steps back while the rewind button is held on the first controller.
+// Returns true if the frame must not be emulated.
+static bool rewind_update()
+{
+   if (!input_cb(0, RETRO_DEVICE_JOYPAD, 0, rewind_button))
+   {
+      rewind_held_frames = 0;
+      if (rewind_NextFrame())
+         with_emu_stopped(rewind_Snapshot);
+      return false;
+   }
+   // Step back every few frames so that rewinding runs at about twice the normal speed
+   if (rewind_held_frames++ % (REWIND_INTERVAL / 2) != 0)
+      return true;
+   with_emu_stopped(rewind_step);
+
+   return false;
 }
 
 // Cheats
@@ -2364,6 +2623,7 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
    }
 
    info->timing.sample_rate = 44100.0;
+   audio_set_frame_rate(info->timing.fps);
 }
 
 unsigned retro_get_region (void)
@@ -2727,6 +2987,9 @@ static void UpdateInputStateNaomi(u32 port)
 
         for (id = RETRO_DEVICE_ID_JOYPAD_B; id <= RETRO_DEVICE_ID_JOYPAD_R3; ++id)
         {
+           // Reserved for rewinding
+           if (port == 0 && (int)id == rewind_button && settings.rewind.Enable && settings.System == DC_PLATFORM_DREAMCAST)
+              continue;
            switch (id)
            {
               case RETRO_DEVICE_ID_JOYPAD_L3:
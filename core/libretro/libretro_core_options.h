@@ -248,6 +248,44 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "512MB",
    },
+#endif
+#ifdef HAVE_SOFTREND
+   {
+      CORE_OPTION_NAME "_renderer",
+      "Renderer (Restart)",
+      "Render on the GPU or with the multithreaded software renderer. The software renderer outputs 640x480 and doesn't support modifier volumes or fog. Render to texture frames are skipped, so games that draw to textures show stale or missing textures. Headless uses the software renderer without video output, audio output nor frame limiting. Its frames can be written with 'Software Renderer Frame Output'.",
+      {
+         { "hardware", "Hardware (OpenGL/Vulkan)" },
+         { "software", "Software" },
+         { "headless", "Software, headless" },
+         { NULL, NULL },
+      },
+      "hardware",
+   },
+   {
+      CORE_OPTION_NAME "_frame_output",
+      "Software Renderer Frame Output (Restart)",
+      "Writes each frame rendered by the software renderer to a shared memory ring named '/reicast-frames-<pid>' (Linux only), or to raw XRGB8888 or PNG files in the 'frames' folder of the data directory.",
+      {
+         { "disabled", NULL },
+         { "shm",      "Shared memory" },
+         { "raw",      "Raw files" },
+         { "png",      "PNG files" },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+   {
+      CORE_OPTION_NAME "_softrend_simd",
+      "Software Renderer SIMD",
+      "Rasterize 8 pixels at a time with AVX2 when the CPU supports it, or 4 pixels at a time with SSE2.",
+      {
+         { "auto", "Auto (AVX2 if available)" },
+         { "sse2", "SSE2" },
+         { NULL, NULL },
+      },
+      "auto",
+   },
 #endif
    {
       CORE_OPTION_NAME "_internal_resolution",
@@ -335,6 +373,29 @@ struct retro_core_option_definition option_defs_us[] = {
       "disabled",
 #endif
    },
+   {
+      CORE_OPTION_NAME "_chd_cache_size",
+      "CHD Cache Size",
+      "Number of decompressed CHD hunks kept in memory. A hunk usually holds 8 sectors, about 20 KB. Larger caches avoid decompressing the same data again when games seek back and forth. Takes effect when the disc is loaded.",
+      {
+         { "16",  NULL },
+         { "64",  NULL },
+         { "256", NULL },
+         { NULL, NULL },
+      },
+      "64",
+   },
+   {
+      CORE_OPTION_NAME "_chd_read_ahead",
+      "CHD Read-Ahead",
+      "Decompresses the CHD sectors the GD-ROM is about to read on a background thread, to avoid hitches when games stream data. Takes effect when the disc is loaded.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "enabled",
+   },
    {
       CORE_OPTION_NAME "_mipmapping",
       "Mipmapping",
@@ -460,6 +521,28 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "auto",
    },
+   {
+      CORE_OPTION_NAME "_dynarec_block_cache",
+      "Dynarec Block Cache",
+      "Save decoded and optimized code blocks to disk and reuse them on the next run of the same content to reduce stuttering at startup.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+   {
+      CORE_OPTION_NAME "_dynarec_background_optimizer",
+      "Dynarec Background Optimizer",
+      "Compile new code blocks without optimizations and optimize them on a separate thread. Reduces stuttering when a lot of new code is run.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    {
       CORE_OPTION_NAME "_force_wince",
       "Force Windows CE Mode",
@@ -529,6 +612,21 @@ struct retro_core_option_definition option_defs_us[] = {
       "enabled",
 #endif
    },
+#if !defined(TARGET_NO_THREADS)
+   {
+      CORE_OPTION_NAME "_aica_thread",
+      "Audio Thread",
+      "Runs the sound CPU, sound channels and DSP on their own thread, at most the given number of samples behind the main CPU. Uses one more CPU core. Larger values let the threads run more independently but delay the sound hardware more.",
+      {
+         { "disabled", NULL },
+         { "64",       NULL },
+         { "128",      NULL },
+         { "256",      NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+#endif
    {
       CORE_OPTION_NAME "_anisotropic_filtering",
       "Anisotropic Filtering",
@@ -644,6 +742,29 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      CORE_OPTION_NAME "_render_queue_depth",
+      "Render Queue Depth",
+      "Number of frames that can wait to be rendered. Higher values drop fewer frames and let the emulation run ahead of the GPU, but add latency and may cause texture glitches. Note: This setting only applies when 'Threaded Rendering' is enabled.",
+      {
+         { "1", NULL },
+         { "2", NULL },
+         { "3", NULL },
+         { NULL, NULL },
+      },
+      "1",
+   },
+   {
+      CORE_OPTION_NAME "_render_queue_latest_only",
+      "Render Latest Frame Only",
+      "Skips the frames waiting to be rendered when a more recent one is available, to reduce latency when the GPU falls behind. Note: This setting only applies when 'Threaded Rendering' is enabled and 'Render Queue Depth' is higher than 1.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
 #endif
    {
       CORE_OPTION_NAME "_frame_skipping",
@@ -716,6 +837,32 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      CORE_OPTION_NAME "_capture_ta_frames",
+      "Capture TA Frames",
+      "Writes the next rendered frames to the 'tacapture' folder of the data directory, to be replayed offline with the ta_replay tool. Frames are captured again every time this setting is changed.",
+      {
+         { "disabled", NULL },
+         { "1",        NULL },
+         { "10",       NULL },
+         { "60",       NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+   {
+      CORE_OPTION_NAME "_record_sched_trace",
+      "Record Scheduler Trace",
+      "Records the events of the SH4 scheduler during the next frames to the 'schedtrace' folder of the data directory, to be replayed offline with the sched_bench tool. A trace is recorded again every time this setting is changed.",
+      {
+         { "disabled", NULL },
+         { "60",       NULL },
+         { "600",      NULL },
+         { "3600",     NULL },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
    {
       CORE_OPTION_NAME "_per_content_vmus",
       "Per-Game VMUs",
@@ -728,6 +875,44 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "disabled",
    },
+   {
+      CORE_OPTION_NAME "_rewind",
+      "Rewind",
+      "Keep snapshots of the last seconds of emulation in memory, and rewind while the selected button of the first controller is held. The button is reserved for rewinding and isn't sent to the game. It can be remapped as 'Rewind' in the frontend controls. Dreamcast only.",
+      {
+         { "disabled", NULL },
+         { "l3",       "Hold L3" },
+         { "r3",       "Hold R3" },
+         { NULL, NULL },
+      },
+      "disabled",
+   },
+   {
+      CORE_OPTION_NAME "_rewind_buffer_size",
+      "Rewind Buffer Size",
+      "Memory used by the compressed rewind snapshots, in addition to a copy of the emulated memory.",
+      {
+         { "64",  "64 MB" },
+         { "128", "128 MB" },
+         { "256", "256 MB" },
+         { "512", "512 MB" },
+         { NULL, NULL },
+      },
+      "128",
+   },
+   {
+      CORE_OPTION_NAME "_rewind_depth",
+      "Rewind Depth",
+      "Maximum number of seconds that can be rewound.",
+      {
+         { "10",  "10 seconds" },
+         { "30",  "30 seconds" },
+         { "60",  "60 seconds" },
+         { "120", "120 seconds" },
+         { NULL, NULL },
+      },
+      "30",
+   },
    {
       CORE_OPTION_NAME "_show_vmu_screen_settings",
       "Show VMU Display Settings",
@@ -225,14 +225,18 @@ static mem_handle_t allocate_shared_filemem(unsigned size) {
 	void* mem = memalign(0x1000, size);
 	return (uintptr_t)mem;
 	#else
+		// Unique name: several emulator processes, or several copies of the core in one process, can be starting at once
+		static char instance_tag;
+		char name[64];
+		sprintf(name, "/dcnzorz_mem_%d_%p", (int)getpid(), &instance_tag);
 		#if HOST_OS != OS_DARWIN
-		fd = shm_open("/dcnzorz_mem", O_CREAT | O_EXCL | O_RDWR, S_IREAD | S_IWRITE);
-		shm_unlink("/dcnzorz_mem");
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IREAD | S_IWRITE);
+		shm_unlink(name);
 		#endif
 
 		// if shmem does not work (or using OSX) fallback to a regular file on disk
 		if (fd < 0) {
-			string path = get_writable_data_path("/dcnzorz_mem");
+			string path = get_writable_data_path(name);
 			fd = open(path.c_str(), O_CREAT|O_RDWR|O_TRUNC, S_IRWXU|S_IRWXG|S_IRWXO);
 			unlink(path.c_str());
 		}
@@ -545,12 +545,22 @@ void LoadSettings(void)
    settings.pvr.Emulation.zMax         = 1.0f;
 
 	settings.pvr.MaxThreads			       = 3;
+	settings.pvr.TaBatchDecoder          = true;
 #ifndef __LIBRETRO__
    settings.pvr.Emulation.ModVol       = true;
    settings.rend.RenderToTextureBuffer  = false;
    settings.rend.RenderToTextureUpscale = 1;
    settings.rend.MaxFilteredTextureSize = 256;
    settings.pvr.SynchronousRendering	 = 0;
+   settings.pvr.RenderQueueDepth        = 1;
+   settings.pvr.RenderQueueLatestOnly   = false;
+   settings.pvr.CaptureFrames           = 0;
+   settings.pvr.SoftRendAVX2            = true;
+   settings.pvr.Headless                = false;
+   settings.pvr.FrameOutput             = 0;
+   settings.imgread.ChdCacheHunks       = 64;
+   settings.imgread.ChdReadAhead        = true;
+   settings.aica.ThreadLag              = 0;
 #endif
    settings.rend.AutoExtraDepthScale    = true;
    settings.rend.ExtraDepthScale        = 1.f;
@@ -352,6 +352,33 @@ public:
 
                break;
 
+            case shop_jexit:
+					{
+						Xbyak::Label stay;
+						if (op.rs1.is_imm())
+						{
+							if (op.rs1._imm != op.rs2._imm)
+								break;
+						}
+						else
+						{
+							cmp(regalloc.MapRegister(op.rs1), op.rs2._imm);
+							jne(stay, T_NEAR);
+						}
+						// Give back the cycles of the rest of the trace
+#ifdef FEAT_NO_RWX_PAGES
+						mov(rax, (uintptr_t)&cycle_counter);
+						add(dword[rax], op.flags);
+#else
+						add(dword[rip + &cycle_counter], op.flags);
+#endif
+						mov(rax, (size_t)&next_pc);
+						mov(dword[rax], op.rs3._imm);
+						jmp(exit_block, T_NEAR);
+						L(stay);
+					}
+					break;
+
             case shop_jcond:
             case shop_jdyn:
 					{
@@ -1196,7 +1223,18 @@ public:
 
 				jne(branch_not_taken, T_SHORT);
 				mov(dword[rax], block->BranchBlock);
-				L(branch_not_taken);
+				if (block->trace_candidate)
+				{
+					jmp(exit_block, T_NEAR);
+					L(branch_not_taken);
+					// Count the runs going past the branch and turn the block into a trace when it gets hot
+					mov(rdx, (uintptr_t)&block->runs);
+					inc(dword[rdx]);
+					cmp(dword[rdx], TRACE_HOT_RUNS);
+					je(hot_block, T_NEAR);
+				}
+				else
+					L(branch_not_taken);
 			}
 			break;
 
@@ -1237,6 +1275,18 @@ public:
 #endif
 		ret();
 
+		if (block->trace_candidate)
+		{
+			L(hot_block);
+#ifdef _WIN32
+			add(rsp, 0x28);
+#else
+			add(rsp, 0x8);
+#endif
+			mov(call_regs[0], block->addr);
+			jmp((const void *)&rdv_CompileTrace);
+		}
+
 		ready();
 
 		block->code = (DynarecCodeEntryPtr)getCode();
@@ -2106,6 +2156,7 @@ private:
 	Xbyak::util::Cpu cpu;
 	size_t current_opid;
 	Xbyak::Label exit_block;
+	Xbyak::Label hot_block;
 	static const u32 read_mem_op_size;
 	static const u32 write_mem_op_size;
 public:
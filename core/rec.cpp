@@ -11,6 +11,7 @@ void (*ngen_CC_Call)(shil_opcode*op, void* function);
 void (*ngen_CC_Param)(shil_opcode* op, shil_param* par, CanonicalParamType tp);
 void (*ngen_CC_Finish)(shil_opcode* op);
 void (*ngen_ResetBlocks)() = &ngen_ResetBlocksNop;
+bool ngen_SideExits;
 
 void ngen_init(void)
 {
@@ -79,6 +80,7 @@ void ngen_init(void)
          ngen_CC_Call = ngen_CC_Call_x64;
          ngen_CC_Param = ngen_CC_Param_x64;
          ngen_CC_Finish = ngen_CC_Finish_x64;
+         ngen_SideExits = true;
 
          break;
 #elif defined(TARGET_NO_JIT)
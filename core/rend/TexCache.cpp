@@ -1,7 +1,11 @@
 #include <algorithm>
+#include <deque>
 #if defined(HAVE_TEXUPSCALE) && !defined(TARGET_NO_OPENMP)
 #include <omp.h>
 #endif
+#if defined(HAVE_TEXCONV_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "TexCache.h"
 #include "hw/pvr/pvr_regs.h"
 #include "hw/pvr/pvr_mem.h"
@@ -16,14 +20,18 @@
 
 #define TEX_HASH_CHECK_FRAMES 1
 
-u8* vq_codebook;
-u32 palette_index;
+thread_local u8* vq_codebook;
+thread_local u32 palette_index;
 bool KillTex=false;
 u32 palette16_ram[1024];
 u32 palette32_ram[1024];
 u32 pal_hash_256[4];
 u32 pal_hash_16[64];
 
+// Textures updated while a batch is active are decoded in parallel when it's flushed
+static bool texture_batch_active;
+static std::deque<TextureStaging> texture_batch;
+
 // Rough approximation of LoD bias from D adjust param
 const std::array<f32, 16> D_Adjust_LoD_Bias = {
 		0.f, -4.f, -2.f, -1.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f
@@ -135,6 +143,9 @@ using namespace std;
 vector<vram_block*> VramLocks[VRAM_SIZE_MAX / PAGE_SIZE];
 //vram 32-64b
 VArray2 vram;
+// Vram write tracking for the rewind buffer and incremental save states
+static bool vram_tracking;		// all vram was write-protected by vramlock_ResetWriteTracking
+static bool vram_written_pages[VRAM_SIZE_MAX / PAGE_SIZE];
 
 //List functions
 //
@@ -223,6 +234,8 @@ bool VramLockedWriteOffset(size_t offset)
    {
       vramlist_lock.Lock();
 
+      vram_written_pages[addr_hash] = true;
+
       for (size_t i = 0; i < list.size(); i++)
       {
          if (list[i] != nullptr)
@@ -248,6 +261,30 @@ bool VramLockedWriteOffset(size_t offset)
    return true;
 }
 
+bool vramlock_ResetWriteTracking()
+{
+#ifndef TARGET_NO_EXCEPTIONS
+	if (!settings.dreamcast.FullMMU)
+	{
+		vramlist_lock.Lock();
+		memset(vram_written_pages, 0, sizeof(vram_written_pages));
+		_vmem_protect_vram(0, VRAM_SIZE);
+		vram_tracking = true;
+		vramlist_lock.Unlock();
+
+		return true;
+	}
+#endif
+	vram_tracking = false;
+
+	return false;
+}
+
+bool vramlock_IsPageWritten(u32 offset)
+{
+	return !vram_tracking || vram_written_pages[(offset & VRAM_MASK) / PAGE_SIZE];
+}
+
 bool VramLockedWrite(u8* address)
 {
 	u32 offset = _vmem_get_vram_offset(address);
@@ -394,6 +431,31 @@ void shutdown_thread_pool()
 }
 #endif
 
+//We ask the compiler to generate the templates here
+//;)
+//planar formats !
+template void texture_PL<conv565_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_PL<conv1555_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_PL<conv4444_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_PL<convYUV_PL<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+
+//twiddled formats !
+template void texture_TW<conv565_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<conv1555_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<conv4444_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<convYUV_TW<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+
+template void texture_TW<convPAL4_TW<pp_565, u16>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<convPAL8_TW<pp_565, u16>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<convPAL4_TW<pp_8888, u32>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_TW<convPAL8_TW<pp_8888, u32>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+
+//VQ formats !
+template void texture_VQ<conv565_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_VQ<conv1555_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_VQ<conv4444_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
+template void texture_VQ<convYUV_TW<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
+
 struct PvrTexInfo
 {
 	const char* name;
@@ -421,6 +483,85 @@ static const PvrTexInfo format[8] =
 	{"ns/1555", 0},																														// Not supported (1555)
 };
 
+#if defined(HAVE_TEXCONV_X86)
+static bool CpuHasSSE41()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[2] & 0x80000) != 0;
+#else
+	return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+	__cpuid(regs, 1);
+	// AVX and OSXSAVE, and the OS saves the ymm registers
+	if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & 0x20) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+bool texconv_InitTable(TexConvTable& table, const char *isa)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		table.TW[i] = format[i].TW;
+		table.VQ[i] = format[i].VQ;
+		table.TW32[i] = format[i].TW32;
+	}
+	table.name = "generic";
+	if (isa == NULL || !strcmp(isa, "generic"))
+		return true;
+#if defined(HAVE_TEXCONV_X86)
+	if (!strcmp(isa, "sse4.1") && CpuHasSSE41())
+	{
+		texconv_InitSSE41(table);
+		return true;
+	}
+	if (!strcmp(isa, "avx2") && CpuHasAVX2())
+	{
+		texconv_InitAVX2(table);
+		return true;
+	}
+#elif defined(HAVE_TEXCONV_NEON) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+	if (!strcmp(isa, "neon"))
+	{
+		texconv_InitNEON(table);
+		return true;
+	}
+#endif
+	return false;
+}
+
+static TexConvTable BestTexConvTable()
+{
+	TexConvTable table;
+	if (!texconv_InitTable(table, "avx2") && !texconv_InitTable(table, "sse4.1") && !texconv_InitTable(table, "neon"))
+		texconv_InitTable(table, NULL);
+	INFO_LOG(RENDERER, "Texture converters: %s", table.name);
+
+	return table;
+}
+
+const TexConvTable& texconv_GetTable()
+{
+	static const TexConvTable table = BestTexConvTable();
+	return table;
+}
+
 static const u32 VQMipPoint[11] =
 {
 	0x00000,//1
@@ -566,7 +707,7 @@ void BaseTextureCacheData::Create()
 			vq_codebook = sa;
 			if (tcw.MipMapped)
 				sa += VQMipPoint[tsp.TexU + 3];
-			texconv = tex->VQ;
+			texconv = texconv_GetTable().VQ[tex - format];
 			texconv32 = tex->VQ32;
 			size = w * h / 8;
 		}
@@ -575,8 +716,8 @@ void BaseTextureCacheData::Create()
 			verify(tex->TW != NULL || tex->TW32 != NULL);
 			if (tcw.MipMapped)
 				sa += OtherMipPoint[tsp.TexU + 3] * tex->bpp / 8;
-			texconv = tex->TW;
-			texconv32 = tex->TW32;
+			texconv = texconv_GetTable().TW[tex - format];
+			texconv32 = texconv_GetTable().TW32[tex - format];
 			size = w * h * tex->bpp / 8;
 		}
 	}
@@ -591,7 +732,18 @@ void BaseTextureCacheData::ComputeHash()
 	texture_hash ^= tcw.full & 0xFC000000;	// everything but texaddr, reserved and stride
 }
 
-void BaseTextureCacheData::Update()
+u64 BaseTextureCacheData::ContentKey(const TextureStaging& staging)
+{
+	u64 seed = (tcw.full >> 26) | (tsp.TexU << 6) | (tsp.TexV << 9) | (staging.stride << 14);
+	if (IsPaletted())
+		seed |= ((PAL_RAM_CTRL & 3) << 12) | ((u64)palette_hash << 32);
+	// The lock range includes the VQ codebook and the smaller mipmaps
+	u64 key = XXH64(&vram[sa_tex], sa + size - sa_tex, seed);
+
+	return key != 0 ? key : 1;
+}
+
+bool BaseTextureCacheData::PrepareUpdate(TextureStaging& staging)
 {
 	//texture state tracking stuff
 	Updates++;
@@ -599,12 +751,9 @@ void BaseTextureCacheData::Update()
 
 	tex_type = tex->type;
 
-	bool has_alpha = false;
 	if (IsPaletted())
 	{
 		tex_type = PAL_TYPE[PAL_RAM_CTRL&3];
-		if (tex_type != TextureType::_565)
-			has_alpha = true;
 
 		// Get the palette hash to check for future updates
 		if (tcw.PixelFmt == PixelPal4)
@@ -613,45 +762,55 @@ void BaseTextureCacheData::Update()
 			palette_hash = pal_hash_256[tcw.PalSelect >> 4];
 	}
 
-	::palette_index = this->palette_index; // might be used if pal. tex
-	::vq_codebook = &vram[vq_codebook];    // might be used if VQ tex
-
-	//texture conversion work
-	u32 stride = w;
+	staging.texture = this;
+	staging.stride = w;
 
 	if (tcw.StrideSel && tcw.ScanOrder && (tex->PL || tex->PL32))
-		stride = (TEXT_CONTROL & 31) * 32;
+		staging.stride = (TEXT_CONTROL & 31) * 32;
 
-	u32 original_h = h;
+	staging.rows = h;
 	if (sa_tex > VRAM_SIZE || size == 0 || sa + size > VRAM_SIZE)
 	{
 		if (sa + size > VRAM_SIZE)
 		{
 			// Shenmue Space Harrier mini-arcade loads a texture that goes beyond the end of VRAM
 			// but only uses the top portion of it
-			h = (VRAM_SIZE - sa) * 8 / stride / tex->bpp;
-			size = stride * h * tex->bpp/8;
+			staging.rows = (VRAM_SIZE - sa) * 8 / staging.stride / tex->bpp;
+			size = staging.stride * staging.rows * tex->bpp/8;
 		}
 		else
 		{
 			WARN_LOG(RENDERER, "Warning: invalid texture. Address %08X %08X size %d", sa_tex, sa, size);
-			return;
+			return false;
 		}
 	}
 	if (settings.rend.CustomTextures)
 		custom_texture.LoadCustomTextureAsync(this);
 
-	void *temp_tex_buffer = NULL;
+	//lock the texture to detect changes in it
+	lock_block = libCore_vramlock_Lock(sa_tex,sa+size-1,this);
+
+	return true;
+}
+
+void BaseTextureCacheData::Decode(TextureStaging& staging)
+{
+	::palette_index = this->palette_index; // might be used if pal. tex
+	::vq_codebook = &vram[vq_codebook];    // might be used if VQ tex
+
+	// Palettes with alpha
+	bool has_alpha = IsPaletted() && tex_type != TextureType::_565;
+	u32 rows = staging.rows;
 	u32 upscaled_w = w;
-	u32 upscaled_h = h;
+	u32 upscaled_h = rows;
 
-	PixelBuffer<u16> pb16;
-	PixelBuffer<u32> pb32;
+	PixelBuffer<u16>& pb16 = staging.pb16;
+	PixelBuffer<u32>& pb32 = staging.pb32;
 
 	// Figure out if we really need to use a 32-bit pixel buffer
 	bool textureUpscaling = settings.rend.TextureUpscale > 1
 			// Don't process textures that are too big
-			&& w * h <= settings.rend.MaxFilteredTextureSize * settings.rend.MaxFilteredTextureSize
+			&& w * rows <= settings.rend.MaxFilteredTextureSize * settings.rend.MaxFilteredTextureSize
 			// Don't process YUV textures
 			&& tcw.PixelFmt != PixelYUV;
 	bool need_32bit_buffer = true;
@@ -676,7 +835,7 @@ void BaseTextureCacheData::Update()
 #ifndef VITA
 		if (mipmapped)
 		{
-			pb32.init(w, h, true);
+			pb32.init(w, rows, true);
 			for (int i = 0; i <= tsp.TexU + 3; i++)
 			{
 				pb32.set_mipmap(i);
@@ -702,17 +861,17 @@ void BaseTextureCacheData::Update()
 		else
 #endif
 		{
-			pb32.init(w, h);
+			pb32.init(w, rows);
 
-			texconv32(&pb32, (u8*)&vram[sa], stride, h);
+			texconv32(&pb32, (u8*)&vram[sa], staging.stride, rows);
 
 #ifdef DEPOSTERIZE
 			{
 				// Deposterization
 				PixelBuffer<u32> tmp_buf;
-				tmp_buf.init(w, h);
+				tmp_buf.init(w, rows);
 
-				DePosterize(pb32.data(), tmp_buf.data(), w, h);
+				DePosterize(pb32.data(), tmp_buf.data(), w, rows);
 				pb32.steal_data(tmp_buf);
 			}
 #endif
@@ -722,26 +881,26 @@ void BaseTextureCacheData::Update()
 				if (textureUpscaling)
 			{
 				PixelBuffer<u32> tmp_buf;
-				tmp_buf.init(w * settings.rend.TextureUpscale, h * settings.rend.TextureUpscale);
+				tmp_buf.init(w * settings.rend.TextureUpscale, rows * settings.rend.TextureUpscale);
 
 				if (tcw.PixelFmt == Pixel1555 || tcw.PixelFmt == Pixel4444)
 					// Alpha channel formats. Palettes with alpha are already handled
 					has_alpha = true;
-				UpscalexBRZ(settings.rend.TextureUpscale, pb32.data(), tmp_buf.data(), w, h, has_alpha);
+				UpscalexBRZ(settings.rend.TextureUpscale, pb32.data(), tmp_buf.data(), w, rows, has_alpha);
 				pb32.steal_data(tmp_buf);
 				upscaled_w *= settings.rend.TextureUpscale;
 				upscaled_h *= settings.rend.TextureUpscale;
 			}
 #endif
 		}
-		temp_tex_buffer = pb32.data();
+		staging.data = (u8*)pb32.data();
 	}
 	else if (texconv != NULL)
 	{
 #ifndef VITA
 		if (mipmapped)
 		{
-			pb16.init(w, h, true);
+			pb16.init(w, rows, true);
 			for (int i = 0; i <= tsp.TexU + 3; i++)
 			{
 				pb16.set_mipmap(i);
@@ -767,36 +926,156 @@ void BaseTextureCacheData::Update()
 		else
 #endif
 		{
-			pb16.init(w, h);
+			pb16.init(w, rows);
 
-			texconv(&pb16,(u8*)&vram[sa],stride,h);
+			texconv(&pb16,(u8*)&vram[sa],staging.stride,rows);
 		}
-		temp_tex_buffer = pb16.data();
+		staging.data = (u8*)pb16.data();
 	}
 	else
 	{
 		//fill it in with a temp color
 		WARN_LOG(RENDERER, "UNHANDLED TEXTURE");
-		pb16.init(w, h);
-		memset(pb16.data(), 0x80, w * h * 2);
-		temp_tex_buffer = pb16.data();
+		pb16.init(w, rows);
+		memset(pb16.data(), 0x80, w * rows * 2);
+		staging.data = (u8*)pb16.data();
 		mipmapped = false;
 	}
-	// Restore the original texture height if it was constrained to VRAM limits above
-	h = original_h;
-
-	//lock the texture to detect changes in it
-	lock_block = libCore_vramlock_Lock(sa_tex,sa+size-1,this);
+	staging.width = upscaled_w;
+	staging.height = upscaled_h;
+	staging.mipmapped = mipmapped;
+}
 
-	UploadToGPU(upscaled_w, upscaled_h, (u8*)temp_tex_buffer, mipmapped, mipmapped);
+void BaseTextureCacheData::Upload(TextureStaging& staging)
+{
+	UploadToGPU(staging.width, staging.height, staging.data, staging.mipmapped, staging.mipmapped);
 	if (settings.rend.DumpTextures)
 	{
 		ComputeHash();
-		custom_texture.DumpTexture(texture_hash, upscaled_w, upscaled_h, tex_type, temp_tex_buffer);
+		custom_texture.DumpTexture(texture_hash, staging.width, staging.height, tex_type, staging.data);
 	}
 	PrintTextureName();
 }
 
+void BaseTextureCacheData::Update()
+{
+	if (texture_batch_active)
+	{
+		texture_batch.emplace_back();
+		if (!PrepareUpdate(texture_batch.back()) || AttachSharedTexture(texture_batch.back()))
+			texture_batch.pop_back();
+		return;
+	}
+	TextureStaging staging;
+	if (!PrepareUpdate(staging) || AttachSharedTexture(staging))
+		return;
+	Decode(staging);
+	Upload(staging);
+}
+
+#if !defined(TARGET_NO_THREADS)
+struct TextureDecodeWorker
+{
+	TextureDecodeWorker(ThreadEntryFP *func) : thread(func, this) {}
+
+	cThread thread;
+	cResetEvent wakeup;
+};
+
+static vector<TextureDecodeWorker *> texture_workers;
+static volatile bool texture_workers_running;
+static std::atomic<u32> texture_batch_next;
+static std::atomic<int> texture_workers_busy;
+static cResetEvent texture_batch_done;
+
+static void DecodeTextureBatch()
+{
+	while (true)
+	{
+		u32 i = texture_batch_next++;
+		if (i >= texture_batch.size())
+			break;
+		TextureStaging& staging = texture_batch[i];
+		staging.texture->Decode(staging);
+	}
+}
+
+static void *texture_worker_thread(void *param)
+{
+	TextureDecodeWorker *worker = (TextureDecodeWorker *)param;
+	while (true)
+	{
+		worker->wakeup.Wait();
+		if (!texture_workers_running)
+			break;
+		DecodeTextureBatch();
+		if (--texture_workers_busy == 0)
+			texture_batch_done.Set();
+	}
+	return NULL;
+}
+#endif
+
+void BeginTextureBatch()
+{
+#if !defined(TARGET_NO_THREADS)
+	if (settings.pvr.MaxThreads > 1)
+		texture_batch_active = true;
+#endif
+}
+
+void FlushTextureBatch()
+{
+	texture_batch_active = false;
+	if (texture_batch.empty())
+		return;
+#if !defined(TARGET_NO_THREADS)
+	double start_time = os_GetSeconds();
+
+	int worker_count = min((int)settings.pvr.MaxThreads, (int)texture_batch.size()) - 1;
+	if (worker_count > 0)
+	{
+		texture_workers_running = true;
+		while ((int)texture_workers.size() < worker_count)
+		{
+			TextureDecodeWorker *worker = new TextureDecodeWorker(texture_worker_thread);
+			worker->thread.Start();
+			texture_workers.push_back(worker);
+		}
+	}
+	texture_batch_next = 0;
+	texture_workers_busy = max(worker_count, 0);
+	for (int i = 0; i < worker_count; i++)
+		texture_workers[i]->wakeup.Set();
+	DecodeTextureBatch();
+	if (worker_count > 0)
+		texture_batch_done.Wait();
+
+	double decode_time = os_GetSeconds() - start_time;
+#endif
+	for (TextureStaging& staging : texture_batch)
+		staging.texture->Upload(staging);
+#if !defined(TARGET_NO_THREADS)
+	DEBUG_LOG(RENDERER, "Decoded %d textures in %.2f ms, upload %.2f ms", (int)texture_batch.size(),
+			decode_time * 1000.0, (os_GetSeconds() - start_time - decode_time) * 1000.0);
+#endif
+	texture_batch.clear();
+}
+
+void TermTextureDecoder()
+{
+#if !defined(TARGET_NO_THREADS)
+	texture_workers_running = false;
+	for (TextureDecodeWorker *worker : texture_workers)
+	{
+		worker->wakeup.Set();
+		worker->thread.WaitToEnd();
+		delete worker;
+	}
+	texture_workers.clear();
+#endif
+}
+
 void BaseTextureCacheData::CheckCustomTexture()
 {
 	if (IsCustomTextureAvailable())
@@ -13,8 +13,9 @@
 #include <vitaGL.h>
 #endif
 
-extern u8* vq_codebook;
-extern u32 palette_index;
+// Thread local so that textures can be decoded in parallel
+extern thread_local u8* vq_codebook;
+extern thread_local u32 palette_index;
 extern u32 palette16_ram[1024];
 extern u32 palette32_ram[1024];
 extern bool pal_needs_update,fog_needs_update;
@@ -594,31 +595,6 @@ void texture_VQ(PixelBuffer<pixel_type>* pb,u8* p_in,u32 Width,u32 Height)
 	}
 }
 
-//We ask the compiler to generate the templates here
-//;)
-//planar formats !
-template void texture_PL<conv565_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_PL<conv1555_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_PL<conv4444_PL<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_PL<convYUV_PL<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
-
-//twiddled formats !
-template void texture_TW<conv565_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<conv1555_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<conv4444_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<convYUV_TW<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
-
-template void texture_TW<convPAL4_TW<pp_565, u16>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<convPAL8_TW<pp_565, u16>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<convPAL4_TW<pp_8888, u32>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_TW<convPAL8_TW<pp_8888, u32>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
-
-//VQ formats !
-template void texture_VQ<conv565_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_VQ<conv1555_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_VQ<conv4444_TW<pp_565>, u16>(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
-template void texture_VQ<convYUV_TW<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
-
 //Planar
 #define tex565_PL texture_PL<conv565_PL<pp_565>, u16>
 #define tex1555_PL texture_PL<conv1555_PL<pp_565>, u16>
@@ -664,6 +640,10 @@ template void texture_VQ<convYUV_TW<pp_8888>, u32>(PixelBuffer<u32>* pb,u8* p_in
 #define texPAL8_VQ32 texture_VQ<convPAL8_TW<pp_8888, u32>, u32>
 
 bool VramLockedWriteOffset(size_t offset);
+// Write-protects all the vram to track the pages written to. Returns false if not supported.
+bool vramlock_ResetWriteTracking();
+// True if the page has been written to since the last vramlock_ResetWriteTracking, or if writes aren't tracked
+bool vramlock_IsPageWritten(u32 offset);
 #ifdef HAVE_TEXUPSCALE
 void DePosterize(u32* source, u32* dest, int width, int height);
 void UpscalexBRZ(int factor, u32* source, u32* dest, int width, int height, bool has_alpha);
@@ -675,6 +655,46 @@ typedef void TexConvFP(PixelBuffer<u16>* pb,u8* p_in,u32 Width,u32 Height);
 typedef void TexConvFP32(PixelBuffer<u32>* pb,u8* p_in,u32 Width,u32 Height);
 enum class TextureType { _565, _5551, _4444, _8888, _8 };
 
+// Converters of the twiddled and VQ textures, indexed by TCW pixel format
+struct TexConvTable
+{
+	TexConvFP *TW[8];
+	TexConvFP *VQ[8];
+	TexConvFP32 *TW32[8];
+	const char *name;
+};
+// Fills the table with the generic converters, then with the SIMD ones of the instruction set,
+// "sse4.1", "avx2" or "neon". Returns false if they aren't built or the cpu doesn't support them.
+bool texconv_InitTable(TexConvTable& table, const char *isa);
+// The converters used by the texture cache: the fastest ones supported by the cpu
+const TexConvTable& texconv_GetTable();
+// Replace the converters that have a SIMD version. Defined in texconv_*.cpp.
+void texconv_InitSSE41(TexConvTable& table);
+void texconv_InitAVX2(TexConvTable& table);
+void texconv_InitNEON(TexConvTable& table);
+
+struct BaseTextureCacheData;
+
+// Decoded texture data waiting to be uploaded
+struct TextureStaging
+{
+	BaseTextureCacheData *texture = nullptr;
+	PixelBuffer<u16> pb16;
+	PixelBuffer<u32> pb32;
+	u8 *data = nullptr;
+	u32 stride = 0;		// in pixels
+	u32 rows = 0;		// number of rows read from vram
+	u32 width = 0;		// size of the decoded texture
+	u32 height = 0;
+	bool mipmapped = false;
+};
+
+// Texture updates requested between these calls are decoded on a worker pool.
+// Only the upload is done by the calling thread when the batch is flushed.
+void BeginTextureBatch();
+void FlushTextureBatch();
+void TermTextureDecoder();
+
 struct BaseTextureCacheData
 {
 	TSP tsp;        //dreamcast texture parameters
@@ -749,6 +769,14 @@ struct BaseTextureCacheData
 	void Create();
 	void ComputeHash();
 	void Update();
+	bool PrepareUpdate(TextureStaging& staging);
+	void Decode(TextureStaging& staging);
+	void Upload(TextureStaging& staging);
+	// Hash of the vram data and of the parameters affecting the decoded texture. Never 0.
+	u64 ContentKey(const TextureStaging& staging);
+	// Lets the renderer reuse the host texture of an identical texture at another vram address.
+	// Returns true if no decoding or upload is needed.
+	virtual bool AttachSharedTexture(TextureStaging& staging) { return false; }
 	virtual void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) = 0;
 	virtual bool Force32BitTexture(TextureType type) const { 
 		return false;
@@ -10,6 +10,7 @@
 #include "hw/pvr/Renderer_if.h"
 #include "hw/mem/_vmem.h"
 #include "postprocess.h"
+#include "deps/xxhash/xxhash.h"
 
 #ifndef GL_RED
 #define GL_RED                            0x1903
@@ -376,6 +377,7 @@ PipelineShader *GetProgram(
    	shader->pp_BumpMap = pp_BumpMap;
    	shader->fog_clamping = fog_clamping;
    	shader->trilinear = trilinear;
+   	shader->program = gl_shader_cache_load(rv);
    	CompilePipelineShader(shader);
    }
 #ifdef RPI4_SET_UNIFORM_ATTRIBUTES_BUG
@@ -520,6 +522,10 @@ GLuint gl_CompileAndLink(const char* VertexShader, const char* FragmentShader)
 #ifndef HAVE_OPENGLES
 	glBindFragDataLocation(program, 0, "FragColor");
 #endif
+#ifndef HAVE_OPENGLES2
+	if (gl.program_binary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 
 	glLinkProgram(program);
 	glGetProgramiv(program, GL_LINK_STATUS, &result);
@@ -556,17 +562,25 @@ GLuint gl_CompileAndLink(const char* VertexShader, const char* FragmentShader)
 
 bool CompilePipelineShader(PipelineShader *s)
 {
-   char vshader[8192];
+   if (s->program != 0)
+   {
+      // Loaded from the shader cache
+      glcache.UseProgram(s->program);
+   }
+   else
+   {
+      char vshader[8192];
 
-   sprintf(vshader, VertexShaderSource, gl.glsl_version_header, gl.gl_version, s->pp_Gouraud);
+      sprintf(vshader, VertexShaderSource, gl.glsl_version_header, gl.gl_version, s->pp_Gouraud);
 
-	char pshader[8192];
+      char pshader[8192];
 
-   sprintf(pshader,PixelPipelineShader, gl.glsl_version_header, gl.gl_version,
-                s->cp_AlphaTest,s->pp_ClipTestMode,s->pp_UseAlpha,
-                s->pp_Texture,s->pp_IgnoreTexA,s->pp_ShadInstr,s->pp_Offset,s->pp_FogCtrl, s->pp_Gouraud, s->pp_BumpMap, s->fog_clamping, s->trilinear);
+      sprintf(pshader,PixelPipelineShader, gl.glsl_version_header, gl.gl_version,
+                   s->cp_AlphaTest,s->pp_ClipTestMode,s->pp_UseAlpha,
+                   s->pp_Texture,s->pp_IgnoreTexA,s->pp_ShadInstr,s->pp_Offset,s->pp_FogCtrl, s->pp_Gouraud, s->pp_BumpMap, s->fog_clamping, s->trilinear);
 
-	s->program            = gl_CompileAndLink(vshader, pshader);
+      s->program = gl_CompileAndLink(vshader, pshader);
+   }
 
 
 	//setup texture 0 as the input for the shader
@@ -680,9 +694,63 @@ static void gl_term(void)
 	glDeleteTextures(1, &fogTextureId);
 	fogTextureId = 0;
 
+	gl_shader_cache_term();
 	gl_delete_shaders();
 }
 
+// Pipeline shaders of the previous sessions that have no usable program binary
+static std::vector<u32> pending_shaders;
+
+static void gl_create_shader(u32 key)
+{
+	// See GetProgram
+	bool trilinear = key & 1;
+	bool fog_clamping = (key >> 1) & 1;
+	bool pp_BumpMap = (key >> 2) & 1;
+	bool pp_Gouraud = (key >> 3) & 1;
+	u32 pp_FogCtrl = (key >> 4) & 3;
+	u32 pp_Offset = (key >> 6) & 1;
+	u32 pp_ShadInstr = (key >> 7) & 3;
+	u32 pp_IgnoreTexA = (key >> 9) & 1;
+	u32 pp_UseAlpha = (key >> 10) & 1;
+	u32 pp_Texture = (key >> 11) & 1;
+	u32 cp_AlphaTest = (key >> 12) & 1;
+	u32 pp_ClipTestMode = key >> 13;
+	GetProgram(cp_AlphaTest, pp_ClipTestMode, pp_Texture, pp_UseAlpha, pp_IgnoreTexA, pp_ShadInstr, pp_Offset,
+			pp_FogCtrl, pp_Gouraud, pp_BumpMap, fog_clamping, trilinear);
+}
+
+// Creates the pipeline shaders used by the previous sessions, so that the first frames using them don't stall.
+// Only the ones with a program binary are created now since it's fast. The others must be compiled from
+// source (always on GLES2) and are spread over the first frames instead.
+static void gl_precompile_shaders()
+{
+	u64 sourceHash = XXH64(VertexShaderSource, strlen(VertexShaderSource), 0);
+	sourceHash = XXH64(PixelPipelineShader, strlen(PixelPipelineShader), sourceHash);
+	gl_shader_cache_init(sourceHash);
+
+	pending_shaders.clear();
+	for (u32 key : gl_shader_cache_keys())
+	{
+		if (gl_shader_cache_has_binary(key))
+			gl_create_shader(key);
+		else
+			pending_shaders.push_back(key);
+	}
+	if (!gl.shaders.empty() || !pending_shaders.empty())
+		INFO_LOG(RENDERER, "%d shaders created in advance, %d pending", (int)gl.shaders.size(), (int)pending_shaders.size());
+}
+
+// Compiles a few of the pending shaders. Called once per frame.
+static void gl_compile_pending_shaders()
+{
+	for (int i = 0; i < 2 && !pending_shaders.empty(); i++)
+	{
+		gl_create_shader(pending_shaders.back());
+		pending_shaders.pop_back();
+	}
+}
+
 static bool gl_create_resources(void)
 {
 	/* create VBOs */
@@ -704,6 +772,8 @@ static bool gl_create_resources(void)
    gl.modvol_shader.extra_depth_scale = glGetUniformLocation(gl.modvol_shader.program, "extra_depth_scale");
 	gl.modvol_shader.sp_ShaderColor = glGetUniformLocation(gl.modvol_shader.program, "sp_ShaderColor");
 
+	gl_precompile_shaders();
+
 	return true;
 }
 
@@ -766,6 +836,7 @@ static bool RenderFrame(void)
    int lightgun_port = 0 ;
 
    DoCleanup();
+	gl_compile_pending_shaders();
 
 	bool is_rtt=pvrrc.isRTT;
 
@@ -1107,10 +1178,14 @@ bool ProcessFrame(TA_context* ctx)
 	}
 	else
 	{
-		if (!ta_parse_vdrc(ctx))
+		BeginTextureBatch();
+		bool parsed = ta_parse_vdrc(ctx);
+		FlushTextureBatch();
+		if (!parsed)
 			return false;
 	}
    TexCache.CollectCleanup();
+   gl_LogTextureCacheStats();
 
    return !ctx->rend.Overrun;
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <unordered_map>
+#include <vector>
 #include <atomic>
 #include <libretro.h>
 #include "rend/rend.h"
@@ -94,6 +95,7 @@ struct gl_ctx
    GLenum index_type;
    bool stencil_present;
    f32 max_anisotropy;
+   bool program_binary;	// glGetProgramBinary is supported
 
    size_t get_index_size() { return index_type == GL_UNSIGNED_INT ? sizeof(u32) : sizeof(u16); }
 };
@@ -103,6 +105,7 @@ extern GLuint fbTextureId;
 extern float fb_scale_x, fb_scale_y;
 
 u64 gl_GetTexture(TSP tsp,TCW tcw);
+void gl_LogTextureCacheStats();
 struct text_info {
 	u16* pdata;
 	u32 width;
@@ -135,6 +138,12 @@ void findGLVersion();
 GLuint gl_CompileShader(const char* shader, GLuint type);
 GLuint gl_CompileAndLink(const char* VertexShader, const char* FragmentShader);
 bool CompilePipelineShader(PipelineShader* s);
+// Shader cache (glshadercache.cpp)
+void gl_shader_cache_init(u64 sourceHash);
+std::vector<u32> gl_shader_cache_keys();
+bool gl_shader_cache_has_binary(u32 key);
+GLuint gl_shader_cache_load(u32 key);
+void gl_shader_cache_term();
 void co_dc_yield(void);
 void vertex_buffer_unmap();
 
@@ -190,9 +199,15 @@ struct TextureCacheData : BaseTextureCacheData
 {
 	GLuint texID;   //gl texture
 	u16* pData;
+	bool hasTexStorage;		// immutable storage has been allocated for texID
+	u64 contentKey;			// key of the shared gl texture used, 0 if texID isn't shared
+	u64 pendingContentKey;	// key to register texID with once uploaded
 	virtual std::string GetId() override { return std::to_string(texID); }
 	virtual void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override;
+	virtual bool AttachSharedTexture(TextureStaging& staging) override;
 	virtual bool Delete() override;
+	// Drops this entry's reference to its gl texture and deletes it if unused
+	void ReleaseTexture();
 };
 
 class GlTextureCache : public BaseTextureCache<TextureCacheData>
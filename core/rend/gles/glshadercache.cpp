@@ -0,0 +1,175 @@
+/*
+	Shader cache of the GLES renderer.
+
+	Remembers the pipeline shaders used by the previous sessions in gl_shaders.cache, with their program binaries
+	when the driver supports GL_ARB_get_program_binary or GLES 3. The binaries are only kept for the driver and
+	shader sources that produced them. The shader list is kept in any case so that all the shaders can be created
+	when the renderer starts instead of when a new polygon type first shows up.
+*/
+#include <map>
+#include <vector>
+#include "gles.h"
+#include "stdclass.h"
+#include "deps/xxhash/xxhash.h"
+
+static const char *ShaderCacheFileName = "gl_shaders.cache";
+static const u32 ShaderCacheMagic = 0x48534C47;	// "GLSH"
+static const u32 ShaderCacheVersion = 1;
+
+struct ProgramBinary
+{
+	GLenum format = 0;
+	std::vector<u8> data;
+};
+
+// Shaders of the previous sessions by key, with their binary if it can be used
+static std::map<u32, ProgramBinary> programs;
+static u64 driverHash;
+static bool binarySupported;
+
+static u64 getDriverHash(u64 sourceHash)
+{
+	string driver;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+	{
+		const char *s = (const char *)glGetString(name);
+		driver += s != nullptr ? s : "";
+		driver += '\n';
+	}
+	return XXH64(driver.data(), driver.size(), sourceHash);
+}
+
+void gl_shader_cache_init(u64 sourceHash)
+{
+	programs.clear();
+	driverHash = getDriverHash(sourceHash);
+	binarySupported = false;
+#ifndef HAVE_OPENGLES2
+	while (glGetError() != GL_NO_ERROR)
+		;
+	// GL_INVALID_ENUM without GL 4.1 or GL_ARB_get_program_binary
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	binarySupported = glGetError() == GL_NO_ERROR && formats > 0;
+#endif
+	gl.program_binary = binarySupported;
+
+	string path = get_writable_data_path(ShaderCacheFileName);
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	u32 header[3];
+	u64 fileDriverHash;
+	if (fread(header, sizeof(header), 1, f) == 1 && header[0] == ShaderCacheMagic && header[1] == ShaderCacheVersion
+			&& fread(&fileDriverHash, sizeof(fileDriverHash), 1, f) == 1)
+	{
+		bool keepBinaries = binarySupported && fileDriverHash == driverHash;
+		for (u32 i = 0; i < header[2]; i++)
+		{
+			u32 entry[3];	// key, format, size
+			if (fread(entry, sizeof(entry), 1, f) != 1)
+				break;
+			ProgramBinary& program = programs[entry[0]];
+			if (keepBinaries && entry[2] != 0)
+			{
+				program.format = entry[1];
+				program.data.resize(entry[2]);
+				if (fread(&program.data[0], 1, entry[2], f) != entry[2])
+				{
+					programs.erase(entry[0]);
+					break;
+				}
+			}
+			else if (fseek(f, entry[2], SEEK_CUR) != 0)
+				break;
+		}
+		INFO_LOG(RENDERER, "Shader cache loaded from %s: %d shaders, binaries %s", path.c_str(), (int)programs.size(),
+				keepBinaries ? "kept" : !binarySupported ? "not supported" : "dropped");
+	}
+	fclose(f);
+}
+
+std::vector<u32> gl_shader_cache_keys()
+{
+	std::vector<u32> keys;
+	for (const auto& it : programs)
+		keys.push_back(it.first);
+	return keys;
+}
+
+bool gl_shader_cache_has_binary(u32 key)
+{
+	auto it = programs.find(key);
+	return it != programs.end() && !it->second.data.empty();
+}
+
+GLuint gl_shader_cache_load(u32 key)
+{
+#ifndef HAVE_OPENGLES2
+	auto it = programs.find(key);
+	if (it == programs.end() || it->second.data.empty())
+		return 0;
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, it->second.format, &it->second.data[0], it->second.data.size());
+	GLint result = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (result == GL_TRUE)
+		return program;
+	// The driver may reject binaries at any time
+	DEBUG_LOG(RENDERER, "Shader cache: program binary %x rejected", key);
+	glDeleteProgram(program);
+	it->second.data.clear();
+#endif
+	return 0;
+}
+
+void gl_shader_cache_term()
+{
+	bool dirty = false;
+	for (const auto& it : gl.shaders)
+	{
+		if (it.second.program == 0)
+			continue;
+		auto inserted = programs.emplace(it.first, ProgramBinary());
+		dirty = dirty || inserted.second;
+#ifndef HAVE_OPENGLES2
+		ProgramBinary& program = inserted.first->second;
+		if (binarySupported && program.data.empty())
+		{
+			GLint length = 0;
+			glGetProgramiv(it.second.program, GL_PROGRAM_BINARY_LENGTH, &length);
+			if (length > 0)
+			{
+				program.data.resize(length);
+				glGetProgramBinary(it.second.program, length, &length, &program.format, &program.data[0]);
+				program.data.resize(length);
+				dirty = dirty || length > 0;
+			}
+		}
+#endif
+	}
+	if (dirty)
+	{
+		string path = get_writable_data_path(ShaderCacheFileName);
+		FILE *f = fopen(path.c_str(), "wb");
+		if (f == nullptr)
+			WARN_LOG(RENDERER, "Can't save the shader cache to %s", path.c_str());
+		else
+		{
+			u32 header[3] = { ShaderCacheMagic, ShaderCacheVersion, (u32)programs.size() };
+			bool written = fwrite(header, sizeof(header), 1, f) == 1 && fwrite(&driverHash, sizeof(driverHash), 1, f) == 1;
+			for (const auto& it : programs)
+			{
+				u32 entry[3] = { it.first, it.second.format, (u32)it.second.data.size() };
+				written = written && fwrite(entry, sizeof(entry), 1, f) == 1
+						&& (entry[2] == 0 || fwrite(&it.second.data[0], 1, entry[2], f) == entry[2]);
+			}
+			if (fclose(f) != 0 || !written)
+			{
+				WARN_LOG(RENDERER, "Error writing the shader cache to %s", path.c_str());
+				remove(path.c_str());
+			}
+		}
+	}
+	programs.clear();
+}
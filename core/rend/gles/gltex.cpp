@@ -1,5 +1,6 @@
 #include <math.h>
 #include <algorithm>
+#include <unordered_map>
 
 #include <glsm/glsm.h>
 #include <glsm/glsmsym.h>
@@ -46,6 +47,84 @@ GlTextureCache TexCache;
 
 extern "C" struct retro_hw_render_callback hw_render;
 
+// Textures with identical contents at different vram addresses share the same gl texture
+struct SharedTexture
+{
+	GLuint texID;
+	u32 refs;
+	u32 size;	// in bytes
+};
+static std::unordered_map<u64, SharedTexture> shared_textures;
+static u32 SharedTextureLookups;
+static u32 SharedTextureHits;
+static u64 SharedTextureBytesSaved;
+
+void TextureCacheData::ReleaseTexture()
+{
+	pendingContentKey = 0;
+	if (contentKey != 0)
+	{
+		auto it = shared_textures.find(contentKey);
+		verify(it != shared_textures.end());
+		contentKey = 0;
+		if (it->second.refs > 1)
+		{
+			it->second.refs--;
+			SharedTextureBytesSaved -= it->second.size;
+			texID = 0;
+			hasTexStorage = false;
+			return;
+		}
+		shared_textures.erase(it);
+	}
+	if (texID != 0)
+		glcache.DeleteTextures(1, &texID);
+	texID = 0;
+	hasTexStorage = false;
+}
+
+bool TextureCacheData::AttachSharedTexture(TextureStaging& staging)
+{
+	if (texID == 0 || settings.rend.CustomTextures || settings.rend.DumpTextures)
+		return false;
+	SharedTextureLookups++;
+	u64 key = ContentKey(staging);
+	if (key == contentKey)
+		// Written to but unchanged
+		return true;
+
+	auto it = shared_textures.find(key);
+	if (it != shared_textures.end())
+	{
+		ReleaseTexture();
+		texID = it->second.texID;
+		hasTexStorage = true;
+		contentKey = key;
+		it->second.refs++;
+		SharedTextureBytesSaved += it->second.size;
+		SharedTextureHits++;
+
+		return true;
+	}
+	// The texture will be uploaded so it needs its own gl texture
+	if (contentKey != 0)
+	{
+		if (shared_textures[contentKey].refs > 1)
+		{
+			ReleaseTexture();
+			texID = glcache.GenTexture();
+		}
+		else
+		{
+			shared_textures.erase(contentKey);
+			contentKey = 0;
+		}
+	}
+	pendingContentKey = key;
+
+	return false;
+}
+
 void TextureCacheData::UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded)
 {
 	if (texID != 0)
@@ -103,10 +182,11 @@ void TextureCacheData::UploadToGPU(int width, int height, u8 *temp_tex_buffer, b
 					internalFormat = GL_RGBA8;
 					break;
 				}
-				if (Updates == 1)
+				if (!hasTexStorage)
 				{
 					glTexStorage2D(GL_TEXTURE_2D, mipmapLevels, internalFormat, width, height);
 					glCheck();
+					hasTexStorage = true;
 				}
 				for (int i = 0; i < mipmapLevels; i++)
 				{
@@ -133,6 +213,17 @@ void TextureCacheData::UploadToGPU(int width, int height, u8 *temp_tex_buffer, b
 				glGenerateMipmap(GL_TEXTURE_2D);
 	}
 		glCheck();
+
+		// Texture uploads for the same contents in a batch aren't shared
+		if (pendingContentKey != 0 && shared_textures.count(pendingContentKey) == 0)
+		{
+			u32 size = width * height * (tex_type == TextureType::_8888 ? 4 : 2);
+			if (mipmapped)
+				size = size * 4 / 3;
+			shared_textures[pendingContentKey] = { texID, 1, size };
+			contentKey = pendingContentKey;
+		}
+		pendingContentKey = 0;
 	}
 	else {
 		#if FEAT_HAS_SOFTREND
@@ -180,9 +271,7 @@ bool TextureCacheData::Delete()
 		#endif
 	}
 
-	if (texID) {
-		glcache.DeleteTextures(1, &texID);
-	}
+	ReleaseTexture();
 	
 	return true;
 }
@@ -345,7 +434,7 @@ void ReadRTTBuffer() {
 
     	TextureCacheData *texture_data = TexCache.getTextureCacheData(tsp, tcw);
     	if (texture_data->texID != 0)
-    		glcache.DeleteTextures(1, &texture_data->texID);
+    		texture_data->ReleaseTexture();
     	else
     		texture_data->Create();
     	texture_data->texID = gl.rtt.tex;
@@ -365,6 +454,20 @@ static int TexCacheLookups;
 static int TexCacheHits;
 static float LastTexCacheStats;
 
+void gl_LogTextureCacheStats()
+{
+	double now = os_GetSeconds();
+	if (now - LastTexCacheStats < 10)
+		return;
+	LastTexCacheStats = now;
+	DEBUG_LOG(RENDERER, "Texture cache: %d/%d hits, %d/%d shared texture hits, %d shared textures, %d KB saved",
+			TexCacheHits, TexCacheLookups, SharedTextureHits, SharedTextureLookups,
+			(int)shared_textures.size(), (int)(SharedTextureBytesSaved / 1024));
+	TexCacheLookups = 0;
+	TexCacheHits = 0;
+	SharedTextureLookups = 0;
+	SharedTextureHits = 0;
+}
 
 u64 gl_GetTexture(TSP tsp, TCW tcw)
 {
@@ -386,7 +489,7 @@ u64 gl_GetTexture(TSP tsp, TCW tcw)
    {
       if (tf->IsCustomTextureAvailable())
       {
-      	glcache.DeleteTextures(1, &tf->texID);
+      	tf->ReleaseTexture();
       	tf->texID = glcache.GenTexture();
       	tf->CheckCustomTexture();
       }
@@ -1,118 +1,138 @@
-#include <omp.h>
-#include "hw/pvr/pvr.h"
-
 /*
-	SSE/MMX based softrend
+	SSE2 based softrend
 
 	Initial code by skmp and gigaherz
 
-	This is a rather weird very basic pvr softrend. 
-	Renders	in some kind of tile format (that I forget now),
-	and does depth and color, but no alpha, texture, or pixel
-	processing. All of the pipeline is based on quads.
-*/
+	This is a rather weird very basic pvr softrend.
+	Renders in 4x4 pixel blocks, and does depth, color, textures
+	(bilinear filtered), punch-through alpha test and alpha blending,
+	but no fog, offset color or modifier volumes.
 
-#include <mmintrin.h>
-#include <xmmintrin.h>
+	Like the PowerVR, the frame is split in 32x32 tiles. Triangles are
+	binned by tile, in rendering order, then the tiles are rasterized in
+	parallel. Each thread renders to its own tile color and depth buffers,
+	that are copied to the frame once the tile is done.
+
+	When the cpu supports it, the triangles are rasterized by the AVX2
+	version in softrend_avx2.cpp, 8 pixels at a time.
+*/
 #include <emmintrin.h>
-#ifdef __SSE4_1__
-#include <smmintrin.h>
-#endif
+#include <atomic>
 #include <cmath>
 #include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-#include "rend/gles/gles.h"
-
-#define MAX_RENDER_WIDTH 640
-#define MAX_RENDER_HEIGHT 480
-#define MAX_RENDER_PIXELS (MAX_RENDER_WIDTH * MAX_RENDER_HEIGHT)
+#include "softrend_raster.h"
+#include "softrend_output.h"
+#include "rend/TexCache.h"
+#include "rend/sorter.h"
 
-#define STRIDE_PIXEL_OFFSET MAX_RENDER_WIDTH
-#define Z_BUFFER_PIXEL_OFFSET MAX_RENDER_PIXELS
+extern u32 decoded_colors[3][65536];
 
-DECL_ALIGN(32) u32 render_buffer[MAX_RENDER_PIXELS * 2]; //Color + depth
-DECL_ALIGN(32) u32 pixels[MAX_RENDER_PIXELS];
+static DECL_ALIGN(16) u32 pixels[MAX_RENDER_PIXELS];
 
-#ifdef __SSE2__
 union m128i
 {
 	__m128i mm;
 	int8_t m128i_i8[16];
+	uint8_t m128i_u8[16];
 	int16_t m128i_i16[8];
 	int32_t m128i_i32[4];
 	uint32_t m128i_u32[4];
 };
-#endif
 
-bool operator<(const PolyParam &left, const PolyParam &right)
+struct SoftTexture : BaseTextureCacheData
 {
-/* put any condition you want to sort on here */
-	return left.zvZ<right.zvZ;
-	//return left.zMin<right.zMax;
-}
+	bool created = false;
+	u32 width = 0;
+	u32 height = 0;
+	bool pow2 = false;
+	vector<u32> texel_data;
+	SoftTexels texels = { NULL };
 
-//Sort based on min-z of each strip
-void SortPParams(int first, int count)
-{
-	if (pvrrc.verts.used() == 0 || count <= 1)
-		return;
+	std::string GetId() override { char s[20]; sprintf(s, "%p", this); return s; }
 
-	Vertex* vtx_base=pvrrc.verts.head();
-	u16* idx_base=pvrrc.idx.head();
+	void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded) override
+	{
+		u32 bpp = tex_type == TextureType::_8888 ? 4 : 2;
+		if (mipmapsIncluded)
+			// Smallest level first
+			for (int dim = 1; dim < width; dim *= 2)
+				temp_tex_buffer += dim * dim * bpp;
+
+		this->width = width;
+		this->height = height;
+		pow2 = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+		texel_data.resize(width * height * 4);
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+			{
+				u32 *data = &texel_data[(x + y * width) * 4];
+				data[0] = Texel(temp_tex_buffer, (x + 1) % width + (y + 1) % height * width);
+				data[1] = Texel(temp_tex_buffer, (x + 0) % width + (y + 1) % height * width);
+				data[2] = Texel(temp_tex_buffer, (x + 1) % width + (y + 0) % height * width);
+				data[3] = Texel(temp_tex_buffer, (x + 0) % width + (y + 0) % height * width);
+			}
+		texels = { &texel_data[0], this->width, this->height, pow2 };
+	}
+
+	bool Delete() override
+	{
+		if (!BaseTextureCacheData::Delete())
+			return false;
+		texels.data = NULL;
+		texel_data.clear();
+		texel_data.shrink_to_fit();
 
-	PolyParam* pp = &pvrrc.global_param_tr.head()[first];
-	PolyParam* pp_end = pp + count;
+		return true;
+	}
 
-	while(pp!=pp_end)
+private:
+	// Converts to the frame pixel format (ARGB)
+	u32 Texel(const u8 *data, u32 index) const
 	{
-		if (pp->count<2)
+		if (tex_type == TextureType::_8888)
 		{
-			pp->zvZ=0;
+			u32 c = ((const u32 *)data)[index];
+			return (c & 0xFF00FF00) | ((c >> 16) & 0xFF) | ((c & 0xFF) << 16);
 		}
-		else
-		{
-			u16* idx=idx_base+pp->first;
+		return decoded_colors[(int)tex_type][((const u16 *)data)[index]];
+	}
+};
 
-			Vertex* vtx=vtx_base+idx[0];
-			Vertex* vtx_end=vtx_base + idx[pp->count-1]+1;
+#define TPL_DECL_pixel template<bool useoldmsk, int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
+#define TPL_DECL_triangle template<int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
 
-			u32 zv=0xFFFFFFFF;
-			while(vtx!=vtx_end)
-			{
-				zv=min(zv,(u32&)vtx->z);
-				vtx++;
-			}
+#define TPL_PRMS_pixel(useoldmsk) <useoldmsk, alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+#define TPL_PRMS_triangle <alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
 
-			pp->zvZ=(f32&)zv;
-		}
-		pp++;
-	}
 
-	std::stable_sort(pvrrc.global_param_tr.head() + first, pvrrc.global_param_tr.head() + first + count);
-}
+//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+static RendtriangleFnTable RendtriangleFns;
+static RendtriangleFnTable RendtriangleFnsAVX2;
+static bool cpu_has_avx2;
 
-static __m128 _mm_load_scaled_float(float v, float s)
-{
-	return _mm_setr_ps(v, v + s, v + s + s, v + s + s + s);
-}
-static __m128 _mm_broadcast_float(float v)
-{
-	return _mm_setr_ps(v, v, v, v);
-}
-static __m128i _mm_broadcast_int(int v)
-{
-	__m128i rv = _mm_cvtsi32_si128(v);
-	return _mm_shuffle_epi32(rv, 0);
-}
-static __m128 _mm_load_ps_r(float a, float b, float c, float d)
-{
-   DECL_ALIGN(128) float v[4];
-	v[0] = a;
-	v[1] = b;
-	v[2] = c;
-	v[3] = d;
+__m128i const_setAlpha;
+__m128i const_alphaRef;
 
-	return _mm_load_ps(v);
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+	__cpuid(regs, 1);
+	// AVX and OSXSAVE, and the OS saves the ymm registers
+	if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & 0x20) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
 }
 
 __forceinline int iround(float x)
@@ -134,45 +154,6 @@ float mmax(float a, float b, float c, float d)
 	return min(d, rv);
 }
 
-//i think this gives false positives ...
-//yup, if ANY of the 3 tests fail the ANY tests fails.
-__forceinline void EvalHalfSpace(bool& all, bool& any, float cp, float sv, float lv)
-{
-	//bool a00 = C1 + DX12 * y0 - DY12 * x0 > 0;
-	//bool a10 = C1 + DX12 * y0 - DY12 * x0 > qDY12;
-	//bool a01 = C1 + DX12 * y0 - DY12 * x0 > -qDX12;
-	//bool a11 = C1 + DX12 * y0 - DY12 * x0 > (qDY12-qDX12);
-
-	//C1 + DX12 * y0 - DY12 * x0 > 0
-	// + DX12 * y0 - DY12 * x0 > 0 - C1
-	//int pd=DX * y0 - DY * x0;
-
-	bool a = cp > sv;	//needed for ANY
-	bool b = cp > lv;	//needed for ALL
-
-	any &= a;
-	all &= b;
-}
-
-//return true if any is positive
-__forceinline bool EvalHalfSpaceFAny(float cp12, float cp23, float cp31)
-{
-	bool svt = cp12 > 0; //needed for ANY
-	svt |= cp23 > 0;
-	svt |= cp31 > 0;
-
-	return svt;
-}
-
-__forceinline bool EvalHalfSpaceFAll(float cp12, float cp23, float cp31, float lv12, float lv23, float lv31)
-{
-	bool lvt = (cp12 - lv12) > 0;
-	lvt &= (cp23 - lv23) > 0;
-	lvt &= (cp31 - lv31) > 0;	//needed for all
-
-	return lvt;
-}
-
 __forceinline void PlaneMinMax(float& MIN, float& MAX, float DX, float DY, float q)
 {
 	float q_fp = (q - 1);
@@ -185,118 +166,210 @@ __forceinline void PlaneMinMax(float& MIN, float& MAX, float DX, float DY, float
 	MAX = max(v1, max(v2, max(v3, v4)));
 }
 
-struct PlaneStepper
+bool SetupTriangle(TriangleEdges& e, IPs& ip, const PolyParam* pp, const SoftTexels* texture, int vertex_offset,
+		const Vertex &v1, const Vertex &v2, const Vertex &v3, const TileArea* area)
 {
-	__m128 ddx, ddy;
-	__m128 c;
-
-	void Setup(const Vertex &v1, const Vertex &v2, const Vertex &v3, int minx, int miny, int q
-		, float v1_a, float v2_a, float v3_a
-		, float v1_b, float v2_b, float v3_b
-		, float v1_c, float v2_c, float v3_c
-		, float v1_d, float v2_d, float v3_d)
+	//Plane equation
+
+
+	// 28.4 fixed-point coordinates
+	const float Y1 = v1.y;// iround(16.0f * v1.y);
+	const float Y2 = v2.y;// iround(16.0f * v2.y);
+	const float Y3 = v3.y;// iround(16.0f * v3.y);
+
+	const float X1 = v1.x;// iround(16.0f * v1.x);
+	const float X2 = v2.x;// iround(16.0f * v2.x);
+	const float X3 = v3.x;// iround(16.0f * v3.x);
+
+	int sgn = 1;
+
+	// Deltas
 	{
-		//			float v1_z=v1.z,v2_z=v2.z,v3_z=v3.z;
-		float Aa = ((v3_a - v1_a) * (v2.y - v1.y) - (v2_a - v1_a) * (v3.y - v1.y));
-		float Ba = ((v3.x - v1.x) * (v2_a - v1_a) - (v2.x - v1.x) * (v3_a - v1_a));
+		//area: (X1-X3)*(Y2-Y3)-(Y1-Y3)*(X2-X3)
+		float area = ((X1 - X3)*(Y2 - Y3) - (Y1 - Y3)*(X2 - X3));
 
-		float Ab = ((v3_b - v1_b) * (v2.y - v1.y) - (v2_b - v1_b) * (v3.y - v1.y));
-		float Bb = ((v3.x - v1.x) * (v2_b - v1_b) - (v2.x - v1.x) * (v3_b - v1_b));
+		if (area>0)
+			sgn = -1;
 
-		float Ac = ((v3_c - v1_c) * (v2.y - v1.y) - (v2_c - v1_c) * (v3.y - v1.y));
-		float Bc = ((v3.x - v1.x) * (v2_c - v1_c) - (v2.x - v1.x) * (v3_c - v1_c));
+		if (pp->isp.CullMode != 0) {
+			float abs_area = fabsf(area);
 
-		float Ad = ((v3_d - v1_d) * (v2.y - v1.y) - (v2_d - v1_d) * (v3.y - v1.y));
-		float Bd = ((v3.x - v1.x) * (v2_d - v1_d) - (v2.x - v1.x) * (v3_d - v1_d));
+			if (abs_area < FPU_CULL_VAL)
+				return false;
 
-		float C = ((v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y));
-		float ddx_s_a = -Aa / C;
-		float ddy_s_a = -Ba / C;
+			if (pp->isp.CullMode >= 2) {
+				u32 mode = (vertex_offset & 1) ^ (pp->isp.CullMode & 1);
 
-		float ddx_s_b = -Ab / C;
-		float ddy_s_b = -Bb / C;
+				if (
+					(mode == 0 && area < 0) ||
+					(mode == 1 && area > 0)) {
+					return false;
+				}
+			}
+		}
+	}
 
-		float ddx_s_c = -Ac / C;
-		float ddy_s_c = -Bc / C;
+	const float DX12 = sgn*(X1 - X2);
+	const float DX23 = sgn*(X2 - X3);
+	const float DX31 = sgn*(X3 - X1);
 
-		float ddx_s_d = -Ad / C;
-		float ddy_s_d = -Bd / C;
+	const float DY12 = sgn*(Y1 - Y2);
+	const float DY23 = sgn*(Y2 - Y3);
+	const float DY31 = sgn*(Y3 - Y1);
 
-		ddx = _mm_load_ps_r(ddx_s_a, ddx_s_b, ddx_s_c, ddx_s_d);
-		ddy = _mm_load_ps_r(ddy_s_a, ddy_s_b, ddy_s_c, ddy_s_d);
+	// Fixed-point deltas
+	e.FDX12 = DX12;// << 4;
+	e.FDX23 = DX23;// << 4;
+	e.FDX31 = DX31;// << 4;
 
-		float c_s_a = (v1_a - ddx_s_a *v1.x - ddy_s_a*v1.y);
-		float c_s_b = (v1_b - ddx_s_b *v1.x - ddy_s_b*v1.y);
-		float c_s_c = (v1_c - ddx_s_c *v1.x - ddy_s_c*v1.y);
-		float c_s_d = (v1_d - ddx_s_d *v1.x - ddy_s_d*v1.y);
+	e.FDY12 = DY12;// << 4;
+	e.FDY23 = DY23;// << 4;
+	e.FDY31 = DY31;// << 4;
 
-		c = _mm_load_ps_r(c_s_a, c_s_b, c_s_c, c_s_d);
+	// Block size, standard 4x4 (must be power of two)
+	const int q = 4;
 
-		//z = z1 + dzdx * (minx - v1.x) + dzdy * (minx - v1.y);
-		//z = (z1 - dzdx * v1.x - v1.y*dzdy) +  dzdx*inx + dzdy *iny;	
-	}
+	// Bounding rectangle
+	// Also clamped as integers so that invalid vertices can't draw outside of the tile
+	e.minx = max(iround(mmin(X1, X2, X3, area->left)), area->left);// +0xF) >> 4;
+	e.miny = max(iround(mmin(Y1, Y2, Y3, area->top)), area->top);// +0xF) >> 4;
 
-	__forceinline __m128 Ip(__m128 x, __m128 y) const
-	{
-		__m128 p1 = _mm_mul_ps(x, ddx);
-		__m128 p2 = _mm_mul_ps(y, ddy);
+	// Start in corner of block
+	e.minx &= ~(q - 1);
+	e.miny &= ~(q - 1);
 
-		__m128 s1 = _mm_add_ps(p1, p2);
-		return _mm_add_ps(s1, c);
-	}
+	e.spanx = min(iround(mmax(X1 + 0.5f, X2 + 0.5f, X3 + 0.5f, area->right)), area->right) - e.minx;
+	e.spany = min(iround(mmax(Y1 + 0.5f, Y2 + 0.5f, Y3 + 0.5f, area->bottom)), area->bottom) - e.miny;
 
-	__forceinline __m128 InStep(__m128 bas) const
-	{
-		return _mm_add_ps(bas, ddx);
-	}
-};
+	//Inside scissor area?
+	if (e.spanx < 0 || e.spany < 0)
+		return false;
+
+
+	// Half-edge constants
+	float C1 = DY12 * X1 - DX12 * Y1;
+	float C2 = DY23 * X2 - DX23 * Y2;
+	float C3 = DY31 * X3 - DX31 * Y3;
+
+	// Correct for fill convention
+	if (DY12 < 0 || (DY12 == 0 && DX12 > 0)) C1++;
+	if (DY23 < 0 || (DY23 == 0 && DX23 > 0)) C2++;
+	if (DY31 < 0 || (DY31 == 0 && DX31 > 0)) C3++;
+
+	float MIN_12, MIN_23, MIN_31;
+
+	PlaneMinMax(MIN_12, e.MAX_12, DX12, DY12, q);
+	PlaneMinMax(MIN_23, e.MAX_23, DX23, DY23, q);
+	PlaneMinMax(MIN_31, e.MAX_31, DX31, DY31, q);
+
+	e.FDqX12 = e.FDX12 * q;
+	e.FDqX23 = e.FDX23 * q;
+	e.FDqX31 = e.FDX31 * q;
+
+	e.FDqY12 = e.FDY12 * q;
+	e.FDqY23 = e.FDY23 * q;
+	e.FDqY31 = e.FDY31 * q;
+
+	e.hs12 = C1 + e.FDX12 * (e.miny + 0.5f) - e.FDY12 * (e.minx + 0.5f) + e.FDqY12 - MIN_12;
+	e.hs23 = C2 + e.FDX23 * (e.miny + 0.5f) - e.FDY23 * (e.minx + 0.5f) + e.FDqY23 - MIN_23;
+	e.hs31 = C3 + e.FDX31 * (e.miny + 0.5f) - e.FDY31 * (e.minx + 0.5f) + e.FDqY31 - MIN_31;
+
+	e.MAX_12 -= MIN_12;
+	e.MAX_23 -= MIN_23;
+	e.MAX_31 -= MIN_31;
+
+	e.C1_pm = MIN_12;
+	e.C2_pm = MIN_23;
+	e.C3_pm = MIN_31;
+
+	ip.Setup(texture, v1, v2, v3);
+
+	return true;
+}
 
-struct IPs
+// Multiplies 2 pixels (8 u16) by their alpha
+static __forceinline __m128i MulAlpha(__m128i c, __m128i alpha_src)
 {
-	PlaneStepper ZUV;
-	PlaneStepper Col;
+	__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(alpha_src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_mullo_epi16(c, alpha);
+}
 
-	void Setup(PolyParam* pp, text_info* texture, const Vertex &v1, const Vertex &v2, const Vertex &v3, int minx, int miny, int q)
-	{
-		u32 w = 0, h = 0;
-		if (texture) {
-			w = texture->width;
-			h = texture->height;
-		}
+// Blends 4 pixels: src * alpha + dst * (1 - alpha)
+static __forceinline __m128i AlphaBlend(__m128i src, __m128i dst, __m128i alpha_src)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi16(255);
+
+	__m128i lo_src = _mm_unpacklo_epi8(src, zero);
+	__m128i hi_src = _mm_unpackhi_epi8(src, zero);
+	__m128i lo_dst = _mm_unpacklo_epi8(dst, zero);
+	__m128i hi_dst = _mm_unpackhi_epi8(dst, zero);
+	__m128i lo_alpha = _mm_unpacklo_epi8(alpha_src, zero);
+	__m128i hi_alpha = _mm_unpackhi_epi8(alpha_src, zero);
+
+	lo_src = MulAlpha(lo_src, lo_alpha);
+	hi_src = MulAlpha(hi_src, hi_alpha);
+	lo_dst = MulAlpha(lo_dst, _mm_sub_epi16(ones, lo_alpha));
+	hi_dst = MulAlpha(hi_dst, _mm_sub_epi16(ones, hi_alpha));
+
+	return _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(lo_src, lo_dst), 8), _mm_srli_epi16(_mm_adds_epu16(hi_src, hi_dst), 8));
+}
 
-		ZUV.Setup(v1, v2, v3, minx, miny, q,
-			v1.z, v2.z, v3.z,
-			v1.u * w * v1.z, v2.u * w* v2.z, v3.u * w* v3.z,
-			v1.v * h* v1.z, v2.v * h* v2.z, v3.v * h* v3.z,
-			0, -1, 1);
-
-		Col.Setup(v1, v2, v3, minx, miny, q,
-			v1.col[2], v2.col[2], v3.col[2],
-			v1.col[1], v2.col[1], v3.col[1],
-			v1.col[0], v2.col[0], v3.col[0],
-			v1.col[3], v2.col[3], v3.col[3]
-			);
-	}
-};
+// Multiplies 4 pixels component-wise
+static __forceinline __m128i Modulate(__m128i a, __m128i b)
+{
+	__m128i zero = _mm_setzero_si128();
 
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
 
-#define TPL_DECL_pixel template<bool useoldmsk, int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
-#define TPL_DECL_triangle template<int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset >
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
 
-#define TPL_PRMS_pixel(useoldmsk) <useoldmsk, alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-#define TPL_PRMS_triangle <alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+// Bilinear filtered texture fetch of 4 pixels. Weights are in 1/256 units.
+static __forceinline __m128i TextureFetch(const SoftTexels* texture, __m128 u, __m128 v)
+{
+	m128i ui, vi, ufi, vfi;
+	ui.mm = _mm_cvttps_epi32(u);
+	vi.mm = _mm_cvttps_epi32(v);
+	// Round toward -inf
+	ui.mm = _mm_add_epi32(ui.mm, _mm_castps_si128(_mm_cmplt_ps(u, _mm_cvtepi32_ps(ui.mm))));
+	vi.mm = _mm_add_epi32(vi.mm, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(vi.mm))));
+
+	__m128 uf = _mm_sub_ps(u, _mm_cvtepi32_ps(ui.mm));
+	__m128 vf = _mm_sub_ps(v, _mm_cvtepi32_ps(vi.mm));
+	ufi.mm = _mm_cvttps_epi32(_mm_mul_ps(uf, _mm_set1_ps(256)));
+	vfi.mm = _mm_cvttps_epi32(_mm_mul_ps(vf, _mm_set1_ps(256)));
+
+	__m128i zero = _mm_setzero_si128();
+	m128i textel;
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i *)&texture->data[TexelIndex(texture, ui.m128i_i32[i], vi.m128i_i32[i])]);
 
+		s16 fu = (s16)ufi.m128i_i32[i];
+		s16 fv = (s16)vfi.m128i_i32[i];
+		__m128i uw = _mm_set_epi16(256 - fu, 256 - fu, 256 - fu, 256 - fu, fu, fu, fu, fu);
+		__m128i vw = _mm_set_epi16(256 - fv, 256 - fv, 256 - fv, 256 - fv, fv, fv, fv, fv);
 
-//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-typedef void(*RendtriangleFn)(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area);
-RendtriangleFn RendtriangleFns[3][2][2][2][4][2];
+		// (x+1,y+1) (x,y+1)
+		__m128i bottom = _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), uw);
+		// (x+1,y) (x,y)
+		__m128i top = _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), uw);
+		bottom = _mm_srli_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), 8);
+		top = _mm_srli_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), 8);
 
+		__m128i col = _mm_mullo_epi16(_mm_unpacklo_epi64(bottom, top), vw);
+		col = _mm_srli_epi16(_mm_add_epi16(col, _mm_srli_si128(col, 8)), 8);
 
-__m128i const_setAlpha;
-__m128i shuffle_alpha;
+		textel.m128i_i32[i] = _mm_cvtsi128_si32(_mm_packus_epi16(col, col));
+	}
+
+	return textel.mm;
+}
 
 TPL_DECL_pixel
-static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8* cb, __m128 oldmask, IPs& ip)
+static u32 PixelFlush(const SoftTexels* texture, __m128 x, __m128 y, u8* cb, __m128 oldmask, IPs& ip)
 {
 	x = _mm_shuffle_ps(x, x, 0);
 	__m128 invW = ip.ZUV.Ip(x, y);
@@ -322,7 +395,7 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 	u32 msk = _mm_movemask_ps(ZMask);//0xF
 
 	if (msk == 0)
-		return;
+		return 0;
 
 	__m128i rv;
 
@@ -332,8 +405,6 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 		__m128 c = ip.Col.InStep(b);
 		__m128 d = ip.Col.InStep(c);
 
-		//we need : 
-
 		__m128i ab = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
 		__m128i cd = _mm_packs_epi32(_mm_cvttps_epi32(c), _mm_cvttps_epi32(d));
 
@@ -344,282 +415,56 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 		}
 
 		if (pp_Texture) {
-
-			__m128i ui = _mm_cvttps_epi32(u);
-			__m128i vi = _mm_cvttps_epi32(v);
-
-			__m128 uf = _mm_sub_ps(u, _mm_cvtepi32_ps(ui));
-			__m128 vf = _mm_sub_ps(v, _mm_cvtepi32_ps(vi));
-
-			__m128i ufi = _mm_cvttps_epi32(_mm_mul_ps(uf, _mm_set1_ps(256)));
-			__m128i vfi = _mm_cvttps_epi32(_mm_mul_ps(vf, _mm_set1_ps(256)));
-
-			//(int)v<<x+(int)u
-         __m128i textadr;
-#ifdef __SSE4_1__
-			textadr.mm = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#else
-			textadr    = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#endif
-			__m128i textel;
-
-			for (int i = 0; i < 4; i++) {
-				u32 u = textadr.m128i_i16[i * 2 + 0];
-				u32 v = textadr.m128i_i16[i * 2 + 1];
-				
-				__m128i mufi_ = _mm_shuffle_epi32(ufi, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128i mufi_n = _mm_sub_epi32(_mm_set1_epi32(255), mufi_);
-
-				__m128i mvfi_ = _mm_shuffle_epi32(vfi, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128i mvfi_n = _mm_sub_epi32(_mm_set1_epi32(255), mvfi_);
-				
-				ufi = _mm_shuffle_epi32(ufi, _MM_SHUFFLE(0,3,2,1));
-				vfi = _mm_shuffle_epi32(vfi, _MM_SHUFFLE(0,3,2,1));
-
-				u32 pixel;
-				
-#if 0
-				u32 textel_size = 2;
-				
-				u32 pixel00 = decoded_colors[texture->textype][texture->pdata[((u + 1) % texture->width + (v + 1) % texture->height * texture->width)]];
-				u32 pixel01 = decoded_colors[texture->textype][texture->pdata[((u + 0) % texture->width + (v + 1) % texture->height * texture->width)]];
-				u32 pixel10 = decoded_colors[texture->textype][texture->pdata[((u + 1) % texture->width + (v + 0) % texture->height * texture->width)]];
-				u32 pixel11 = decoded_colors[texture->textype][texture->pdata[((u + 0) % texture->width + (v + 0) % texture->height * texture->width)]];
-
-				
-				for (int j = 0; j < 4; j++) {
-				((u8*)&pixel)[j] =
-				
-				(((u8*)&pixel00)[j] * uf.m128_f32[i] + ((u8*)&pixel01)[j] * (1 - uf.m128_f32[i])) * vf.m128_f32[i] + (((u8*)&pixel10)[j] * uf.m128_f32[i] + ((u8*)&pixel11)[j] * (1 - uf.m128_f32[i])) * (1 - vf.m128_f32[i]);
-				}
-#endif
-
-				__m128i px = ((__m128i*)texture->pdata)[((u + 0) % texture->width + (v + 0) % texture->height * texture->width)];
-
-
-				
-				__m128i tex_00 = _mm_cvtepu8_epi32(px);
-				__m128i tex_01 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 1)));
-				__m128i tex_10 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 2)));
-				__m128i tex_11 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 3)));
-
-				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mufi_), _mm_mullo_epi32(tex_01, mufi_n));
-				tex_10 = _mm_add_epi32(_mm_mullo_epi32(tex_10, mufi_), _mm_mullo_epi32(tex_10, mufi_n));
-				
-				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mvfi_), _mm_mullo_epi32(tex_10, mvfi_n));
-				tex_00 = _mm_srli_epi32(tex_00, 16);
-
-				tex_00 = _mm_packus_epi32(tex_00, tex_00);
-				tex_00 = _mm_packus_epi16(tex_00, tex_00);
-				pixel = _mm_cvtsi128_si32(tex_00);
-#if 0
-				//top    = c0 * a + c1 * (1-a)
-				//bottom = c2 * a + c3 * (1-a)
-
-				//[c0 c2] [c1 c3]
-				//[c0 c2]*a + [c1 c3] * (1 - a) = [cx cy]
-				//[cx * d + cy * (1-d)]
-				//cf
-				_mm_unpacklo_epi8()
-				__m128i y = _mm_cvtps_epi32(x);    // Convert them to 32-bit ints
-				y = _mm_packus_epi32(y, y);        // Pack down to 16 bits
-				y = _mm_packus_epi16(y, y);        // Pack down to 8 bits
-				*(int*)out = _mm_cvtsi128_si32(y); // Store the lower 32 bits
-
-				// 0x000000FF * 0x00010001 = 0x00FF00FF
-				
-				
-
-
-				__m128i px = ((__m128i*)texture->pdata)[((u) & ( texture->width - 1) + (v) & (texture->height-1) * texture->width)];
-
-				__m128i lo_px = _mm_cvtepu8_epi16(px);
-				__m128i hi_px = _mm_cvtepu8_epi16(_mm_shuffle_epi32(px, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
-				textel.m128i_i32[i] = pixel;
-			}
+			__m128i textel = TextureFetch(texture, u, v);
 
 			if (pp_IgnoreTexA) {
-#ifdef __SSE4_1__
-            textel.mm = _mm_or_si128(textel.mm, const_setAlpha);
-#else
 				textel = _mm_or_si128(textel, const_setAlpha);
-#endif
 			}
 
-			if (pp_ShadInstr == 0){
-					//color.rgb = texcol.rgb;
-					//color.a = texcol.a;
-#ifdef __SSE4_1__
-            rv = textel.mm;
-#else
-            rv = textel;
-#endif
+			if (pp_ShadInstr == 0) {
+				//color.rgb = texcol.rgb;
+				//color.a = texcol.a;
+				rv = textel;
 			}
 			else if (pp_ShadInstr == 1) {
 				//color.rgb *= texcol.rgb;
 				//color.a = texcol.a;
-
-				//color.a = 1
 				rv = _mm_or_si128(rv, const_setAlpha);
-
-				//color *= texcol
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-#ifdef __SSE4_1__
-            __m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
-            __m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
-
-
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_fb);
-
-				rv = _mm_packus_epi16(_mm_srli_epi16(lo_rv, 8), _mm_srli_epi16(hi_rv, 8));
+				rv = Modulate(rv, textel);
 			}
 			else if (pp_ShadInstr == 2) {
 				//color.rgb=mix(color.rgb,texcol.rgb,texcol.a);
-
 				// a bit wrong atm, as it also mixes alphas
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-#ifdef __SSE4_1__
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
-
-				__m128i lo_rv_alpha = _mm_shuffle_epi8(lo_fb, shuffle_alpha);
-				__m128i hi_rv_alpha = _mm_shuffle_epi8(hi_fb, shuffle_alpha);
-
-				__m128i lo_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), lo_rv_alpha);
-				__m128i hi_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), hi_rv_alpha);
-
-
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_rv_alpha);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_rv_alpha);
-
-				lo_fb = _mm_mullo_epi16(lo_fb, lo_fb_alpha);
-				hi_fb = _mm_mullo_epi16(hi_fb, hi_fb_alpha);
-
-				rv = _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(lo_rv, lo_fb), 8), _mm_srli_epi16(_mm_adds_epu16(hi_rv, hi_fb), 8));
+				rv = AlphaBlend(textel, rv, textel);
 			}
 			else if (pp_ShadInstr == 3) {
 				//color*=texcol
-				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
-				hi_rv = _mm_mullo_epi16(hi_rv, hi_fb);
-
-				rv = _mm_packus_epi16(_mm_srli_epi16(lo_rv, 8), _mm_srli_epi16(hi_rv, 8));
+				rv = Modulate(rv, textel);
 			}
 
 			if (pp_Offset) {
 				//add offset
 			}
-			
-
-			//textadr = _mm_add_epi32(textadr, _mm_setr_epi32(tex_addr, tex_addr, tex_addr, tex_addr));
-#ifdef __SSE4_1__
-			//rv = textel.mm; // _mm_xor_si128(rv, textadr);
-#else
-			//rv = textel; // _mm_xor_si128(rv, textadr);
-#endif
 		}
 	}
 
-	//__m128i rv=ip.col;//_mm_xor_si128(_mm_cvtps_epi32(_mm_mul_ps(x,Z.c)),_mm_cvtps_epi32(y));
-
-	//Alpha test
 	if (alpha_mode == 1) {
-		__m128i fb = *(__m128i*)cb;
-
-#if 1
-#ifdef __SSE4_1__
-      m128i mm_rv, mm_fb;
-      mm_rv.mm = rv;
-      mm_fb.mm = fb;
-#endif
-		//ALPHA_TEST
-		for (int i = 0; i < 4; i++)
-      {
-#ifdef __SSE4_1__
-			if (mm_rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
-				mm_rv.m128i_u32[i] = mm_fb.m128i_u32[i];
-#else
-			if (rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
-				rv.m128i_u32[i] = fb.m128i_u32[i];
-#endif
-		}
-
-#ifdef __SSE4_1__
-		rv = mm_rv.mm;
-#endif
-#else
-		__m128i ALPHA_TEST = _mm_set1_epi8(PT_ALPHA_REF);
-		__m128i mask = _mm_cmplt_epi8(_mm_subs_epu16(ALPHA_TEST, rv), _mm_setzero_si128());
-
-		mask = _mm_srai_epi32(mask, 31); //FF on the pixels we want to keep
-
-		rv = _mm_or_si128(_mm_and_si128(rv, mask), _mm_andnot_si128(mask, cb));
-#endif
-
+		//Alpha test: the pixels below PT_ALPHA_REF are discarded
+		__m128i alpha_ok = _mm_cmpgt_epi32(_mm_srli_epi32(rv, 24), const_alphaRef);
+		ZMask = _mm_and_ps(ZMask, _mm_castsi128_ps(alpha_ok));
+		msk = _mm_movemask_ps(ZMask);
+		if (msk == 0)
+			return 0;
 	}
 	else if (alpha_mode == 2) {
-		__m128i fb = *(__m128i*)cb;
-#if 0
-		for (int i = 0; i < 16; i += 4) {
-			u8 src_blend[4] = { rv.m128i_u8[i + 3], rv.m128i_u8[i + 3], rv.m128i_u8[i + 3], rv.m128i_u8[i + 3] };
-			u8 dst_blend[4] = { 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3], 255 - rv.m128i_u8[i + 3] };
-			for (int j = 0; j < 4; j++) {
-				rv.m128i_u8[i + j] = (rv.m128i_u8[i + j] * src_blend[j]) / 256 + (fb.m128i_u8[i + j] * dst_blend[j]) / 256;
-			}
-		}
-#else
-
-
-		__m128i lo_rv = _mm_cvtepu8_epi16(rv);
-		__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
-
-
-		__m128i lo_fb = _mm_cvtepu8_epi16(fb);
-		__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(fb, _MM_SHUFFLE(1, 0, 3, 2)));
-
-		__m128i lo_rv_alpha = _mm_shuffle_epi8(lo_rv, shuffle_alpha);
-		__m128i hi_rv_alpha = _mm_shuffle_epi8(hi_rv, shuffle_alpha);
-
-		__m128i lo_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), lo_rv_alpha);
-		__m128i hi_fb_alpha = _mm_sub_epi16(_mm_set1_epi16(255), hi_rv_alpha);
-
-
-		lo_rv = _mm_mullo_epi16(lo_rv, lo_rv_alpha);
-		hi_rv = _mm_mullo_epi16(hi_rv, hi_rv_alpha);
-
-		lo_fb = _mm_mullo_epi16(lo_fb, lo_fb_alpha);
-		hi_fb = _mm_mullo_epi16(hi_fb, hi_fb_alpha);
-
-		rv = _mm_packus_epi16(_mm_srli_epi16(_mm_adds_epu16(lo_rv, lo_fb), 8), _mm_srli_epi16(_mm_adds_epu16(hi_rv, hi_fb), 8));
-#endif
+		rv = AlphaBlend(rv, *(__m128i*)cb, rv);
 	}
 
 	if (msk != 0xF)
 	{
-		rv = _mm_and_si128(rv, *(__m128i*)&ZMask);
-		rv = _mm_or_si128(_mm_andnot_si128(*(__m128i*)&ZMask, *(__m128i*)cb), rv);
+		__m128i mask = _mm_castps_si128(ZMask);
+		rv = _mm_and_si128(rv, mask);
+		rv = _mm_or_si128(_mm_andnot_si128(mask, *(__m128i*)cb), rv);
 
 		invW = _mm_and_ps(invW, ZMask);
 		invW = _mm_or_ps(_mm_andnot_ps(ZMask, *zb), invW);
@@ -627,168 +472,48 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 	}
 	*zb = invW;
 	*(__m128i*)cb = rv;
+
+	return PixelCount(msk);
 }
 
-//u32 nok,fok;
 TPL_DECL_triangle
-static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area)
+static u32 Rendtriangle(const PolyParam* pp, const SoftTexels* texture, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, const TileArea* area)
 {
-	text_info texture = { 0 };
-
-	if (pp_Texture) {
-
-		#pragma omp critical (texture_lookup)
-		{
-			texture = raw_GetTexture(pp->tsp, pp->tcw);
-		}
-			
-	}
-
 	const int stride_bytes = STRIDE_PIXEL_OFFSET * 4;
-	//Plane equation
-
-
-	// 28.4 fixed-point coordinates
-	const float Y1 = v1.y;// iround(16.0f * v1.y);
-	const float Y2 = v2.y;// iround(16.0f * v2.y);
-	const float Y3 = v3.y;// iround(16.0f * v3.y);
-
-	const float X1 = v1.x;// iround(16.0f * v1.x);
-	const float X2 = v2.x;// iround(16.0f * v2.x);
-	const float X3 = v3.x;// iround(16.0f * v3.x);
-
-	int sgn = 1;
-
-	// Deltas
-	{
-		//area: (X1-X3)*(Y2-Y3)-(Y1-Y3)*(X2-X3)
-		float area = ((X1 - X3)*(Y2 - Y3) - (Y1 - Y3)*(X2 - X3));
-
-		if (area>0)
-			sgn = -1;
-
-		if (pp->isp.CullMode != 0) {
-			float abs_area = fabsf(area);
-
-			if (abs_area < FPU_CULL_VAL)
-				return;
-
-			if (pp->isp.CullMode >= 2) {
-				u32 mode = vertex_offset ^ pp->isp.CullMode & 1;
-
-				if (
-					(mode == 0 && area < 0) ||
-					(mode == 1 && area > 0)) {
-					return;
-				}
-			}
-		}
-	}
-
-	const float DX12 = sgn*(X1 - X2);
-	const float DX23 = sgn*(X2 - X3);
-	const float DX31 = sgn*(X3 - X1);
-
-	const float DY12 = sgn*(Y1 - Y2);
-	const float DY23 = sgn*(Y2 - Y3);
-	const float DY31 = sgn*(Y3 - Y1);
-
-	// Fixed-point deltas
-	const float FDX12 = DX12;// << 4;
-	const float FDX23 = DX23;// << 4;
-	const float FDX31 = DX31;// << 4;
-
-	const float FDY12 = DY12;// << 4;
-	const float FDY23 = DY23;// << 4;
-	const float FDY31 = DY31;// << 4;
-
 	// Block size, standard 4x4 (must be power of two)
 	const int q = 4;
 
-	// Bounding rectangle
-	int minx = iround(mmin(X1, X2, X3, area->left));// +0xF) >> 4;
-	int miny = iround(mmin(Y1, Y2, Y3, area->top));// +0xF) >> 4;
-
-	// Start in corner of block
-	minx &= ~(q - 1);
-	miny &= ~(q - 1);
-
-	int spanx = iround(mmax(X1 + 0.5f, X2 + 0.5f, X3 + 0.5f, area->right)) - minx;
-	int spany = iround(mmax(Y1 + 0.5f, Y2 + 0.5f, Y3 + 0.5f, area->bottom)) - miny;
-
-	//Inside scissor area?
-	if (spanx < 0 || spany < 0)
-		return;
-
-
-	// Half-edge constants
-	float C1 = DY12 * X1 - DX12 * Y1;
-	float C2 = DY23 * X2 - DX23 * Y2;
-	float C3 = DY31 * X3 - DX31 * Y3;
-
-	// Correct for fill convention
-	if (DY12 < 0 || (DY12 == 0 && DX12 > 0)) C1++;
-	if (DY23 < 0 || (DY23 == 0 && DX23 > 0)) C2++;
-	if (DY31 < 0 || (DY31 == 0 && DX31 > 0)) C3++;
-
-	float MAX_12, MAX_23, MAX_31, MIN_12, MIN_23, MIN_31;
-
-	PlaneMinMax(MIN_12, MAX_12, DX12, DY12, q);
-	PlaneMinMax(MIN_23, MAX_23, DX23, DY23, q);
-	PlaneMinMax(MIN_31, MAX_31, DX31, DY31, q);
-
-	const float FDqX12 = FDX12 * q;
-	const float FDqX23 = FDX23 * q;
-	const float FDqX31 = FDX31 * q;
-
-	const float FDqY12 = FDY12 * q;
-	const float FDqY23 = FDY23 * q;
-	const float FDqY31 = FDY31 * q;
-
-	const float FDX12mq = FDX12 + FDY12*q;
-	const float FDX23mq = FDX23 + FDY23*q;
-	const float FDX31mq = FDX31 + FDY31*q;
-
-	float hs12 = C1 + FDX12 * (miny + 0.5f) - FDY12 * (minx + 0.5f) + FDqY12 - MIN_12;
-	float hs23 = C2 + FDX23 * (miny + 0.5f) - FDY23 * (minx + 0.5f) + FDqY23 - MIN_23;
-	float hs31 = C3 + FDX31 * (miny + 0.5f) - FDY31 * (minx + 0.5f) + FDqY31 - MIN_31;
-
-	MAX_12 -= MIN_12;
-	MAX_23 -= MIN_23;
-	MAX_31 -= MIN_31;
-
-	float C1_pm = MIN_12;
-	float C2_pm = MIN_23;
-	float C3_pm = MIN_31;
-
+	TriangleEdges e;
+	DECL_ALIGN(64) IPs ip;
+	if (!SetupTriangle(e, ip, pp, texture, vertex_offset, v1, v2, v3, area))
+		return 0;
 
+	// The color buffer holds the tile only
 	u8* cb_y = (u8*)colorBuffer;
-	cb_y += miny*stride_bytes + minx*(q * 4);
+	cb_y += (e.miny - area->top)*stride_bytes + (e.minx - area->left)*(q * 4);
 
-   DECL_ALIGN(64) IPs ip;
 
-	ip.Setup(pp, &texture, v1, v2, v3, minx, miny, q);
-	
-	
-	__m128 y_ps = _mm_broadcast_float(miny);
-	__m128 minx_ps = _mm_load_scaled_float(minx - q, 1);
-	static DECL_ALIGN(16) float ones_ps[4] = { 1, 1, 1, 1 };
-	static DECL_ALIGN(16) float q_ps[4] = { q, q, q, q };
+	__m128 y_ps = _mm_broadcast_float(e.miny);
+	__m128 minx_ps = _mm_load_scaled_float(e.minx - q, 1);
+	const __m128 ones_ps = _mm_set1_ps(1);
+	const __m128 q_ps = _mm_set1_ps(q);
+
+	u32 pixel_count = 0;
 
 	// Loop through blocks
-	for (int y = spany; y > 0; y -= q)
+	for (int y = e.spany; y > 0; y -= q)
 	{
-		float Xhs12 = hs12;
-		float Xhs23 = hs23;
-		float Xhs31 = hs31;
+		float Xhs12 = e.hs12;
+		float Xhs23 = e.hs23;
+		float Xhs31 = e.hs31;
 		u8* cb_x = cb_y;
 		__m128 x_ps = minx_ps;
-		for (int x = spanx; x > 0; x -= q)
+		for (int x = e.spanx; x > 0; x -= q)
 		{
-			Xhs12 -= FDqY12;
-			Xhs23 -= FDqY23;
-			Xhs31 -= FDqY31;
-			x_ps = _mm_add_ps(x_ps, *(__m128*)q_ps);
+			Xhs12 -= e.FDqY12;
+			Xhs23 -= e.FDqY23;
+			Xhs31 -= e.FDqY31;
+			x_ps = _mm_add_ps(x_ps, q_ps);
 
 			// Corners of block
 			bool any = EvalHalfSpaceFAny(Xhs12, Xhs23, Xhs31);
@@ -800,7 +525,7 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 				continue;
 			}
 
-			bool all = EvalHalfSpaceFAll(Xhs12, Xhs23, Xhs31, MAX_12, MAX_23, MAX_31);
+			bool all = EvalHalfSpaceFAll(Xhs12, Xhs23, Xhs31, e.MAX_12, e.MAX_23, e.MAX_31);
 
 			// Accept whole block when totally covered
 			if (all)
@@ -808,28 +533,27 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 				__m128 yl_ps = y_ps;
 				for (int iy = q; iy > 0; iy--)
 				{
-					PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, x_ps, ip);
-					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
+					pixel_count += PixelFlush TPL_PRMS_pixel(false) (texture, x_ps, yl_ps, cb_x, x_ps, ip);
+					yl_ps = _mm_add_ps(yl_ps, ones_ps);
 					cb_x += sizeof(__m128);
 				}
 			}
 			else // Partially covered block
 			{
-				float CY1 = C1_pm + Xhs12;
-				float CY2 = C2_pm + Xhs23;
-				float CY3 = C3_pm + Xhs31;
+				float CY1 = e.C1_pm + Xhs12;
+				float CY2 = e.C2_pm + Xhs23;
+				float CY3 = e.C3_pm + Xhs31;
 
-				__m128 pfdx12 = _mm_broadcast_float(FDX12);
-				__m128 pfdx23 = _mm_broadcast_float(FDX23);
-				__m128 pfdx31 = _mm_broadcast_float(FDX31);
+				__m128 pfdx12 = _mm_broadcast_float(e.FDX12);
+				__m128 pfdx23 = _mm_broadcast_float(e.FDX23);
+				__m128 pfdx31 = _mm_broadcast_float(e.FDX31);
 
-				__m128 pcy1 = _mm_load_scaled_float(CY1, -FDY12);
-				__m128 pcy2 = _mm_load_scaled_float(CY2, -FDY23);
-				__m128 pcy3 = _mm_load_scaled_float(CY3, -FDY31);
+				__m128 pcy1 = _mm_load_scaled_float(CY1, -e.FDY12);
+				__m128 pcy2 = _mm_load_scaled_float(CY2, -e.FDY23);
+				__m128 pcy3 = _mm_load_scaled_float(CY3, -e.FDY31);
 
 				__m128 pzero = _mm_setzero_ps();
 
-				//bool ok=false;
 				__m128 yl_ps = y_ps;
 
 				for (int iy = q; iy > 0; iy--)
@@ -839,139 +563,300 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 					__m128 mask3 = _mm_cmple_ps(pcy3, pzero);
 					__m128 summary = _mm_or_ps(mask3, _mm_or_ps(mask2, mask1));
 
-					__m128i a = _mm_cmpeq_epi32((__m128i&)summary, (__m128i&)pzero);
-					int msk = _mm_movemask_ps((__m128&)a);
+					__m128 a = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_castps_si128(summary), _mm_castps_si128(pzero)));
+					int msk = _mm_movemask_ps(a);
 
 					if (msk != 0)
 					{
 						if (msk != 0xF)
-							PixelFlush TPL_PRMS_pixel(true) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
+							pixel_count += PixelFlush TPL_PRMS_pixel(true) (texture, x_ps, yl_ps, cb_x, a, ip);
 						else
-							PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
+							pixel_count += PixelFlush TPL_PRMS_pixel(false) (texture, x_ps, yl_ps, cb_x, a, ip);
 					}
 
-					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
+					yl_ps = _mm_add_ps(yl_ps, ones_ps);
 					cb_x += sizeof(__m128);
 
-					//CY1 += FDX12mq;
-					//CY2 += FDX23mq;
-					//CY3 += FDX31mq;
 					pcy1 = _mm_add_ps(pcy1, pfdx12);
 					pcy2 = _mm_add_ps(pcy2, pfdx23);
 					pcy3 = _mm_add_ps(pcy3, pfdx31);
 				}
-				/*
-				if (!ok)
-				{
-				nok++;
-				}
-				else
-				{
-				fok++;
-				}*/
 			}
 		}
-	next_y:
-		hs12 += FDqX12;
-		hs23 += FDqX23;
-		hs31 += FDqX31;
+		e.hs12 += e.FDqX12;
+		e.hs23 += e.FDqX23;
+		e.hs31 += e.FDqX31;
 		cb_y += stride_bytes*q;
-		y_ps = _mm_add_ps(y_ps, *(__m128*)q_ps);
+		y_ps = _mm_add_ps(y_ps, q_ps);
+	}
+
+	return pixel_count;
+}
+
+void co_dc_yield();
+
+// Triangle binned to the tiles it overlaps
+struct SoftTriangle
+{
+	RendtriangleFn fn;
+	const PolyParam* pp;
+	const SoftTexels* texture;
+	const Vertex* v[3];
+	int vertex_offset;
+};
+
+// Tile row or column of a coordinate. Clamped as integers since NaNs go through the float tests with -ffast-math
+static int TileIndex(float v, int tile_count)
+{
+	int index = (int)min(max(v, 0.f), tile_count * TILE_SIZE - 1.f) / TILE_SIZE;
+	return min(max(index, 0), tile_count - 1);
+}
+
+static vector<SoftTriangle> triangles;
+static vector<u32> tile_bins[TILE_COUNT];
+static std::atomic<int> tile_next;
+static DECL_ALIGN(16) u32 tile_buffer[TILE_PIXELS * 2];	//Color + depth
+static std::atomic<u64> frame_pixels;
+static SoftrendStats stats;
+
+static void RenderTile(int tile, u32* buffer)
+{
+	int tile_x = tile % TILES_X * TILE_SIZE;
+	int tile_y = tile / TILES_X * TILE_SIZE;
+	TileArea area = { tile_x, tile_y, tile_x + TILE_SIZE, tile_y + TILE_SIZE };
+
+	memset(buffer, 0, TILE_PIXELS * 2 * sizeof(u32));
+	u64 pixel_count = 0;
+	for (u32 index : tile_bins[tile])
+	{
+		const SoftTriangle& t = triangles[index];
+		pixel_count += t.fn(t.pp, t.texture, t.vertex_offset, *t.v[0], *t.v[1], *t.v[2], buffer, &area);
 	}
+	frame_pixels += pixel_count;
+
+	// 4x4 blocks to lines
+	const __m128i* src = (const __m128i*)buffer;
+	for (int y = tile_y; y < tile_y + TILE_SIZE; y += 4)
+		for (int x = tile_x; x < tile_x + TILE_SIZE; x += 4)
+			for (int i = 0; i < 4; i++)
+				_mm_store_si128((__m128i*)&pixels[(y + i) * MAX_RENDER_WIDTH + x], *src++);
 }
 
+static void RenderTiles(u32* buffer)
+{
+	while (true)
+	{
+		int tile = tile_next++;
+		if (tile >= TILE_COUNT)
+			break;
+		RenderTile(tile, buffer);
+	}
+}
+
+#if !defined(TARGET_NO_THREADS)
+struct SoftTileWorker
+{
+	SoftTileWorker(ThreadEntryFP *func) : thread(func, this) {}
+
+	cThread thread;
+	cResetEvent wakeup;
+	DECL_ALIGN(16) u32 buffer[TILE_PIXELS * 2];	//Color + depth
+};
+
+static vector<SoftTileWorker *> tile_workers;
+static volatile bool tile_workers_running;
+static std::atomic<int> tile_workers_busy;
+static cResetEvent tiles_done;
+
+static void *tile_worker_thread(void *param)
+{
+	SoftTileWorker *worker = (SoftTileWorker *)param;
+	while (true)
+	{
+		worker->wakeup.Wait();
+		if (!tile_workers_running)
+			break;
+		RenderTiles(worker->buffer);
+		if (--tile_workers_busy == 0)
+			tiles_done.Set();
+	}
+	return NULL;
+}
+#endif
 
 struct softrend : Renderer
 {
-	virtual bool Process(TA_context* ctx) {
-		//disable RTTs for now ..
+	bool Process(TA_context* ctx) override
+	{
+		// Render to texture isn't supported: the frame is skipped and the texture keeps its vram contents
 		if (ctx->rend.isRTT)
 			return false;
 
+		if (ctx->rend.isRenderFramebuffer)
+			return RenderFramebuffer();
+
 		ctx->rend_inuse.Lock();
 
-		if (!ta_parse_vdrc(ctx))
-			return false;
+		if (KillTex)
+			textures.Clear();
 
-		return true;
-	}
+		BeginTextureBatch();
+		bool parsed = ta_parse_vdrc(ctx);
+		FlushTextureBatch();
+		textures.CollectCleanup();
 
-	
+		return parsed && !ctx->rend.Overrun;
+	}
 
+	// Bins the triangles of a list to the tiles they overlap
 	template <int alpha_mode>
-	void RenderParamList(List<PolyParam>* param_list, RECT* area) {
-		
-		Vertex* verts = pvrrc.verts.head();
-		u16* idx = pvrrc.idx.head();
-
-		PolyParam* params = param_list->head();
-		int param_count = param_list->used();
+	void BinParams(List<PolyParam>* param_list, u32 first, u32 end, RendtriangleFnTable& fns)
+	{
+		const Vertex* verts = pvrrc.verts.head();
+		const u32* idx = pvrrc.idx.head();
 
-		for (int i = 0; i < param_count; i++)
+		for (u32 i = first; i < end; i++)
 		{
-			int vertex_count = params[i].count - 2;
+			const PolyParam* pp = &param_list->head()[i];
+			const SoftTexels* texture = NULL;
+			if (pp->pcw.Texture && pp->texid != (u64)-1)
+			{
+				texture = &((const SoftTexture*)(uintptr_t)pp->texid)->texels;
+				if (texture->data == NULL)
+					texture = NULL;
+			}
+			//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+			RendtriangleFn fn = fns[alpha_mode][pp->tsp.UseAlpha][texture != NULL][pp->tsp.IgnoreTexA][pp->tsp.ShadInstr][pp->pcw.Offset];
 
-			u16* poly_idx = &idx[params[i].first];
+			const u32* poly_idx = &idx[pp->first];
+			for (int v = 0; v + 2 < (int)pp->count; v++)
+			{
+				const Vertex* v1 = &verts[poly_idx[v]];
+				const Vertex* v2 = &verts[poly_idx[v + 1]];
+				const Vertex* v3 = &verts[poly_idx[v + 2]];
+
+				float minx = min(v1->x, min(v2->x, v3->x));
+				float maxx = max(v1->x, max(v2->x, v3->x));
+				float miny = min(v1->y, min(v2->y, v3->y));
+				float maxy = max(v1->y, max(v2->y, v3->y));
+				if (!(maxx >= 0 && maxy >= 0 && minx < MAX_RENDER_WIDTH && miny < MAX_RENDER_HEIGHT))
+					continue;
+
+				int tx0 = TileIndex(minx, TILES_X);
+				int tx1 = TileIndex(maxx + 1.f, TILES_X);
+				int ty0 = TileIndex(miny, TILES_Y);
+				int ty1 = TileIndex(maxy + 1.f, TILES_Y);
+
+				u32 index = triangles.size();
+				triangles.push_back({ fn, pp, texture, { v1, v2, v3 }, v });
+				for (int ty = ty0; ty <= ty1; ty++)
+					for (int tx = tx0; tx <= tx1; tx++)
+						tile_bins[ty * TILES_X + tx].push_back(index);
+			}
+		}
+	}
 
-			for (int v = 0; v < vertex_count; v++) {
-				////<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-				RendtriangleFn fn = RendtriangleFns[alpha_mode][params[i].tsp.UseAlpha][params[i].pcw.Texture][params[i].tsp.IgnoreTexA][params[i].tsp.ShadInstr][params[i].pcw.Offset];
+	void BinTriangles(RendtriangleFnTable& fns)
+	{
+		triangles.clear();
+		for (vector<u32>& bin : tile_bins)
+			bin.clear();
+
+		u32 op_first = 0;
+		u32 pt_first = 0;
+		u32 tr_first = 0;
+		for (int pass = 0; pass < pvrrc.render_passes.used(); pass++)
+		{
+			const RenderPass& render_pass = pvrrc.render_passes.head()[pass];
 
-				fn(&params[i], v, verts[poly_idx[v]], verts[poly_idx[v + 1]], verts[poly_idx[v + 2]], render_buffer, area);
-			}
+			BinParams<0>(&pvrrc.global_param_op, op_first, render_pass.op_count, fns);
+			BinParams<1>(&pvrrc.global_param_pt, pt_first, render_pass.pt_count, fns);
+			if (render_pass.autosort)
+				SortPParams(tr_first, render_pass.tr_count - tr_first);
+			BinParams<2>(&pvrrc.global_param_tr, tr_first, render_pass.tr_count, fns);
+
+			op_first = render_pass.op_count;
+			pt_first = render_pass.pt_count;
+			tr_first = render_pass.tr_count;
 		}
 	}
-	virtual bool Render() {
-		bool is_rtt = pvrrc.isRTT;
 
-		memset(render_buffer, 0, sizeof(render_buffer));
+	bool Render() override
+	{
+		if (pvrrc.isRenderFramebuffer)
+		{
+			softrend_output_frame(pixels);
+			return true;
+		}
 
 		if (pvrrc.verts.used()<3)
 			return false;
 
-      if (pvrrc.render_passes.head()[0].autosort)
-			SortPParams(0, pvrrc.global_param_tr.used());
+		double start = os_GetSeconds();
+		const_alphaRef = _mm_set1_epi32((int)(PT_ALPHA_REF & 0xFF) - 1);
+		bool use_avx2 = cpu_has_avx2 && settings.pvr.SoftRendAVX2;
+		BinTriangles(use_avx2 ? RendtriangleFnsAVX2 : RendtriangleFns);
 
-		int tcount = omp_get_num_procs() - 1;
-		if (tcount == 0) tcount = 1;
-		if (tcount > settings.pvr.MaxThreads) tcount = settings.pvr.MaxThreads;
-#pragma omp parallel num_threads(tcount)
+		tile_next = 0;
+		frame_pixels = 0;
+#if !defined(TARGET_NO_THREADS)
+		int worker_count = min((int)settings.pvr.MaxThreads, TILE_COUNT) - 1;
+		if (worker_count > 0)
 		{
-			int thd = omp_get_thread_num();
-			int y_offs = 480 % omp_get_num_threads();
-			int y_thd = 480 / omp_get_num_threads();
-			int y_start = (!!thd) * y_offs + y_thd * thd;
-			int y_end =  y_offs + y_thd * (thd + 1);
-
-			RECT area = { 0, y_start, 640, y_end };
-			RenderParamList<0>(&pvrrc.global_param_op, &area);
-			RenderParamList<1>(&pvrrc.global_param_pt, &area);
-			RenderParamList<2>(&pvrrc.global_param_tr, &area);
+			tile_workers_running = true;
+			while ((int)tile_workers.size() < worker_count)
+			{
+				SoftTileWorker *worker = new SoftTileWorker(tile_worker_thread);
+				worker->thread.Start();
+				tile_workers.push_back(worker);
+			}
 		}
+		tile_workers_busy = max(worker_count, 0);
+		for (int i = 0; i < worker_count; i++)
+			tile_workers[i]->wakeup.Set();
+#endif
+		RenderTiles(tile_buffer);
+#if !defined(TARGET_NO_THREADS)
+		if (worker_count > 0)
+			tiles_done.Wait();
+#endif
+		stats.pixels = frame_pixels;
+		stats.render_ms = (os_GetSeconds() - start) * 1000.0;
+		stats.avx2 = use_avx2;
+		DEBUG_LOG(RENDERER, "softrend: %s %.3f Mpixels in %.3f ms, %.1f Mpixels/s", use_avx2 ? "AVX2" : "SSE2",
+				stats.pixels / 1000000.0, stats.render_ms, stats.render_ms > 0 ? stats.pixels / stats.render_ms / 1000.0 : 0.0);
+		softrend_output_frame(pixels);
 
-		
-		
+		return true;
+	}
 
-		/*
-		for (int y = 0; y < 480; y++) {
-			for (int x = 0; x < 640; x++) {
-				color_buffer[x + y * 640] = rand();
-			}
-		} */
+	bool RenderFramebuffer()
+	{
+		if (FB_R_SIZE.fb_x_size == 0 || FB_R_SIZE.fb_y_size == 0)
+			return false;
 
-		return !is_rtt;
-	}
+		PixelBuffer<u32> pb;
+		int width;
+		int height;
+		ReadFramebuffer(pb, width, height);
 
-	HWND hWnd;
-	HBITMAP hBMP = 0, holdBMP;
-	HDC hmem;
-	
+		memset(pixels, 0, sizeof(pixels));
+		width = min(width, MAX_RENDER_WIDTH);
+		height = min(height, MAX_RENDER_HEIGHT);
+		for (int y = 0; y < height; y++)
+		{
+			const u32* src = pb.data(0, y);
+			u32* dst = &pixels[y * MAX_RENDER_WIDTH];
+			// RGBA to ARGB
+			for (int x = 0; x < width; x++)
+				dst[x] = (src[x] & 0xFF00FF00) | ((src[x] >> 16) & 0xFF) | ((src[x] & 0xFF) << 16);
+		}
 
+		return true;
+	}
 
-	virtual bool Init() {
+	bool Init() override {
 		const_setAlpha = _mm_set1_epi32(0xFF000000);
-		u8 ushuffle[] = { 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80};
-		memcpy(&shuffle_alpha, ushuffle, sizeof(shuffle_alpha));
 
 		#define REP_16(x) ((x)* 16 + (x))
 		#define REP_32(x) ((x)* 8 + (x)/4)
@@ -1183,54 +1068,74 @@ struct softrend : Renderer
 			RendtriangleFns[2][1][0][1][3][1] = &Rendtriangle<2, 1, 0, 1, 3, 1>;
 		}
 
+		cpu_has_avx2 = CpuHasAVX2();
+		if (cpu_has_avx2)
+			softrend_InitAVX2(RendtriangleFnsAVX2);
+		INFO_LOG(RENDERER, "softrend: AVX2 %s", cpu_has_avx2 ? "supported" : "not supported");
+		softrend_output_init((FrameOutputMode)settings.pvr.FrameOutput);
+
+		textures.Clear();
+
 		return true;
 	}
 
-	virtual void Resize(int w, int h) {
+	void Resize(int w, int h) override {
 
 	}
 
-	virtual void Term() {
+	void Term() override {
+#if !defined(TARGET_NO_THREADS)
+		tile_workers_running = false;
+		for (SoftTileWorker *worker : tile_workers)
+		{
+			worker->wakeup.Set();
+			worker->thread.WaitToEnd();
+			delete worker;
+		}
+		tile_workers.clear();
+#endif
+		softrend_output_term();
+		textures.Clear();
+		triangles.clear();
+		triangles.shrink_to_fit();
+		for (vector<u32>& bin : tile_bins)
+		{
+			bin.clear();
+			bin.shrink_to_fit();
+		}
 	}
 
-	#define RR(x, a, b, c, d) (x + a), (x + b), (x + c), (x + d)
-	#define R(a, b, c, d) RR(12, a, b, c, d), RR(8, a, b, c, d), RR(4, a, b, c, d),  RR(0, a, b, c, d)
-
-	//R coefs should be adjusted to match pixel format
-	INLINE __m128 shuffle_pixel(__m128 v)
-   {
-		return (__m128)_mm_shuffle_epi8((__m128i)v, _mm_set_epi8(R(0x80,2,1, 0)));
- 	}
-
-	virtual void Present() {
-
-		__m128* psrc = (__m128*)render_buffer;
-		__m128* pdst = (__m128*)pixels;
-
-		#define SHUFFL(v) v
-
-		#if HOST_OS == OS_WINDOWS
-			#define FLIP_Y 479 - 
-		#else
-			#define FLIP_Y
-		#endif
+	void Present() override {
+		co_dc_yield();
+	}
 
-		const int stride = STRIDE_PIXEL_OFFSET / 4;
-		for (int y = 0; y<MAX_RENDER_HEIGHT; y += 4)
+	u64 GetTexture(TSP tsp, TCW tcw) override
+	{
+		SoftTexture* texture = textures.getTextureCacheData(tsp, tcw);
+		if (!texture->created)
 		{
-			for (int x = 0; x<MAX_RENDER_WIDTH; x += 4)
-			{
-				pdst[(FLIP_Y - (y + 0))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 1))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 2))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 3))*stride + x / 4] = SHUFFL(*psrc++);
-			}
+			texture->Create();
+			texture->created = true;
 		}
+		if (texture->NeedsUpdate())
+			texture->Update();
 
-      /* should do a video_cb call here */
+		return (u64)(uintptr_t)texture;
 	}
+
+	BaseTextureCache<SoftTexture> textures;
 };
 
+const u32* softrend_GetFrame()
+{
+	return pixels;
+}
+
+SoftrendStats softrend_GetStats()
+{
+	return stats;
+}
+
 Renderer* rend_softrend() {
-	return new(_mm_malloc(sizeof(softrend), 32)) softrend();
+	return new softrend();
 }
@@ -0,0 +1,19 @@
+#pragma once
+#include "hw/pvr/Renderer_if.h"
+
+#define MAX_RENDER_WIDTH 640
+#define MAX_RENDER_HEIGHT 480
+#define MAX_RENDER_PIXELS (MAX_RENDER_WIDTH * MAX_RENDER_HEIGHT)
+
+// Last frame rendered by the software renderer. XRGB8888, MAX_RENDER_WIDTH pixels per line.
+const u32* softrend_GetFrame();
+
+struct SoftrendStats
+{
+	u64 pixels;			// pixels written by the rasterizer, overdraw included
+	double render_ms;	// binning and rasterization time
+	bool avx2;			// rendered with the AVX2 rasterizer
+};
+
+// Statistics of the last frame rendered by the software renderer
+SoftrendStats softrend_GetStats();
@@ -0,0 +1,418 @@
+/*
+	AVX2 rasterizer of the software renderer
+
+	Same triangle setup and 4x4 block traversal as the SSE2 rasterizer in softrend.cpp,
+	but pixels are shaded 8 at a time: 2 rows of a block, that are contiguous in the tile buffer.
+	Texels are fetched with gathers.
+
+	This file is built with AVX2 code generation and is only used when the cpu supports it.
+	It must not use inline functions or templates shared with other files (STL included),
+	see softrend_raster.h.
+*/
+#include <immintrin.h>
+#include "softrend_raster.h"
+
+namespace {
+
+// Plane equations of the 4 attributes of a PlaneStepper, for 2 rows of 4 pixels.
+// Stepped from the left of the row like the SSE2 version so that both give the same results.
+struct PlaneStepper8
+{
+	__m256 ddx[4], ddy[4], c[4];
+	__m256 step1[4], step2[4], step3[4];	// ddx for the pixels at x >= 1, 2 and 3
+
+	__forceinline void Setup(const PlaneStepper& ps)
+	{
+		DECL_ALIGN(16) float dx[4], dy[4], cs[4];
+		_mm_store_ps(dx, ps.ddx);
+		_mm_store_ps(dy, ps.ddy);
+		_mm_store_ps(cs, ps.c);
+		for (int i = 0; i < 4; i++)
+		{
+			ddx[i] = _mm256_set1_ps(dx[i]);
+			ddy[i] = _mm256_set1_ps(dy[i]);
+			c[i] = _mm256_set1_ps(cs[i]);
+			step1[i] = _mm256_setr_ps(0, dx[i], dx[i], dx[i], 0, dx[i], dx[i], dx[i]);
+			step2[i] = _mm256_setr_ps(0, 0, dx[i], dx[i], 0, 0, dx[i], dx[i]);
+			step3[i] = _mm256_setr_ps(0, 0, 0, dx[i], 0, 0, 0, dx[i]);
+		}
+	}
+
+	// x is the left of the rows
+	__forceinline __m256 Ip(int i, __m256 x, __m256 y) const
+	{
+		__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, ddx[i]), _mm256_mul_ps(y, ddy[i])), c[i]);
+		return _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(v, step1[i]), step2[i]), step3[i]);
+	}
+};
+
+struct IPs8
+{
+	PlaneStepper8 ZUV;
+	PlaneStepper8 Col;
+
+	__forceinline void Setup(const IPs& ip)
+	{
+		ZUV.Setup(ip.ZUV);
+		Col.Setup(ip.Col);
+	}
+};
+
+// Multiplies 4 pixels (16 u16) by their alpha
+__forceinline __m256i MulAlpha8(__m256i c, __m256i alpha_src)
+{
+	__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(alpha_src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_mullo_epi16(c, alpha);
+}
+
+// Blends 8 pixels: src * alpha + dst * (1 - alpha)
+__forceinline __m256i AlphaBlend8(__m256i src, __m256i dst, __m256i alpha_src)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i ones = _mm256_set1_epi16(255);
+
+	__m256i lo_src = _mm256_unpacklo_epi8(src, zero);
+	__m256i hi_src = _mm256_unpackhi_epi8(src, zero);
+	__m256i lo_dst = _mm256_unpacklo_epi8(dst, zero);
+	__m256i hi_dst = _mm256_unpackhi_epi8(dst, zero);
+	__m256i lo_alpha = _mm256_unpacklo_epi8(alpha_src, zero);
+	__m256i hi_alpha = _mm256_unpackhi_epi8(alpha_src, zero);
+
+	lo_src = MulAlpha8(lo_src, lo_alpha);
+	hi_src = MulAlpha8(hi_src, hi_alpha);
+	lo_dst = MulAlpha8(lo_dst, _mm256_sub_epi16(ones, lo_alpha));
+	hi_dst = MulAlpha8(hi_dst, _mm256_sub_epi16(ones, hi_alpha));
+
+	return _mm256_packus_epi16(_mm256_srli_epi16(_mm256_adds_epu16(lo_src, lo_dst), 8), _mm256_srli_epi16(_mm256_adds_epu16(hi_src, hi_dst), 8));
+}
+
+// Multiplies 8 pixels component-wise
+__forceinline __m256i Modulate8(__m256i a, __m256i b)
+{
+	__m256i zero = _mm256_setzero_si256();
+
+	__m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+	__m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+	return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+// (a * w + b * (256 - w)) / 256 for each component of 8 pixels. w holds the weight of each pixel in both u16 halves.
+__forceinline __m256i Lerp8(__m256i a, __m256i b, __m256i w)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i wi = _mm256_sub_epi16(_mm256_set1_epi16(256), w);
+	// Weights of the pixels 0,1 and 4,5 for the low halves, 2,3 and 6,7 for the high ones
+	__m256i w_lo = _mm256_unpacklo_epi32(w, w);
+	__m256i w_hi = _mm256_unpackhi_epi32(w, w);
+	__m256i wi_lo = _mm256_unpacklo_epi32(wi, wi);
+	__m256i wi_hi = _mm256_unpackhi_epi32(wi, wi);
+
+	__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), w_lo), _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), wi_lo));
+	__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), w_hi), _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), wi_hi));
+
+	return _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+}
+
+// Bilinear filtered texture fetch of 8 pixels. Weights are in 1/256 units.
+__forceinline __m256i TextureFetch8(const SoftTexels* texture, __m256 u, __m256 v)
+{
+	__m256i ui = _mm256_cvttps_epi32(u);
+	__m256i vi = _mm256_cvttps_epi32(v);
+	// Round toward -inf
+	ui = _mm256_add_epi32(ui, _mm256_castps_si256(_mm256_cmp_ps(u, _mm256_cvtepi32_ps(ui), _CMP_LT_OQ)));
+	vi = _mm256_add_epi32(vi, _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_cvtepi32_ps(vi), _CMP_LT_OQ)));
+
+	__m256 uf = _mm256_sub_ps(u, _mm256_cvtepi32_ps(ui));
+	__m256 vf = _mm256_sub_ps(v, _mm256_cvtepi32_ps(vi));
+	__m256i ufi = _mm256_cvttps_epi32(_mm256_mul_ps(uf, _mm256_set1_ps(256)));
+	__m256i vfi = _mm256_cvttps_epi32(_mm256_mul_ps(vf, _mm256_set1_ps(256)));
+	// Same truncation to s16 as the SSE2 version
+	ufi = _mm256_and_si256(ufi, _mm256_set1_epi32(0xFFFF));
+	vfi = _mm256_and_si256(vfi, _mm256_set1_epi32(0xFFFF));
+	ufi = _mm256_or_si256(ufi, _mm256_slli_epi32(ufi, 16));
+	vfi = _mm256_or_si256(vfi, _mm256_slli_epi32(vfi, 16));
+
+	__m256i index;
+	if (texture->pow2)
+	{
+		__m256i um = _mm256_and_si256(ui, _mm256_set1_epi32(texture->width - 1));
+		__m256i vm = _mm256_and_si256(vi, _mm256_set1_epi32(texture->height - 1));
+		index = _mm256_mullo_epi32(vm, _mm256_set1_epi32(texture->width));
+		index = _mm256_slli_epi32(_mm256_add_epi32(index, um), 2);
+	}
+	else
+	{
+		DECL_ALIGN(32) u32 us[8], vs[8], is[8];
+		_mm256_store_si256((__m256i*)us, ui);
+		_mm256_store_si256((__m256i*)vs, vi);
+		for (int i = 0; i < 8; i++)
+			is[i] = TexelIndex(texture, us[i], vs[i]);
+		index = _mm256_load_si256((const __m256i*)is);
+	}
+
+	const int* data = (const int*)texture->data;
+	// (x+1,y+1) (x,y+1) (x+1,y) (x,y)
+	__m256i t0 = _mm256_i32gather_epi32(data, index, 4);
+	__m256i t1 = _mm256_i32gather_epi32(data + 1, index, 4);
+	__m256i t2 = _mm256_i32gather_epi32(data + 2, index, 4);
+	__m256i t3 = _mm256_i32gather_epi32(data + 3, index, 4);
+
+	__m256i bottom = Lerp8(t0, t1, ufi);
+	__m256i top = Lerp8(t2, t3, ufi);
+
+	return Lerp8(bottom, top, vfi);
+}
+
+// Color component of 8 pixels, saturated to 0..255 like the SSE2 packs
+__forceinline __m256i ColorComponent(__m256 c)
+{
+	__m256i ci = _mm256_cvttps_epi32(c);
+	return _mm256_max_epi32(_mm256_min_epi32(ci, _mm256_set1_epi32(255)), _mm256_setzero_si256());
+}
+
+// Number of pixels set in a 8-bit mask
+__forceinline u32 PixelCount8(u32 mask)
+{
+	return PixelCount(mask) + PixelCount(mask >> 4);
+}
+
+// Shades 2 rows of a 4x4 block
+template<bool useoldmsk, int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset>
+__forceinline u32 PixelFlush8(const SoftTexels* texture, __m256 x, __m256 y, u8* cb, __m256 oldmask, const IPs8& ip)
+{
+	__m256 invW = ip.ZUV.Ip(0, x, y);
+
+	float* zb = (float*)&cb[Z_BUFFER_PIXEL_OFFSET * 4];
+	__m256 zbuf = _mm256_loadu_ps(zb);
+
+	__m256 ZMask = _mm256_cmp_ps(invW, zbuf, _CMP_GE_OS);
+	if (useoldmsk)
+		ZMask = _mm256_and_ps(oldmask, ZMask);
+	u32 msk = _mm256_movemask_ps(ZMask);
+
+	if (msk == 0)
+		return 0;
+
+	__m256i dst = _mm256_loadu_si256((const __m256i*)cb);
+	__m256i rv;
+
+	{
+		rv = ColorComponent(ip.Col.Ip(0, x, y));
+		rv = _mm256_or_si256(rv, _mm256_slli_epi32(ColorComponent(ip.Col.Ip(1, x, y)), 8));
+		rv = _mm256_or_si256(rv, _mm256_slli_epi32(ColorComponent(ip.Col.Ip(2, x, y)), 16));
+		rv = _mm256_or_si256(rv, _mm256_slli_epi32(ColorComponent(ip.Col.Ip(3, x, y)), 24));
+
+		__m256i setAlpha = _mm256_set1_epi32(0xFF000000);
+		if (!pp_UseAlpha) {
+			rv = _mm256_or_si256(rv, setAlpha);
+		}
+
+		if (pp_Texture) {
+			__m256 u = _mm256_div_ps(ip.ZUV.Ip(1, x, y), invW);
+			__m256 v = _mm256_div_ps(ip.ZUV.Ip(2, x, y), invW);
+			__m256i textel = TextureFetch8(texture, u, v);
+
+			if (pp_IgnoreTexA) {
+				textel = _mm256_or_si256(textel, setAlpha);
+			}
+
+			if (pp_ShadInstr == 0) {
+				//color.rgb = texcol.rgb;
+				//color.a = texcol.a;
+				rv = textel;
+			}
+			else if (pp_ShadInstr == 1) {
+				//color.rgb *= texcol.rgb;
+				//color.a = texcol.a;
+				rv = _mm256_or_si256(rv, setAlpha);
+				rv = Modulate8(rv, textel);
+			}
+			else if (pp_ShadInstr == 2) {
+				//color.rgb=mix(color.rgb,texcol.rgb,texcol.a);
+				// a bit wrong atm, as it also mixes alphas
+				rv = AlphaBlend8(textel, rv, textel);
+			}
+			else if (pp_ShadInstr == 3) {
+				//color*=texcol
+				rv = Modulate8(rv, textel);
+			}
+
+			if (pp_Offset) {
+				//add offset
+			}
+		}
+	}
+
+	if (alpha_mode == 1) {
+		//Alpha test: the pixels below PT_ALPHA_REF are discarded
+		__m256i alpha_ok = _mm256_cmpgt_epi32(_mm256_srli_epi32(rv, 24), _mm256_broadcastsi128_si256(const_alphaRef));
+		ZMask = _mm256_and_ps(ZMask, _mm256_castsi256_ps(alpha_ok));
+		msk = _mm256_movemask_ps(ZMask);
+		if (msk == 0)
+			return 0;
+	}
+	else if (alpha_mode == 2) {
+		rv = AlphaBlend8(rv, dst, rv);
+	}
+
+	if (msk != 0xFF)
+	{
+		rv = _mm256_blendv_epi8(dst, rv, _mm256_castps_si256(ZMask));
+		invW = _mm256_blendv_ps(zbuf, invW, ZMask);
+	}
+	_mm256_storeu_ps(zb, invW);
+	_mm256_storeu_si256((__m256i*)cb, rv);
+
+	return PixelCount8(msk);
+}
+
+template<int alpha_mode, bool pp_UseAlpha, bool pp_Texture, bool pp_IgnoreTexA, int pp_ShadInstr, bool pp_Offset>
+u32 Rendtriangle8(const PolyParam* pp, const SoftTexels* texture, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, const TileArea* area)
+{
+	#define PIXEL_FLUSH(useoldmsk) PixelFlush8<useoldmsk, alpha_mode, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset>
+	const int stride_bytes = STRIDE_PIXEL_OFFSET * 4;
+	// Block size, standard 4x4 (must be power of two)
+	const int q = 4;
+	// Size of 2 rows of a block
+	const int rows_bytes = 2 * sizeof(__m128);
+
+	TriangleEdges e;
+	DECL_ALIGN(64) IPs planes;
+	if (!SetupTriangle(e, planes, pp, texture, vertex_offset, v1, v2, v3, area))
+		return 0;
+
+	// The color buffer holds the tile only
+	u8* cb_y = (u8*)colorBuffer;
+	cb_y += (e.miny - area->top)*stride_bytes + (e.minx - area->left)*(q * 4);
+
+	IPs8 ip;
+	ip.Setup(planes);
+
+	// Left and y of the 8 pixels of 2 block rows
+	__m256 y_ps = _mm256_add_ps(_mm256_set1_ps(e.miny), _mm256_setr_ps(0, 0, 0, 0, 1, 1, 1, 1));
+	__m256 minx_ps = _mm256_set1_ps(e.minx - q);
+	const __m256 twos_ps = _mm256_set1_ps(2);
+	const __m256 q_ps = _mm256_set1_ps(q);
+
+	u32 pixel_count = 0;
+
+	// Loop through blocks
+	for (int y = e.spany; y > 0; y -= q)
+	{
+		float Xhs12 = e.hs12;
+		float Xhs23 = e.hs23;
+		float Xhs31 = e.hs31;
+		u8* cb_x = cb_y;
+		__m256 x_ps = minx_ps;
+		for (int x = e.spanx; x > 0; x -= q)
+		{
+			Xhs12 -= e.FDqY12;
+			Xhs23 -= e.FDqY23;
+			Xhs31 -= e.FDqY31;
+			x_ps = _mm256_add_ps(x_ps, q_ps);
+
+			// Corners of block
+			bool any = EvalHalfSpaceFAny(Xhs12, Xhs23, Xhs31);
+
+			// Skip block when outside an edge
+			if (!any)
+			{
+				cb_x += q*q * 4;
+				continue;
+			}
+
+			bool all = EvalHalfSpaceFAll(Xhs12, Xhs23, Xhs31, e.MAX_12, e.MAX_23, e.MAX_31);
+
+			// Accept whole block when totally covered
+			if (all)
+			{
+				__m256 yl_ps = y_ps;
+				for (int iy = q; iy > 0; iy -= 2)
+				{
+					pixel_count += PIXEL_FLUSH(false)(texture, x_ps, yl_ps, cb_x, x_ps, ip);
+					yl_ps = _mm256_add_ps(yl_ps, twos_ps);
+					cb_x += rows_bytes;
+				}
+			}
+			else // Partially covered block
+			{
+				float CY1 = e.C1_pm + Xhs12;
+				float CY2 = e.C2_pm + Xhs23;
+				float CY3 = e.C3_pm + Xhs31;
+
+				__m128 pfdx12 = _mm_broadcast_float(e.FDX12);
+				__m128 pfdx23 = _mm_broadcast_float(e.FDX23);
+				__m128 pfdx31 = _mm_broadcast_float(e.FDX31);
+
+				// First row, and the second one as stepped by the SSE2 rasterizer
+				__m128 row1 = _mm_load_scaled_float(CY1, -e.FDY12);
+				__m128 row2 = _mm_load_scaled_float(CY2, -e.FDY23);
+				__m128 row3 = _mm_load_scaled_float(CY3, -e.FDY31);
+				__m256 pcy1 = _mm256_insertf128_ps(_mm256_castps128_ps256(row1), _mm_add_ps(row1, pfdx12), 1);
+				__m256 pcy2 = _mm256_insertf128_ps(_mm256_castps128_ps256(row2), _mm_add_ps(row2, pfdx23), 1);
+				__m256 pcy3 = _mm256_insertf128_ps(_mm256_castps128_ps256(row3), _mm_add_ps(row3, pfdx31), 1);
+				__m256 pfdx12_8 = _mm256_set1_ps(e.FDX12);
+				__m256 pfdx23_8 = _mm256_set1_ps(e.FDX23);
+				__m256 pfdx31_8 = _mm256_set1_ps(e.FDX31);
+
+				__m256 pzero = _mm256_setzero_ps();
+
+				__m256 yl_ps = y_ps;
+
+				for (int iy = q; iy > 0; iy -= 2)
+				{
+					// Inside when all the edge functions are > 0, or NaN
+					__m256 a = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(pcy1, pzero, _CMP_NLE_UQ),
+							_mm256_cmp_ps(pcy2, pzero, _CMP_NLE_UQ)), _mm256_cmp_ps(pcy3, pzero, _CMP_NLE_UQ));
+					int msk = _mm256_movemask_ps(a);
+
+					if (msk != 0)
+					{
+						if (msk != 0xFF)
+							pixel_count += PIXEL_FLUSH(true)(texture, x_ps, yl_ps, cb_x, a, ip);
+						else
+							pixel_count += PIXEL_FLUSH(false)(texture, x_ps, yl_ps, cb_x, a, ip);
+					}
+
+					yl_ps = _mm256_add_ps(yl_ps, twos_ps);
+					cb_x += rows_bytes;
+
+					pcy1 = _mm256_add_ps(_mm256_add_ps(pcy1, pfdx12_8), pfdx12_8);
+					pcy2 = _mm256_add_ps(_mm256_add_ps(pcy2, pfdx23_8), pfdx23_8);
+					pcy3 = _mm256_add_ps(_mm256_add_ps(pcy3, pfdx31_8), pfdx31_8);
+				}
+			}
+		}
+		e.hs12 += e.FDqX12;
+		e.hs23 += e.FDqX23;
+		e.hs31 += e.FDqX31;
+		cb_y += stride_bytes*q;
+		y_ps = _mm256_add_ps(y_ps, q_ps);
+	}
+	#undef PIXEL_FLUSH
+
+	return pixel_count;
+}
+
+}
+
+void softrend_InitAVX2(RendtriangleFnTable& fns)
+{
+	//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+	#define FN_OFFSET(a, b, c, d, e) fns[a][b][c][d][e][0] = &Rendtriangle8<a, b, c, d, e, 0>; fns[a][b][c][d][e][1] = &Rendtriangle8<a, b, c, d, e, 1>;
+	#define FN_SHADINSTR(a, b, c, d) FN_OFFSET(a, b, c, d, 0) FN_OFFSET(a, b, c, d, 1) FN_OFFSET(a, b, c, d, 2) FN_OFFSET(a, b, c, d, 3)
+	#define FN_IGNORETEXA(a, b, c) FN_SHADINSTR(a, b, c, 0) FN_SHADINSTR(a, b, c, 1)
+	#define FN_TEXTURE(a, b) FN_IGNORETEXA(a, b, 0) FN_IGNORETEXA(a, b, 1)
+	#define FN_USEALPHA(a) FN_TEXTURE(a, 0) FN_TEXTURE(a, 1)
+
+	FN_USEALPHA(0)
+	FN_USEALPHA(1)
+	FN_USEALPHA(2)
+
+	#undef FN_USEALPHA
+	#undef FN_TEXTURE
+	#undef FN_IGNORETEXA
+	#undef FN_SHADINSTR
+	#undef FN_OFFSET
+}
@@ -0,0 +1,189 @@
+/*
+	Frame output of the software renderer. See softrend_output.h
+*/
+#include <errno.h>
+#include <limits.h>
+#include <new>
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAVE_FRAME_RING
+#endif
+#include <stb_image_write.h>
+
+#include "softrend_output.h"
+#include "softrend.h"
+#include "file/file_path.h"
+
+#ifdef _WIN32
+#define FRAME_OUTPUT_DIR "frames\\"
+#else
+#define FRAME_OUTPUT_DIR "frames/"
+#endif
+
+static FrameOutputMode output_mode = FrameOutputNone;
+static u64 frame_number;
+static string output_dir;
+
+#ifdef HAVE_FRAME_RING
+static string ring_name;
+static FrameRingHeader* ring;
+static size_t ring_size;
+
+static bool ring_create()
+{
+	// Several copies of the core can run in one process (see batch_runner.cpp): the first one gets
+	// FRAME_RING_NAME<pid>, the next ones FRAME_RING_NAME<pid>-2, -3...
+	int fd = -1;
+	for (int instance = 1; fd < 0 && instance <= 64; instance++)
+	{
+		ring_name = FRAME_RING_NAME + std::to_string(getpid());
+		if (instance > 1)
+			ring_name += "-" + std::to_string(instance);
+		fd = shm_open(ring_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0 && errno != EEXIST)
+			break;
+	}
+	if (fd < 0)
+	{
+		WARN_LOG(RENDERER, "Frame output: can't create shared memory %s: errno %d", ring_name.c_str(), errno);
+		return false;
+	}
+	u32 header_size = (sizeof(FrameRingHeader) + 63) & ~63;
+	u32 slot_size = sizeof(FrameRingSlot) + MAX_RENDER_PIXELS * sizeof(u32);
+	ring_size = header_size + (size_t)slot_size * FRAME_RING_SLOTS;
+	void* p = MAP_FAILED;
+	if (ftruncate(fd, ring_size) == 0)
+		p = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		WARN_LOG(RENDERER, "Frame output: can't map shared memory %s: errno %d", ring_name.c_str(), errno);
+		shm_unlink(ring_name.c_str());
+		return false;
+	}
+	ring = new (p) FrameRingHeader();
+	ring->version = FRAME_RING_VERSION;
+	ring->width = MAX_RENDER_WIDTH;
+	ring->height = MAX_RENDER_HEIGHT;
+	ring->stride = MAX_RENDER_WIDTH * sizeof(u32);
+	ring->slot_count = FRAME_RING_SLOTS;
+	ring->slot_size = slot_size;
+	ring->header_size = header_size;
+	ring->frame_count = 0;
+	for (int i = 0; i < FRAME_RING_SLOTS; i++)
+		new ((u8*)ring + header_size + (size_t)slot_size * i) FrameRingSlot();
+	// Readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	ring->magic = FRAME_RING_MAGIC;
+	INFO_LOG(RENDERER, "Frame output: writing frames to shared memory %s", ring_name.c_str());
+
+	return true;
+}
+
+static void ring_write(const u32* pixels)
+{
+	FrameRingSlot* slot = (FrameRingSlot*)((u8*)ring + ring->header_size + (size_t)ring->slot_size * ((frame_number - 1) % ring->slot_count));
+	slot->frame.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy((u8 *)(slot + 1), pixels, MAX_RENDER_PIXELS * sizeof(u32));
+	slot->frame.store(frame_number, std::memory_order_release);
+	ring->frame_count.store(frame_number, std::memory_order_release);
+}
+
+static void ring_destroy()
+{
+	if (ring == NULL)
+		return;
+	munmap(ring, ring_size);
+	shm_unlink(ring_name.c_str());
+	ring = NULL;
+}
+#endif
+
+static void file_write(const u32* pixels)
+{
+	extern char content_name[PATH_MAX];
+
+	char name[32];
+	sprintf(name, "_%06u.%s", (u32)frame_number, output_mode == FrameOutputPng ? "png" : "raw");
+	string path = output_dir + content_name + name;
+	bool written;
+	if (output_mode == FrameOutputPng)
+	{
+		// XRGB to RGB
+		static u8 rgb[MAX_RENDER_PIXELS * 3];
+		for (int i = 0; i < MAX_RENDER_PIXELS; i++)
+		{
+			rgb[i * 3] = pixels[i] >> 16;
+			rgb[i * 3 + 1] = pixels[i] >> 8;
+			rgb[i * 3 + 2] = pixels[i];
+		}
+		written = stbi_write_png(path.c_str(), MAX_RENDER_WIDTH, MAX_RENDER_HEIGHT, 3, rgb, MAX_RENDER_WIDTH * 3) != 0;
+	}
+	else
+	{
+		FILE* f = fopen(path.c_str(), "wb");
+		written = f != NULL && fwrite(pixels, sizeof(u32), MAX_RENDER_PIXELS, f) == MAX_RENDER_PIXELS;
+		if (f != NULL)
+			written = fclose(f) == 0 && written;
+	}
+	if (!written)
+		WARN_LOG(RENDERER, "Frame output: error writing %s", path.c_str());
+}
+
+bool softrend_output_init(FrameOutputMode mode)
+{
+	softrend_output_term();
+	frame_number = 0;
+	switch (mode)
+	{
+	case FrameOutputSharedMemory:
+#ifdef HAVE_FRAME_RING
+		if (!ring_create())
+			return false;
+		break;
+#else
+		WARN_LOG(RENDERER, "Frame output: shared memory isn't supported on this platform");
+		return false;
+#endif
+
+	case FrameOutputRaw:
+	case FrameOutputPng:
+		output_dir = get_writable_data_path(FRAME_OUTPUT_DIR);
+		if (!path_is_valid(output_dir.c_str()))
+			path_mkdir(output_dir.c_str());
+		INFO_LOG(RENDERER, "Frame output: writing %s frames to %s", mode == FrameOutputPng ? "PNG" : "raw", output_dir.c_str());
+		break;
+
+	default:
+		break;
+	}
+	output_mode = mode;
+
+	return true;
+}
+
+void softrend_output_frame(const u32* pixels)
+{
+	if (output_mode == FrameOutputNone)
+		return;
+	frame_number++;
+	if (output_mode == FrameOutputSharedMemory)
+	{
+#ifdef HAVE_FRAME_RING
+		ring_write(pixels);
+#endif
+	}
+	else
+		file_write(pixels);
+}
+
+void softrend_output_term()
+{
+#ifdef HAVE_FRAME_RING
+	ring_destroy();
+#endif
+	output_mode = FrameOutputNone;
+}
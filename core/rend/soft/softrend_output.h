@@ -0,0 +1,58 @@
+/*
+	Frame output of the software renderer, for headless runs: automated tests and streaming.
+
+	Each frame rendered is either written to a shared memory ring that other processes can map,
+	or to a sequence of raw or PNG files in the "frames" folder of the data directory, named
+	<content>_<frame number>.raw|.png. Frames are numbered from 1 in rendering order.
+
+	Pixels are XRGB8888: B, G, R, X bytes in memory, MAX_RENDER_WIDTH pixels per line.
+	Raw files are just the pixels. PNG files are RGB.
+*/
+#pragma once
+#include <atomic>
+#include "types.h"
+
+enum FrameOutputMode
+{
+	FrameOutputNone,
+	FrameOutputSharedMemory,
+	FrameOutputRaw,
+	FrameOutputPng,
+};
+
+// Shared memory ring, named FRAME_RING_NAME followed by the pid of the emulator, as given to shm_open().
+// When several copies of the core run in one process, the second one adds "-2" to the name, and so on.
+// The header is followed by slot_count slots of slot_size bytes. Each slot starts with a FrameRingSlot
+// followed by the pixels.
+// Frame n goes to slot (n - 1) % slot_count. The writer clears the slot frame number while it copies the
+// pixels, then sets it and frame_count. A reader copies the pixels of the slot, and keeps them if the slot
+// frame number is still the one it wants afterwards.
+#define FRAME_RING_NAME "/reicast-frames-"
+#define FRAME_RING_MAGIC 0x474E5246		// "FRNG"
+#define FRAME_RING_VERSION 1
+#define FRAME_RING_SLOTS 4
+
+struct FrameRingHeader
+{
+	u32 magic;
+	u32 version;
+	u32 width;
+	u32 height;
+	u32 stride;						// bytes per line
+	u32 slot_count;
+	u32 slot_size;					// bytes, slot header included
+	u32 header_size;				// bytes, offset of the first slot
+	std::atomic<u64> frame_count;	// last frame written, 0 if none
+};
+
+struct FrameRingSlot
+{
+	std::atomic<u64> frame;			// frame held by the slot, 0 while it's written
+	u64 reserved[7];				// pixels are 64-byte aligned
+};
+
+// Starts writing frames with the given mode. Returns false and leaves the output disabled if it can't be set up.
+bool softrend_output_init(FrameOutputMode mode);
+// Called by the software renderer with each finished frame
+void softrend_output_frame(const u32* pixels);
+void softrend_output_term();
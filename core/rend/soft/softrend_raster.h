@@ -0,0 +1,211 @@
+/*
+	Software renderer rasterizer, shared by the SSE2 (softrend.cpp) and AVX2 (softrend_avx2.cpp) code paths.
+
+	softrend_avx2.cpp is built with AVX2 code generation. Functions defined here are in an anonymous
+	namespace so that each file gets its own copy: a shared inline function could otherwise be linked
+	to its AVX2 version and be called on cpus without AVX2. The PlaneStepper and IPs member functions
+	are only used by softrend.cpp.
+*/
+#pragma once
+#include <emmintrin.h>
+#include <math.h>
+#include "softrend.h"
+#include "hw/pvr/pvr_regs.h"
+
+#define TILE_SIZE 32
+#define TILE_PIXELS (TILE_SIZE * TILE_SIZE)
+#define TILES_X (MAX_RENDER_WIDTH / TILE_SIZE)
+#define TILES_Y (MAX_RENDER_HEIGHT / TILE_SIZE)
+#define TILE_COUNT (TILES_X * TILES_Y)
+
+// The tile buffers are made of 4x4 pixel blocks, followed by the depth buffer
+#define STRIDE_PIXEL_OFFSET TILE_SIZE
+#define Z_BUFFER_PIXEL_OFFSET TILE_PIXELS
+
+struct TileArea
+{
+	int left, top, right, bottom;
+};
+
+// Texture as used by the rasterizer: 4 texels for each texel, for bilinear filtering: (x+1,y+1) (x,y+1) (x+1,y) (x,y)
+struct SoftTexels
+{
+	const u32* data;
+	u32 width;
+	u32 height;
+	bool pow2;
+};
+
+// Rasterizes a triangle in a tile. Returns the number of pixels written.
+typedef u32(*RendtriangleFn)(const PolyParam* pp, const SoftTexels* texture, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, const TileArea* area);
+//<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+typedef RendtriangleFn RendtriangleFnTable[3][2][2][2][4][2];
+
+extern __m128i const_setAlpha;
+extern __m128i const_alphaRef;		// PT_ALPHA_REF - 1
+
+// Fills the table with the AVX2 rasterizer functions
+void softrend_InitAVX2(RendtriangleFnTable& fns);
+
+// Plane equations of 4 attributes
+struct PlaneStepper
+{
+	__m128 ddx, ddy;
+	__m128 c;
+
+	__forceinline void Setup(const Vertex &v1, const Vertex &v2, const Vertex &v3
+		, float v1_a, float v2_a, float v3_a
+		, float v1_b, float v2_b, float v3_b
+		, float v1_c, float v2_c, float v3_c
+		, float v1_d, float v2_d, float v3_d)
+	{
+		float Aa = ((v3_a - v1_a) * (v2.y - v1.y) - (v2_a - v1_a) * (v3.y - v1.y));
+		float Ba = ((v3.x - v1.x) * (v2_a - v1_a) - (v2.x - v1.x) * (v3_a - v1_a));
+
+		float Ab = ((v3_b - v1_b) * (v2.y - v1.y) - (v2_b - v1_b) * (v3.y - v1.y));
+		float Bb = ((v3.x - v1.x) * (v2_b - v1_b) - (v2.x - v1.x) * (v3_b - v1_b));
+
+		float Ac = ((v3_c - v1_c) * (v2.y - v1.y) - (v2_c - v1_c) * (v3.y - v1.y));
+		float Bc = ((v3.x - v1.x) * (v2_c - v1_c) - (v2.x - v1.x) * (v3_c - v1_c));
+
+		float Ad = ((v3_d - v1_d) * (v2.y - v1.y) - (v2_d - v1_d) * (v3.y - v1.y));
+		float Bd = ((v3.x - v1.x) * (v2_d - v1_d) - (v2.x - v1.x) * (v3_d - v1_d));
+
+		float C = ((v2.x - v1.x) * (v3.y - v1.y) - (v3.x - v1.x) * (v2.y - v1.y));
+		float ddx_s_a = -Aa / C;
+		float ddy_s_a = -Ba / C;
+
+		float ddx_s_b = -Ab / C;
+		float ddy_s_b = -Bb / C;
+
+		float ddx_s_c = -Ac / C;
+		float ddy_s_c = -Bc / C;
+
+		float ddx_s_d = -Ad / C;
+		float ddy_s_d = -Bd / C;
+
+		ddx = _mm_setr_ps(ddx_s_a, ddx_s_b, ddx_s_c, ddx_s_d);
+		ddy = _mm_setr_ps(ddy_s_a, ddy_s_b, ddy_s_c, ddy_s_d);
+
+		float c_s_a = (v1_a - ddx_s_a *v1.x - ddy_s_a*v1.y);
+		float c_s_b = (v1_b - ddx_s_b *v1.x - ddy_s_b*v1.y);
+		float c_s_c = (v1_c - ddx_s_c *v1.x - ddy_s_c*v1.y);
+		float c_s_d = (v1_d - ddx_s_d *v1.x - ddy_s_d*v1.y);
+
+		c = _mm_setr_ps(c_s_a, c_s_b, c_s_c, c_s_d);
+
+		//z = z1 + dzdx * (minx - v1.x) + dzdy * (minx - v1.y);
+		//z = (z1 - dzdx * v1.x - v1.y*dzdy) +  dzdx*inx + dzdy *iny;
+	}
+
+	__forceinline __m128 Ip(__m128 x, __m128 y) const
+	{
+		__m128 p1 = _mm_mul_ps(x, ddx);
+		__m128 p2 = _mm_mul_ps(y, ddy);
+
+		__m128 s1 = _mm_add_ps(p1, p2);
+		return _mm_add_ps(s1, c);
+	}
+
+	__forceinline __m128 InStep(__m128 bas) const
+	{
+		return _mm_add_ps(bas, ddx);
+	}
+};
+
+struct IPs
+{
+	PlaneStepper ZUV;
+	PlaneStepper Col;
+
+	__forceinline void Setup(const SoftTexels* texture, const Vertex &v1, const Vertex &v2, const Vertex &v3)
+	{
+		u32 w = 0, h = 0;
+		if (texture) {
+			w = texture->width;
+			h = texture->height;
+		}
+
+		ZUV.Setup(v1, v2, v3,
+			v1.z, v2.z, v3.z,
+			v1.u * w * v1.z, v2.u * w* v2.z, v3.u * w* v3.z,
+			v1.v * h* v1.z, v2.v * h* v2.z, v3.v * h* v3.z,
+			0, -1, 1);
+
+		Col.Setup(v1, v2, v3,
+			v1.col[2], v2.col[2], v3.col[2],
+			v1.col[1], v2.col[1], v3.col[1],
+			v1.col[0], v2.col[0], v3.col[0],
+			v1.col[3], v2.col[3], v3.col[3]
+			);
+	}
+};
+
+// Edge equations of a triangle, and its bounding box in 4x4 blocks
+struct TriangleEdges
+{
+	int minx, miny;
+	int spanx, spany;
+
+	float FDX12, FDX23, FDX31;
+	float FDY12, FDY23, FDY31;
+	float FDqX12, FDqX23, FDqX31;
+	float FDqY12, FDqY23, FDqY31;
+	float hs12, hs23, hs31;
+	float MAX_12, MAX_23, MAX_31;
+	float C1_pm, C2_pm, C3_pm;
+};
+
+// Culls the triangle and sets up its edges in the tile, and its attribute planes.
+// Returns false if the triangle is culled or outside of the tile.
+// Shared by both rasterizers so that they compute the same pixels from the same planes.
+bool SetupTriangle(TriangleEdges& e, IPs& ip, const PolyParam* pp, const SoftTexels* texture, int vertex_offset,
+		const Vertex &v1, const Vertex &v2, const Vertex &v3, const TileArea* area);
+
+namespace {
+
+__forceinline __m128 _mm_load_scaled_float(float v, float s)
+{
+	return _mm_setr_ps(v, v + s, v + s + s, v + s + s + s);
+}
+__forceinline __m128 _mm_broadcast_float(float v)
+{
+	return _mm_setr_ps(v, v, v, v);
+}
+
+//return true if any is positive
+__forceinline bool EvalHalfSpaceFAny(float cp12, float cp23, float cp31)
+{
+	bool svt = cp12 > 0; //needed for ANY
+	svt |= cp23 > 0;
+	svt |= cp31 > 0;
+
+	return svt;
+}
+
+__forceinline bool EvalHalfSpaceFAll(float cp12, float cp23, float cp31, float lv12, float lv23, float lv31)
+{
+	bool lvt = (cp12 - lv12) > 0;
+	lvt &= (cp23 - lv23) > 0;
+	lvt &= (cp31 - lv31) > 0;	//needed for all
+
+	return lvt;
+}
+
+// Index of the 4 texels used to filter a texel
+__forceinline u32 TexelIndex(const SoftTexels* texture, int u, int v)
+{
+	if (texture->pow2)
+		return ((v & (texture->height - 1)) * texture->width + (u & (texture->width - 1))) * 4;
+	else
+		return ((u32)v % texture->height * texture->width + (u32)u % texture->width) * 4;
+}
+
+// Number of pixels set in a 4-bit mask
+__forceinline u32 PixelCount(u32 mask)
+{
+	static const u8 counts[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	return counts[mask & 0xF];
+}
+
+}
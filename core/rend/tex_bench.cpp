@@ -0,0 +1,196 @@
+/*
+	tex_bench: checks the SIMD texture converters against the generic ones and measures them.
+
+	Built with "make tex_bench". Usage: tex_bench [-n iterations] [-s size]
+
+	Every converter of each instruction set supported by the cpu is run on pseudo-random texels, palettes and
+	VQ codebooks, for all the texture sizes from 8x8 to 1024x1024, with and without mipmaps, and its output
+	must be identical to the generic converter's. Then each converter converts a size x size texture
+	(256 by default) iterations times and the megatexels per second are reported.
+	Exits with 1 if any output differs.
+*/
+#include "TexCache.h"
+
+static const char * const isas[] = { "sse4.1", "avx2", "neon" };
+static const u32 isa_count = sizeof(isas) / sizeof(isas[0]);
+
+static const char * const format_names[8] = { "1555", "565", "4444", "yuv", "bumpmap", "pal4", "pal8", "reserved" };
+
+enum ConvType { TW, VQ, TW32 };
+static const char * const type_names[] = { "twiddled", "vq", "twiddled 32-bit" };
+
+static u32 rand_state = 1;
+
+static u32 bench_rand()
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+// 1024x1024 at 16 bpp, plus the VQ codebook
+static u8 texels[256 * 4 * 2 + 1024 * 1024 * 2];
+
+static void randomize()
+{
+	for (u32 i = 0; i < sizeof(texels); i++)
+		texels[i] = bench_rand();
+	vq_codebook = texels;
+	// The 16-bit palette entries have garbage in the upper bits, which must be ignored
+	for (u32 i = 0; i < 1024; i++)
+	{
+		palette16_ram[i] = bench_rand() | (bench_rand() << 16);
+		palette32_ram[i] = bench_rand() | (bench_rand() << 16);
+	}
+}
+
+template<typename pixel_type, typename Converter>
+static bool compare(Converter *conv, Converter *ref, u32 width, u32 height, bool mipmapped)
+{
+	PixelBuffer<pixel_type> out, expected;
+	if (mipmapped)
+	{
+		out.init(width, height, true);
+		expected.init(width, height, true);
+		size_t size = 0;
+		for (int i = 0; (1u << i) <= width; i++)
+		{
+			out.set_mipmap(i);
+			expected.set_mipmap(i);
+			conv(&out, texels, 1 << i, 1 << i);
+			ref(&expected, texels, 1 << i, 1 << i);
+			size += 1 << (2 * i);
+		}
+		out.set_mipmap(0);
+		expected.set_mipmap(0);
+		return memcmp(out.data(), expected.data(), size * sizeof(pixel_type)) == 0;
+	}
+	out.init(width, height);
+	expected.init(width, height);
+	conv(&out, texels, width, height);
+	ref(&expected, texels, width, height);
+
+	return memcmp(out.data(), expected.data(), width * height * sizeof(pixel_type)) == 0;
+}
+
+// Returns the first size where the outputs differ, or NULL
+template<typename pixel_type, typename Converter>
+static const char *check(Converter *conv, Converter *ref)
+{
+	static char where[32];
+	for (u32 w = 8; w <= 1024; w *= 2)
+		for (u32 h = 8; h <= 1024; h *= 2)
+		{
+			if (w * h > 512 * 1024)
+				continue;
+			if (!compare<pixel_type>(conv, ref, w, h, false))
+			{
+				sprintf(where, "%dx%d", w, h);
+				return where;
+			}
+		}
+	for (u32 size = 8; size <= 1024; size *= 2)
+		if (!compare<pixel_type>(conv, ref, size, size, true))
+		{
+			sprintf(where, "%dx%d mipmapped", size, size);
+			return where;
+		}
+
+	return NULL;
+}
+
+template<typename pixel_type, typename Converter>
+static double bench(Converter *conv, u32 size, int iterations)
+{
+	PixelBuffer<pixel_type> out;
+	out.init(size, size);
+	double start = os_GetSeconds();
+	for (int i = 0; i < iterations; i++)
+		conv(&out, texels, size, size);
+	double seconds = os_GetSeconds() - start;
+
+	return (double)size * size * iterations / seconds / 1000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 200;
+	u32 size = 256;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			size = max(8, min(1024, atoi(argv[++i])));
+		else
+		{
+			fprintf(stderr, "Usage: %s [-n iterations] [-s size]\n", argv[0]);
+			return 1;
+		}
+	}
+	size = 1 << bitscanrev(size);
+	randomize();
+
+	TexConvTable generic;
+	texconv_InitTable(generic, NULL);
+	TexConvTable tables[isa_count];
+	bool supported[isa_count];
+	printf("%dx%d textures, MTexels/s\n%-24s %10s", size, size, "", generic.name);
+	for (u32 i = 0; i < isa_count; i++)
+	{
+		supported[i] = texconv_InitTable(tables[i], isas[i]);
+		if (supported[i])
+			printf(" %10s", isas[i]);
+	}
+	printf("\n");
+
+	bool ok = true;
+	for (int type = TW; type <= TW32; type++)
+		for (int fmt = 0; fmt < 8; fmt++)
+		{
+			bool simd = false;
+			for (u32 i = 0; i < isa_count; i++)
+				simd |= supported[i] && (type == TW ? tables[i].TW[fmt] != generic.TW[fmt]
+						: type == VQ ? tables[i].VQ[fmt] != generic.VQ[fmt] : tables[i].TW32[fmt] != generic.TW32[fmt]);
+			if (!simd)
+				continue;
+			// Any palette
+			palette_index = fmt == PixelPal4 ? (bench_rand() % 64) << 4 : (bench_rand() % 4) << 8;
+
+			char name[32];
+			sprintf(name, "%s %s", format_names[fmt], type_names[type]);
+			printf("%-24s", name);
+			if (type == TW32)
+				printf(" %10.1f", bench<u32>(generic.TW32[fmt], size, iterations));
+			else
+				printf(" %10.1f", bench<u16>(type == TW ? generic.TW[fmt] : generic.VQ[fmt], size, iterations));
+			string errors;
+			for (u32 i = 0; i < isa_count; i++)
+			{
+				if (!supported[i])
+					continue;
+				const char *where;
+				double rate;
+				if (type == TW32)
+				{
+					where = check<u32>(tables[i].TW32[fmt], generic.TW32[fmt]);
+					rate = bench<u32>(tables[i].TW32[fmt], size, iterations);
+				}
+				else
+				{
+					TexConvFP *conv = type == TW ? tables[i].TW[fmt] : tables[i].VQ[fmt];
+					where = check<u16>(conv, type == TW ? generic.TW[fmt] : generic.VQ[fmt]);
+					rate = bench<u16>(conv, size, iterations);
+				}
+				printf(" %10.1f", rate);
+				if (where != NULL)
+				{
+					errors += string("  ") + isas[i] + " differs at " + where;
+					ok = false;
+				}
+			}
+			printf("%s\n", errors.c_str());
+		}
+	printf(ok ? "All the converters match the generic ones\n" : "Some converters don't match the generic ones\n");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+/*
+	AVX2 texture converters, see texconv_simd.h
+
+	This file is built with AVX2 code generation and is only used when the cpu supports it.
+*/
+#include "texconv_simd.h"
+
+void texconv_InitAVX2(TexConvTable& table)
+{
+	fill_table(table, "avx2");
+}
@@ -0,0 +1,13 @@
+/*
+	NEON texture converters, see texconv_simd.h
+
+	Only built for ARM. The generic converters are kept if the target doesn't have NEON.
+*/
+#include "texconv_simd.h"
+
+void texconv_InitNEON(TexConvTable& table)
+{
+#if defined(TEXCONV_NEON)
+	fill_table(table, "neon");
+#endif
+}
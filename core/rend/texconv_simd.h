@@ -0,0 +1,544 @@
+/*
+	SIMD texture converters, shared by the SSE4.1 (texconv_sse41.cpp), AVX2 (texconv_avx2.cpp) and NEON
+	(texconv_neon.cpp) versions. Each file is built with the code generation of its instruction set and only
+	used when the cpu supports it. As in softrend_raster.h, everything here is in an anonymous namespace so that
+	each file gets its own copy, and the generic converters are called through the table, never instantiated here.
+
+	Twiddled textures are converted one 4x4 tile at a time, or one 8x8 block of 4 tiles by the AVX2 16-bit
+	converters. The 16 texels of a tile are contiguous: texel n is at x = ((n >> 1) & 1) | ((n >> 2) & 2),
+	y = (n & 1) | ((n >> 1) & 2), so row 0 is made of texels 0, 2, 8 and 10. The tiles of a block are
+	at (0, 0), (0, 4), (4, 0) and (4, 4). A VQ tile is made of the 2x2 codebook entries of 4 consecutive indices.
+	The 16-bit conversions are rotations: 565 is unchanged, 1555 and 4444 rotate by 1 and 4 bits.
+	4bpp palettes are looked up with byte shuffles on x86, 8bpp ones with gathers on AVX2, the others
+	one texel at a time. Textures smaller than a tile or block, or whose size isn't a power of 2,
+	use the generic converters.
+*/
+#pragma once
+#include "TexCache.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TEXCONV_X86
+#define TEXCONV_AVX2
+#elif defined(__SSE4_1__) || defined(_M_X64) || defined(_M_IX86)
+// MSVC has the SSE4.1 intrinsics without any option
+#include <smmintrin.h>
+#define TEXCONV_X86
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEXCONV_NEON
+#endif
+
+#if defined(TEXCONV_X86) || defined(TEXCONV_NEON)
+
+namespace {
+
+// The converters replaced by this file, used for the sizes it doesn't handle
+TexConvTable generic;
+
+// A Kernel is constructed once per texture and converts a tile or block at a time
+template<typename Kernel>
+void texture_tiles(PixelBuffer<typename Kernel::pixel_type>* pb, u8* p_in, u32 Width, u32 Height)
+{
+	if (Width < Kernel::Size || Height < Kernel::Size || (Width & (Width - 1)) != 0 || (Height & (Height - 1)) != 0)
+	{
+		Kernel::Fallback(pb, p_in, Width, Height);
+		return;
+	}
+	Kernel kernel;
+	const u32 bcx = bitscanrev(Width);
+	const u32 bcy = bitscanrev(Height);
+
+	for (u32 y = 0; y < Height; y += Kernel::Size)
+		for (u32 x = 0; x < Width; x += Kernel::Size)
+			kernel.Convert(pb, x, y, p_in, twop(x, y, bcx, bcy));
+}
+
+template<typename pixel_type>
+__forceinline void lookup_pal4(const u32 *pal, const u8 *p, pixel_type *texels)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		texels[i * 2] = pal[p[i] & 0xF];
+		texels[i * 2 + 1] = pal[p[i] >> 4];
+	}
+}
+
+template<typename pixel_type>
+__forceinline void lookup_pal8(const u32 *pal, const u8 *p, pixel_type *texels)
+{
+	for (int i = 0; i < 16; i++)
+		texels[i] = pal[p[i]];
+}
+
+#if defined(TEXCONV_X86)
+
+template<int Rotate>
+__forceinline __m128i rotate16(__m128i v)
+{
+	if (Rotate == 0)
+		return v;
+	return _mm_or_si128(_mm_slli_epi16(v, Rotate), _mm_srli_epi16(v, 16 - Rotate));
+}
+
+// Texels 0-7 and 8-15 of a tile
+template<int Rotate>
+__forceinline void store_tile16(PixelBuffer<u16>* pb, u32 x, u32 y, __m128i a, __m128i b)
+{
+	// Texel pairs (0, 2) (1, 3) (4, 6) (5, 7) are the halves of rows 0, 1, 2 and 3
+	const __m128i pairs = _mm_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+	a = _mm_shuffle_epi8(a, pairs);
+	b = _mm_shuffle_epi8(b, pairs);
+	__m128i rows01 = rotate16<Rotate>(_mm_unpacklo_epi32(a, b));
+	__m128i rows23 = rotate16<Rotate>(_mm_unpackhi_epi32(a, b));
+	_mm_storel_epi64((__m128i *)pb->data(x, y), rows01);
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 1), _mm_srli_si128(rows01, 8));
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 2), rows23);
+	_mm_storel_epi64((__m128i *)pb->data(x, y + 3), _mm_srli_si128(rows23, 8));
+}
+
+template<int Rotate>
+__forceinline void store_tile16(PixelBuffer<u16>* pb, u32 x, u32 y, const void *texels)
+{
+	store_tile16<Rotate>(pb, x, y, _mm_loadu_si128((const __m128i *)texels), _mm_loadu_si128((const __m128i *)texels + 1));
+}
+
+template<int Imm>
+__forceinline __m128i shuffle32(__m128i a, __m128i b)
+{
+	return _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), Imm));
+}
+
+// Texels 0-3, 4-7, 8-11 and 12-15 of a tile
+__forceinline void store_tile32(PixelBuffer<u32>* pb, u32 x, u32 y, __m128i v0, __m128i v1, __m128i v2, __m128i v3)
+{
+	_mm_storeu_si128((__m128i *)pb->data(x, y), shuffle32<_MM_SHUFFLE(2, 0, 2, 0)>(v0, v2));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 1), shuffle32<_MM_SHUFFLE(3, 1, 3, 1)>(v0, v2));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 2), shuffle32<_MM_SHUFFLE(2, 0, 2, 0)>(v1, v3));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 3), shuffle32<_MM_SHUFFLE(3, 1, 3, 1)>(v1, v3));
+}
+
+__forceinline void store_tile32(PixelBuffer<u32>* pb, u32 x, u32 y, const u32 *texels)
+{
+	const __m128i *v = (const __m128i *)texels;
+	store_tile32(pb, x, y, _mm_loadu_si128(v), _mm_loadu_si128(v + 1), _mm_loadu_si128(v + 2), _mm_loadu_si128(v + 3));
+}
+
+__forceinline __m128i load_vq(u8 index0, u8 index1)
+{
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)&vq_codebook[index0 * 8]),
+			_mm_loadl_epi64((const __m128i *)&vq_codebook[index1 * 8]));
+}
+
+// Byte i of the 16 entries of a 4bpp palette, to be looked up with pshufb
+struct Pal4Bytes
+{
+	__m128i bytes[4];
+
+	Pal4Bytes(const u32 *pal)
+	{
+		DECL_ALIGN(16) u8 b[4][16];
+		for (int i = 0; i < 16; i++)
+			for (int j = 0; j < 4; j++)
+				b[j][i] = pal[i] >> (j * 8);
+		for (int j = 0; j < 4; j++)
+			bytes[j] = _mm_load_si128((const __m128i *)b[j]);
+	}
+};
+
+// The 16 palette indices of a tile, in texel order
+__forceinline __m128i pal4_indices(const u8 *p)
+{
+	const __m128i mask = _mm_set1_epi8(0xF);
+	__m128i v = _mm_loadl_epi64((const __m128i *)p);
+	return _mm_unpacklo_epi8(_mm_and_si128(v, mask), _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+}
+
+struct PAL4_32
+{
+	typedef u32 pixel_type;
+	static const u32 Size = 4;
+	Pal4Bytes pal;
+
+	PAL4_32() : pal(&palette32_ram[palette_index]) {}
+
+	static void Fallback(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW32[PixelPal4](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u32>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		__m128i idx = pal4_indices(&p_in[offset / 2]);
+		__m128i b0 = _mm_shuffle_epi8(pal.bytes[0], idx);
+		__m128i b1 = _mm_shuffle_epi8(pal.bytes[1], idx);
+		__m128i b2 = _mm_shuffle_epi8(pal.bytes[2], idx);
+		__m128i b3 = _mm_shuffle_epi8(pal.bytes[3], idx);
+		__m128i lo = _mm_unpacklo_epi8(b0, b1);
+		__m128i hi = _mm_unpacklo_epi8(b2, b3);
+		__m128i v0 = _mm_unpacklo_epi16(lo, hi);
+		__m128i v1 = _mm_unpackhi_epi16(lo, hi);
+		lo = _mm_unpackhi_epi8(b0, b1);
+		hi = _mm_unpackhi_epi8(b2, b3);
+		store_tile32(pb, x, y, v0, v1, _mm_unpacklo_epi16(lo, hi), _mm_unpackhi_epi16(lo, hi));
+	}
+};
+
+#endif
+
+#if defined(TEXCONV_AVX2)
+
+template<int Rotate>
+__forceinline __m256i rotate16(__m256i v)
+{
+	if (Rotate == 0)
+		return v;
+	return _mm256_or_si256(_mm256_slli_epi16(v, Rotate), _mm256_srli_epi16(v, 16 - Rotate));
+}
+
+// Rows y and y + 4 of a block
+__forceinline void store_rows(PixelBuffer<u16>* pb, u32 x, u32 y, __m256i rows)
+{
+	_mm_storeu_si128((__m128i *)pb->data(x, y), _mm256_castsi256_si128(rows));
+	_mm_storeu_si128((__m128i *)pb->data(x, y + 4), _mm256_extracti128_si256(rows, 1));
+}
+
+// a and b are texels 0-7 and 8-15 of the tiles at (0, 0) and (0, 4), in the low and high lanes.
+// c and d are the same for the tiles at (4, 0) and (4, 4).
+template<int Rotate>
+__forceinline void store_block16(PixelBuffer<u16>* pb, u32 x, u32 y, __m256i a, __m256i b, __m256i c, __m256i d)
+{
+	const __m256i pairs = _mm256_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15,
+			0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+	a = _mm256_shuffle_epi8(a, pairs);
+	b = _mm256_shuffle_epi8(b, pairs);
+	c = _mm256_shuffle_epi8(c, pairs);
+	d = _mm256_shuffle_epi8(d, pairs);
+	// Rows 0-1 and 2-3 of each tile
+	__m256i left01 = _mm256_unpacklo_epi32(a, b);
+	__m256i left23 = _mm256_unpackhi_epi32(a, b);
+	__m256i right01 = _mm256_unpacklo_epi32(c, d);
+	__m256i right23 = _mm256_unpackhi_epi32(c, d);
+	store_rows(pb, x, y, rotate16<Rotate>(_mm256_unpacklo_epi64(left01, right01)));
+	store_rows(pb, x, y + 1, rotate16<Rotate>(_mm256_unpackhi_epi64(left01, right01)));
+	store_rows(pb, x, y + 2, rotate16<Rotate>(_mm256_unpacklo_epi64(left23, right23)));
+	store_rows(pb, x, y + 3, rotate16<Rotate>(_mm256_unpackhi_epi64(left23, right23)));
+}
+
+__forceinline __m256i set_lanes(__m128i lo, __m128i hi)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+__forceinline __m256i load_lanes(const u8 *lo, const u8 *hi)
+{
+	return set_lanes(_mm_loadu_si128((const __m128i *)lo), _mm_loadu_si128((const __m128i *)hi));
+}
+
+// 8 texels from an 8bpp palette
+__forceinline __m256i gather_pal8(const u32 *pal, const u8 *p)
+{
+	return _mm256_i32gather_epi32((const int *)pal, _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)), 4);
+}
+
+// Texels 0-7 of two tiles, truncated to 16 bits, in the low and high lanes
+__forceinline __m256i pack_pal8(__m256i tile0, __m256i tile1)
+{
+	const __m256i mask = _mm256_set1_epi32(0xFFFF);
+	__m256i packed = _mm256_packus_epi32(_mm256_and_si256(tile0, mask), _mm256_and_si256(tile1, mask));
+	return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+template<int Fmt, int Rotate>
+struct TW16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 8;
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[Fmt](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		const u8 *p = &p_in[offset * 2];
+		store_block16<Rotate>(pb, x, y, load_lanes(p, p + 32), load_lanes(p + 16, p + 48),
+				load_lanes(p + 64, p + 96), load_lanes(p + 80, p + 112));
+	}
+};
+
+template<int Fmt, int Rotate>
+struct VQ16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 8;
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.VQ[Fmt](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		// Skip the codebook. Each index is a 2x2 block.
+		const u8 *p = &p_in[256 * 4 * 2 + offset / 4];
+		store_block16<Rotate>(pb, x, y, set_lanes(load_vq(p[0], p[1]), load_vq(p[4], p[5])),
+				set_lanes(load_vq(p[2], p[3]), load_vq(p[6], p[7])),
+				set_lanes(load_vq(p[8], p[9]), load_vq(p[12], p[13])),
+				set_lanes(load_vq(p[10], p[11]), load_vq(p[14], p[15])));
+	}
+};
+
+struct PAL4_16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 8;
+	__m256i lo_bytes;
+	__m256i hi_bytes;
+
+	PAL4_16()
+	{
+		Pal4Bytes pal(&palette16_ram[palette_index]);
+		lo_bytes = _mm256_broadcastsi128_si256(pal.bytes[0]);
+		hi_bytes = _mm256_broadcastsi128_si256(pal.bytes[1]);
+	}
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[PixelPal4](pb, p_in, Width, Height); }
+
+	// Texels 0-7 and 8-15 of two consecutive tiles
+	__forceinline void Lookup(const u8 *p, __m256i& a, __m256i& b)
+	{
+		const __m128i mask = _mm_set1_epi8(0xF);
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i lo = _mm_and_si128(v, mask);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m256i idx = set_lanes(_mm_unpacklo_epi8(lo, hi), _mm_unpackhi_epi8(lo, hi));
+		__m256i texels_lo = _mm256_shuffle_epi8(lo_bytes, idx);
+		__m256i texels_hi = _mm256_shuffle_epi8(hi_bytes, idx);
+		a = _mm256_unpacklo_epi8(texels_lo, texels_hi);
+		b = _mm256_unpackhi_epi8(texels_lo, texels_hi);
+	}
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		const u8 *p = &p_in[offset / 2];
+		__m256i a, b, c, d;
+		Lookup(p, a, b);
+		Lookup(p + 16, c, d);
+		store_block16<0>(pb, x, y, a, b, c, d);
+	}
+};
+
+struct PAL8_16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 8;
+	const u32 *pal = &palette16_ram[palette_index];
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[PixelPal8](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		const u8 *p = &p_in[offset];
+		store_block16<0>(pb, x, y, pack_pal8(gather_pal8(pal, p), gather_pal8(pal, p + 16)),
+				pack_pal8(gather_pal8(pal, p + 8), gather_pal8(pal, p + 24)),
+				pack_pal8(gather_pal8(pal, p + 32), gather_pal8(pal, p + 48)),
+				pack_pal8(gather_pal8(pal, p + 40), gather_pal8(pal, p + 56)));
+	}
+};
+
+struct PAL8_32
+{
+	typedef u32 pixel_type;
+	static const u32 Size = 4;
+	const u32 *pal = &palette32_ram[palette_index];
+
+	static void Fallback(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW32[PixelPal8](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u32>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		__m256i v01 = gather_pal8(pal, &p_in[offset]);
+		__m256i v23 = gather_pal8(pal, &p_in[offset + 8]);
+		store_tile32(pb, x, y, _mm256_castsi256_si128(v01), _mm256_extracti128_si256(v01, 1),
+				_mm256_castsi256_si128(v23), _mm256_extracti128_si256(v23, 1));
+	}
+};
+
+#else
+
+#if defined(TEXCONV_NEON)
+
+template<int Rotate>
+__forceinline uint16x4_t rotate16(uint16x4_t v)
+{
+	if (Rotate == 0)
+		return v;
+	return vorr_u16(vshl_n_u16(v, Rotate), vshr_n_u16(v, 16 - Rotate));
+}
+
+// Texels 0-7 and 8-15 of a tile
+template<int Rotate>
+__forceinline void store_tile16(PixelBuffer<u16>* pb, u32 x, u32 y, uint16x8_t a, uint16x8_t b)
+{
+	// Even texels are on rows 0 and 2, odd ones on rows 1 and 3
+	uint16x8x2_t texels = vuzpq_u16(a, b);
+	uint32x4_t even = vreinterpretq_u32_u16(texels.val[0]);
+	uint32x4_t odd = vreinterpretq_u32_u16(texels.val[1]);
+	uint32x2x2_t even_rows = vuzp_u32(vget_low_u32(even), vget_high_u32(even));
+	uint32x2x2_t odd_rows = vuzp_u32(vget_low_u32(odd), vget_high_u32(odd));
+	vst1_u16(pb->data(x, y), rotate16<Rotate>(vreinterpret_u16_u32(even_rows.val[0])));
+	vst1_u16(pb->data(x, y + 1), rotate16<Rotate>(vreinterpret_u16_u32(odd_rows.val[0])));
+	vst1_u16(pb->data(x, y + 2), rotate16<Rotate>(vreinterpret_u16_u32(even_rows.val[1])));
+	vst1_u16(pb->data(x, y + 3), rotate16<Rotate>(vreinterpret_u16_u32(odd_rows.val[1])));
+}
+
+template<int Rotate>
+__forceinline void store_tile16(PixelBuffer<u16>* pb, u32 x, u32 y, const void *texels)
+{
+	store_tile16<Rotate>(pb, x, y, vld1q_u16((const u16 *)texels), vld1q_u16((const u16 *)texels + 8));
+}
+
+__forceinline void store_tile32(PixelBuffer<u32>* pb, u32 x, u32 y, const u32 *texels)
+{
+	uint32x4x2_t rows01 = vuzpq_u32(vld1q_u32(texels), vld1q_u32(texels + 8));
+	uint32x4x2_t rows23 = vuzpq_u32(vld1q_u32(texels + 4), vld1q_u32(texels + 12));
+	vst1q_u32(pb->data(x, y), rows01.val[0]);
+	vst1q_u32(pb->data(x, y + 1), rows01.val[1]);
+	vst1q_u32(pb->data(x, y + 2), rows23.val[0]);
+	vst1q_u32(pb->data(x, y + 3), rows23.val[1]);
+}
+
+__forceinline uint16x8_t load_vq(u8 index0, u8 index1)
+{
+	return vcombine_u16(vld1_u16((const u16 *)&vq_codebook[index0 * 8]), vld1_u16((const u16 *)&vq_codebook[index1 * 8]));
+}
+
+struct PAL4_32
+{
+	typedef u32 pixel_type;
+	static const u32 Size = 4;
+	const u32 *pal = &palette32_ram[palette_index];
+
+	static void Fallback(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW32[PixelPal4](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u32>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		DECL_ALIGN(16) u32 texels[16];
+		lookup_pal4(pal, &p_in[offset / 2], texels);
+		store_tile32(pb, x, y, texels);
+	}
+};
+
+#endif
+
+// 4x4 tiles
+
+template<int Fmt, int Rotate>
+struct TW16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 4;
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[Fmt](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		store_tile16<Rotate>(pb, x, y, &p_in[offset * 2]);
+	}
+};
+
+template<int Fmt, int Rotate>
+struct VQ16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 4;
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.VQ[Fmt](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		// Skip the codebook. Each index is a 2x2 block.
+		const u8 *p = &p_in[256 * 4 * 2 + offset / 4];
+		store_tile16<Rotate>(pb, x, y, load_vq(p[0], p[1]), load_vq(p[2], p[3]));
+	}
+};
+
+struct PAL4_16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 4;
+#if defined(TEXCONV_X86)
+	Pal4Bytes pal;
+
+	PAL4_16() : pal(&palette16_ram[palette_index]) {}
+#else
+	const u32 *pal = &palette16_ram[palette_index];
+#endif
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[PixelPal4](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+#if defined(TEXCONV_X86)
+		__m128i idx = pal4_indices(&p_in[offset / 2]);
+		__m128i lo = _mm_shuffle_epi8(pal.bytes[0], idx);
+		__m128i hi = _mm_shuffle_epi8(pal.bytes[1], idx);
+		store_tile16<0>(pb, x, y, _mm_unpacklo_epi8(lo, hi), _mm_unpackhi_epi8(lo, hi));
+#else
+		DECL_ALIGN(16) u16 texels[16];
+		lookup_pal4(pal, &p_in[offset / 2], texels);
+		store_tile16<0>(pb, x, y, texels);
+#endif
+	}
+};
+
+struct PAL8_16
+{
+	typedef u16 pixel_type;
+	static const u32 Size = 4;
+	const u32 *pal = &palette16_ram[palette_index];
+
+	static void Fallback(PixelBuffer<u16>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW[PixelPal8](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u16>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		DECL_ALIGN(16) u16 texels[16];
+		lookup_pal8(pal, &p_in[offset], texels);
+		store_tile16<0>(pb, x, y, texels);
+	}
+};
+
+struct PAL8_32
+{
+	typedef u32 pixel_type;
+	static const u32 Size = 4;
+	const u32 *pal = &palette32_ram[palette_index];
+
+	static void Fallback(PixelBuffer<u32>* pb, u8* p_in, u32 Width, u32 Height) { generic.TW32[PixelPal8](pb, p_in, Width, Height); }
+
+	__forceinline void Convert(PixelBuffer<u32>* pb, u32 x, u32 y, const u8 *p_in, u32 offset)
+	{
+		DECL_ALIGN(16) u32 texels[16];
+		lookup_pal8(pal, &p_in[offset], texels);
+		store_tile32(pb, x, y, texels);
+	}
+};
+
+#endif
+
+void fill_table(TexConvTable& table, const char *name)
+{
+	generic = table;
+	table.name = name;
+
+	table.TW[Pixel1555] = texture_tiles<TW16<Pixel1555, 1>>;
+	table.TW[Pixel565] = texture_tiles<TW16<Pixel565, 0>>;
+	table.TW[Pixel4444] = texture_tiles<TW16<Pixel4444, 4>>;
+	table.TW[PixelBumpMap] = texture_tiles<TW16<PixelBumpMap, 4>>;
+	table.TW[PixelPal4] = texture_tiles<PAL4_16>;
+	table.TW[PixelPal8] = texture_tiles<PAL8_16>;
+
+	table.VQ[Pixel1555] = texture_tiles<VQ16<Pixel1555, 1>>;
+	table.VQ[Pixel565] = texture_tiles<VQ16<Pixel565, 0>>;
+	table.VQ[Pixel4444] = texture_tiles<VQ16<Pixel4444, 4>>;
+	table.VQ[PixelBumpMap] = texture_tiles<VQ16<PixelBumpMap, 4>>;
+
+	table.TW32[PixelPal4] = texture_tiles<PAL4_32>;
+	table.TW32[PixelPal8] = texture_tiles<PAL8_32>;
+}
+
+}
+
+#endif
@@ -0,0 +1,11 @@
+/*
+	SSE4.1 texture converters, see texconv_simd.h
+
+	This file is built with SSE4.1 code generation and is only used when the cpu supports it.
+*/
+#include "texconv_simd.h"
+
+void texconv_InitSSE41(TexConvTable& table)
+{
+	fill_table(table, "sse4.1");
+}
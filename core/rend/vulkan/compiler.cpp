@@ -19,9 +19,22 @@
     along with Flycast.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include <glm/glm.hpp>
+#include <map>
+#include <mutex>
 #include "compiler.h"
 #include "SPIRV/GlslangToSpv.h"
 #include "vulkan_context.h"
+#include "deps/xxhash/xxhash.h"
+
+static const char *SpirvCacheFileName = "vulkan_spirv.cache";
+static const u32 SpirvCacheMagic = 0x56525053;	// "SPRV"
+static const u32 SpirvCacheVersion = 1;			// bump when the shader compiler settings change
+
+// SPIR-V of the shaders compiled so far, by hash of their stage and source.
+// The shader sources include their parameters, so each variant has its own entry.
+static std::map<u64, std::vector<unsigned int>> spirvCache;
+static bool spirvCacheDirty;
+static std::mutex spirvCacheMutex;
 
 static const TBuiltInResource DefaultTBuiltInResource = {
     /* .MaxLights = */ 32,
@@ -131,15 +144,77 @@ static const TBuiltInResource DefaultTBuiltInResource = {
 
 int ShaderCompiler::initCount;
 
+static void loadSpirvCache()
+{
+	std::string path = get_writable_data_path(SpirvCacheFileName);
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	u32 header[3];
+	if (fread(header, sizeof(header), 1, f) == 1 && header[0] == SpirvCacheMagic && header[1] == SpirvCacheVersion)
+	{
+		for (u32 i = 0; i < header[2]; i++)
+		{
+			u64 key;
+			u32 size;
+			if (fread(&key, sizeof(key), 1, f) != 1 || fread(&size, sizeof(size), 1, f) != 1)
+				break;
+			std::vector<unsigned int> spirv(size);
+			if (size == 0 || fread(&spirv[0], sizeof(unsigned int), size, f) != size)
+				break;
+			spirvCache[key] = std::move(spirv);
+		}
+		INFO_LOG(RENDERER, "SPIR-V cache loaded from %s: %d shaders", path.c_str(), (int)spirvCache.size());
+	}
+	fclose(f);
+}
+
+static void saveSpirvCache()
+{
+	if (!spirvCacheDirty)
+		return;
+	std::string path = get_writable_data_path(SpirvCacheFileName);
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(RENDERER, "Can't save the SPIR-V cache to %s", path.c_str());
+		return;
+	}
+	u32 header[3] = { SpirvCacheMagic, SpirvCacheVersion, (u32)spirvCache.size() };
+	bool written = fwrite(header, sizeof(header), 1, f) == 1;
+	for (const auto& entry : spirvCache)
+	{
+		u32 size = (u32)entry.second.size();
+		written = written && fwrite(&entry.first, sizeof(entry.first), 1, f) == 1
+				&& fwrite(&size, sizeof(size), 1, f) == 1
+				&& fwrite(&entry.second[0], sizeof(unsigned int), size, f) == size;
+	}
+	if (fclose(f) != 0 || !written)
+	{
+		WARN_LOG(RENDERER, "Error writing the SPIR-V cache to %s", path.c_str());
+		remove(path.c_str());
+	}
+	spirvCacheDirty = false;
+}
+
 void ShaderCompiler::Init()
 {
 	if (initCount++ == 0)
+	{
 		verify(glslang::InitializeProcess());
+		std::lock_guard<std::mutex> lock(spirvCacheMutex);
+		loadSpirvCache();
+	}
 }
 void ShaderCompiler::Term()
 {
 	if (--initCount == 0)
+	{
 		glslang::FinalizeProcess();
+		std::lock_guard<std::mutex> lock(spirvCacheMutex);
+		saveSpirvCache();
+		spirvCache.clear();
+	}
 	initCount = std::max(initCount, 0);
 }
 
@@ -208,9 +283,22 @@ static bool GLSLtoSPV(const vk::ShaderStageFlagBits shaderType, std::string cons
 
 vk::UniqueShaderModule ShaderCompiler::Compile(vk::ShaderStageFlagBits shaderStage, std::string const& shaderText)
 {
+	u64 key = XXH64(shaderText.data(), shaderText.size(), (u64)shaderStage);
 	std::vector<unsigned int> shaderSPV;
-	bool ok = GLSLtoSPV(shaderStage, shaderText, shaderSPV);
-	verify(ok);
+	{
+		std::lock_guard<std::mutex> lock(spirvCacheMutex);
+		auto it = spirvCache.find(key);
+		if (it != spirvCache.end())
+			shaderSPV = it->second;
+	}
+	if (shaderSPV.empty())
+	{
+		bool ok = GLSLtoSPV(shaderStage, shaderText, shaderSPV);
+		verify(ok);
+		std::lock_guard<std::mutex> lock(spirvCacheMutex);
+		spirvCache[key] = shaderSPV;
+		spirvCacheDirty = true;
+	}
 
 	return VulkanContext::Instance()->GetDevice().createShaderModuleUnique
 			(vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), shaderSPV.size() * sizeof(unsigned int), shaderSPV.data()));
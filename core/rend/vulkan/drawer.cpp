@@ -695,6 +695,7 @@ void ScreenDrawer::Init(SamplerManager *samplerManager, ShaderManager *shaderMan
 	if (!screenPipelineManager)
 		screenPipelineManager = std::unique_ptr<PipelineManager>(new PipelineManager());
 	screenPipelineManager->Init(shaderManager, *renderPass);
+	screenPipelineManager->WarmUp("vulkan_pipelines.list");
 	Drawer::Init(samplerManager, screenPipelineManager.get());
 }
 
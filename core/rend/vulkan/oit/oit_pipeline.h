@@ -26,6 +26,7 @@
 #include "oit_renderpass.h"
 #include "oit_buffer.h"
 #include "../texture.h"
+#include "../pipeline_warmup.h"
 #include "hw/pvr/ta_ctx.h"
 
 class OITDescriptorSets
@@ -211,6 +212,10 @@ public:
 
 	virtual void Init(OITShaderManager *shaderManager, OITBuffers *oitBuffers)
 	{
+		// Stop the warm-up worker before changing what it uses
+		warmUp.Cancel();
+		pipelines.clear();
+		modVolPipelines.clear();
 		this->shaderManager = shaderManager;
 
 		if (!perFrameLayout)
@@ -245,21 +250,38 @@ public:
 			pipelineLayout = GetContext()->GetDevice().createPipelineLayoutUnique(
 					vk::PipelineLayoutCreateInfo(vk::PipelineLayoutCreateFlags(), ARRAY_SIZE(layouts), layouts, 1, &pushConstant));
 		}
-
-		pipelines.clear();
-		modVolPipelines.clear();
 	}
 
 	vk::Pipeline GetPipeline(u32 listType, bool autosort, const PolyParam& pp, Pass pass)
 	{
-		u32 pipehash = hash(listType, autosort, &pp, pass);
+		bool clamping = IsColorClamped(pp);
+		u32 pipehash = hash(listType, autosort, &pp, pass, clamping);
 		const auto &pipeline = pipelines.find(pipehash);
 		if (pipeline != pipelines.end())
 			return pipeline->second.get();
 
-		CreatePipeline(listType, autosort, pp, pass);
+		warmUp.Collect(pipelines);
+		vk::UniquePipeline& newPipeline = pipelines[pipehash];
+		if (!newPipeline)
+			newPipeline = CreatePipeline(listType, autosort, pp, pass, clamping);
+		warmUp.Record(PipelineKey(listType, (u32)autosort | ((u32)pass << 1), pp, clamping));
+
+		return *newPipeline;
+	}
 
-		return *pipelines[pipehash];
+	// Creates the pipelines used by the last run on a worker thread, and records the new ones in the given file
+	void WarmUp(const char *fileName)
+	{
+		warmUp.Load(fileName);
+		// The worker can't create the render pass
+		renderPasses->GetRenderPass(true, true);
+		warmUp.Start([this](const PipelineKey& key) {
+			PolyParam pp = key.ToPolyParam();
+			bool autosort = key.variant & 1;
+			Pass pass = (Pass)(key.variant >> 1);
+			return std::make_pair(hash(key.listType, autosort, &pp, pass, key.clamping),
+					CreatePipeline(key.listType, autosort, pp, pass, key.clamping));
+		});
 	}
 
 	vk::Pipeline GetModifierVolumePipeline(ModVolMode mode, int cullMode)
@@ -305,7 +327,7 @@ private:
 	void CreateModVolPipeline(ModVolMode mode, int cullMode);
 	void CreateTrModVolPipeline(ModVolMode mode, int cullMode);
 
-	u32 hash(u32 listType, bool autosort, const PolyParam *pp, Pass pass) const
+	u32 hash(u32 listType, bool autosort, const PolyParam *pp, Pass pass, bool clamping) const
 	{
 		u32 hash = pp->pcw.Gouraud | (pp->pcw.Offset << 1) | (pp->pcw.Texture << 2) | (pp->pcw.Shadow << 3)
 			| (((pp->tileclip >> 28) == 3) << 4);
@@ -322,7 +344,7 @@ private:
 				| (pp->tsp.SrcInstr << 14) | (pp->tsp.DstInstr << 17);
 		}
 		hash |= (pp->isp.ZWriteDis << 20) | (pp->isp.CullMode << 21) | ((autosort ? 6 : pp->isp.DepthMode) << 23);
-		hash |= (u32)pass << 26;
+		hash |= ((u32)pass << 26) | ((u32)clamping << 28);
 
 		return hash;
 	}
@@ -360,7 +382,8 @@ private:
 				full ? vertexInputAttributeDescriptions : vertexInputLightAttributeDescriptions);
 	}
 
-	void CreatePipeline(u32 listType, bool autosort, const PolyParam& pp, Pass pass);
+	// Called by the warm-up worker too, so it must not use the render context
+	vk::UniquePipeline CreatePipeline(u32 listType, bool autosort, const PolyParam& pp, Pass pass, bool clamping);
 	void CreateFinalPipeline();
 	void CreateClearPipeline();
 
@@ -381,6 +404,8 @@ protected:
 
 	RenderPasses *renderPasses;
 	OITShaderManager *shaderManager = nullptr;
+	// Must be destroyed first, its worker uses the members above
+	PipelineWarmUp warmUp;
 };
 
 class RttOITPipelineManager : public OITPipelineManager
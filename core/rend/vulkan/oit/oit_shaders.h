@@ -20,6 +20,7 @@
 */
 #pragma once
 #include <map>
+#include <mutex>
 #include "../vulkan.h"
 #include "../utils.h"
 
@@ -106,6 +107,8 @@ private:
 	template<typename T>
 	vk::ShaderModule getShader(std::map<u32, vk::UniqueShaderModule>& map, T params)
 	{
+		// Pipelines are also created by the warm-up thread
+		std::lock_guard<std::mutex> lock(mutex);
 		auto it = map.find(params.hash());
 		if (it != map.end())
 			return it->second.get();
@@ -123,6 +126,7 @@ private:
 
 	std::map<u32, vk::UniqueShaderModule> vertexShaders;
 	std::map<u32, vk::UniqueShaderModule> fragmentShaders;
+	std::mutex mutex;
 	vk::UniqueShaderModule modVolVertexShader;
 	vk::UniqueShaderModule modVolShader;
 	std::vector<vk::UniqueShaderModule> trModVolShaders;
@@ -25,6 +25,7 @@
 #include "utils.h"
 #include "hw/pvr/ta_ctx.h"
 #include "vulkan_context.h"
+#include "pipeline_warmup.h"
 
 class DescriptorSets
 {
@@ -129,6 +130,10 @@ public:
 
 	void Init(ShaderManager *shaderManager, vk::RenderPass renderPass)
 	{
+		// Stop the warm-up worker before changing the render pass it uses
+		bool renderPassChanged = this->renderPass != renderPass;
+		if (renderPassChanged)
+			Reset();
 		this->shaderManager = shaderManager;
 
 		if (!perFrameLayout)
@@ -152,23 +157,36 @@ public:
 					vk::PipelineLayoutCreateInfo(vk::PipelineLayoutCreateFlags(), ARRAY_SIZE(layouts), layouts, 1, &pushConstant));
 		}
 
-		if (this->renderPass != renderPass)
-		{
+		if (renderPassChanged)
 			this->renderPass = renderPass;
-			Reset();
-		}
 	}
 
 	vk::Pipeline GetPipeline(u32 listType, bool sortTriangles, const PolyParam& pp)
 	{
-		u32 pipehash = hash(listType, sortTriangles, &pp);
+		bool clamping = IsColorClamped(pp);
+		u32 pipehash = hash(listType, sortTriangles, &pp, clamping);
 		const auto &pipeline = pipelines.find(pipehash);
 		if (pipeline != pipelines.end())
 			return pipeline->second.get();
 
-		CreatePipeline(listType, sortTriangles, pp);
+		warmUp.Collect(pipelines);
+		vk::UniquePipeline& newPipeline = pipelines[pipehash];
+		if (!newPipeline)
+			newPipeline = CreatePipeline(listType, sortTriangles, pp, clamping);
+		warmUp.Record(PipelineKey(listType, sortTriangles, pp, clamping));
 
-		return *pipelines[pipehash];
+		return *newPipeline;
+	}
+
+	// Creates the pipelines used by the last run on a worker thread, and records the new ones in the given file
+	void WarmUp(const char *fileName)
+	{
+		warmUp.Load(fileName);
+		warmUp.Start([this](const PipelineKey& key) {
+			PolyParam pp = key.ToPolyParam();
+			return std::make_pair(hash(key.listType, key.variant, &pp, key.clamping),
+					CreatePipeline(key.listType, key.variant, pp, key.clamping));
+		});
 	}
 
 	vk::Pipeline GetModifierVolumePipeline(ModVolMode mode, int cullMode)
@@ -184,6 +202,7 @@ public:
 
 	void Reset()
 	{
+		warmUp.Cancel();
 		pipelines.clear();
 		modVolPipelines.clear();
 	}
@@ -196,7 +215,7 @@ public:
 private:
 	void CreateModVolPipeline(ModVolMode mode, int cullMode);
 
-	u32 hash(u32 listType, bool sortTriangles, const PolyParam *pp) const
+	u32 hash(u32 listType, bool sortTriangles, const PolyParam *pp, bool clamping) const
 	{
 		u32 hash = pp->pcw.Gouraud | (pp->pcw.Offset << 1) | (pp->pcw.Texture << 2) | (pp->pcw.Shadow << 3)
 			| (((pp->tileclip >> 28) == 3) << 4);
@@ -205,7 +224,7 @@ private:
 			| (pp->tsp.ColorClamp << 11) | (pp->tsp.FogCtrl << 12) | (pp->tsp.SrcInstr << 14)
 			| (pp->tsp.DstInstr << 17);
 		hash |= (pp->isp.ZWriteDis << 20) | (pp->isp.CullMode << 21) | (pp->isp.DepthMode << 23);
-		hash |= (u32)sortTriangles << 26;
+		hash |= ((u32)sortTriangles << 26) | ((u32)clamping << 28);
 
 		return hash;
 	}
@@ -240,7 +259,8 @@ private:
 				full ? vertexInputAttributeDescriptions : vertexInputLightAttributeDescriptions);
 	}
 
-	void CreatePipeline(u32 listType, bool sortTriangles, const PolyParam& pp);
+	// Called by the warm-up worker too, so it must not use the render context
+	vk::UniquePipeline CreatePipeline(u32 listType, bool sortTriangles, const PolyParam& pp, bool clamping);
 
 	std::map<u32, vk::UniquePipeline> pipelines;
 	std::map<u32, vk::UniquePipeline> modVolPipelines;
@@ -254,6 +274,8 @@ protected:
 
 	vk::RenderPass renderPass;
 	ShaderManager *shaderManager;
+	// Must be destroyed first, its worker uses the members above
+	PipelineWarmUp warmUp;
 };
 
 class RttPipelineManager : public PipelineManager
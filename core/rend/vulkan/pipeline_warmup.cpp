@@ -0,0 +1,102 @@
+/*
+	Vulkan pipeline warm-up. See pipeline_warmup.h
+*/
+#include "pipeline_warmup.h"
+#include "stdclass.h"
+
+static const u32 PipelineKeysMagic = 0x4C505056;	// "VPPL"
+static const u32 PipelineKeysVersion = 2;			// bump when PipelineKey changes
+
+void PipelineWarmUp::Load(const char *fileName)
+{
+	if (!this->fileName.empty())
+		return;
+	this->fileName = fileName;
+	std::string path = get_writable_data_path(fileName);
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return;
+	u32 header[3];
+	if (fread(header, sizeof(header), 1, f) == 1 && header[0] == PipelineKeysMagic && header[1] == PipelineKeysVersion)
+	{
+		PipelineKey key;
+		for (u32 i = 0; i < header[2] && fread(&key, sizeof(key), 1, f) == 1; i++)
+			keys.insert(key);
+		DEBUG_LOG(RENDERER, "%d pipelines loaded from %s", (int)keys.size(), path.c_str());
+	}
+	fclose(f);
+}
+
+void PipelineWarmUp::Save()
+{
+	if (!dirty)
+		return;
+	dirty = false;
+	std::string path = get_writable_data_path(fileName);
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == nullptr)
+	{
+		WARN_LOG(RENDERER, "Can't save the pipeline list to %s", path.c_str());
+		return;
+	}
+	u32 header[3] = { PipelineKeysMagic, PipelineKeysVersion, (u32)keys.size() };
+	bool written = fwrite(header, sizeof(header), 1, f) == 1;
+	for (const PipelineKey& key : keys)
+		written = written && fwrite(&key, sizeof(key), 1, f) == 1;
+	if (fclose(f) != 0 || !written)
+	{
+		WARN_LOG(RENDERER, "Error writing the pipeline list to %s", path.c_str());
+		remove(path.c_str());
+	}
+}
+
+void PipelineWarmUp::Start(CreateFunction create)
+{
+	if (started)
+		return;
+	started = true;
+	if (keys.empty())
+		return;
+	this->create = create;
+	pending.assign(keys.begin(), keys.end());
+	cancelled = false;
+	done = false;
+	thread = std::thread(&PipelineWarmUp::Run, this);
+}
+
+void PipelineWarmUp::Run()
+{
+	for (const PipelineKey& key : pending)
+	{
+		if (cancelled)
+			break;
+		created.push_back(create(key));
+	}
+	DEBUG_LOG(RENDERER, "Pipeline warm-up: %d/%d pipelines created", (int)created.size(), (int)pending.size());
+	done = true;
+}
+
+void PipelineWarmUp::Cancel()
+{
+	started = false;
+	if (!thread.joinable())
+		return;
+	cancelled = true;
+	thread.join();
+	done = false;
+	created.clear();
+	pending.clear();
+}
+
+void PipelineWarmUp::Collect(std::map<u32, vk::UniquePipeline>& pipelines)
+{
+	if (!done)
+		return;
+	thread.join();
+	done = false;
+	for (auto& pair : created)
+		// Keep the pipelines created in the meantime, they may be in use
+		pipelines.emplace(pair.first, std::move(pair.second));
+	created.clear();
+	pending.clear();
+}
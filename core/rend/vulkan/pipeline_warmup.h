@@ -0,0 +1,100 @@
+/*
+	Vulkan pipeline warm-up. See PipelineWarmUp.
+*/
+#pragma once
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vulkan.h"
+#include "hw/pvr/ta_ctx.h"
+#include "hw/pvr/Renderer_if.h"
+
+// Polygon state a pipeline was created for
+struct PipelineKey
+{
+	u32 listType;
+	u32 variant;		// sort triangles or autosort, and OIT pass
+	u32 pcw;
+	u32 isp;
+	u32 tsp;
+	u32 tcw;
+	u32 tileclip;
+	u32 tsp1;
+	u32 tcw1;
+	u32 clamping;		// depends on the frame fog clamp registers
+
+	PipelineKey() = default;
+	PipelineKey(u32 listType, u32 variant, const PolyParam& pp, bool clamping)
+		: listType(listType), variant(variant), pcw(pp.pcw.full), isp(pp.isp.full), tsp(pp.tsp.full), tcw(pp.tcw.full),
+		  tileclip(pp.tileclip), tsp1(pp.tsp1.full), tcw1(pp.tcw1.full), clamping(clamping) {}
+
+	PolyParam ToPolyParam() const
+	{
+		PolyParam pp = {};
+		pp.pcw.full = pcw;
+		pp.isp.full = isp;
+		pp.tsp.full = tsp;
+		pp.tcw.full = tcw;
+		pp.tileclip = tileclip;
+		pp.tsp1.full = tsp1;
+		pp.tcw1.full = tcw1;
+		return pp;
+	}
+	bool operator<(const PipelineKey& other) const { return memcmp(this, &other, sizeof(*this)) < 0; }
+};
+
+// Color clamping of a polygon in the frame being rendered. Only called on the render thread.
+static inline bool IsColorClamped(const PolyParam& pp)
+{
+	return pp.tsp.ColorClamp && (pvrrc.fog_clamp_min != 0 || pvrrc.fog_clamp_max != 0xffffffff);
+}
+
+// Remembers the pipelines created by a pipeline manager in a file of the data directory, and creates them
+// again on a worker thread at the next start so that new polygon types don't stall the first frames.
+// The pipeline manager records each pipeline it creates, starts the worker once its render pass is known,
+// and picks up the pipelines created by the worker when it needs one that it doesn't have.
+class PipelineWarmUp
+{
+public:
+	using CreateFunction = std::function<std::pair<u32, vk::UniquePipeline>(const PipelineKey&)>;
+
+	~PipelineWarmUp() { Cancel(); Save(); }
+
+	// Loads the pipelines recorded by the last run from the given file. Does nothing the second time.
+	void Load(const char *fileName);
+	// Saves the recorded pipelines if there are new ones
+	void Save();
+	void Record(const PipelineKey& key)
+	{
+		if (!fileName.empty() && keys.insert(key).second)
+			dirty = true;
+	}
+	// Creates the pipelines loaded or recorded so far on a worker thread. Does nothing if the worker
+	// has already been started since the last Cancel.
+	void Start(CreateFunction create);
+	// Stops the worker and drops the pipelines it created. Pipelines already collected aren't affected.
+	// The next Start creates all the pipelines again, for a pipeline manager that dropped its own.
+	void Cancel();
+	// Moves the pipelines created by the worker to the given map once it's done.
+	void Collect(std::map<u32, vk::UniquePipeline>& pipelines);
+
+private:
+	void Run();
+
+	std::string fileName;
+	std::set<PipelineKey> keys;
+	std::vector<PipelineKey> pending;
+	bool dirty = false;
+	bool started = false;
+	CreateFunction create;
+
+	std::thread thread;
+	std::atomic<bool> cancelled { false };
+	std::atomic<bool> done { false };
+	std::vector<std::pair<u32, vk::UniquePipeline>> created;
+};
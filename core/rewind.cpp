@@ -0,0 +1,282 @@
+/*
+	In-core rewind buffer. See rewind.h
+*/
+#include <deque>
+#include "rewind.h"
+#include "deps/zlib/zlib.h"
+#include "hw/aica/aica_if.h"
+#include "hw/mem/_vmem.h"
+
+extern VArray2 mem_b;
+extern VArray2 vram;
+
+enum RewindArea { AreaRam, AreaVram, AreaAram };
+
+struct RewindPage
+{
+	u32 area;
+	u32 offset;
+};
+
+struct RewindFrame
+{
+	vector<u8> data;	// compressed undo record
+	u32 size;			// uncompressed size
+};
+
+// Undo record: u32 previous state size, u32 delta size, machine state XOR delta,
+// then a RewindPage header followed by the page XOR delta for each changed page
+static std::deque<RewindFrame> frames;
+static size_t frames_size;
+static u32 frame_count;
+
+// Contents at the last snapshot
+static vector<u8> shadow[3];
+static vector<u8> last_state;
+
+static vector<u8> record;
+static vector<u8> state;
+
+static u8 *rewind_AreaData(int area)
+{
+	switch (area)
+	{
+	case AreaRam:
+		return mem_b.data;
+	case AreaVram:
+		return vram.data;
+	default:
+		return aica_ram.data;
+	}
+}
+
+static u32 rewind_AreaSize(int area)
+{
+	switch (area)
+	{
+	case AreaRam:
+		return mem_b.size;
+	case AreaVram:
+		return vram.size;
+	default:
+		return aica_ram.size;
+	}
+}
+
+// False if the page is known to be unchanged since the last snapshot
+static bool rewind_MaybeWritten(int area, u32 offset)
+{
+	switch (area)
+	{
+	case AreaRam:
+		return dc_ram_page_written(WriteTrackerRewind, offset);
+	case AreaVram:
+		return dc_vram_page_written(WriteTrackerRewind, offset);
+	default:
+		// aica ram isn't write-protected
+		return true;
+	}
+}
+
+static void rewind_Xor(u8 *dst, const u8 *src, u32 size)
+{
+	u32 i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		u64 d, s;
+		memcpy(&d, dst + i, 8);
+		memcpy(&s, src + i, 8);
+		d ^= s;
+		memcpy(dst + i, &d, 8);
+	}
+	for (; i < size; i++)
+		dst[i] ^= src[i];
+}
+
+// Memory sizes change with the emulated system
+static bool rewind_ShadowValid()
+{
+	for (int area = AreaRam; area <= AreaAram; area++)
+		if (shadow[area].size() != rewind_AreaSize(area))
+			return false;
+	return !last_state.empty();
+}
+
+static bool rewind_SerializeState(vector<u8>& out)
+{
+	unsigned int total_size = 0;
+	void *data = NULL;
+	if (!dc_serialize_without_memory(&data, &total_size))
+		return false;
+	out.resize(total_size);
+	data = &out[0];
+	return dc_serialize_without_memory(&data, &total_size);
+}
+
+static void rewind_UnserializeState()
+{
+	unsigned int total_size = 0;
+	void *data = &last_state[0];
+	dc_unserialize_without_memory(&data, &total_size, last_state.size());
+}
+
+static void rewind_Append(const void *p, size_t size)
+{
+	size_t pos = record.size();
+	record.resize(pos + size);
+	memcpy(&record[pos], p, size);
+}
+
+void rewind_Snapshot()
+{
+	if (!rewind_SerializeState(state))
+		return;
+	if (!rewind_ShadowValid())
+	{
+		rewind_Reset();
+		for (int area = AreaRam; area <= AreaAram; area++)
+		{
+			u8 *data = rewind_AreaData(area);
+			shadow[area].assign(data, data + rewind_AreaSize(area));
+		}
+		last_state.swap(state);
+		dc_reset_write_tracking(WriteTrackerRewind);
+		return;
+	}
+	record.clear();
+	u32 prev_size = last_state.size();
+	u32 delta_size = max(prev_size, (u32)state.size());
+	rewind_Append(&prev_size, sizeof(prev_size));
+	rewind_Append(&delta_size, sizeof(delta_size));
+	size_t delta_pos = record.size();
+	record.resize(delta_pos + delta_size, 0);
+	memcpy(&record[delta_pos], &last_state[0], prev_size);
+	rewind_Xor(&record[delta_pos], &state[0], state.size());
+
+	for (int area = AreaRam; area <= AreaAram; area++)
+	{
+		u8 *data = rewind_AreaData(area);
+		u32 size = rewind_AreaSize(area);
+		for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+		{
+			if (!rewind_MaybeWritten(area, offset) || !memcmp(&data[offset], &shadow[area][offset], PAGE_SIZE))
+				continue;
+			RewindPage page = { (u32)area, offset };
+			rewind_Append(&page, sizeof(page));
+			size_t pos = record.size();
+			rewind_Append(&shadow[area][offset], PAGE_SIZE);
+			rewind_Xor(&record[pos], &data[offset], PAGE_SIZE);
+			memcpy(&shadow[area][offset], &data[offset], PAGE_SIZE);
+		}
+	}
+	last_state.swap(state);
+	dc_reset_write_tracking(WriteTrackerRewind);
+
+	RewindFrame frame;
+	uLongf compressed_size = compressBound(record.size());
+	frame.data.resize(compressed_size);
+	if (compress2(&frame.data[0], &compressed_size, &record[0], record.size(), Z_BEST_SPEED) != Z_OK)
+	{
+		WARN_LOG(SAVESTATE, "Rewind snapshot compression failed");
+		rewind_Reset();
+		return;
+	}
+	frame.data.resize(compressed_size);
+	frame.data.shrink_to_fit();
+	frame.size = record.size();
+	frames_size += frame.data.size();
+	frames.push_back(std::move(frame));
+
+	size_t max_frames = max(1u, settings.rewind.Depth * 60 / REWIND_INTERVAL);
+	while (!frames.empty() && (frames.size() > max_frames || frames_size > (size_t)settings.rewind.BufferSize * 1024 * 1024))
+	{
+		frames_size -= frames.front().data.size();
+		frames.pop_front();
+	}
+}
+
+bool rewind_NextFrame()
+{
+	if (++frame_count < REWIND_INTERVAL)
+		return false;
+	frame_count = 0;
+
+	return true;
+}
+
+bool rewind_Step()
+{
+	if (!rewind_ShadowValid())
+		return false;
+
+	// Back to the last snapshot
+	for (int area = AreaRam; area <= AreaAram; area++)
+	{
+		u8 *data = rewind_AreaData(area);
+		u32 size = rewind_AreaSize(area);
+		for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+			if (rewind_MaybeWritten(area, offset) && memcmp(&data[offset], &shadow[area][offset], PAGE_SIZE))
+				memcpy(&data[offset], &shadow[area][offset], PAGE_SIZE);
+	}
+	// And to the one before if any
+	if (!frames.empty())
+	{
+		RewindFrame& frame = frames.back();
+		record.resize(frame.size);
+		uLongf size = frame.size;
+		if (uncompress(&record[0], &size, &frame.data[0], frame.data.size()) != Z_OK || size != frame.size)
+		{
+			WARN_LOG(SAVESTATE, "Corrupted rewind snapshot");
+			rewind_Reset();
+			return false;
+		}
+		u32 prev_size, delta_size;
+		memcpy(&prev_size, &record[0], sizeof(prev_size));
+		memcpy(&delta_size, &record[sizeof(prev_size)], sizeof(delta_size));
+		size_t pos = sizeof(prev_size) + sizeof(delta_size);
+		last_state.resize(delta_size, 0);
+		rewind_Xor(&last_state[0], &record[pos], delta_size);
+		last_state.resize(prev_size);
+		pos += delta_size;
+
+		while (pos + sizeof(RewindPage) + PAGE_SIZE <= record.size())
+		{
+			RewindPage page;
+			memcpy(&page, &record[pos], sizeof(page));
+			pos += sizeof(page);
+			u8 *shadow_page = &shadow[page.area][page.offset];
+			rewind_Xor(shadow_page, &record[pos], PAGE_SIZE);
+			memcpy(&rewind_AreaData(page.area)[page.offset], shadow_page, PAGE_SIZE);
+			pos += PAGE_SIZE;
+		}
+		frames_size -= frame.data.size();
+		frames.pop_back();
+	}
+	rewind_UnserializeState();
+	dc_reset_write_tracking(WriteTrackerRewind);
+	frame_count = 0;
+
+	return true;
+}
+
+void rewind_Reset()
+{
+	frames.clear();
+	frames_size = 0;
+	frame_count = 0;
+	last_state.clear();
+	for (auto& area : shadow)
+	{
+		area.clear();
+		area.shrink_to_fit();
+	}
+}
+
+void rewind_Term()
+{
+	rewind_Reset();
+	record.clear();
+	record.shrink_to_fit();
+	state.clear();
+	state.shrink_to_fit();
+}
@@ -0,0 +1,24 @@
+/*
+	In-core rewind buffer.
+
+	A snapshot is taken every REWIND_INTERVAL frames. Ram, vram and aica ram are kept in shadow copies of
+	their content at the last snapshot, so only the pages changed since then are compared and saved.
+	Each snapshot is stored as a zlib compressed undo record: the XOR delta of the changed pages and of
+	the rest of the machine state against the previous snapshot.
+	Stepping back only restores the changed pages instead of unserializing a full state.
+*/
+#pragma once
+#include "types.h"
+
+#define REWIND_INTERVAL 15		// frames between snapshots
+
+void rewind_Term();
+// Drops all the snapshots. Must be called when the emulated machine state is replaced.
+void rewind_Reset();
+// Called once per frame. Returns true every REWIND_INTERVAL frames, when rewind_Snapshot should be called.
+bool rewind_NextFrame();
+// Takes a snapshot. The emulator must be stopped.
+void rewind_Snapshot();
+// Restores the previous snapshot. Returns false if there is none.
+// The caller must reset the cpu and other caches as after dc_unserialize.
+bool rewind_Step();
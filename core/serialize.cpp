@@ -3,6 +3,7 @@
 #include "types.h"
 #include "hw/aica/dsp.h"
 #include "hw/aica/aica.h"
+#include "hw/aica/aica_thread.h"
 #include "hw/aica/sgc_if.h"
 #include "hw/arm7/arm7.h"
 #include "hw/holly/sb.h"
@@ -32,6 +33,8 @@
 #include "hw/sh4/dyna/ngen.h"
 #include "hw/naomi/naomi_cart.h"
 #include "hw/naomi/naomi.h"
+#include "rend/TexCache.h"
+#include "deps/xxhash/xxhash.h"
 
 #define LIBRETRO_SKIP(size) do { if (*data) *(u8**)data += (size); *total_size += (size); } while (false)
 
@@ -303,6 +306,90 @@ bool register_unserialize(T& regs,void **data, unsigned int *total_size, u32 for
 	return true ;
 }
 
+// Incremental states only contain the ram, vram and aica ram pages written to since the previous one
+static bool serialize_incremental;
+// States without memory leave out ram, vram and aica ram, for callers saving them themselves
+static bool serialize_skip_memory;
+
+// The block manager and the vram lock only record the pages written to since they were last restarted.
+// When a tracker restarts them, the pages they recorded are kept here for the other trackers.
+static bool tracking[WriteTrackerCount];
+static bool ram_written_pages[WriteTrackerCount][RAM_SIZE_MAX / PAGE_SIZE];
+static bool vram_written_pages[WriteTrackerCount][VRAM_SIZE_MAX / PAGE_SIZE];
+static bool aram_tracking;
+static u64 aram_page_hashes[ARAM_SIZE_MAX / PAGE_SIZE];
+
+static bool ram_page_written(u32 offset)
+{
+#if FEAT_SHREC != DYNAREC_NONE
+	return bm_IsRamPageWritten(offset);
+#else
+	return true;
+#endif
+}
+
+// aica ram isn't write-protected so pages are compared with their hash at the last incremental state
+static bool aram_page_written(u32 offset, bool update)
+{
+	u64 hash = XXH64(&aica_ram.data[offset], PAGE_SIZE, 0);
+	bool written = !aram_tracking || hash != aram_page_hashes[offset / PAGE_SIZE];
+	if (update)
+		aram_page_hashes[offset / PAGE_SIZE] = hash;
+
+	return written;
+}
+
+// Incremental format: u32 page count, then for each page its u32 offset followed by its data
+template<typename F>
+static void serialize_memory(u8 *mem, u32 size, F page_written, void **data, unsigned int *total_size)
+{
+	if (serialize_skip_memory)
+		return;
+	if (!serialize_incremental)
+	{
+		LIBRETRO_SA(mem, size);
+		return;
+	}
+	u8 *count_ptr = *(u8 **)data;
+	u32 count = 0;
+	LIBRETRO_S(count);
+	for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+	{
+		if (!page_written(offset))
+			continue;
+		LIBRETRO_S(offset);
+		LIBRETRO_SA(&mem[offset], PAGE_SIZE);
+		count++;
+	}
+	if (count_ptr != NULL)
+		memcpy(count_ptr, &count, sizeof(count));
+}
+
+static void unserialize_memory(u8 *mem, u32 size, void **data, unsigned int *total_size)
+{
+	if (serialize_skip_memory)
+		return;
+	if (!serialize_incremental)
+	{
+		LIBRETRO_USA(mem, size);
+		return;
+	}
+	u32 count;
+	LIBRETRO_US(count);
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 offset;
+		LIBRETRO_US(offset);
+		if (offset % PAGE_SIZE != 0 || offset >= size)
+		{
+			WARN_LOG(SAVESTATE, "Invalid page offset %x in incremental state", offset);
+			LIBRETRO_SKIP(PAGE_SIZE);
+			continue;
+		}
+		LIBRETRO_USA(&mem[offset], PAGE_SIZE);
+	}
+}
+
 bool dc_serialize(void **data, unsigned int *total_size)
 {
 	int i = 0;
@@ -310,6 +397,11 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	serialize_version_enum version = V11;
 
 	*total_size = 0 ;
+#ifdef HAVE_AICA_THREAD
+	// Only counting the size mustn't disturb the aica thread
+	if (*data != NULL)
+		aica_thread_SyncState();
+#endif
 
 	//dc not initialized yet
 	if ( p_sh4rcb == NULL )
@@ -336,7 +428,9 @@ bool dc_serialize(void **data, unsigned int *total_size)
 		LIBRETRO_S(timers[i].m_step);
 	}
 
-	LIBRETRO_SA(aica_ram.data,aica_ram.size) ;
+	bool update = *data != NULL;
+	serialize_memory(aica_ram.data, aica_ram.size, [update](u32 offset) { return aram_page_written(offset, update); },
+			data, total_size);
 	LIBRETRO_S(VREG);
 	LIBRETRO_S(ARMRST);
 	LIBRETRO_S(rtc_EN);
@@ -418,7 +512,8 @@ bool dc_serialize(void **data, unsigned int *total_size)
 
 	SerializeTAContext(data, total_size);
 
-	LIBRETRO_SA(vram.data, vram.size);
+	serialize_memory(vram.data, vram.size, [](u32 offset) { return dc_vram_page_written(WriteTrackerIncremental, offset); },
+			data, total_size);
 
 	LIBRETRO_SA(OnChipRAM.data(), OnChipRAM_SIZE);
 
@@ -433,7 +528,8 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	register_serialize(SCI, data, total_size) ;
 	register_serialize(SCIF, data, total_size) ;
 
-	LIBRETRO_SA(mem_b.data, mem_b.size);
+	serialize_memory(mem_b.data, mem_b.size, [](u32 offset) { return dc_ram_page_written(WriteTrackerIncremental, offset); },
+			data, total_size);
 
 	LIBRETRO_SA(InterruptEnvId,32);
 	LIBRETRO_SA(InterruptBit,32);
@@ -588,6 +684,13 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	serialize_version_enum version = V1 ;
 
 	*total_size = 0 ;
+#ifdef HAVE_AICA_THREAD
+	aica_thread_SyncState();
+#endif
+	// The memory contents change: tracking must be restarted before the written pages are known again
+	for (int i = 0; i < WriteTrackerCount; i++)
+		tracking[i] = false;
+	aram_tracking = false;
 
 	LIBRETRO_US(version) ;
 
@@ -624,7 +727,7 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	}
 
 
-	LIBRETRO_USA(aica_ram.data,aica_ram.size) ;
+	unserialize_memory(aica_ram.data, aica_ram.size, data, total_size);
 	LIBRETRO_US(VREG);
 	LIBRETRO_US(ARMRST);
 	LIBRETRO_US(rtc_EN);
@@ -806,7 +909,7 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	if (version >= V10)
 		UnserializeTAContext(data, total_size);
 
-	LIBRETRO_USA(vram.data, vram.size);
+	unserialize_memory(vram.data, vram.size, data, total_size);
 
 	LIBRETRO_USA(OnChipRAM.data(), OnChipRAM_SIZE);
 
@@ -821,7 +924,7 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 	register_unserialize(SCI, data, total_size) ;
 	register_unserialize(SCIF, data, total_size) ;
 
-	LIBRETRO_USA(mem_b.data, mem_b.size);
+	unserialize_memory(mem_b.data, mem_b.size, data, total_size);
 
 	if (version < V9)
 	{
@@ -917,6 +1020,7 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 		LIBRETRO_US(dummy_int);
 #endif
 	}
+	sh4_sched_restore();
 
 	if (version < V3)
 	{
@@ -1090,3 +1194,91 @@ bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_si
 
 	return true ;
 }
+
+bool dc_serialize_incremental(void **data, unsigned int *total_size)
+{
+	serialize_incremental = true;
+	bool rc = dc_serialize(data, total_size);
+	serialize_incremental = false;
+
+	if (rc && *data != NULL)
+	{
+		// The next incremental state will contain the pages written to from now on
+		dc_reset_write_tracking(WriteTrackerIncremental);
+		aram_tracking = true;
+	}
+	return rc;
+}
+
+bool dc_unserialize_incremental(void **data, unsigned int *total_size, size_t actual_data_size)
+{
+	serialize_incremental = true;
+	bool rc = dc_unserialize(data, total_size, actual_data_size);
+	serialize_incremental = false;
+
+	return rc;
+}
+
+bool dc_serialize_without_memory(void **data, unsigned int *total_size)
+{
+	serialize_skip_memory = true;
+	bool rc = dc_serialize(data, total_size);
+	serialize_skip_memory = false;
+
+	return rc;
+}
+
+bool dc_unserialize_without_memory(void **data, unsigned int *total_size, size_t actual_data_size)
+{
+	serialize_skip_memory = true;
+	bool rc = dc_unserialize(data, total_size, actual_data_size);
+	serialize_skip_memory = false;
+
+	return rc;
+}
+
+void dc_reset_write_tracking(WriteTracker tracker)
+{
+	for (int i = 0; i < WriteTrackerCount; i++)
+	{
+		if (i == tracker || !tracking[i])
+			continue;
+		for (u32 offset = 0; offset < RAM_SIZE; offset += PAGE_SIZE)
+			ram_written_pages[i][offset / PAGE_SIZE] |= ram_page_written(offset);
+		for (u32 offset = 0; offset < VRAM_SIZE; offset += PAGE_SIZE)
+			vram_written_pages[i][offset / PAGE_SIZE] |= vramlock_IsPageWritten(offset);
+	}
+	memset(ram_written_pages[tracker], 0, sizeof(ram_written_pages[tracker]));
+	memset(vram_written_pages[tracker], 0, sizeof(vram_written_pages[tracker]));
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_ResetRamWriteTracking();
+#endif
+	vramlock_ResetWriteTracking();
+	tracking[tracker] = true;
+}
+
+bool dc_ram_page_written(WriteTracker tracker, u32 offset)
+{
+	offset &= RAM_MASK;
+	return !tracking[tracker] || ram_written_pages[tracker][offset / PAGE_SIZE] || ram_page_written(offset);
+}
+
+bool dc_vram_page_written(WriteTracker tracker, u32 offset)
+{
+	offset &= VRAM_MASK;
+	return !tracking[tracker] || vram_written_pages[tracker][offset / PAGE_SIZE] || vramlock_IsPageWritten(offset);
+}
+
+unsigned int dc_serialize_size(bool incremental)
+{
+	// Counting pass: nothing is written and the emulator state isn't touched
+	unsigned int total_size = 0;
+	void *data = NULL;
+	if (!dc_serialize(&data, &total_size))
+		return 0;
+	if (incremental)
+		// Page counts and offsets when all pages are written to
+		total_size += 3 * sizeof(u32) + (RAM_SIZE + VRAM_SIZE + ARAM_SIZE) / PAGE_SIZE * sizeof(u32);
+
+	return total_size;
+}
@@ -0,0 +1,237 @@
+/*
+	serialize_test: checks that a base incremental save state plus the deltas taken after it restore the same
+	machine state as full save states.
+
+	Built with "make serialize_test". Usage: serialize_test [-n rounds] [-f frames] [-s system_dir] [-o option=value]... content
+
+	The core linked into the tool runs the content without threaded rendering, stopped by a scheduler event
+	every frames 1/60 s of emulated time (10 by default). After the first stop, an incremental state is taken
+	as the base: it holds all the memory pages. After each of the following rounds (4 by default), an
+	incremental state with the pages written to during the round and a full state are taken.
+	Then the base is loaded, and after each delta is loaded on top of it the machine state must serialize to
+	the full state of the same round. dc_serialize_size must be at least the size of the states.
+	Exits with 1 if any check fails.
+*/
+#include <stdarg.h>
+#include <map>
+#include <libretro.h>
+#include "types.h"
+#include "emulator.h"
+#include "hw/sh4/sh4_sched.h"
+
+static std::map<std::string, std::string> options;
+static std::string system_dir = ".";
+
+static void log_printf(enum retro_log_level level, const char *fmt, ...)
+{
+	static const char *level_names[] = { "D", "I", "W", "E" };
+
+	char line[1024];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	size_t len = strlen(line);
+	printf("%s: %s%s", level_names[level & 3], line, len > 0 && line[len - 1] == '\n' ? "" : "\n");
+}
+
+static bool environment(unsigned cmd, void *data)
+{
+	switch (cmd)
+	{
+	case RETRO_ENVIRONMENT_GET_VARIABLE:
+		{
+			retro_variable *var = (retro_variable *)data;
+			auto it = options.find(var->key);
+			if (it == options.end())
+				return false;
+			var->value = it->second.c_str();
+			return true;
+		}
+
+	case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+	case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+		*(const char **)data = system_dir.c_str();
+		return true;
+
+	case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+		((retro_log_callback *)data)->log = log_printf;
+		return true;
+
+	case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+		*(bool *)data = true;
+		return true;
+
+	case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static void video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) { }
+static void audio_sample(int16_t left, int16_t right) { }
+static size_t audio_sample_batch(const int16_t *data, size_t frames) { return frames; }
+static void input_poll() { }
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id) { return 0; }
+
+static bool stopped;
+
+static int stop_sched(int tag, int cycles, int jitter)
+{
+	stopped = true;
+	dc_stop();
+
+	return 0;
+}
+
+// Rendered frames also stop the emulator, hence the loop
+static void run(int stop_id, u32 frames)
+{
+	stopped = false;
+	sh4_sched_request(stop_id, SH4_MAIN_CLOCK / 60 * frames);
+	while (!stopped)
+		retro_run();
+}
+
+static bool save(bool incremental, vector<u8>& state)
+{
+	bool (*serialize)(void **, unsigned int *) = incremental ? dc_serialize_incremental : dc_serialize;
+	unsigned int total_size = 0;
+	void *data = NULL;
+	if (!serialize(&data, &total_size))
+		return false;
+	state.resize(total_size);
+	data = &state[0];
+
+	return serialize(&data, &total_size);
+}
+
+static bool load_incremental(vector<u8>& state)
+{
+	unsigned int total_size = 0;
+	void *data = &state[0];
+
+	return dc_unserialize_incremental(&data, &total_size, state.size()) && total_size == state.size();
+}
+
+// Offset of the first differing byte, or -1
+static s64 compare(const vector<u8>& state, const vector<u8>& expected)
+{
+	size_t size = min(state.size(), expected.size());
+	for (size_t i = 0; i < size; i++)
+		if (state[i] != expected[i])
+			return i;
+
+	return state.size() == expected.size() ? -1 : (s64)size;
+}
+
+int main(int argc, char *argv[])
+{
+	u32 rounds = 4;
+	u32 frames = 10;
+	const char *content = NULL;
+	options["reicast_renderer"] = "headless";
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			rounds = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			frames = min(60, max(1, atoi(argv[++i])));
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			system_dir = argv[++i];
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+		{
+			const char *arg = argv[++i];
+			const char *eq = strchr(arg, '=');
+			if (eq != NULL)
+				options[std::string(arg, eq - arg)] = eq + 1;
+		}
+		else
+			content = argv[i];
+	}
+	if (content == NULL)
+	{
+		fprintf(stderr, "Usage: %s [-n rounds] [-f frames] [-s system_dir] [-o option=value]... content\n", argv[0]);
+		return 1;
+	}
+	// The emulator only runs in retro_run and is stopped between rounds
+	options["reicast_threaded_rendering"] = "disabled";
+
+	retro_set_environment(environment);
+	retro_set_video_refresh(video_refresh);
+	retro_set_audio_sample(audio_sample);
+	retro_set_audio_sample_batch(audio_sample_batch);
+	retro_set_input_poll(input_poll);
+	retro_set_input_state(input_state);
+	retro_init();
+	retro_game_info game = {};
+	game.path = content;
+	if (!retro_load_game(&game))
+	{
+		fprintf(stderr, "Can't load %s\n", content);
+		return 1;
+	}
+	int stop_id = sh4_sched_register(0, &stop_sched);
+
+	bool failed = false;
+	vector<u8> base;
+	run(stop_id, frames);
+	if (!save(true, base))
+	{
+		fprintf(stderr, "Can't save the base state\n");
+		return 1;
+	}
+	printf("base: %u bytes\n", (u32)base.size());
+	vector<vector<u8>> deltas(rounds);
+	vector<vector<u8>> full_states(rounds);
+	for (u32 round = 0; round < rounds; round++)
+	{
+		run(stop_id, frames);
+		if (!save(true, deltas[round]) || !save(false, full_states[round]))
+		{
+			fprintf(stderr, "Can't save the states of round %d\n", round + 1);
+			return 1;
+		}
+		printf("round %d: delta %u bytes, full state %u bytes\n", round + 1, (u32)deltas[round].size(), (u32)full_states[round].size());
+		if (dc_serialize_size() < full_states[round].size() || dc_serialize_size(true) < deltas[round].size())
+		{
+			printf("round %d: dc_serialize_size %u, incremental %u, is too small\n", round + 1, dc_serialize_size(), dc_serialize_size(true));
+			failed = true;
+		}
+	}
+	if (dc_serialize_size(true) < base.size())
+	{
+		printf("base: dc_serialize_size incremental %u is too small\n", dc_serialize_size(true));
+		failed = true;
+	}
+
+	vector<u8> restored;
+	if (!load_incremental(base))
+	{
+		fprintf(stderr, "Can't load the base state\n");
+		return 1;
+	}
+	for (u32 round = 0; round < rounds; round++)
+	{
+		if (!load_incremental(deltas[round]) || !save(false, restored))
+		{
+			fprintf(stderr, "Can't restore the state of round %d\n", round + 1);
+			return 1;
+		}
+		s64 offset = compare(restored, full_states[round]);
+		if (offset >= 0)
+		{
+			printf("round %d: restored state differs from the full state at offset %x\n", round + 1, (u32)offset);
+			failed = true;
+		}
+	}
+	if (!failed)
+		printf("All states restored\n");
+
+	retro_unload_game();
+	retro_deinit();
+
+	return failed ? 1 : 0;
+}
@@ -42,6 +42,20 @@ string get_writable_data_path(const string& filename)
          + filename);
 }
 
+// Per-content cache files are stored in the data directory
+string get_game_cache_path(const string& extension)
+{
+   extern char content_name[PATH_MAX];
+
+   return get_writable_data_path("data" +
+#ifdef _WIN32
+         std::string("\\")
+#else
+         std::string("/")
+#endif
+         + content_name + "." + extension);
+}
+
 string get_writable_vmu_path(const char *logical_port)
 {
    extern char vmu_dir_no_slash[PATH_MAX];
@@ -105,6 +105,7 @@ void add_system_data_dir(const string& dir);
 //subpath format: /data/fsca-table.bit
 string get_writable_data_path(const string& filename);
 string get_writable_vmu_path(const char *logical_port);
+string get_game_cache_path(const string& extension);
 
 bool mem_region_lock(void *start, size_t len);
 bool mem_region_unlock(void *start, size_t len);
@@ -563,6 +563,8 @@ struct settings_t
 		bool disable_vmem32;
       bool DisableDivMatching;
       bool ForceDisableDivMatching;
+		bool BlockCache;		// persist decoded blocks across sessions
+		bool BackgroundOptimizer;	// optimize new blocks on a worker thread
 	} dynarec;
 	
 	struct
@@ -588,6 +590,7 @@ struct settings_t
       u32 DSPEnabled;		//0 -> no, 1 -> yes
       u32 NoBatch;
       u32 NoSound;        //0 ->sound, 1 -> no sound
+      u32 ThreadLag;      // samples the AICA thread can be behind the SH4, 0 to run the AICA on the SH4 thread
    } aica;
 
 	struct
@@ -595,6 +598,8 @@ struct settings_t
 		bool PatchRegion;
 		bool LoadDefaultImage;
 		char DefaultImage[512];
+		u32 ChdCacheHunks;		// decompressed CHD hunks kept in memory
+		bool ChdReadAhead;		// decompress the next CHD hunks in the background
 	} imgread;
 
 	struct
@@ -634,13 +639,27 @@ struct settings_t
 		
 		u32 MaxThreads;
 		u32 SynchronousRendering;
+		u32 RenderQueueDepth;			// 1 to RENDER_QUEUE_MAX pending frames
+		bool RenderQueueLatestOnly;		// skip pending frames that have a more recent one behind them
+		u32 CaptureFrames;				// number of frames left to write to TA capture files
+		bool SoftRendAVX2;				// software renderer uses AVX2 when the cpu supports it
+		bool TaBatchDecoder;			// TA parser decodes strip vertices 4 at a time when the vertex type allows it
+		bool Headless;					// software renderer without video output nor frame limiting
+		u32 FrameOutput;				// FrameOutputMode: where the software renderer writes its frames
 	} pvr;
 
    unsigned UpdateMode;
    unsigned UpdateModeForced;
 
+	struct {
+		bool Enable;
+		u32 BufferSize;		// compressed snapshots budget in MB
+		u32 Depth;			// in seconds
+	} rewind;
+
 	struct {
 		bool SerialConsole;
+		u32 SchedTraceFrames;	// length of the next scheduler trace to record, in 1/60 s of emulated time
 	} debug;
 
 	struct {
@@ -704,6 +723,7 @@ void libCore_gdrom_disc_change(void);
 
 //IO
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+void libGDR_ReadAhead(u32 StartSector,u32 SectorCount);
 void libGDR_ReadSubChannel(u8 * buff, u32 format, u32 len);
 void libGDR_GetToc(u32* toc,u32 area);
 u32 libGDR_GetDiscType(void);
@@ -773,6 +793,21 @@ bool ra_serialize(const void *src, unsigned int src_size, void **dest, unsigned
 bool ra_unserialize(void *src, unsigned int src_size, void **dest, unsigned int *total_size);
 bool dc_serialize(void **data, unsigned int *total_size);
 bool dc_unserialize(void **data, unsigned int *total_size, size_t actual_data_size);
+// Only saves the ram, vram and aica ram pages written to since the previous incremental state, or all of them for
+// the first one and after a state is loaded. Unserializing one requires the state it was built upon to be restored first.
+bool dc_serialize_incremental(void **data, unsigned int *total_size);
+bool dc_unserialize_incremental(void **data, unsigned int *total_size, size_t actual_data_size);
+// State without ram, vram and aica ram, for callers saving them themselves
+bool dc_serialize_without_memory(void **data, unsigned int *total_size);
+bool dc_unserialize_without_memory(void **data, unsigned int *total_size, size_t actual_data_size);
+// Users of the ram and vram write tracking. Each one restarts it without affecting the others.
+enum WriteTracker { WriteTrackerRewind, WriteTrackerIncremental, WriteTrackerCount };
+void dc_reset_write_tracking(WriteTracker tracker);
+// True if the page may have been written to since the tracker was restarted. Always true after a state is loaded.
+bool dc_ram_page_written(WriteTracker tracker, u32 offset);
+bool dc_vram_page_written(WriteTracker tracker, u32 offset);
+// Maximum size of a serialized state, without serializing it
+unsigned int dc_serialize_size(bool incremental = false);
 
 #define LIBRETRO_S(v) ra_serialize(&(v), sizeof(v), data, total_size)
 #define LIBRETRO_US(v) ra_unserialize(&(v), sizeof(v), data, total_size)